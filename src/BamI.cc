@@ -126,7 +126,11 @@ Bam::Bam(const char *path)
     eof_(false),
     n_records_read_(0),
     prev_chrom_(0),
-    prev_pos_(0)
+    prev_pos_(0),
+    idx_(NULL),
+    itr_(NULL),
+    regions_(),
+    next_region_(0)
 {
     this->path   = string(path);
     check_open(bam_fh, path);
@@ -149,7 +153,11 @@ Bam::Bam(const string& path, BamHeader&& header)
     eof_(false),
     n_records_read_(0),
     prev_chrom_(0),
-    prev_pos_(0)
+    prev_pos_(0),
+    idx_(NULL),
+    itr_(NULL),
+    regions_(),
+    next_region_(0)
 {
     this->path   = path;
     check_open(bam_fh, path);
@@ -162,6 +170,69 @@ Bam::Bam(const string& path, BamHeader&& header)
     }
 }
 
+void Bam::set_thread_pool(HtsThreadPool& pool, int qsize) {
+    assert(bam_fh);
+    if (pool.hts() == NULL)
+        return;
+    htsThreadPool p {pool.hts(), qsize};
+    if (hts_set_thread_pool(bam_fh, &p) != 0) {
+        cerr << "Error: Failed to attach a thread pool to BAM file '" << path << "'.\n";
+        throw exception();
+    }
+}
+
+Bam::~Bam() {
+    if (itr_)
+        hts_itr_destroy(itr_);
+    if (idx_)
+        hts_idx_destroy(idx_);
+    if (bam_fh)
+        hts_close(bam_fh);
+}
+
+bool Bam::load_index() {
+    assert(bam_fh);
+    if (idx_ == NULL)
+        idx_ = sam_index_load(bam_fh, path.c_str());
+    return idx_ != NULL;
+}
+
+int64_t Bam::index_n_mapped(int32_t chrom) const {
+    assert(idx_);
+    uint64_t mapped, unmapped;
+    if (hts_idx_get_stat(idx_, chrom, &mapped, &unmapped) != 0)
+        return -1;
+    return mapped;
+}
+
+void Bam::set_regions(vector<BamRegion>&& regions) {
+    assert(idx_ && !regions.empty());
+    regions_ = move(regions);
+    next_region_ = 0;
+    if (itr_) {
+        hts_itr_destroy(itr_);
+        itr_ = NULL;
+    }
+    next_region();
+}
+
+bool Bam::next_region() {
+    if (next_region_ == regions_.size())
+        return false;
+    const BamRegion& r = regions_[next_region_];
+    hts_itr_t* itr = sam_itr_queryi(idx_, r.chrom, r.beg, r.end);
+    if (itr == NULL) {
+        cerr << "Error: Failed to query region " << r.chrom << ':' << r.beg << '-' << r.end
+             << " of BAM file '" << path << "'.\n";
+        throw exception();
+    }
+    if (itr_)
+        hts_itr_destroy(itr_);
+    itr_ = itr;
+    ++next_region_;
+    return true;
+}
+
 void Bam::check_open(const htsFile* bam_f, const string& path) {
     if (bam_f == NULL) {
         #pragma omp critical (bam_check_open)
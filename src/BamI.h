@@ -32,6 +32,7 @@
 #include <utility>
 
 #include "htslib/sam.h"
+#include "htslib/thread_pool.h"
 
 #include "stacks.h"
 #include "input.h"
@@ -144,6 +145,38 @@ public:
     static void check_same_ref_chroms(const BamHeader& h1, const BamHeader& h2);
 };
 
+//
+// HtsThreadPool: a pool of threads for BGZF (de)compression, which can be
+// shared by several files. It must outlive the files that use it.
+//
+class HtsThreadPool {
+    htsThreadPool p_;
+
+    HtsThreadPool(const HtsThreadPool&) = delete;
+    HtsThreadPool& operator= (const HtsThreadPool&) = delete;
+
+public:
+    HtsThreadPool(int n_threads) : p_ {NULL, 0} {
+        if (n_threads > 0 && (p_.pool = hts_tpool_init(n_threads)) == NULL)
+            throw std::bad_alloc();
+    }
+    ~HtsThreadPool() {if (p_.pool) hts_tpool_destroy(p_.pool);}
+
+    size_t n_threads() const {return p_.pool ? hts_tpool_size(p_.pool) : 0;}
+    hts_tpool* hts() {return p_.pool;}
+};
+
+//
+// BamRegion: an interval [beg, end) on a reference sequence, for indexed
+// reading. `chrom` may be `HTS_IDX_NOCOOR` for the unplaced records that are
+// at the end of sorted files.
+//
+struct BamRegion {
+    int32_t chrom;
+    int32_t beg;
+    int32_t end;
+};
+
 class Bam: public Input {
     htsFile*  bam_fh;
     BamHeader hdr;
@@ -153,13 +186,19 @@ class Bam: public Input {
     int32_t prev_chrom_;
     int32_t prev_pos_;
 
+    // For indexed reading, c.f. `set_regions()`.
+    hts_idx_t* idx_;
+    hts_itr_t* itr_;
+    vector<BamRegion> regions_;
+    size_t next_region_;
+
     Bam(Bam&&) = delete; // (This is just not implemented at the moment.)
 
 public:
     Bam(const char* path);
     Bam(const string& path) : Bam(path.c_str()) {}
     Bam(const string& path, BamHeader&& header);
-    ~Bam() {if (bam_fh) hts_close(bam_fh);}
+    ~Bam();
 
     const BamHeader& h() const {return hdr;}
 
@@ -169,6 +208,19 @@ public:
     void close() { assert(bam_fh); if(hts_close(bam_fh) != 0) throw ios::failure("hts_close"); bam_fh = NULL;}
     size_t n_records_read() const {return n_records_read_;}
 
+    // Decompress/compress this file on `pool`, buffering up to `qsize` BGZF
+    // blocks (0 for the htslib default, twice the size of the pool).
+    void set_thread_pool(HtsThreadPool& pool, int qsize=0);
+
+    // Loads the .bai/.csi index of the file. Returns false if there is none.
+    bool load_index();
+    // The number of mapped records on reference sequence `chrom` according to
+    // the index, or -1 if the index does not record it.
+    int64_t index_n_mapped(int32_t chrom) const;
+    // Restricts reading to the records that overlap `regions` (which must be
+    // sorted), using the index. Once they have all been read, `eof()` is true.
+    void set_regions(vector<BamRegion>&& regions);
+
     Seq *next_seq();
     int  next_seq(Seq&);
 
@@ -176,6 +228,7 @@ public:
 
 private:
     static void check_open(const htsFile* bam_f, const string& path);
+    bool next_region();
 };
 
 //
@@ -187,7 +240,14 @@ inline
 bool Bam::next_record(BamRecord& rec) {
     if (rec.empty())
         rec.reinit();
-    int rv = bam_read1(bam_fh->fp.bgzf, rec.hts());
+    int rv;
+    if (itr_ == NULL) {
+        rv = bam_read1(bam_fh->fp.bgzf, rec.hts());
+    } else {
+        rv = sam_itr_next(bam_fh, itr_, rec.hts());
+        while (rv == -1 && next_region())
+            rv = sam_itr_next(bam_fh, itr_, rec.hts());
+    }
     if (rv == -1) {
         eof_ = true;
         rec.destroy();
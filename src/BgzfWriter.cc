@@ -0,0 +1,181 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <mutex>
+
+#include "constants.h"
+#include "BgzfWriter.h"
+
+int        BgzfWriter::n_threads_  = 1;
+hts_tpool* BgzfWriter::given_pool_ = NULL;
+
+namespace {
+
+//
+// The compression pool shared by all writers. It is never destroyed, as
+// writers may still be open (e.g. globals) when static objects are torn down.
+//
+hts_tpool* shared_pool(int n_threads) {
+    static std::mutex mtx;
+    static hts_tpool* pool = NULL;
+
+    std::lock_guard<std::mutex> lock (mtx);
+    if (pool == NULL) {
+        pool = hts_tpool_init(n_threads);
+        if (pool == NULL) {
+            cerr << "Error: Failed to create a pool of " << n_threads << " compression threads.\n";
+            throw exception();
+        }
+    }
+    return pool;
+}
+
+}
+
+struct BgzfWriter::Block {
+    size_t len;      // Of the uncompressed data.
+    size_t comp_len; // Of the compressed data.
+    int    status;   // Of bgzf_compress().
+    char   data[BGZF_BLOCK_SIZE];
+    char   comp[BGZF_MAX_BLOCK_SIZE];
+
+    Block() : len(0), comp_len(0), status(0) {}
+};
+
+void BgzfWriter::open(const string& path) {
+    if (bgzf_ != NULL)
+        close();
+    path_ = path;
+    bgzf_ = bgzf_open(path_.c_str(), "w");
+    if (bgzf_ == NULL)
+        return;
+
+    if (given_pool_ != NULL)
+        pool_ = given_pool_;
+    else if (n_threads_ > 1)
+        pool_ = shared_pool(n_threads_);
+
+    if (pool_ != NULL) {
+        //
+        // The blocks are compressed by the shared pool and written from here.
+        // (Attaching the pool to the BGZF handle would make htslib start a
+        // writer thread for each file, e.g. thousands for process_radtags.)
+        // Each file keeps at most as many blocks in flight as the pool has
+        // threads.
+        //
+        queue_ = hts_tpool_process_init(pool_, std::max(2, hts_tpool_size(pool_)), 0);
+        if (queue_ == NULL) {
+            cerr << "Error: Failed to set up threaded compression for '" << path_ << "'.\n";
+            throw exception();
+        }
+        block_ = new Block();
+    }
+}
+
+int BgzfWriter::close() {
+    if (bgzf_ == NULL)
+        return 0;
+
+    int rv = 0;
+    if (queue_ != NULL) {
+        if (block_->len > 0 && dispatch_block() != 0)
+            rv = -1;
+        while (rv == 0 && hts_tpool_process_sz(queue_) > 0)
+            rv = write_next_block(true);
+        hts_tpool_process_destroy(queue_);
+        queue_ = NULL;
+        pool_ = NULL;
+
+        delete block_;
+        block_ = NULL;
+        for (Block* b : free_)
+            delete b;
+        free_.clear();
+    }
+
+    if (bgzf_close(bgzf_) != 0) // (Writes the EOF block.)
+        rv = -1;
+    bgzf_ = NULL;
+    return rv;
+}
+
+ssize_t BgzfWriter::write_queued(const char* s, size_t len) {
+    for (size_t n = len; n > 0; ) {
+        size_t k = std::min(n, size_t(BGZF_BLOCK_SIZE) - block_->len);
+        memcpy(block_->data + block_->len, s, k);
+        block_->len += k;
+        s += k;
+        n -= k;
+        if (block_->len == size_t(BGZF_BLOCK_SIZE) && dispatch_block() != 0)
+            return -1;
+    }
+    return len;
+}
+
+int BgzfWriter::dispatch_block() {
+    //
+    // Make room in the queue first: the pool stops working on a queue whose
+    // results are not collected, so dispatching to a full one would hang.
+    //
+    while (hts_tpool_process_sz(queue_) >= hts_tpool_process_qsize(queue_))
+        if (write_next_block(true) != 0)
+            return -1;
+
+    if (hts_tpool_dispatch(pool_, queue_, compress_block, block_) != 0)
+        return -1;
+
+    if (free_.empty()) {
+        block_ = new Block();
+    } else {
+        block_ = free_.back();
+        free_.pop_back();
+        block_->len = 0;
+    }
+
+    // Write the blocks that are already compressed.
+    int rv;
+    while ((rv = write_next_block(false)) == 0)
+        ;
+    return rv < 0 ? -1 : 0;
+}
+
+//
+// Writes the next block of the file once it is compressed. If `wait` is false
+// and it is not ready yet, returns 1. Returns -1 on error.
+//
+int BgzfWriter::write_next_block(bool wait) {
+    hts_tpool_result* r = wait ? hts_tpool_next_result_wait(queue_) : hts_tpool_next_result(queue_);
+    if (r == NULL)
+        return wait ? -1 : 1;
+    Block* b = (Block*) hts_tpool_result_data(r);
+    hts_tpool_delete_result(r, 0);
+    free_.push_back(b);
+
+    if (b->status != 0 || bgzf_raw_write(bgzf_, b->comp, b->comp_len) < 0)
+        return -1;
+    return 0;
+}
+
+void* BgzfWriter::compress_block(void* block) {
+    Block* b = (Block*) block;
+    b->comp_len = BGZF_MAX_BLOCK_SIZE;
+    b->status = bgzf_compress(b->comp, &b->comp_len, b->data, b->len, -1);
+    return b;
+}
@@ -0,0 +1,98 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef BGZFWRITER_H
+#define BGZFWRITER_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "htslib/bgzf.h"
+#include "htslib/thread_pool.h"
+
+//
+// BgzfWriter: a compressed output file in the BGZF format.
+//
+// BGZF files are series of independent gzip members, so that they can be
+// read by gunzip/zlib (and indexed by tabix), while their blocks can be
+// compressed in parallel. When `set_n_threads()` was called with more than one
+// thread, all the BgzfWriters of the program share one compression pool: the
+// blocks of each file are compressed by the pool, and written in order by the
+// thread that writes to the file. A program may also provide the pool, c.f.
+// `set_thread_pool()`.
+//
+// Like the zlib functions they replace, the write methods return -1 on error.
+//
+class BgzfWriter {
+    struct Block;
+
+    std::string         path_;
+    BGZF*               bgzf_;
+    hts_tpool*          pool_;  // NULL if the blocks are compressed by bgzf_.
+    hts_tpool_process*  queue_; //
+    Block*              block_; // The block being filled.
+    std::vector<Block*> free_;  // Blocks that can be reused.
+
+    static int        n_threads_;
+    static hts_tpool* given_pool_;
+
+    ssize_t write_queued(const char* s, size_t len);
+    int     dispatch_block();
+    int     write_next_block(bool wait);
+    static void* compress_block(void* block);
+
+public:
+    BgzfWriter() : path_(), bgzf_(NULL), pool_(NULL), queue_(NULL), block_(NULL), free_() {}
+    BgzfWriter(const std::string& path) : BgzfWriter() {open(path);}
+    BgzfWriter(const BgzfWriter&) = delete;
+    BgzfWriter& operator= (const BgzfWriter&) = delete;
+    ~BgzfWriter() {close();}
+
+    // Opens the file; is_open() is false on failure.
+    void open(const std::string& path);
+    // Flushes and closes the file. Returns -1 on error.
+    int close();
+
+    bool is_open() const {return bgzf_ != NULL;}
+    const std::string& path() const {return path_;}
+
+    ssize_t write(const char* s, size_t len) {
+        if (len == 0)
+            return 0;
+        return queue_ == NULL ? bgzf_write(bgzf_, s, len) : write_queued(s, len);
+    }
+    ssize_t write(const std::string& s) {return write(s.c_str(), s.length());}
+    ssize_t puts(const char* s) {return write(s, strlen(s));}
+    int     putc(char c) {return write(&c, 1) == 1 ? (unsigned char) c : -1;}
+
+    // Sets the number of compression threads of the writers opened from now
+    // on. The pool is created on first use and lives until the program exits.
+    static void set_n_threads(int n_threads) {n_threads_ = n_threads;}
+    static int  n_threads() {return n_threads_;}
+
+    // Makes the writers opened from now on compress their blocks on `pool`
+    // (e.g. the one that also decompresses the inputs) instead of on a pool of
+    // their own; NULL reverts to `set_n_threads()`. The pool must outlive the
+    // writers.
+    static void set_thread_pool(hts_tpool* pool) {given_pool_ = pool;}
+};
+
+#endif // BGZFWRITER_H
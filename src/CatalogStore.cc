@@ -0,0 +1,295 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "constants.h"
+#include "stacks.h"
+#include "locus.h"
+#include "CatalogStore.h"
+
+const char CatalogStore::magic[9] = "STACKSCS";
+
+namespace {
+
+// The header is padded so that the index is aligned.
+const size_t header_size = 32;
+
+static_assert(sizeof(CatalogStore::Entry) == 40, "unexpected CatalogStore::Entry layout");
+static_assert(sizeof(CatalogStore::SnpRec) == 16, "unexpected CatalogStore::SnpRec layout");
+
+}
+
+//
+// CatalogStore
+// ============
+//
+
+bool CatalogStore::open(const string& path) {
+    close();
+    path_ = path;
+
+    int fd = ::open(path_.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < header_size) {
+        ::close(fd);
+        cerr << "Error: '" << path_ << "' is not a catalog store.\n";
+        return false;
+    }
+    map_len_ = st.st_size;
+    void* m = mmap(NULL, map_len_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        cerr << "Error: Failed to map '" << path_ << "': " << strerror(errno) << ".\n";
+        map_len_ = 0;
+        return false;
+    }
+    map_ = (const char*) m;
+
+    //
+    // Check the header and the index.
+    //
+    uint32_t version, entry_size;
+    uint64_t n_loci;
+    memcpy(&version,    map_ + 8,  4);
+    memcpy(&entry_size, map_ + 12, 4);
+    memcpy(&n_loci,     map_ + 16, 8);
+    if (memcmp(map_, magic, 8) != 0 || version != CatalogStore::version || entry_size != sizeof(Entry)
+        || n_loci > (map_len_ - header_size) / sizeof(Entry)) {
+        cerr << "Error: '" << path_ << "' is not a catalog store of version " << CatalogStore::version << ".\n";
+        close();
+        return false;
+    }
+    index_  = (const Entry*) (map_ + header_size);
+    n_loci_ = n_loci;
+
+    size_t data_offset = header_size + n_loci_ * sizeof(Entry);
+    for (size_t i = 0; i < n_loci_; ++i) {
+        const Entry& e = index_[i];
+        if (e.offset < data_offset || e.alleles_offset < e.offset || e.alleles_offset > map_len_
+            || (i > 0 && e.id <= index_[i-1].id)) {
+            cerr << "Error: Corrupted catalog store '" << path_ << "'.\n";
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CatalogStore::close() {
+    if (map_ != NULL)
+        munmap((void*) map_, map_len_);
+    map_     = NULL;
+    map_len_ = 0;
+    index_   = NULL;
+    n_loci_  = 0;
+}
+
+const CatalogStore::Entry* CatalogStore::find(int id) const {
+    const Entry* end = index_ + n_loci_;
+    const Entry* e = std::lower_bound(index_, end, id, [] (const Entry& e, int id) {return e.id < id;});
+    return e != end && e->id == id ? e : NULL;
+}
+
+void CatalogStore::load(const Entry& e, Locus& loc, bool load_comps, bool load_all_model_calls) const {
+    loc.id  = e.id;
+    loc.len = e.len;
+    loc.con = arena_str(loc.arena, con(e), e.len);
+
+    const char* p = con(e) + e.len + 1;
+    if (e.flags & f_model) {
+        loc.model = arena_str(loc.arena, p);
+        p += strlen(p) + 1;
+    }
+
+    for (uint32_t i = 0; i < e.n_comps; ++i) {
+        if (load_comps)
+            loc.comp.push_back(arena_str(loc.arena, p));
+        p += strlen(p) + 1;
+    }
+
+    for (uint32_t i = 0; i < e.n_snps; ++i, p += sizeof(SnpRec)) {
+        SnpRec r;
+        memcpy(&r, p, sizeof(r));
+        if (!load_all_model_calls && r.type != snp_type_het)
+            continue;
+        SNP* snp = arena_snp(loc.arena);
+        snp->col    = r.col;
+        snp->lratio = r.lratio;
+        snp->type   = snp_type(r.type);
+        snp->rank_1 = r.rank[0];
+        snp->rank_2 = r.rank[1];
+        snp->rank_3 = r.rank[2];
+        snp->rank_4 = r.rank[3];
+        loc.snps.push_back(snp);
+    }
+
+    p = map_ + e.alleles_offset;
+    for (uint32_t i = 0; i < e.n_alleles; ++i) {
+        int32_t cnt;
+        memcpy(&cnt, p, 4);
+        p += 4;
+        loc.alleles[p] = cnt;
+        p += strlen(p) + 1;
+    }
+}
+
+//
+// CatalogStoreWriter
+// ==================
+//
+
+CatalogStoreWriter::~CatalogStoreWriter() {
+    if (fh_ != NULL) {
+        // Unfinished.
+        fclose(fh_);
+        remove(tmp_path_.c_str());
+    }
+}
+
+void CatalogStoreWriter::write_bytes(const char* s, size_t len) {
+    if (len > 0 && fwrite(s, 1, len, fh_) != len) {
+        cerr << "Error: Failed to write to '" << tmp_path_ << "'.\n";
+        throw exception();
+    }
+}
+
+void CatalogStoreWriter::open(const string& path, size_t n_loci) {
+    path_     = path;
+    tmp_path_ = path + ".tmp";
+    fh_ = fopen(tmp_path_.c_str(), "wb");
+    if (fh_ == NULL) {
+        cerr << "Error: Failed to open '" << tmp_path_ << "' for writing.\n";
+        throw exception();
+    }
+    n_loci_ = n_loci;
+    index_.clear();
+    index_.reserve(n_loci);
+
+    // The data follows the index, which is written last.
+    offset_ = header_size + n_loci * sizeof(CatalogStore::Entry);
+    if (fseeko(fh_, offset_, SEEK_SET) != 0) {
+        cerr << "Error: Failed to write to '" << tmp_path_ << "'.\n";
+        throw exception();
+    }
+}
+
+void CatalogStoreWriter::write(const Locus& loc) {
+    vector<string> comps;
+    for (const char* c : loc.comp)
+        comps.push_back(c);
+    write(loc, comps);
+}
+
+void CatalogStoreWriter::write(const Locus& loc, const vector<string>& comps) {
+    if (index_.size() == n_loci_ || (!index_.empty() && loc.id <= index_.back().id)) {
+        cerr << "Error: Unexpected locus " << loc.id << " while writing '" << path_ << "'.\n";
+        throw exception();
+    }
+
+    CatalogStore::Entry e;
+    memset(&e, 0, sizeof(e));
+    e.id        = loc.id;
+    e.len       = loc.len;
+    e.n_comps   = comps.size();
+    e.n_snps    = loc.snps.size();
+    e.n_alleles = loc.alleles.size();
+    e.flags     = loc.model != NULL ? uint32_t(CatalogStore::f_model) : 0;
+    e.offset    = offset_;
+
+    buf_.assign(loc.con, loc.len);
+    buf_.push_back('\0');
+    if (loc.model != NULL)
+        buf_.append(loc.model, strlen(loc.model) + 1);
+    for (const string& c : comps)
+        buf_.append(c.c_str(), c.length() + 1);
+    for (const SNP* snp : loc.snps) {
+        CatalogStore::SnpRec r;
+        memset(&r, 0, sizeof(r));
+        r.col     = snp->col;
+        r.lratio  = snp->lratio;
+        r.type    = snp->type;
+        r.rank[0] = snp->rank_1;
+        r.rank[1] = snp->rank_2;
+        r.rank[2] = snp->rank_3;
+        r.rank[3] = snp->rank_4;
+        buf_.append((const char*) &r, sizeof(r));
+    }
+
+    e.alleles_offset = offset_ + buf_.size();
+    for (auto& a : loc.alleles) {
+        int32_t cnt = a.second;
+        buf_.append((const char*) &cnt, 4);
+        buf_.append(a.first.c_str(), a.first.length() + 1);
+    }
+
+    write_bytes(buf_.data(), buf_.size());
+    offset_ += buf_.size();
+    index_.push_back(e);
+}
+
+void CatalogStoreWriter::close() {
+    if (fh_ == NULL)
+        return;
+    if (index_.size() != n_loci_) {
+        cerr << "Error: Expected " << n_loci_ << " loci but got " << index_.size() << " while writing '" << path_ << "'.\n";
+        throw exception();
+    }
+
+    buf_.assign(CatalogStore::magic, 8);
+    uint32_t version = CatalogStore::version;
+    uint32_t entry_size = sizeof(CatalogStore::Entry);
+    uint64_t n_loci = n_loci_;
+    buf_.append((const char*) &version, 4);
+    buf_.append((const char*) &entry_size, 4);
+    buf_.append((const char*) &n_loci, 8);
+    buf_.resize(header_size, '\0');
+    if (fseeko(fh_, 0, SEEK_SET) != 0) {
+        cerr << "Error: Failed to write to '" << tmp_path_ << "'.\n";
+        throw exception();
+    }
+    write_bytes(buf_.data(), buf_.size());
+    write_bytes((const char*) index_.data(), index_.size() * sizeof(CatalogStore::Entry));
+
+    int rv = fclose(fh_);
+    fh_ = NULL;
+    if (rv != 0 || rename(tmp_path_.c_str(), path_.c_str()) != 0) {
+        cerr << "Error: Failed to write '" << path_ << "'.\n";
+        throw exception();
+    }
+}
+
+bool use_catalog_store(const string& prefix) {
+    struct stat store, other;
+    if (stat((prefix + ".store").c_str(), &store) != 0)
+        return false;
+    for (const char* suffix : {".tags.tsv", ".tags.tsv.gz", ".loci.bin"})
+        if (stat((prefix + suffix).c_str(), &other) == 0 && other.st_mtime > store.st_mtime)
+            return false;
+    return true;
+}
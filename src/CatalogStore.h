@@ -0,0 +1,141 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef CATALOGSTORE_H
+#define CATALOGSTORE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+class Locus;
+
+//
+// The catalog store (`catalog.store`)
+// ===================================
+//
+// An indexed copy of the catalog tags/snps/alleles files that is read through
+// mmap(): programs only fault in the pages they touch (e.g. tsv2bam only reads
+// the index), and processes running on the same node share the page cache.
+//
+// File layout, in the host byte order:
+//   header : magic "STACKSCS", uint32 version, uint32 entry size, uint64 n_loci
+//   index  : n_loci `Entry`s, sorted by locus ID
+//   data   : for each locus, the consensus and the model (NUL-terminated),
+//            the components (NUL-terminated), the SNPs (`SnpRec`s), and at
+//            `alleles_offset` the alleles (int32 count, NUL-terminated haplotype)
+//
+class CatalogStore {
+public:
+    static const char     magic[9];
+    static const uint32_t version = 1;
+
+    enum Flag : uint32_t {f_model = 1};
+
+    struct Entry {
+        int32_t  id;
+        uint32_t len;            // Consensus length.
+        uint32_t n_comps;
+        uint32_t n_snps;
+        uint32_t n_alleles;
+        uint32_t flags;
+        uint64_t offset;         // Of the consensus.
+        uint64_t alleles_offset;
+    };
+
+    struct SnpRec {
+        uint32_t col;
+        float    lratio;
+        uint8_t  type;
+        char     rank[4];
+        char     pad[3];
+    };
+
+private:
+    string       path_;
+    const char*  map_;
+    size_t       map_len_;
+    const Entry* index_;
+    size_t       n_loci_;
+
+public:
+    CatalogStore() : path_(), map_(NULL), map_len_(0), index_(NULL), n_loci_(0) {}
+    CatalogStore(const CatalogStore&) = delete;
+    CatalogStore& operator= (const CatalogStore&) = delete;
+    ~CatalogStore() {close();}
+
+    // Maps the file. Returns false on failure.
+    bool open(const string& path);
+    void close();
+
+    const string& path() const {return path_;}
+    size_t size() const {return n_loci_;}
+    const Entry& entry(size_t i) const {return index_[i];}
+    // Returns NULL if there is no such locus.
+    const Entry* find(int id) const;
+
+    // Pointers into the mapping; valid until close().
+    const char* con(const Entry& e) const {return map_ + e.offset;}
+    const char* model(const Entry& e) const {return e.flags & f_model ? map_ + e.offset + e.len + 1 : NULL;}
+
+    // Fills an empty locus. The components are only loaded if `load_comps` is
+    // set, and heterozygous SNPs only unless `load_all_model_calls` is set.
+    void load(const Entry& e, Locus& loc, bool load_comps, bool load_all_model_calls) const;
+};
+
+//
+// CatalogStoreWriter: writes the store of a catalog of `n_loci` loci, which
+// must be written in increasing ID order. Reads and depths are not stored.
+// The file is only renamed to `path` on close(). Errors are reported and throw.
+//
+class CatalogStoreWriter {
+    string                     path_;
+    string                     tmp_path_;
+    FILE*                      fh_;
+    size_t                     n_loci_;
+    vector<CatalogStore::Entry> index_;
+    uint64_t                   offset_;
+    string                     buf_;
+
+    void write_bytes(const char* s, size_t len);
+
+public:
+    CatalogStoreWriter() : path_(), tmp_path_(), fh_(NULL), n_loci_(0), index_(), offset_(0) {}
+    CatalogStoreWriter(const CatalogStoreWriter&) = delete;
+    CatalogStoreWriter& operator= (const CatalogStoreWriter&) = delete;
+    ~CatalogStoreWriter();
+
+    void open(const string& path, size_t n_loci);
+    // Writes a locus; its components are either `loc.comp` or `comps`.
+    void write(const Locus& loc);
+    void write(const Locus& loc, const vector<string>& comps);
+    void close();
+};
+
+//
+// Whether the loci of `prefix` (i.e. the catalog) should be read from
+// `<prefix>.store`: it exists and is at least as recent as the other files.
+//
+bool use_catalog_store(const string& prefix);
+
+#endif // CATALOGSTORE_H
@@ -0,0 +1,300 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "FastxI.h"
+
+// Number of records buffered by next_seq().
+const size_t buffered_batch_size = 1000;
+
+Fastx::Fastx(const char *path, bool fastq)
+    : Input(), gz_fh(NULL), fastq(fastq), eof(false), buffered_i(0)
+{
+    this->path = string(path);
+
+    // gzread() reads uncompressed files transparently.
+    this->gz_fh = gzopen(path, "rb");
+    if (!this->gz_fh) {
+        cerr << "Failed to open file '" << path << "': " << strerror(errno) << ".\n";
+        exit(EXIT_FAILURE);
+    }
+    #if ZLIB_VERNUM >= 0x1240
+    gzbuffer(this->gz_fh, libz_buffer_size);
+    #endif
+}
+
+Fastx::~Fastx()
+{
+    gzclose(this->gz_fh);
+}
+
+//
+// Appends the next block of the file to the arena.
+//
+void
+Fastx::fill(vector<char> &arena)
+{
+    size_t old_size = arena.size();
+    arena.resize(old_size + libz_buffer_size);
+
+    int n = gzread(this->gz_fh, arena.data() + old_size, libz_buffer_size);
+    if (n < 0) {
+        int errnum;
+        const char *msg = gzerror(this->gz_fh, &errnum);
+        cerr << "Error: Failed to read '" << this->path << "': " << msg << ".\n";
+        throw exception();
+    }
+    arena.resize(old_size + n);
+
+    if (n == 0)
+        this->eof = true;
+}
+
+//
+// Makes sure that the byte at `pos` has been read; false at the end of the file.
+//
+bool
+Fastx::peek(vector<char> &arena, size_t pos)
+{
+    while (pos >= arena.size()) {
+        if (this->eof)
+            return false;
+        this->fill(arena);
+    }
+    return true;
+}
+
+//
+// Terminates the line starting at `pos` in place, stripping the newline and
+// any carriage return. Sets `beg` and `len` to the line and advances `pos` to
+// the next one.
+//
+bool
+Fastx::next_line(vector<char> &arena, size_t &pos, size_t &beg, size_t &len)
+{
+    if (!this->peek(arena, pos))
+        return false;
+
+    size_t end = pos;
+    while (true) {
+        const char *p = (const char *) memchr(arena.data() + end, '\n', arena.size() - end);
+        if (p != NULL) {
+            end = p - arena.data();
+            arena[end] = '\0';
+            beg = pos;
+            pos = end + 1;
+            break;
+        }
+        end = arena.size();
+        if (this->eof) {
+            // Last line, without a newline.
+            arena.push_back('\0');
+            beg = pos;
+            pos = arena.size();
+            break;
+        }
+        this->fill(arena);
+    }
+
+    len = end - beg;
+    if (len > 0 && arena[end - 1] == '\r') {
+        arena[end - 1] = '\0';
+        --len;
+    }
+
+    return true;
+}
+
+bool
+Fastx::parse_fastq(SeqBatch &batch, size_t &pos)
+{
+    vector<char> &a = batch.arena_;
+    size_t beg, len;
+
+    //
+    // Skip anything that precedes the header of the record.
+    //
+    do {
+        if (!this->next_line(a, pos, beg, len))
+            return false;
+    } while (a[beg] != '@');
+
+    SeqBatch::Rec r;
+    r.id      = beg + 1;
+    r.comment = -1;
+
+    if (!this->next_line(a, pos, beg, len))
+        return false;
+    r.seq = beg;
+
+    //
+    // The repeat of the ID.
+    //
+    if (!this->next_line(a, pos, beg, len) || a[beg] != '+')
+        return false;
+
+    if (!this->next_line(a, pos, beg, len))
+        return false;
+    r.qual = beg;
+
+    batch.recs_.push_back(r);
+
+    return true;
+}
+
+bool
+Fastx::parse_fasta(SeqBatch &batch, size_t &pos)
+{
+    vector<char> &a = batch.arena_;
+    size_t beg, len;
+
+    do {
+        if (!this->next_line(a, pos, beg, len))
+            return false;
+    } while (a[beg] != '>');
+
+    SeqBatch::Rec r;
+    r.id      = beg + 1;
+    r.comment = -1;
+
+    //
+    // Check if the ID line of the FASTA file has a comment after the ID.
+    //
+    size_t end = beg + len;
+    for (size_t q = r.id + 1; q < end; q++) {
+        if (a[q] == ' ' || a[q] == '\t') {
+            a[q]      = '\0';
+            r.comment = q + 1;
+            break;
+        }
+    }
+
+    //
+    // Read the sequence -- keep reading lines until we reach the next record
+    // or the end of file, and move them next to one another. An empty sequence
+    // points at the terminator of the ID line.
+    //
+    r.seq = end;
+    size_t seq_end = pos;
+    bool   first   = true;
+    while (this->peek(a, pos) && a[pos] != '>') {
+        this->next_line(a, pos, beg, len);
+        if (first) {
+            r.seq   = beg;
+            seq_end = beg;
+            first   = false;
+        }
+        memmove(a.data() + seq_end, a.data() + beg, len);
+        seq_end += len;
+        a[seq_end] = '\0';
+    }
+    r.qual = -1;
+
+    batch.recs_.push_back(r);
+
+    return true;
+}
+
+size_t
+Fastx::next_batch(SeqBatch &batch, size_t max_n)
+{
+    batch.clear();
+    vector<char> &a = batch.arena_;
+    a.insert(a.end(), this->carry.begin(), this->carry.end());
+
+    size_t pos     = 0;
+    size_t rec_end = 0;
+    bool   more    = true;
+    while (batch.size() < max_n) {
+        more = this->fastq ? this->parse_fastq(batch, pos) : this->parse_fasta(batch, pos);
+        if (!more)
+            break;
+        rec_end = pos;
+    }
+
+    //
+    // Keep what was read beyond the last record for the next batch. If parsing
+    // stopped at the end of the file, there is nothing left.
+    //
+    if (more)
+        this->carry.assign(a.begin() + rec_end, a.end());
+    else
+        this->carry.clear();
+    a.resize(rec_end);
+
+    batch.seal();
+
+    return batch.size();
+}
+
+Seq *
+Fastx::next_buffered()
+{
+    if (this->buffered_i == this->buffered.size()) {
+        if (this->next_batch(this->buffered, buffered_batch_size) == 0)
+            return NULL;
+        this->buffered_i = 0;
+    }
+    return this->buffered[this->buffered_i++];
+}
+
+Seq *
+Fastx::next_seq()
+{
+    Seq *r = this->next_buffered();
+    if (r == NULL)
+        return NULL;
+
+    Seq *s = new Seq;
+    s->id = new char[strlen(r->id) + 1];
+    strcpy(s->id, r->id);
+    s->seq = new char[strlen(r->seq) + 1];
+    strcpy(s->seq, r->seq);
+    if (r->qual != NULL) {
+        s->qual = new char[strlen(r->qual) + 1];
+        strcpy(s->qual, r->qual);
+    }
+    s->comment = r->comment;
+
+    return s;
+}
+
+int
+Fastx::next_seq(Seq &s)
+{
+    Seq *r = this->next_buffered();
+    if (r == NULL)
+        return 0;
+
+    //
+    // As for the Fastq/Fasta readers, the caller provides the buffers; FASTA
+    // sequences are of arbitrary length and are reserved for.
+    //
+    strcpy(s.id, r->id);
+    if (this->fastq) {
+        strcpy(s.seq, r->seq);
+        strcpy(s.qual, r->qual);
+    } else {
+        s.comment = r->comment;
+        s.reserve(strlen(r->seq), false);
+        strcpy(s.seq, r->seq);
+    }
+
+    return 1;
+}
@@ -0,0 +1,62 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __FASTXI_H__
+#define __FASTXI_H__
+
+#include "input.h"
+
+//
+// Fastx: reads FASTQ or FASTA files, gzipped or not.
+//
+// The file is decompressed in large blocks directly into the arena of the
+// SeqBatch being filled, and the records are parsed in place (lines are
+// NUL-terminated where they stand; multi-line FASTA sequences are compacted).
+// The bytes read past the last record of a batch are carried over to the next.
+//
+// next_batch() is the efficient interface; the next_seq() methods are
+// provided for compatibility and copy the records out of an internal batch.
+//
+class Fastx: public Input {
+    gzFile       gz_fh;
+    bool         fastq;
+    bool         eof;
+    vector<char> carry;  // Data read beyond the last record of the previous batch.
+
+    SeqBatch     buffered; // For next_seq().
+    size_t       buffered_i;
+
+    void fill(vector<char> &arena);
+    bool peek(vector<char> &arena, size_t pos);
+    bool next_line(vector<char> &arena, size_t &pos, size_t &beg, size_t &len);
+    bool parse_fastq(SeqBatch &batch, size_t &pos);
+    bool parse_fasta(SeqBatch &batch, size_t &pos);
+    Seq *next_buffered();
+
+ public:
+    Fastx(const char *path, bool fastq);
+    Fastx(string path, bool fastq) : Fastx(path.c_str(), fastq) { };
+    ~Fastx();
+    Seq   *next_seq();
+    int    next_seq(Seq &s);
+    size_t next_batch(SeqBatch &batch, size_t max_n);
+};
+
+#endif // __FASTXI_H__
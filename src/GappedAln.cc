@@ -0,0 +1,1023 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2016 - 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "GappedAln.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GAPPEDALN_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+//
+// The scoring scheme, in half points.
+//
+const int32_t gapopen_hp  = int32_t(gapopen_score  * 2);
+const int32_t gapext_hp   = int32_t(gapext_score   * 2);
+const int32_t mismatch_hp = int32_t(mismatch_score * 2);
+const int32_t match_hp    = int32_t(match_score    * 2);
+
+const uint8_t path_diag = 1;
+const uint8_t path_up   = 2;
+const uint8_t path_left = 4;
+
+//
+// Scores one cell from its upper, left and upper-left neighbors. All the
+// moves that reach the best score are recorded in the path, except that when
+// the three are equal only the vertical and diagonal moves are kept. In a
+// local alignment, cells that do not score above zero get no path.
+//
+inline int32_t
+score_cell(bool local,
+           int32_t m_up, uint8_t p_up_cell, int32_t m_left, uint8_t p_left_cell, int32_t m_diag,
+           bool match, uint8_t &p)
+{
+    int32_t down  = m_up   + (p_up_cell   & path_up   ? gapext_hp : gapopen_hp);
+    int32_t diag  = m_diag + (match ? match_hp : mismatch_hp);
+    int32_t right = m_left + (p_left_cell & path_left ? gapext_hp : gapopen_hp);
+
+    int32_t best = std::max(std::max(down, diag), right);
+
+    uint8_t f = (down == best ? path_up : 0) | (diag == best ? path_diag : 0) | (right == best ? path_left : 0);
+    if (f == (path_up | path_diag | path_left))
+        f = path_up | path_diag;
+    if (local && best <= 0)
+        f = 0;
+
+    p = f;
+    return best;
+}
+
+//
+// Scores `n` consecutive cells of an anti-diagonal. `m_up`, `m_left`, `p_up`
+// and `p_left` point into the previous anti-diagonal, `m_diag` into the one
+// before; `q` and `s` are the query and (reversed) subject characters of the
+// cells. Returns the highest score of the cells.
+//
+typedef int32_t (*DiagF)(size_t n, bool local,
+                         const int32_t *m_up, const int32_t *m_left, const int32_t *m_diag,
+                         const uint8_t *p_up, const uint8_t *p_left,
+                         const char *q, const char *s,
+                         int32_t *m_out, uint8_t *p_out);
+
+int32_t
+score_diag_tail(size_t k, size_t n, bool local,
+                const int32_t *m_up, const int32_t *m_left, const int32_t *m_diag,
+                const uint8_t *p_up, const uint8_t *p_left,
+                const char *q, const char *s,
+                int32_t *m_out, uint8_t *p_out, int32_t max)
+{
+    for (; k < n; k++) {
+        m_out[k] = score_cell(local, m_up[k], p_up[k], m_left[k], p_left[k], m_diag[k], q[k] == s[k], p_out[k]);
+        if (m_out[k] > max)
+            max = m_out[k];
+    }
+    return max;
+}
+
+int32_t
+score_diag_scalar(size_t n, bool local,
+                  const int32_t *m_up, const int32_t *m_left, const int32_t *m_diag,
+                  const uint8_t *p_up, const uint8_t *p_left,
+                  const char *q, const char *s,
+                  int32_t *m_out, uint8_t *p_out)
+{
+    return score_diag_tail(0, n, local, m_up, m_left, m_diag, p_up, p_left, q, s, m_out, p_out, INT32_MIN);
+}
+
+#ifdef GAPPEDALN_X86
+
+inline int32_t load4(const void *p) {int32_t x; memcpy(&x, p, 4); return x;}
+inline int64_t load8(const void *p) {int64_t x; memcpy(&x, p, 8); return x;}
+
+__attribute__((target("sse4.1")))
+int32_t
+score_diag_sse41(size_t n, bool local,
+                 const int32_t *m_up, const int32_t *m_left, const int32_t *m_diag,
+                 const uint8_t *p_up, const uint8_t *p_left,
+                 const char *q, const char *s,
+                 int32_t *m_out, uint8_t *p_out)
+{
+    const __m128i v_open    = _mm_set1_epi32(gapopen_hp);
+    const __m128i v_ext     = _mm_set1_epi32(gapext_hp - gapopen_hp);
+    const __m128i v_mism    = _mm_set1_epi32(mismatch_hp);
+    const __m128i v_match   = _mm_set1_epi32(match_hp - mismatch_hp);
+    const __m128i v_up      = _mm_set1_epi32(path_up);
+    const __m128i v_left    = _mm_set1_epi32(path_left);
+    const __m128i v_diag    = _mm_set1_epi32(path_diag);
+    const __m128i v_all     = _mm_set1_epi32(path_up | path_left | path_diag);
+    const __m128i v_zero    = _mm_setzero_si128();
+    const __m128i v_local   = local ? _mm_set1_epi32(-1) : v_zero;
+
+    __m128i v_max = _mm_set1_epi32(INT32_MIN);
+
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128i mu = _mm_loadu_si128((const __m128i *) (m_up + k));
+        __m128i ml = _mm_loadu_si128((const __m128i *) (m_left + k));
+        __m128i md = _mm_loadu_si128((const __m128i *) (m_diag + k));
+        __m128i pu = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load4(p_up + k)));
+        __m128i pl = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load4(p_left + k)));
+        __m128i qc = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load4(q + k)));
+        __m128i sc = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load4(s + k)));
+
+        __m128i down  = _mm_add_epi32(mu, _mm_add_epi32(v_open, _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(pu, v_up), v_up), v_ext)));
+        __m128i right = _mm_add_epi32(ml, _mm_add_epi32(v_open, _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(pl, v_left), v_left), v_ext)));
+        __m128i diag  = _mm_add_epi32(md, _mm_add_epi32(v_mism, _mm_and_si128(_mm_cmpeq_epi32(qc, sc), v_match)));
+        __m128i best  = _mm_max_epi32(_mm_max_epi32(down, diag), right);
+
+        __m128i f = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_cmpeq_epi32(down, best), v_up),
+                                              _mm_and_si128(_mm_cmpeq_epi32(diag, best), v_diag)),
+                                 _mm_and_si128(_mm_cmpeq_epi32(right, best), v_left));
+        f = _mm_andnot_si128(_mm_and_si128(_mm_cmpeq_epi32(f, v_all), v_left), f);
+        f = _mm_andnot_si128(_mm_and_si128(v_local, _mm_cmpgt_epi32(_mm_set1_epi32(1), best)), f);
+
+        _mm_storeu_si128((__m128i *) (m_out + k), best);
+        __m128i f8 = _mm_packus_epi16(_mm_packus_epi32(f, f), v_zero);
+        int32_t f4 = _mm_cvtsi128_si32(f8);
+        memcpy(p_out + k, &f4, 4);
+
+        v_max = _mm_max_epi32(v_max, best);
+    }
+
+    v_max = _mm_max_epi32(v_max, _mm_shuffle_epi32(v_max, _MM_SHUFFLE(1, 0, 3, 2)));
+    v_max = _mm_max_epi32(v_max, _mm_shuffle_epi32(v_max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return score_diag_tail(k, n, local, m_up, m_left, m_diag, p_up, p_left, q, s, m_out, p_out,
+                           _mm_cvtsi128_si32(v_max));
+}
+
+__attribute__((target("avx2")))
+int32_t
+score_diag_avx2(size_t n, bool local,
+                const int32_t *m_up, const int32_t *m_left, const int32_t *m_diag,
+                const uint8_t *p_up, const uint8_t *p_left,
+                const char *q, const char *s,
+                int32_t *m_out, uint8_t *p_out)
+{
+    const __m256i v_open    = _mm256_set1_epi32(gapopen_hp);
+    const __m256i v_ext     = _mm256_set1_epi32(gapext_hp - gapopen_hp);
+    const __m256i v_mism    = _mm256_set1_epi32(mismatch_hp);
+    const __m256i v_match   = _mm256_set1_epi32(match_hp - mismatch_hp);
+    const __m256i v_up      = _mm256_set1_epi32(path_up);
+    const __m256i v_left    = _mm256_set1_epi32(path_left);
+    const __m256i v_diag    = _mm256_set1_epi32(path_diag);
+    const __m256i v_all     = _mm256_set1_epi32(path_up | path_left | path_diag);
+    const __m256i v_zero    = _mm256_setzero_si256();
+    const __m256i v_local   = local ? _mm256_set1_epi32(-1) : v_zero;
+
+    __m256i v_max = _mm256_set1_epi32(INT32_MIN);
+
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i mu = _mm256_loadu_si256((const __m256i *) (m_up + k));
+        __m256i ml = _mm256_loadu_si256((const __m256i *) (m_left + k));
+        __m256i md = _mm256_loadu_si256((const __m256i *) (m_diag + k));
+        __m256i pu = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(load8(p_up + k)));
+        __m256i pl = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(load8(p_left + k)));
+        __m256i qc = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(load8(q + k)));
+        __m256i sc = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(load8(s + k)));
+
+        __m256i down  = _mm256_add_epi32(mu, _mm256_add_epi32(v_open, _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(pu, v_up), v_up), v_ext)));
+        __m256i right = _mm256_add_epi32(ml, _mm256_add_epi32(v_open, _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(pl, v_left), v_left), v_ext)));
+        __m256i diag  = _mm256_add_epi32(md, _mm256_add_epi32(v_mism, _mm256_and_si256(_mm256_cmpeq_epi32(qc, sc), v_match)));
+        __m256i best  = _mm256_max_epi32(_mm256_max_epi32(down, diag), right);
+
+        __m256i f = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi32(down, best), v_up),
+                                                    _mm256_and_si256(_mm256_cmpeq_epi32(diag, best), v_diag)),
+                                    _mm256_and_si256(_mm256_cmpeq_epi32(right, best), v_left));
+        f = _mm256_andnot_si256(_mm256_and_si256(_mm256_cmpeq_epi32(f, v_all), v_left), f);
+        f = _mm256_andnot_si256(_mm256_and_si256(v_local, _mm256_cmpgt_epi32(_mm256_set1_epi32(1), best)), f);
+
+        _mm256_storeu_si256((__m256i *) (m_out + k), best);
+        // Packing works within 128-bit lanes: bytes 0-3 and 16-19 hold the flags.
+        __m256i f8 = _mm256_packus_epi16(_mm256_packus_epi32(f, f), v_zero);
+        int32_t f4[2] = {_mm256_extract_epi32(f8, 0), _mm256_extract_epi32(f8, 4)};
+        memcpy(p_out + k, f4, 8);
+
+        v_max = _mm256_max_epi32(v_max, best);
+    }
+
+    __m128i v_max4 = _mm_max_epi32(_mm256_castsi256_si128(v_max), _mm256_extracti128_si256(v_max, 1));
+    v_max4 = _mm_max_epi32(v_max4, _mm_shuffle_epi32(v_max4, _MM_SHUFFLE(1, 0, 3, 2)));
+    v_max4 = _mm_max_epi32(v_max4, _mm_shuffle_epi32(v_max4, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return score_diag_tail(k, n, local, m_up, m_left, m_diag, p_up, p_left, q, s, m_out, p_out,
+                           _mm_cvtsi128_si32(v_max4));
+}
+
+#endif // GAPPEDALN_X86
+
+DiagF
+select_diag_kernel()
+{
+#ifdef GAPPEDALN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return score_diag_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return score_diag_sse41;
+#endif
+    return score_diag_scalar;
+}
+
+DiagF score_diag = select_diag_kernel();
+
+}
+
+bool
+GappedAln::set_kernel(const string& name)
+{
+    if (name == "scalar") {
+        score_diag = score_diag_scalar;
+        return true;
+    }
+#ifdef GAPPEDALN_X86
+    __builtin_cpu_init();
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        score_diag = score_diag_avx2;
+        return true;
+    }
+    if (name == "sse4.1" && __builtin_cpu_supports("sse4.1")) {
+        score_diag = score_diag_sse41;
+        return true;
+    }
+#endif
+    return false;
+}
+
+GappedAln::GappedAln()
+{
+    this->_m           = 0;
+    this->_n           = 0;
+    this->_max_score   = 0;
+    this->_max_score_m = 0;
+    this->_max_score_n = 0;
+}
+
+GappedAln::GappedAln(int len_1, int len_2, bool initialize)
+    : GappedAln()
+{
+    this->init(len_1, len_2, initialize);
+}
+
+int
+GappedAln::init(int size_1, int size_2)
+{
+    return this->init(size_1, size_2, false);
+}
+
+int
+GappedAln::init(int size_1, int size_2, bool initialize)
+{
+    this->_m = size_1 + 1;
+    this->_n = size_2 + 1;
+
+    //
+    // Resize the underlying matrix and path arrays, if necessary, to be 25%
+    // larger than the requested size.
+    //
+    size_t n_cells = size_t(this->_m + this->_n - 1) * this->_m;
+    if (n_cells > this->matrix.size()) {
+        n_cells += n_cells / 4;
+        this->matrix.resize(n_cells);
+        this->path.resize(n_cells);
+    }
+
+    if (initialize) {
+        n_cells = size_t(this->_m + this->_n - 1) * this->_m;
+        memset(this->matrix.data(), 0, sizeof(int32_t) * n_cells);
+        memset(this->path.data(),   0, sizeof(uint8_t) * n_cells);
+        this->_aln.clear();
+        this->_max_score   = 0;
+        this->_max_score_m = 0;
+        this->_max_score_n = 0;
+    }
+
+    return 0;
+}
+
+inline void
+GappedAln::update_max(int32_t score, uint i, uint j)
+{
+    //
+    // The best score is kept rounded down to a whole point: a cell scoring
+    // half a point more still takes over, and so does a later cell with the
+    // same half point score.
+    //
+    if (score > this->_max_score) {
+        this->_max_score   = score - (score & 1);
+        this->_max_score_m = i;
+        this->_max_score_n = j;
+    }
+}
+
+int
+GappedAln::align(const string& tag_1, const string& tag_2)
+{
+    //         j---->        tag_2
+    //        [0][1][2][3]...[n-1]
+    //       +--------------------
+    // i [0] | [i][j]
+    // | [1] |
+    // | [2] |
+    // v [3] |
+    //   ... |
+    // [m-1] |
+    // tag_1
+    //
+
+    //
+    // Initialize the first column and row of the dynamic programming
+    // matrix and the path array.
+    //
+    this->pth(0, 0) = 0;
+    this->mat(0, 0) = 0;
+    for (uint i = 1; i < this->_m; i++) {
+        this->mat(i, 0) = this->mat(i - 1, 0) + (this->pth(i - 1, 0) & path_up ? gapext_hp : gapopen_hp);
+        this->pth(i, 0) = path_up;
+    }
+    for (uint j = 1; j < this->_n; j++) {
+        this->mat(0, j) = this->mat(0, j - 1) + (this->pth(0, j - 1) & path_left ? gapext_hp : gapopen_hp);
+        this->pth(0, j) = path_left;
+    }
+
+    this->score(false, tag_1, 1, this->_m - 1, tag_2, 1, this->_n - 1);
+
+    if (this->trace_global_alignment(tag_1, tag_2))
+        return 1;
+
+    return 0;
+}
+
+int
+GappedAln::align_region(const string& query,  const string& subj,
+                        const size_t q_start, const size_t q_end,
+                        const size_t s_start, const size_t s_end)
+{
+    //         j---->      subject
+    //        [0][1][2][3]...[n-1]
+    //       +--------------------
+    // i [0] | [i][j]
+    // | [1] |
+    // | [2] |
+    // v [3] |
+    //   ... |
+    // [m-1] |
+    // query
+    //
+    // Row and column 0 of the matrix are boundary cells, so the scored region
+    // cannot start before (1, 1).
+    //
+    const size_t q_first = q_start < 1 ? 1 : q_start;
+    const size_t s_first = s_start < 1 ? 1 : s_start;
+
+    this->bound_region(q_first, q_end + 1, s_first, s_end + 1);
+    this->score(true, query, q_first, q_end + 1, subj, s_first, s_end + 1);
+
+    if (this->trace_local_alignment(query, subj))
+        return 1;
+
+    return 0;
+}
+
+int
+GappedAln::align_constrained(const string& query, const string& subj, const vector<STAln> &alns)
+{
+    //         j---->      subject
+    //        [0][1][2][3]...[n-1]
+    //       +--------------------
+    // i [0] | [i][j]
+    // | [1] |
+    // | [2] |
+    // v [3] |
+    //   ... |
+    // [m-1] |
+    // query
+
+    uint q_start, q_end, s_start, s_end;
+    uint q_len, q;
+
+    //
+    // Does the first pre-aligned region start at the beginning of the query? If not, fill in the matrix.
+    //
+    if (alns.front().query_pos > 0) {
+        q_start = 1;
+        q_end   = 1 + alns.front().query_pos - 1;
+        q_len   = q_end;
+        s_start = (alns.front().subj_pos >= (q_len * 2)) ? 1 + alns.front().subj_pos - (q_len * 2) : 1;
+        s_end   = 1 + alns.front().subj_pos - 1;
+
+        this->pth(q_start, s_start) = 0;
+
+        // cerr << "Filling start region; q_start: " << q_start << ", q_end: " << q_end << "; s_start: " << s_start << ", s_end: " << s_end << "\n";
+        this->bound_region(q_start, q_end, s_start, s_end);
+        this->score(true, query, q_start, q_end, subj, s_start, s_end);
+    }
+
+    //
+    // Fill in each pre-aligned region of the sequences starting from the first fragment as ordered by
+    // the query sequence.
+    //
+    for (uint n = 0; n < alns.size(); n++) {
+
+        for (uint k = 1; k <= alns[n].aln_len; k++) {
+            uint i = alns[n].query_pos + k;
+            uint j = alns[n].subj_pos  + k;
+            this->mat(i, j) = this->mat(i - 1, j - 1) + match_hp;
+            this->pth(i, j) = path_diag;
+            this->update_max(this->mat(i, j), i, j);
+        }
+
+        //
+        // Next fill in the following connector sequence span the region between two pre-aligned regions.
+        //
+        uint m = n + 1;
+        if (m < alns.size()) {
+            q_start = 1 + alns[n].query_pos + alns[n].aln_len;
+            q_end   = 1 + alns[m].query_pos - 1;
+            s_start = 1 + alns[n].subj_pos + alns[n].aln_len;
+            s_end   = 1 + alns[m].subj_pos - 1;
+
+            // cerr << "q_start: " << q_start << ", q_end: " << q_end << "; s_start: " << s_start << ", s_end: " << s_end << "\n";
+            this->bound_region(q_start, q_end, s_start, s_end);
+            this->score(true, query, q_start, q_end, subj, s_start, s_end);
+        }
+    }
+
+    //
+    // Does the last pre-aligned region end at the end of the query? If not, fill in the matrix.
+    //
+    if (alns.back().query_pos + alns.back().aln_len != query.length()) {
+        q_start = 1 + alns.back().query_pos + alns.back().aln_len;
+        q_end   = query.length();
+
+        assert(q_end >= q_start);
+
+        q_len   = q_end - q_start + 1;
+        q       = 1 + alns.back().subj_pos + alns.back().aln_len;
+        s_start = (q < this->_n) ? q : this->_n - 1;
+        s_end   = (s_start + (q_len * 2) < this->_n) ? s_start + (q_len * 2) : this->_n - 1;
+
+        // cerr << "Filling end region; q_start: " << q_start << ", q_end: " << q_end << "; s_start: " << s_start << ", s_end: " << s_end << "\n";
+        this->bound_region(q_start, q_end, s_start, s_end);
+        this->score(true, query, q_start, q_end, subj, s_start, s_end);
+    }
+
+    if (this->trace_local_alignment(query, subj))
+        return 1;
+
+    return 0;
+}
+
+int
+GappedAln::bound_region(const int q_start, const int q_end,
+                        const int s_start, const int s_end)
+{
+    //         j---->      subject
+    //        [0][1][2][3]...[n-1]
+    //       +--------------------
+    // i [0] | [i][j]
+    // | [1] |
+    // | [2] |
+    // v [3] |
+    //   ... |
+    // [m-1] |
+    // query
+
+    int i_bnd, i_bnd_low, j_bnd, j_bnd_low;
+    //
+    // Bound the region we are about to score taking care not to cross out of the bounds of the matrix.
+    //
+    assert(q_start >= 0);
+    assert(s_start >= 0);
+    assert(q_end   >= 0);
+    assert(s_end   >= 0);
+
+    //
+    // _n and _m are the length of the subject and query, respectively. however, as they are
+    // indexes into a zero-based array, their maximum value is _n - 1 and _m - 1.
+    //
+    j_bnd     = s_end + 1   > (int) this->_n - 1 ? this->_n - 1 : s_end + 1;
+    j_bnd_low = s_start - 1 < 0 ? 0 : s_start - 1;
+    i_bnd     = q_end + 1   > (int) this->_m - 1 ? this->_m - 1 : q_end + 1;
+    i_bnd_low = q_start - 1 < 0 ? 0 : q_start - 1;
+
+    int32_t score_down, score_right;
+
+    // First, bound the top row.
+    if (i_bnd_low >= 0 && s_start < (int) this->_n - 1)
+        for (int j = s_start; j <= j_bnd; j++) {
+            score_right  = this->mat(i_bnd_low, j - 1);
+            score_right += this->pth(i_bnd_low, j - 1) & path_left ? gapext_hp : gapopen_hp;
+            this->mat(i_bnd_low, j) = score_right < 0 ? 0 : score_right;
+            this->pth(i_bnd_low, j) = path_left;
+        }
+
+    // Second, fill the left column.
+    if (j_bnd_low >= 0)
+        for (int i = q_start; i <= i_bnd; i++) {
+            score_down  = this->mat(i - 1, j_bnd_low);
+            score_down += this->pth(i - 1, j_bnd_low) & path_up ? gapext_hp : gapopen_hp;
+            this->mat(i, j_bnd_low) = score_down < 0 ? 0 : score_down;
+            this->pth(i, j_bnd_low) = path_up;
+        }
+
+    // Third, fill the right column.
+    if (s_end + 1 < (int) this->_n)
+        for (int i = i_bnd_low; i <= i_bnd; i++) {
+            score_right  = this->mat(i, j_bnd - 1);
+            score_right += this->pth(i, j_bnd - 1) & path_left ? gapext_hp : gapopen_hp;
+            this->mat(i, j_bnd) = score_right < 0 ? 0 : score_right;
+            this->pth(i, j_bnd) = path_left;
+        }
+
+    // Fourth, bound the bottom row.
+    if (q_end + 1 < (int) this->_m)
+        for (int j = j_bnd_low; j <= j_bnd; j++) {
+            score_down  = this->mat(i_bnd - 1, j);
+            score_down += this->pth(i_bnd - 1, j) & path_up ? gapext_hp : gapopen_hp;
+            this->mat(i_bnd, j) = score_down < 0 ? 0 : score_down;
+            this->pth(i_bnd, j) = path_up;
+        }
+
+    return 0;
+}
+
+int
+GappedAln::score(bool local,
+                 const string& query, const int q_start, const int q_end,
+                 const string& subj, const int s_start, const int s_end)
+{
+    assert(q_start >= 1 && s_start >= 1);
+
+    if (q_start > q_end || s_start > s_end)
+        return 0;
+
+    //
+    // The subject characters of an anti-diagonal are read backwards, so we
+    // reverse the part of the subject covered by the region.
+    //
+    this->subj_rev.assign(subj.rend() - s_end, subj.rend() - (s_start - 1));
+
+    //
+    // Score the region one anti-diagonal (d = i + j) at a time.
+    //
+    const int d_first = q_start + s_start;
+    const int d_last  = q_end   + s_end;
+    this->diag_max.resize(d_last - d_first + 1);
+
+    int32_t max = INT32_MIN;
+    for (int d = d_first; d <= d_last; d++) {
+        int lo = std::max(q_start, d - s_end);
+        int hi = std::min(q_end,   d - s_start);
+
+        int32_t       *m_cur  = this->matrix.data() + size_t(d)     * this->_m;
+        const int32_t *m_prev = this->matrix.data() + size_t(d - 1) * this->_m;
+        const int32_t *m_prv2 = this->matrix.data() + size_t(d - 2) * this->_m;
+        uint8_t       *p_cur  = this->path.data()   + size_t(d)     * this->_m;
+        const uint8_t *p_prev = this->path.data()   + size_t(d - 1) * this->_m;
+
+        int32_t dmax = score_diag(hi - lo + 1, local,
+                                  m_prev + lo - 1, m_prev + lo, m_prv2 + lo - 1,
+                                  p_prev + lo - 1, p_prev + lo,
+                                  query.data() + lo - 1, this->subj_rev.data() + (s_end - d + lo),
+                                  m_cur + lo, p_cur + lo);
+        this->diag_max[d - d_first] = dmax;
+        if (dmax > max)
+            max = dmax;
+    }
+
+    //
+    // Update the best score as if the cells had been visited row by row: the
+    // first cell with the highest score wins, or the last one if it is a half
+    // point score (see update_max()).
+    //
+    if (max <= this->_max_score)
+        return 0;
+
+    bool last = max & 1;
+    uint best_i = 0, best_j = 0;
+    bool found  = false;
+    for (int d = d_first; d <= d_last; d++) {
+        if (this->diag_max[d - d_first] != max)
+            continue;
+        int lo = std::max(q_start, d - s_end);
+        int hi = std::min(q_end,   d - s_start);
+        const int32_t *m_cur = this->matrix.data() + size_t(d) * this->_m;
+        for (int i = lo; i <= hi; i++) {
+            if (m_cur[i] != max)
+                continue;
+            uint j = d - i;
+            if (!found
+                || ( last && (i > (int) best_i || (i == (int) best_i && j > best_j)))
+                || (!last && (i < (int) best_i || (i == (int) best_i && j < best_j)))) {
+                best_i = i;
+                best_j = j;
+                found  = true;
+            }
+        }
+    }
+    this->update_max(max, best_i, best_j);
+
+    return 0;
+}
+
+bool
+compare_alignres(const AlignRes& a, const AlignRes& b)
+{
+    if (a.gap_cnt == b.gap_cnt) {
+
+        if (a.pct_id == b.pct_id)
+            return (a.contiguity > b.contiguity);
+        else
+            return (a.pct_id > b.pct_id);
+
+    } else {
+        return (a.gap_cnt < b.gap_cnt);
+    }
+}
+
+int
+GappedAln::trace_global_alignment(const string& tag_1, const string& tag_2)
+{
+    //         j---->        tag_2
+    //        [0][1][2][3]...[n-1]
+    //       +--------------------
+    // i [0] | [i][j]
+    // | [1] |
+    // | [2] |
+    // v [3] |
+    //   ... |
+    // [m-1] |
+    // tag_1
+    //
+    int    i, j, cnt, len, gaps, contiguity;
+    double ident;
+    string cigar;
+    char   buf[id_len];
+
+    vector<AlignRes> alns;
+    bool more_paths = true;
+    bool seq_break  = false;
+
+    do {
+        more_paths = false;
+
+        i = this->_m - 1;
+        j = this->_n - 1;
+
+        string aln_1, aln_2;
+
+        while (i > 0 || j > 0) {
+            cnt  = __builtin_popcount(this->pth(i, j));
+
+            if (cnt > 1) more_paths = true;
+
+            if (this->pth(i, j) & path_diag) {
+                aln_1 += tag_1[i - 1];
+                aln_2 += tag_2[j - 1];
+                if (cnt > 1) this->pth(i, j) &= ~path_diag;
+                i--;
+                j--;
+            } else if (this->pth(i, j) & path_up) {
+                aln_1 += tag_1[i - 1];
+                aln_2 += "-";
+                if (cnt > 1) this->pth(i, j) &= ~path_up;
+                i--;
+            } else if (this->pth(i, j) & path_left) {
+                aln_1 += "-";
+                aln_2 += tag_2[j - 1];
+                if (cnt > 1) this->pth(i, j) &= ~path_left;
+                j--;
+            }
+        }
+
+        reverse(aln_1.begin(), aln_1.end());
+        reverse(aln_2.begin(), aln_2.end());
+
+        //
+        // Convert to CIGAR strings.
+        //
+        cigar      = "";
+        len        = aln_1.length();
+        gaps       = 0;
+        contiguity = 0;
+        seq_break  = false;
+        ident      = 0.0;
+        i          = 0;
+        while (i < len) {
+            if (aln_1[i] != '-' && aln_2[i] != '-') {
+                cnt = 0;
+                do {
+                    if (aln_1[i] == aln_2[i]) ident++;
+                    cnt++;
+                    i++;
+                    if (seq_break == false) contiguity++;
+                } while (i < len && aln_1[i] != '-' && aln_2[i] != '-');
+                sprintf(buf, "%dM", cnt);
+
+            } else if (aln_1[i] == '-') {
+                cnt = 0;
+                do {
+                    cnt++;
+                    i++;
+                } while (i < len && aln_1[i] == '-');
+                sprintf(buf, "%dD", cnt);
+                gaps++;
+                seq_break = true;
+
+            } else {
+                cnt = 0;
+                do {
+                    cnt++;
+                    i++;
+                } while (i < len && aln_2[i] == '-');
+                sprintf(buf, "%dI", cnt);
+                gaps++;
+                seq_break = true;
+            }
+
+            cigar += buf;
+        }
+
+        alns.push_back(AlignRes(move(cigar), gaps, contiguity, (ident / (double) len)));
+
+        // cerr << aln_1 << " [" << cigar << ", contiguity: " << contiguity << ", gaps: " << gaps << "]\n"
+        //      << aln_2 << "\n";
+
+    } while (more_paths);
+
+    sort(alns.begin(), alns.end(), compare_alignres);
+    this->_aln = alns[0];
+    // cerr << "Final alignment: " << this->_aln.cigar << "; contiguity: " << contiguity << "; gaps: " << this->_aln.gap_cnt << "\n";
+
+    return 1;
+}
+
+int
+GappedAln::trace_local_alignment(const string& query, const string& subj)
+{
+    //         j---->      subject
+    //        [0][1][2][3]...[n-1]
+    //       +--------------------
+    // i [0] | [i][j]
+    // | [1] |
+    // | [2] |
+    // v [3] |
+    //   ... |
+    // [m-1] |
+    // query
+    //
+    int    i, j, cnt, len, gaps, contiguity;
+    double ident;
+    string cigar;
+    char   buf[id_len];
+
+    vector<AlignRes> alns;
+    bool more_paths  = true;
+    bool seq_break   = false;
+    int  query_start;
+
+    do {
+        query_start = 0;
+        more_paths  = false;
+
+        //
+        // For a local alignment, begin the trace at the matrix cell with the highest score.
+        //
+        i = this->_max_score_m;
+        j = this->_max_score_n;
+
+        string aln_1, aln_2;
+
+        while (i > 0 && j > 0) {
+            cnt  = __builtin_popcount(this->pth(i, j));
+
+            if (cnt > 1) more_paths = true;
+
+            if (this->pth(i, j) & path_diag) {
+                aln_1 += query[i - 1];
+                aln_2 += subj[j - 1];
+                if (cnt > 1) this->pth(i, j) &= ~path_diag;
+                i--;
+                j--;
+            } else if (this->pth(i, j) & path_up) {
+                aln_1 += query[i - 1];
+                aln_2 += "-";
+                if (cnt > 1) this->pth(i, j) &= ~path_up;
+                i--;
+            } else if (this->pth(i, j) & path_left) {
+                aln_1 += "-";
+                aln_2 += subj[j - 1];
+                if (cnt > 1) this->pth(i, j) &= ~path_left;
+                j--;
+            } else {
+                //
+                // Stop traversing the matrix when we reach a node with no paths from it.
+                //
+                query_start = i;
+                break;
+            }
+        }
+
+        if (i > 0 && j == 0)
+            query_start = i;
+
+        reverse(aln_1.begin(), aln_1.end());
+        reverse(aln_2.begin(), aln_2.end());
+
+        //
+        // Convert to CIGAR strings.
+        //
+        cigar = "";
+
+        //
+        // If the local alignment didn't span to the beginning of the query, add
+        // the softmasking to the CIGAR string.
+        //
+        if (query_start > 0) {
+            sprintf(buf, "%dS", (int) query_start);
+            cigar += buf;
+        }
+
+        len        = aln_1.length();
+        gaps       = 0;
+        contiguity = 0;
+        seq_break  = false;
+        ident      = 0.0;
+        i          = 0;
+        while (i < len) {
+            if (aln_1[i] != '-' && aln_2[i] != '-') {
+                cnt = 0;
+                do {
+                    if (aln_1[i] == aln_2[i]) ident++;
+                    cnt++;
+                    i++;
+                    if (seq_break == false) contiguity++;
+                } while (i < len && aln_1[i] != '-' && aln_2[i] != '-');
+                sprintf(buf, "%dM", cnt);
+
+            } else if (aln_1[i] == '-') {
+                cnt = 0;
+                do {
+                    cnt++;
+                    i++;
+                } while (i < len && aln_1[i] == '-');
+                sprintf(buf, "%dD", cnt);
+                gaps++;
+                seq_break = true;
+
+            } else {
+                cnt = 0;
+                do {
+                    cnt++;
+                    i++;
+                } while (i < len && aln_2[i] == '-');
+                sprintf(buf, "%dI", cnt);
+                gaps++;
+                seq_break = true;
+            }
+
+            cigar += buf;
+        }
+
+        //
+        // If the entire query was not aligned, add the softmasked bases to the cigar.
+        //
+        if (this->_max_score_m < query.length()) {
+            sprintf(buf, "%dS", (int) query.length() - this->_max_score_m);
+            cigar += buf;
+        }
+
+        alns.push_back(AlignRes(move(cigar), gaps, contiguity, (ident / (double) len), (uint) j));
+
+    } while (more_paths);
+
+    sort(alns.begin(), alns.end(), compare_alignres);
+    this->_aln = alns[0];
+
+    return 1;
+}
+
+const AlignRes&
+GappedAln::result()
+{
+    return this->_aln;
+}
+
+int
+GappedAln::parse_cigar(vector<pair<char, uint> > &cigar)
+{
+    char buf[id_len];
+    int  dist;
+    const char *p, *q;
+
+    p = this->_aln.cigar.c_str();
+
+    cigar.clear();
+
+    while (*p != '\0') {
+        q = p + 1;
+
+        while (*q != '\0' && isdigit(*q))
+            q++;
+        strncpy(buf, p, q - p);
+        buf[q-p] = '\0';
+        dist = atoi(buf);
+
+        cigar.push_back(make_pair(*q, dist));
+
+        p = q + 1;
+    }
+
+    return 0;
+}
+
+int
+GappedAln::dump_alignment(const string& tag_1, const string& tag_2)
+{
+    //         j---->        tag_2
+    //        [0][1][2][3]...[n-1]
+    //       +--------------------
+    // i [0] | [i][j]
+    // | [1] |
+    // | [2] |
+    // v [3] |
+    //   ... |
+    // [m-1] |
+    // tag_1
+    //
+
+    //
+    // Output the score matrix.
+    //
+    cout << "         ";
+    for (uint j = 0; j < this->_n - 1; j++)
+        cout << "   " << tag_2[j] << "  |";
+    cout << "\n";
+
+    cout << "  ";
+    for (uint j = 0; j < this->_n; j++)
+        printf("% 6.1f|", this->mat(0, j) / 2.0);
+    cout << "\n";
+
+    for (uint i = 1; i < this->_m; i++) {
+        cout << tag_1[i - 1] << " ";
+        for (uint j = 0; j < this->_n; j++)
+            printf("% 6.1f|", this->mat(i, j) / 2.0);
+        cout << "\n";
+    }
+
+    cout << "\n";
+
+    //
+    // Output the path matrix.
+    //
+    cout << "      ";
+    for (uint j = 0; j < this->_n - 1; j++)
+        cout << " " << tag_2[j] << " |";
+    cout << "\n";
+
+    cout << "  ";
+    for (uint j = 0; j < this->_n; j++) {
+        (this->pth(0, j) & path_diag) ? cout << "d" : cout << " ";
+        (this->pth(0, j) & path_up) ? cout << "u" : cout << " ";
+        (this->pth(0, j) & path_left) ? cout << "l" : cout << " ";
+        cout << "|";
+    }
+    cout << "\n";
+
+    for (uint i = 1; i < this->_m; i++) {
+        cout << tag_1[i - 1] << " ";
+        for (uint j = 0; j < this->_n; j++) {
+            (this->pth(i, j) & path_diag) ? cout << "d" : cout << " ";
+            (this->pth(i, j) & path_up) ? cout << "u" : cout << " ";
+            (this->pth(i, j) & path_left) ? cout << "l" : cout << " ";
+            cout << "|";
+        }
+        cout << "\n";
+    }
+
+    cout << "\n";
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include <algorithm>
+
+#include "GenotypeMatrix.h"
+
+const uint16_t GenotypeMatrix::no_hap;
+
+GenotypeMatrix::GenotypeMatrix(const CSLocus* cloc, Datum const*const* d, size_t n_samples)
+    : n_samples_(n_samples), col_bytes_((n_samples + 3) / 4), indexed_(false)
+{
+    this->build_snps(cloc, d);
+    this->build_haps(d);
+}
+
+void
+GenotypeMatrix::build_snps(const CSLocus* cloc, Datum const*const* d)
+{
+    size_t n_snps = cloc->snps.size();
+    this->codes_.assign(n_snps * this->col_bytes_, 0);
+    this->allele0_.assign(n_snps, 0);
+    this->allele1_.assign(n_snps, 0);
+    this->regular_.assign(n_snps, true);
+
+    for (size_t k = 0; k < n_snps; k++) {
+        int      col    = cloc->snps[k]->col;
+        uint8_t *column = this->codes_.data() + k * this->col_bytes_;
+        char     a0     = 0;
+        char     a1     = 0;
+        bool     regular = true;
+
+        for (size_t i = 0; i < this->n_samples_; i++) {
+            const Datum *datum = d[i];
+            if (datum == NULL || col >= datum->len || datum->model[col] == 'U')
+                continue;
+            //
+            // Anything but a diploid call at the two alleles of the SNP is left to
+            // the Datum-based code.
+            //
+            if ((datum->model[col] != 'O' && datum->model[col] != 'E') || datum->obshap.size() != 2) {
+                regular = false;
+                break;
+            }
+            char n0 = datum->obshap[0][k];
+            char n1 = datum->obshap[1][k];
+            for (char nuc : {n0, n1}) {
+                if (nuc != 'A' && nuc != 'C' && nuc != 'G' && nuc != 'T')
+                    regular = false;
+                else if (nuc == a0 || nuc == a1)
+                    continue;
+                else if (a0 == 0)
+                    a0 = nuc;
+                else if (a1 == 0)
+                    a1 = nuc;
+                else
+                    regular = false;
+            }
+            if (!regular)
+                break;
+
+            // Codes are relative to the order in which the alleles were seen, for now.
+            uint8_t code = n0 != n1 ? gt_het : (n0 == a0 ? gt_hom0 : gt_hom1);
+            column[i / 4] |= code << (2 * (i % 4));
+        }
+
+        if (!regular) {
+            this->regular_[k] = false;
+            memset(column, 0, this->col_bytes_);
+            continue;
+        }
+
+        if (a1 != 0 && a1 < a0) {
+            //
+            // Order the alleles alphabetically: swap the homozygous codes (01 <-> 11).
+            //
+            std::swap(a0, a1);
+            for (size_t b = 0; b < this->col_bytes_; b++)
+                column[b] ^= (column[b] & 0x55) << 1;
+        }
+        this->allele0_[k] = a0;
+        this->allele1_[k] = a1;
+    }
+}
+
+void
+GenotypeMatrix::build_haps(Datum const*const* d)
+{
+    this->haps_.assign(2 * this->n_samples_, no_hap);
+
+    vector<const char *> haps;
+    for (size_t i = 0; i < this->n_samples_; i++) {
+        if (d[i] == NULL || d[i]->obshap.size() > 2)
+            continue;
+        for (const char *hap : d[i]->obshap)
+            haps.push_back(hap);
+    }
+    std::sort(haps.begin(), haps.end(),
+              [] (const char *a, const char *b) {return strcmp(a, b) < 0;});
+    haps.erase(std::unique(haps.begin(), haps.end(),
+                           [] (const char *a, const char *b) {return strcmp(a, b) == 0;}),
+               haps.end());
+    if (haps.size() >= no_hap)
+        return;
+
+    this->dict_.assign(haps.begin(), haps.end());
+    this->called_.resize(this->dict_.size());
+    for (size_t h = 0; h < this->dict_.size(); h++)
+        this->called_[h] = this->dict_[h].find_first_of("Nn") == string::npos;
+
+    for (size_t i = 0; i < this->n_samples_; i++) {
+        if (d[i] == NULL || d[i]->obshap.size() > 2 || d[i]->obshap.empty())
+            continue;
+        for (size_t j = 0; j < 2; j++) {
+            // Homozygotes may have a single haplotype.
+            const char *hap = d[i]->obshap[j < d[i]->obshap.size() ? j : 0];
+            auto h = std::lower_bound(haps.begin(), haps.end(), hap,
+                                      [] (const char *a, const char *b) {return strcmp(a, b) < 0;});
+            this->haps_[2 * i + j] = h - haps.begin();
+        }
+    }
+    this->indexed_ = true;
+}
+
+void
+GenotypeMatrix::count_gts(size_t snp, size_t start, size_t end, size_t counts[4]) const
+{
+    counts[0] = counts[1] = counts[2] = counts[3] = 0;
+
+    const uint8_t *column = this->codes_.data() + snp * this->col_bytes_;
+    size_t i = start;
+    for (; i <= end && i % 4 != 0; i++)
+        counts[this->gt(snp, i)]++;
+    //
+    // Whole bytes: count the low and high bits of the four codes at once.
+    //
+    size_t lo = 0, hi = 0, both = 0, n = 0;
+    for (; i + 3 <= end; i += 4, n++) {
+        uint8_t b = column[i / 4];
+        uint8_t l = b & 0x55;
+        uint8_t h = (b >> 1) & 0x55;
+        lo   += __builtin_popcount(l & ~h); // 01
+        hi   += __builtin_popcount(h & ~l); // 10
+        both += __builtin_popcount(l & h);  // 11
+    }
+    counts[gt_hom0] += lo;
+    counts[gt_het]  += hi;
+    counts[gt_hom1] += both;
+    counts[gt_missing] += 4 * n - lo - hi - both;
+    for (; i <= end; i++)
+        counts[this->gt(snp, i)]++;
+}
+
+void
+GenotypeMatrix::share_haplotypes(Datum** d) const
+{
+    if (!this->indexed_)
+        return;
+
+    for (size_t i = 0; i < this->n_samples_; i++) {
+        if (d[i] == NULL || d[i]->shared_obshap || !this->has_haps(i))
+            continue;
+        for (size_t j = 0; j < d[i]->obshap.size(); j++) {
+            delete [] d[i]->obshap[j];
+            // N.B. The strings must not be modified from then on.
+            d[i]->obshap[j] = const_cast<char *>(this->dict_[this->hap(i, j)].c_str());
+        }
+        d[i]->shared_obshap = true;
+    }
+}
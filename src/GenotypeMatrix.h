@@ -0,0 +1,105 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef GENOTYPEMATRIX_H
+#define GENOTYPEMATRIX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "PopMap.h"
+
+//
+// GenotypeMatrix: the genotypes of the samples at a locus, in columnar form.
+//
+// Built from the Datums of a locus once it has been filtered (see
+// `BatchLocusProcessor::batch_stats()`), for the summary statistics to scan
+// compact arrays instead of chasing one heap object per sample:
+//
+//   * For each SNP, a column of 2-bit diploid codes, four samples per byte,
+//     relative to the (at most two) alleles observed at the SNP, ordered
+//     alphabetically. SNPs whose genotypes cannot be represented this way
+//     (more alleles, ambiguous calls...) are flagged as not `regular()` and
+//     callers should then use the Datums.
+//
+//   * A dictionary of the distinct haplotypes of the locus, sorted, and for
+//     each sample the indexes of its two haplotypes. Samples without data (or
+//     with more than two haplotypes) get `no_hap`.
+//
+// `share_haplotypes()` then makes the `obshap` strings of the Datums point
+// into the dictionary, so that they are stored once per locus instead of
+// once per sample.
+//
+class GenotypeMatrix {
+public:
+    enum Gt : uint8_t {gt_missing = 0, gt_hom0 = 1, gt_het = 2, gt_hom1 = 3};
+    static const uint16_t no_hap = UINT16_MAX;
+
+private:
+    size_t           n_samples_;
+    size_t           col_bytes_;
+    vector<uint8_t>  codes_;    // SNP-major.
+    vector<char>     allele0_;  // Per SNP; 0 if none.
+    vector<char>     allele1_;
+    vector<bool>     regular_;
+    vector<uint16_t> haps_;     // Two per sample.
+    vector<string>   dict_;
+    vector<bool>     called_;   // Per haplotype; i.e. has no 'N'.
+    bool             indexed_;  // False if there are too many haplotypes for `uint16_t`s.
+
+    void build_snps(const CSLocus* cloc, Datum const*const* d);
+    void build_haps(Datum const*const* d);
+
+public:
+    GenotypeMatrix(const CSLocus* cloc, Datum const*const* d, size_t n_samples);
+    GenotypeMatrix(const GenotypeMatrix&) = delete;
+    GenotypeMatrix& operator= (const GenotypeMatrix&) = delete;
+
+    size_t n_samples() const {return n_samples_;}
+    size_t n_snps()    const {return regular_.size();}
+
+    //
+    // SNP codes.
+    //
+    bool regular(size_t snp) const {return regular_[snp];}
+    char allele0(size_t snp) const {return allele0_[snp];}
+    char allele1(size_t snp) const {return allele1_[snp];}
+    Gt   gt(size_t snp, size_t sample) const
+        {return Gt((codes_[snp * col_bytes_ + sample / 4] >> (2 * (sample % 4))) & 0x3);}
+    // Counts the genotypes of the samples in [start, end]: {missing, hom0, het, hom1}.
+    void count_gts(size_t snp, size_t start, size_t end, size_t counts[4]) const;
+
+    //
+    // Haplotypes; only available if `haps_indexed()`.
+    //
+    bool          haps_indexed()          const {return indexed_;}
+    size_t        n_haps()                const {return dict_.size();}
+    const string& hap_str(size_t h)       const {return dict_[h];}
+    bool          called(size_t h)        const {return called_[h];}
+    bool          has_haps(size_t sample) const {return haps_[2 * sample] != no_hap;}
+    uint16_t      hap(size_t sample, size_t j) const {return haps_[2 * sample + j];}
+
+    // Makes the Datums' `obshap` point into the dictionary; see `Datum::shared_obshap`.
+    void share_haplotypes(Datum** d) const;
+};
+
+#endif // GENOTYPEMATRIX_H
@@ -0,0 +1,577 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "constants.h"
+#include "stacks.h"
+#include "locus.h"
+#include "LociBin.h"
+
+const char LociBin::magic[9] = "STACKSLB";
+
+namespace {
+
+//
+// Sequence encodings.
+//
+enum SeqMode : uint8_t {seq_raw = 0, seq_acgt = 1, seq_iupac = 2, seq_model = 3};
+
+const char acgt_chars[]  = "ACGT";
+const char iupac_chars[] = "ACGTNRYSWKMBDHV-";
+const char model_chars[] = "OEU-";
+
+struct SeqCodes {
+    int8_t acgt[256];
+    int8_t iupac[256];
+    int8_t model[256];
+
+    SeqCodes() {
+        memset(acgt,  -1, sizeof(acgt));
+        memset(iupac, -1, sizeof(iupac));
+        memset(model, -1, sizeof(model));
+        for (int i = 0; i < 4; ++i)
+            acgt[uint8_t(acgt_chars[i])] = i;
+        for (int i = 0; i < 16; ++i)
+            iupac[uint8_t(iupac_chars[i])] = i;
+        for (int i = 0; i < 4; ++i)
+            model[uint8_t(model_chars[i])] = i;
+    }
+};
+const SeqCodes codes;
+
+void put_u32(string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+        out.push_back(char((v >> (8 * i)) & 0xFF));
+}
+
+void put_u64(string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i)
+        out.push_back(char((v >> (8 * i)) & 0xFF));
+}
+
+uint64_t get_le(const char* p, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i)
+        v |= uint64_t(uint8_t(p[i])) << (8 * i);
+    return v;
+}
+
+// Packs `len` letters of `s` on `bits` bits each, using `table`.
+void pack(string& out, const char* s, size_t len, const int8_t* table, int bits) {
+    size_t per_byte = 8 / bits;
+    for (size_t i = 0; i < len; i += per_byte) {
+        uint8_t b = 0;
+        for (size_t j = 0; j < per_byte && i + j < len; ++j)
+            b |= uint8_t(table[uint8_t(s[i + j])]) << (bits * j);
+        out.push_back(char(b));
+    }
+}
+
+void unpack(string& s, const char* p, size_t len, const char* chars, int bits) {
+    size_t per_byte = 8 / bits;
+    uint8_t mask = (1 << bits) - 1;
+    s.resize(len);
+    for (size_t i = 0; i < len; ++i)
+        s[i] = chars[(uint8_t(p[i / per_byte]) >> (bits * (i % per_byte))) & mask];
+}
+
+
+}
+
+void LociBin::put_varint(string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+void LociBin::put_seq(string& out, const char* s, size_t len) {
+    bool acgt = true, iupac = true, model = true;
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t c = s[i];
+        acgt  = acgt  && codes.acgt[c]  >= 0;
+        iupac = iupac && codes.iupac[c] >= 0;
+        model = model && codes.model[c] >= 0;
+    }
+
+    if (acgt) {
+        put_varint(out, len << 2 | seq_acgt);
+        pack(out, s, len, codes.acgt, 2);
+    } else if (model) {
+        put_varint(out, len << 2 | seq_model);
+        pack(out, s, len, codes.model, 2);
+    } else if (iupac) {
+        put_varint(out, len << 2 | seq_iupac);
+        pack(out, s, len, codes.iupac, 4);
+    } else {
+        put_varint(out, len << 2 | seq_raw);
+        out.append(s, len);
+    }
+}
+
+bool LociBin::get_varint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool LociBin::get_svarint(const char*& p, const char* end, int64_t& v) {
+    uint64_t u;
+    if (!get_varint(p, end, u))
+        return false;
+    v = int64_t(u >> 1) ^ -int64_t(u & 1);
+    return true;
+}
+
+bool LociBin::get_string(const char*& p, const char* end, string& s) {
+    uint64_t len;
+    if (!get_varint(p, end, len) || len > uint64_t(end - p))
+        return false;
+    s.assign(p, len);
+    p += len;
+    return true;
+}
+
+bool LociBin::get_seq(const char*& p, const char* end, string& s) {
+    uint64_t v;
+    if (!get_varint(p, end, v))
+        return false;
+    size_t len = v >> 2;
+    size_t n_bytes;
+    switch (v & 3) {
+    case seq_acgt:
+    case seq_model: n_bytes = (len + 3) / 4; break;
+    case seq_iupac: n_bytes = (len + 1) / 2; break;
+    default:        n_bytes = len;           break;
+    }
+    if (n_bytes > size_t(end - p))
+        return false;
+
+    switch (v & 3) {
+    case seq_acgt:  unpack(s, p, len, acgt_chars, 2);  break;
+    case seq_model: unpack(s, p, len, model_chars, 2); break;
+    case seq_iupac: unpack(s, p, len, iupac_chars, 4); break;
+    default:        s.assign(p, len);                  break;
+    }
+    p += n_bytes;
+    return true;
+}
+
+//
+// LociBinWriter
+// =============
+//
+
+void LociBinWriter::write_bytes(const char* s, size_t len) {
+    if (len > 0 && fwrite(s, 1, len, fh_) != len) {
+        cerr << "Error: Failed to write to '" << path_ << "'.\n";
+        throw exception();
+    }
+    offset_ += len;
+}
+
+void LociBinWriter::open(const string& path) {
+    path_ = path;
+    fh_ = fopen(path_.c_str(), "wb");
+    if (fh_ == NULL) {
+        cerr << "Error: Failed to open '" << path_ << "' for writing.\n";
+        throw exception();
+    }
+    offset_ = 0;
+    n_loci_ = 0;
+    blocks_.clear();
+
+    buf_.clear();
+    buf_.append(LociBin::magic, 8);
+    put_u32(buf_, LociBin::version);
+    write_bytes(buf_.data(), buf_.size());
+}
+
+void LociBinWriter::write(const Locus& loc) {
+    using LB = LociBin;
+
+    if (loc.blacklisted)
+        return;
+
+    size_t n_reads = loc.depth;
+    if (loc.comp_cnt.size() != n_reads || loc.comp_type.size() != n_reads
+        || loc.reads.size() != n_reads || loc.comp.size() < n_reads) {
+        cerr << "Error: Locus " << loc.id << " lacks its reads; cannot write it to '" << path_ << "'.\n";
+        throw exception();
+    }
+
+    if (n_loci_ == 0) {
+        first_id_ = loc.id;
+        prev_id_  = 0;
+    }
+
+    LB::put_svarint(cols_[LB::ids], int64_t(loc.id) - prev_id_);
+    prev_id_ = loc.id;
+    LB::put_svarint(cols_[LB::sample_ids], loc.sample_id);
+
+    uint8_t flags = (loc.deleveraged ? LB::f_deleveraged : 0)
+        | (loc.lumberjackstack ? LB::f_lumberjack : 0)
+        | (loc.model != NULL ? LB::f_model : 0);
+    cols_[LB::flags].push_back(char(flags));
+
+    LB::put_seq(cols_[LB::consensus], loc.con, loc.len);
+    if (loc.model != NULL)
+        LB::put_seq(cols_[LB::model], loc.model, strlen(loc.model));
+
+    // The components of the consensus come first, the read IDs last.
+    size_t n_comps = loc.comp.size() - n_reads;
+    LB::put_varint(cols_[LB::comps], n_comps);
+    for (size_t i = 0; i < n_comps; ++i)
+        LB::put_string(cols_[LB::comps], loc.comp[i], strlen(loc.comp[i]));
+
+    LB::put_varint(cols_[LB::read_info], n_reads);
+    for (size_t i = 0; i < n_reads; ++i) {
+        LB::put_varint(cols_[LB::read_info], uint64_t(loc.comp_cnt[i]) << 1 | (loc.comp_type[i] == secondary ? 1 : 0));
+        const char* read_id = loc.comp[n_comps + i];
+        LB::put_string(cols_[LB::read_ids], read_id, strlen(read_id));
+        LB::put_seq(cols_[LB::read_seqs], loc.reads[i], strlen(loc.reads[i]));
+    }
+
+    LB::put_varint(cols_[LB::snps], loc.snps.size());
+    for (const SNP* snp : loc.snps) {
+        string& col = cols_[LB::snps];
+        LB::put_varint(col, snp->col);
+        col.push_back(char(snp->type));
+        uint32_t lratio;
+        static_assert(sizeof(lratio) == sizeof(snp->lratio), "float is not 32 bits");
+        memcpy(&lratio, &snp->lratio, sizeof(lratio));
+        put_u32(col, lratio);
+        col.push_back(snp->rank_1);
+        col.push_back(snp->rank_2);
+        col.push_back(snp->rank_3);
+        col.push_back(snp->rank_4);
+    }
+
+    LB::put_varint(cols_[LB::alleles], loc.alleles.size());
+    for (auto& a : loc.alleles) {
+        LB::put_seq(cols_[LB::alleles], a.first.c_str(), a.first.length());
+        LB::put_svarint(cols_[LB::alleles], a.second);
+    }
+
+    ++n_loci_;
+    if (n_loci_ == LB::block_size)
+        flush_block();
+}
+
+void LociBinWriter::flush_block() {
+    if (n_loci_ == 0)
+        return;
+
+    blocks_.push_back({offset_, n_loci_, first_id_, prev_id_});
+
+    buf_.clear();
+    LociBin::put_varint(buf_, n_loci_);
+    for (string& col : cols_) {
+        // Deflate the column, unless this does not make it smaller.
+        uLongf z_len = compressBound(col.size());
+        zbuf_.resize(z_len);
+        if (col.size() < 64
+            || compress2((Bytef*) &zbuf_[0], &z_len, (const Bytef*) col.data(), col.size(), Z_BEST_SPEED) != Z_OK
+            || z_len >= col.size()) {
+            LociBin::put_varint(buf_, col.size());
+            LociBin::put_varint(buf_, col.size());
+            buf_ += col;
+        } else {
+            LociBin::put_varint(buf_, col.size());
+            LociBin::put_varint(buf_, z_len);
+            buf_.append(zbuf_.data(), z_len);
+        }
+        col.clear();
+    }
+    string len;
+    put_u32(len, buf_.size());
+    write_bytes(len.data(), len.size());
+    write_bytes(buf_.data(), buf_.size());
+
+    n_loci_ = 0;
+}
+
+void LociBinWriter::close() {
+    if (fh_ == NULL)
+        return;
+    flush_block();
+
+    uint64_t footer_offset = offset_;
+    buf_.clear();
+    LociBin::put_varint(buf_, blocks_.size());
+    uint64_t prev_offset = 0;
+    for (const LociBin::Block& b : blocks_) {
+        LociBin::put_varint(buf_, b.offset - prev_offset);
+        LociBin::put_varint(buf_, b.n_loci);
+        LociBin::put_svarint(buf_, b.first_id);
+        LociBin::put_svarint(buf_, b.last_id);
+        prev_offset = b.offset;
+    }
+    put_u64(buf_, footer_offset);
+    buf_.append(LociBin::magic, 8);
+    write_bytes(buf_.data(), buf_.size());
+
+    int rv = fclose(fh_);
+    fh_ = NULL;
+    if (rv != 0) {
+        cerr << "Error: Failed to write to '" << path_ << "'.\n";
+        throw exception();
+    }
+}
+
+//
+// LociBinReader
+// =============
+//
+
+bool LociBinReader::fail(const char* what) {
+    cerr << "Error: Corrupted or truncated file '" << path_ << "' (" << what << ").\n";
+    bad_ = true;
+    return false;
+}
+
+bool LociBinReader::open(const string& path) {
+    path_ = path;
+    fh_ = fopen(path_.c_str(), "rb");
+    if (fh_ == NULL)
+        return false;
+
+    char header[12];
+    if (fread(header, 1, 12, fh_) != 12 || memcmp(header, LociBin::magic, 8) != 0)
+        return fail("bad header");
+    uint32_t version = get_le(header + 8, 4);
+    if (version != LociBin::version) {
+        cerr << "Error: '" << path_ << "' is in version " << version
+             << " of the binary loci format, expected version " << LociBin::version << ".\n";
+        bad_ = true;
+        return false;
+    }
+
+    // Read the trailer, then the footer.
+    char trailer[16];
+    if (fseeko(fh_, -16, SEEK_END) != 0 || fread(trailer, 1, 16, fh_) != 16
+        || memcmp(trailer + 8, LociBin::magic, 8) != 0)
+        return fail("bad trailer");
+    off_t trailer_offset = ftello(fh_) - 16;
+    uint64_t footer_offset = get_le(trailer, 8);
+    if (footer_offset < 12 || footer_offset > uint64_t(trailer_offset))
+        return fail("bad footer offset");
+
+    vector<char> footer (trailer_offset - footer_offset);
+    if (fseeko(fh_, footer_offset, SEEK_SET) != 0
+        || fread(footer.data(), 1, footer.size(), fh_) != footer.size())
+        return fail("bad footer");
+
+    const char* p   = footer.data();
+    const char* end = p + footer.size();
+    uint64_t n_blocks;
+    if (!LociBin::get_varint(p, end, n_blocks))
+        return fail("bad footer");
+    blocks_.clear();
+    n_loci_ = 0;
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < n_blocks; ++i) {
+        uint64_t delta, n;
+        int64_t first, last;
+        if (!LociBin::get_varint(p, end, delta) || !LociBin::get_varint(p, end, n)
+            || !LociBin::get_svarint(p, end, first) || !LociBin::get_svarint(p, end, last))
+            return fail("bad footer");
+        offset += delta;
+        if (offset >= footer_offset)
+            return fail("bad block offset");
+        blocks_.push_back({offset, uint32_t(n), int(first), int(last)});
+        n_loci_ += n;
+    }
+
+    return seek_block(0);
+}
+
+bool LociBinReader::seek_block(size_t b) {
+    next_block_ = b;
+    block_loci_ = 0;
+    block_i_    = 0;
+    return !bad_;
+}
+
+bool LociBinReader::load_block(size_t b, int store_reads) {
+    const LociBin::Block& blk = blocks_.at(b);
+    char len_bytes[4];
+    if (fseeko(fh_, blk.offset, SEEK_SET) != 0 || fread(len_bytes, 1, 4, fh_) != 4)
+        return fail("bad block");
+    payload_.resize(get_le(len_bytes, 4));
+    if (fread(payload_.data(), 1, payload_.size(), fh_) != payload_.size())
+        return fail("bad block");
+
+    const char* p   = payload_.data();
+    const char* end = p + payload_.size();
+    uint64_t n;
+    if (!LociBin::get_varint(p, end, n) || n != blk.n_loci)
+        return fail("bad block");
+    for (size_t c = 0; c < LociBin::n_cols; ++c) {
+        uint64_t len, z_len;
+        if (!LociBin::get_varint(p, end, len) || !LociBin::get_varint(p, end, z_len) || z_len > uint64_t(end - p))
+            return fail("bad block");
+        if (z_len == len) {
+            cur_[c] = p;
+        } else if ((c == LociBin::read_ids && store_reads < 1) || (c == LociBin::read_seqs && store_reads < 2)) {
+            // Not needed.
+            len = 0;
+            cur_[c] = p;
+        } else {
+            string& col = cols_[c];
+            col.resize(len);
+            uLongf out_len = len;
+            if (uncompress((Bytef*) &col[0], &out_len, (const Bytef*) p, z_len) != Z_OK || out_len != len)
+                return fail("bad block");
+            cur_[c] = col.data();
+        }
+        end_[c] = cur_[c] + len;
+        p += z_len;
+    }
+
+    next_block_ = b + 1;
+    block_loci_ = blk.n_loci;
+    block_i_    = 0;
+    prev_id_    = 0;
+    return true;
+}
+
+bool LociBinReader::next(Locus& loc, int store_reads, bool load_all_model_calls) {
+    using LB = LociBin;
+
+    if (bad_)
+        return false;
+    while (block_i_ == block_loci_) {
+        if (next_block_ >= blocks_.size())
+            return false;
+        if (!load_block(next_block_, store_reads))
+            return false;
+    }
+    ++block_i_;
+
+    int64_t id, sample_id;
+    if (!LB::get_svarint(cur_[LB::ids], end_[LB::ids], id)
+        || !LB::get_svarint(cur_[LB::sample_ids], end_[LB::sample_ids], sample_id)
+        || cur_[LB::flags] == end_[LB::flags])
+        return fail("bad locus");
+    prev_id_ += id;
+    loc.id        = prev_id_;
+    loc.sample_id = sample_id;
+    uint8_t flags = *cur_[LB::flags]++;
+    loc.deleveraged     = flags & LB::f_deleveraged;
+    loc.lumberjackstack = flags & LB::f_lumberjack;
+
+    if (!LB::get_seq(cur_[LB::consensus], end_[LB::consensus], seq_))
+        return fail("bad consensus");
+    loc.len = seq_.length();
+    loc.con = arena_str(loc.arena, seq_.data(), seq_.length());
+    if (flags & LB::f_model) {
+        if (!LB::get_seq(cur_[LB::model], end_[LB::model], seq_))
+            return fail("bad model");
+        loc.model = arena_str(loc.arena, seq_.data(), seq_.length());
+    }
+
+    uint64_t n;
+    if (!LB::get_varint(cur_[LB::comps], end_[LB::comps], n))
+        return fail("bad components");
+    for (uint64_t i = 0; i < n; ++i) {
+        if (!LB::get_string(cur_[LB::comps], end_[LB::comps], seq_))
+            return fail("bad components");
+        loc.comp.push_back(arena_str(loc.arena, seq_.data(), seq_.length()));
+    }
+
+    //
+    // Reads; their IDs and sequences are only decoded if requested.
+    //
+    if (!LB::get_varint(cur_[LB::read_info], end_[LB::read_info], n))
+        return fail("bad reads");
+    loc.depth = n;
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t info;
+        if (!LB::get_varint(cur_[LB::read_info], end_[LB::read_info], info))
+            return fail("bad reads");
+        if (store_reads >= 1) {
+            if (store_reads >= 2) {
+                if (!LB::get_seq(cur_[LB::read_seqs], end_[LB::read_seqs], seq_))
+                    return fail("bad read sequence");
+                loc.reads.push_back(arena_str(loc.arena, seq_.data(), seq_.length()));
+            }
+            if (!LB::get_string(cur_[LB::read_ids], end_[LB::read_ids], seq_))
+                return fail("bad read ID");
+            loc.comp.push_back(arena_str(loc.arena, seq_.data(), seq_.length()));
+            loc.comp_cnt.push_back(info >> 1);
+            loc.comp_type.push_back(info & 1 ? secondary : primary);
+        }
+    }
+
+    if (!LB::get_varint(cur_[LB::snps], end_[LB::snps], n))
+        return fail("bad SNPs");
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t c;
+        const char*& p = cur_[LB::snps];
+        if (!LB::get_varint(p, end_[LB::snps], c) || end_[LB::snps] - p < 9)
+            return fail("bad SNPs");
+        snp_type type = snp_type(uint8_t(p[0]));
+        if (load_all_model_calls || type == snp_type_het) {
+            SNP* snp = arena_snp(loc.arena);
+            snp->col  = c;
+            snp->type = type;
+            uint32_t lratio = get_le(p + 1, 4);
+            memcpy(&snp->lratio, &lratio, sizeof(lratio));
+            snp->rank_1 = p[5];
+            snp->rank_2 = p[6];
+            snp->rank_3 = p[7];
+            snp->rank_4 = p[8];
+            loc.snps.push_back(snp);
+        }
+        p += 9;
+    }
+
+    if (!LB::get_varint(cur_[LB::alleles], end_[LB::alleles], n))
+        return fail("bad alleles");
+    for (uint64_t i = 0; i < n; ++i) {
+        int64_t cnt;
+        if (!LB::get_seq(cur_[LB::alleles], end_[LB::alleles], seq_)
+            || !LB::get_svarint(cur_[LB::alleles], end_[LB::alleles], cnt))
+            return fail("bad alleles");
+        loc.alleles[seq_] = cnt;
+    }
+
+    return true;
+}
+
+bool use_loci_bin(const string& sample) {
+    struct stat bin, tsv;
+    if (stat((sample + ".loci.bin").c_str(), &bin) != 0)
+        return false;
+    for (const char* suffix : {".tags.tsv", ".tags.tsv.gz"})
+        if (stat((sample + suffix).c_str(), &tsv) == 0 && tsv.st_mtime > bin.st_mtime)
+            return false;
+    return true;
+}
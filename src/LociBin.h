@@ -0,0 +1,195 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef LOCIBIN_H
+#define LOCIBIN_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+class Locus;
+
+//
+// The binary loci format (`*.loci.bin`)
+// =====================================
+//
+// A compact replacement for the tags/snps/alleles TSV files of a sample or
+// of the catalog, holding everything `load_loci()` reads from them.
+//
+// File layout (integers are little-endian):
+//   header  : magic "STACKSLB", uint32 version
+//   blocks  : uint32 payload length, payload
+//   footer  : the block index (see below)
+//   trailer : uint64 footer offset, magic "STACKSLB"
+//
+// Loci are stored in blocks of up to `block_size` loci. A block payload is
+// columnar: varint n_loci, then each column as varint length, varint stored
+// length and the stored bytes -- deflated if the stored length is smaller --
+// so that unneeded columns (e.g. the reads) are skipped without being
+// inflated or decoded:
+//   ids        zigzag varint, delta to the previous locus
+//   sample_ids zigzag varint
+//   flags      byte: deleveraged, lumberjackstack, has model
+//   consensus  sequence
+//   model      sequence (only for loci that have a model)
+//   comps      varint count, then strings (catalog components)
+//   read_info  varint count (the depth), then varint (stack number << 1 | secondary)
+//   read_ids   strings, for all the reads
+//   read_seqs  sequences, for all the reads
+//   snps       varint count, then varint col, byte type, float lratio, 4 rank bytes
+//   alleles    varint count, then sequence (the haplotype), zigzag varint count
+//
+// Strings are varint length + bytes. Sequences are varint (length << 2 | mode)
+// followed by the packed letters: 2 bits per nucleotide for pure ACGT
+// sequences, 4 bits for IUPAC codes, 2 bits for model calls (O/E/U/-), or
+// plain bytes otherwise.
+//
+// Blacklisted loci are not stored, as `load_loci()` never loads them.
+//
+// The footer holds varint n_blocks then, for each block, varint offset (delta
+// to the previous block), varint n_loci, and the zigzag varint first and last
+// locus IDs.
+//
+class LociBin {
+public:
+    static const char     magic[9];
+    static const uint32_t version    = 1;
+    static const size_t   block_size = 1024;
+
+    enum Col {ids, sample_ids, flags, consensus, model, comps, read_info, read_ids, read_seqs, snps, alleles, n_cols};
+    enum Flag : uint8_t {f_deleveraged = 1, f_lumberjack = 2, f_model = 4};
+
+    struct Block {
+        uint64_t offset;
+        uint32_t n_loci;
+        int      first_id;
+        int      last_id;
+    };
+
+    // Varint & sequence codecs.
+    static void put_varint(string &out, uint64_t v);
+    static void put_svarint(string &out, int64_t v) {put_varint(out, (uint64_t(v) << 1) ^ uint64_t(v >> 63));}
+    static void put_string(string &out, const char *s, size_t len) {put_varint(out, len); out.append(s, len);}
+    static void put_seq(string &out, const char *s, size_t len);
+
+    // Decoding functions advance `p`; they return false if `end` is reached early.
+    static bool get_varint(const char *&p, const char *end, uint64_t &v);
+    static bool get_svarint(const char *&p, const char *end, int64_t &v);
+    static bool get_string(const char *&p, const char *end, string &s);
+    static bool get_seq(const char *&p, const char *end, string &s);
+};
+
+//
+// LociBinWriter: writes loci to a `*.loci.bin` file.
+//
+// The loci are expected to be complete, as loaded with `store_reads` = 2: one
+// entry of `comp_cnt`, `comp_type` and `reads` per read, the read IDs being
+// the last entries of `comp`. Loci should be written in increasing ID order,
+// for the index to be useful. Errors are reported and throw.
+//
+class LociBinWriter {
+    string              path_;
+    FILE*               fh_;
+    uint64_t            offset_;
+    vector<string>      cols_;
+    uint32_t            n_loci_;
+    int                 first_id_;
+    int                 prev_id_;
+    vector<LociBin::Block> blocks_;
+    string              buf_;
+    string              zbuf_;
+
+    void write_bytes(const char* s, size_t len);
+    void flush_block();
+
+public:
+    LociBinWriter() : path_(), fh_(NULL), offset_(0), cols_(LociBin::n_cols), n_loci_(0), first_id_(0), prev_id_(0) {}
+    LociBinWriter(const LociBinWriter&) = delete;
+    LociBinWriter& operator= (const LociBinWriter&) = delete;
+    ~LociBinWriter() {if (fh_ != NULL) fclose(fh_);}
+
+    void open(const string& path);
+    void write(const Locus& loc);
+    // Writes the last block and the footer.
+    void close();
+};
+
+//
+// LociBinReader: reads the loci of a `*.loci.bin` file, in file order.
+//
+class LociBinReader {
+    string                 path_;
+    FILE*                  fh_;
+    vector<LociBin::Block> blocks_;
+    size_t                 n_loci_;
+    bool                   bad_;
+
+    // The current block.
+    size_t                 next_block_;
+    vector<char>           payload_;
+    uint32_t               block_loci_;
+    uint32_t               block_i_;
+    const char*            cur_[LociBin::n_cols];
+    const char*            end_[LociBin::n_cols];
+    int                    prev_id_;
+    string                 seq_;
+
+    vector<string>         cols_;   // Inflated columns.
+
+    bool fail(const char* what);
+    bool load_block(size_t b, int store_reads);
+
+public:
+    LociBinReader() : path_(), fh_(NULL), n_loci_(0), bad_(false),
+                      next_block_(0), block_loci_(0), block_i_(0), prev_id_(0),
+                      cols_(LociBin::n_cols) {}
+    LociBinReader(const LociBinReader&) = delete;
+    LociBinReader& operator= (const LociBinReader&) = delete;
+    ~LociBinReader() {if (fh_ != NULL) fclose(fh_);}
+
+    // Opens the file and reads its index. Returns false on failure.
+    bool open(const string& path);
+
+    const string& path() const {return path_;}
+    size_t n_loci() const {return n_loci_;}
+    const vector<LociBin::Block>& blocks() const {return blocks_;}
+    bool bad() const {return bad_;}
+
+    // Positions the reader at the start of block `b`.
+    bool seek_block(size_t b);
+
+    // Reads the next locus into `loc`, which should be empty. `store_reads` and
+    // `load_all_model_calls` are interpreted as in `load_loci()`; the columns
+    // that are not needed are not decoded. Returns false at the end of the
+    // file or on error.
+    bool next(Locus& loc, int store_reads, bool load_all_model_calls);
+};
+
+//
+// Whether `load_loci()` should read the loci of `sample` from its `.loci.bin`
+// file: it exists and is at least as recent as the TSV files, if any.
+//
+bool use_loci_bin(const string& sample);
+
+#endif // LOCIBIN_H
@@ -0,0 +1,126 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef LOCUSARENA_H
+#define LOCUSARENA_H
+
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "constants.h"
+#include "stacks.h"
+
+//
+// LocusArena: a slab allocator for the strings and SNPs of a batch of loci
+// (e.g. all the loci of a sample, as loaded by `load_loci()`).
+//
+// Objects are packed in 1MB slabs instead of being allocated one by one, and
+// are all freed at once when the arena is destroyed. The arena must outlive
+// the loci that use it. Allocation is not thread-safe; once loaded, loci may
+// be read (and their arena queried) concurrently.
+//
+class LocusArena {
+    static const size_t slab_size = 1 << 20;
+
+    vector<std::pair<char*, size_t>> slabs_; // Sorted by address.
+    char*  cur_;
+    size_t left_;
+    size_t n_bytes_;
+
+    char* new_slab(size_t size) {
+        char* s = new char[size];
+        std::pair<char*, size_t> slab (s, size);
+        slabs_.insert(std::upper_bound(slabs_.begin(), slabs_.end(), slab), slab);
+        n_bytes_ += size;
+        return s;
+    }
+
+public:
+    LocusArena() : slabs_(), cur_(NULL), left_(0), n_bytes_(0) {}
+    LocusArena(const LocusArena&) = delete;
+    LocusArena& operator= (const LocusArena&) = delete;
+    ~LocusArena() {for (auto& s : slabs_) delete [] s.first;}
+
+    void* alloc(size_t n, size_t align = alignof(std::max_align_t)) {
+        size_t pad = (align - (uintptr_t(cur_) % align)) % align;
+        if (cur_ == NULL || pad + n > left_) {
+            if (n > slab_size / 4)
+                // Large objects get their own slab.
+                return new_slab(n);
+            cur_  = new_slab(slab_size);
+            left_ = slab_size;
+            pad   = 0;
+        }
+        char* p = cur_ + pad;
+        cur_  += pad + n;
+        left_ -= pad + n;
+        return p;
+    }
+
+    char* copy(const char* s, size_t len) {
+        char* c = (char*) alloc(len + 1, 1);
+        memcpy(c, s, len);
+        c[len] = '\0';
+        return c;
+    }
+
+    template<typename T>
+    T* make() {
+        static_assert(std::is_trivially_destructible<T>::value, "LocusArena never calls destructors");
+        return new (alloc(sizeof(T), alignof(T))) T();
+    }
+
+    // Whether `p` points into the arena.
+    bool contains(const void* p) const {
+        const char* c = (const char*) p;
+        auto s = std::upper_bound(slabs_.begin(), slabs_.end(), std::make_pair((char*) c, SIZE_MAX));
+        if (s == slabs_.begin())
+            return false;
+        --s;
+        return c < s->first + s->second;
+    }
+
+    size_t n_bytes() const {return n_bytes_;}
+};
+
+//
+// Allocation helpers for the loci loaders: they use the arena if there is
+// one, operator new otherwise.
+//
+inline char* arena_str(LocusArena* arena, const char* s, size_t len) {
+    if (arena != NULL)
+        return arena->copy(s, len);
+    char* c = new char[len + 1];
+    memcpy(c, s, len);
+    c[len] = '\0';
+    return c;
+}
+
+inline char* arena_str(LocusArena* arena, const char* s) {return arena_str(arena, s, strlen(s));}
+
+inline SNP* arena_snp(LocusArena* arena) {
+    return arena != NULL ? arena->make<SNP>() : new SNP();
+}
+
+#endif // LOCUSARENA_H
@@ -266,12 +266,18 @@ void MetaPopInfo::init_directory(const string& dir_path) {
         size_t pos = filename.rfind(".tags.tsv");
         if (pos == string::npos)
             pos = filename.rfind(".tags.tsv.gz");
+        if (pos == string::npos)
+            pos = filename.rfind(".loci.bin");
 
         if (pos != string::npos)
             sample_names.push_back(filename.substr(0, pos));
     }
     closedir(dir);
 
+    // Samples may have both TSV and binary files.
+    std::sort(sample_names.begin(), sample_names.end());
+    sample_names.erase(std::unique(sample_names.begin(), sample_names.end()), sample_names.end());
+
     if (sample_names.empty()) {
         cerr << "Error: Failed to find sample files in directory '" << dir_path << "'.\n";
         throw exception();
@@ -40,18 +40,39 @@ using std::accumulate;
 
 class Datum {
 public:
-    struct SNPData {
-        size_t tot_depth;
-        Counts<Nt2> nt_depths;
+    //
+    // Information on the call at a SNP. This is stored for each sample at each
+    // SNP, so it is stored compactly: depths are 32-bit, and genotype likelihoods
+    // are kept in hundredths of log10 units, the precision at which they are
+    // written in VCF files. (Deep samples routinely have likelihoods far below
+    // 10^-655, so a 16-bit range would not do.)
+    //
+    class SNPData {
+        static const uint32_t no_gl = UINT32_MAX;
+
+        uint32_t           dp_;
+        array<uint32_t, 4> ad_;  // Indexed by Nt2.
+        array<uint32_t,10> gl_;  // As in `GtLiks`; 0 for 0.0, 1+x for -x/100.
+    public:
         uint8_t gq;
-        GtLiks gtliks;
-        SNPData() : tot_depth(0), gq(UINT8_MAX) {}
+
+        SNPData() : dp_(0), ad_{{0,0,0,0}}, gq(UINT8_MAX) {gl_.fill(no_gl);}
+
+        size_t tot_depth()     const {return dp_;}
+        size_t nt_depth(Nt2 n) const {return ad_[size_t(n)];}
+        size_t nt_depths_sum() const {return size_t(ad_[0]) + ad_[1] + ad_[2] + ad_[3];}
+        GtLiks gtliks()        const;
+
+        void set_tot_depth(size_t dp) {dp_ = std::min(dp, size_t(UINT32_MAX));}
+        void set_nt_depths(const Counts<Nt2>& depths);
+        void set_gtliks(const GtLiks& liks);
     };
 
     int            id;            // Stack ID
     int            merge_partner; // Stack ID of merged datum, if this datum was merged/phased from two, overlapping datums.
     int            len;           // Length of locus
     bool           corrected;     // Has this genotype call been corrected
+    bool           shared_obshap; // The obshap strings belong to the locus' GenotypeMatrix.
     char          *model;         // String representing SNP model output for each nucleotide at this locus.
     char          *gtype;         // Genotype
     char          *trans_gtype;   // Translated Genotype
@@ -62,6 +83,7 @@ public:
     Datum()  {
         this->id            = -1;
         this->corrected     = false;
+        this->shared_obshap = false;
         this->gtype         = NULL;
         this->trans_gtype   = NULL;
         this->model         = NULL;
@@ -70,8 +92,9 @@ public:
         this->merge_partner = 0;
     }
     ~Datum() {
-        for (uint i = 0; i < this->obshap.size(); i++)
-            delete [] this->obshap[i];
+        if (!this->shared_obshap)
+            for (uint i = 0; i < this->obshap.size(); i++)
+                delete [] this->obshap[i];
         delete [] this->gtype;
         delete [] this->trans_gtype;
         delete [] this->model;
@@ -79,6 +102,43 @@ public:
     }
 };
 
+inline
+void Datum::SNPData::set_nt_depths(const Counts<Nt2>& depths) {
+    for (Nt2 nt : Nt2::all)
+        ad_[size_t(nt)] = std::min(depths[nt], size_t(UINT32_MAX));
+}
+
+inline
+void Datum::SNPData::set_gtliks(const GtLiks& liks) {
+    for (size_t gt = 0; gt < gl_.size(); ++gt) {
+        if (!liks.has_lik(gt)) {
+            gl_[gt] = no_gl;
+            continue;
+        }
+        double lnl = liks.at(gt);
+        if (lnl == 0.0 && !std::signbit(lnl)) {
+            gl_[gt] = 0;
+        } else {
+            double x = std::round(-lnl / log(10) * 100);
+            gl_[gt] = uint32_t(std::min(x + 1, double(no_gl - 1)));
+        }
+    }
+}
+
+inline
+GtLiks Datum::SNPData::gtliks() const {
+    GtLiks liks;
+    for (size_t gt = 0; gt < gl_.size(); ++gt) {
+        if (gl_[gt] == no_gl)
+            continue;
+        else if (gl_[gt] == 0)
+            liks.set(gt, 0.0);
+        else
+            liks.set(gt, -((gl_[gt] - 1) / 100.0) * log(10));
+    }
+    return liks;
+}
+
 template<class LocusT=Locus>
 class PopMap {
     const MetaPopInfo& metapopinfo;
@@ -343,10 +403,10 @@ void PopMap<LocusT>::populate_internal(
             d->obshap[1][snp_i] = char(rec_alleles.at(gt.second));
             // Record additional information on the call.
             Datum::SNPData& s = d->snpdata[snp_i];
-            s.tot_depth = VcfRecord::util::parse_gt_dp(gt_str, dp_index);
-            s.nt_depths = VcfRecord::util::parse_gt_ad(gt_str, ad_index, rec_alleles);
+            s.set_tot_depth(VcfRecord::util::parse_gt_dp(gt_str, dp_index));
+            s.set_nt_depths(VcfRecord::util::parse_gt_ad(gt_str, ad_index, rec_alleles));
             s.gq = VcfRecord::util::parse_gt_gq(gt_str, gq_index);
-            s.gtliks = VcfRecord::util::parse_gt_gl(gt_str, gl_index, rec_alleles);
+            s.set_gtliks(VcfRecord::util::parse_gt_gl(gt_str, gl_index, rec_alleles));
         } catch (exception&) {
             cerr << "Error: At the " << (sample_vcf_i+1) << "th sample.\n";
             throw;
@@ -500,13 +560,13 @@ try {
         d->snpdata = vector<Datum::SNPData>(1);
         Datum::SNPData& s = d->snpdata[0];
         if (dp_index != SIZE_MAX)
-            s.tot_depth = VcfRecord::util::parse_gt_dp(gt_str, dp_index);
+            s.set_tot_depth(VcfRecord::util::parse_gt_dp(gt_str, dp_index));
         if (ad_index != SIZE_MAX)
-            s.nt_depths = VcfRecord::util::parse_gt_ad(gt_str, ad_index, rec_alleles);
+            s.set_nt_depths(VcfRecord::util::parse_gt_ad(gt_str, ad_index, rec_alleles));
         if (gq_index != SIZE_MAX)
             s.gq = VcfRecord::util::parse_gt_gq(gt_str, gq_index);
         if (gl_index != SIZE_MAX)
-            s.gtliks = VcfRecord::util::parse_gt_gl(gt_str, gl_index, rec_alleles);
+            s.set_gtliks(VcfRecord::util::parse_gt_gl(gt_str, gl_index, rec_alleles));
     } catch (exception&) {
         cerr << "Warning: Malformed sample field '" << *gt_itr << "'.\n";
         throw;
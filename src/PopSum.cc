@@ -46,7 +46,7 @@ LocPopSum::~LocPopSum()
 
 int
 LocPopSum::sum_pops(const CSLocus *cloc, Datum const*const* d, const MetaPopInfo &mpopi,
-                    bool verbose, ostream &log_fh)
+                    bool verbose, ostream &log_fh, const GenotypeMatrix *gts)
 {
     uint len = strlen(cloc->con);
     int res;
@@ -77,7 +77,7 @@ LocPopSum::sum_pops(const CSLocus *cloc, Datum const*const* d, const MetaPopInfo
         // calculate observed genotype frequencies, allele frequencies, and expected genotype frequencies.
         //
         for (uint k = 0; k < cloc->snps.size(); k++) {
-            res = this->tally_heterozygous_pos(cloc, d, s,
+            res = this->tally_heterozygous_pos(cloc, d, gts, s,
                                                cloc->snps[k]->col, k, pop.first_sample, pop.last_sample);
             //
             // If site is incompatible (too many alleles present), log it.
@@ -160,8 +160,8 @@ LocPopSum::tally_fixed_pos(const CSLocus *cloc, Datum const*const* d, LocSum *s,
 }
 
 int
-LocPopSum::tally_heterozygous_pos(const CSLocus *cloc, Datum const*const* d, LocSum *s,
-                                  int pos, int snp_index, uint start, uint end)
+LocPopSum::tally_heterozygous_pos(const CSLocus *cloc, Datum const*const* d, const GenotypeMatrix *gts,
+                                  LocSum *s, int pos, int snp_index, uint start, uint end)
 {
     //
     // Tally up the genotype frequencies.
@@ -173,10 +173,27 @@ LocPopSum::tally_heterozygous_pos(const CSLocus *cloc, Datum const*const* d, Loc
     s->nucs[pos].reset();
     //cout << "  Calculating summary stats at het locus " << cloc->id << " position " << pos << "; snp_index: " << snp_index << "\n";
 
+    //
+    // If the genotypes at this SNP are in the genotype matrix, count them there.
+    //
+    size_t gt_cnts[4] = {0};
+    if (gts != NULL && gts->regular(snp_index)) {
+        gts->count_gts(snp_index, start, end, gt_cnts);
+        const char *acgt = "ACGT";
+        char a0 = gts->allele0(snp_index);
+        char a1 = gts->allele1(snp_index);
+        if (a0 != 0)
+            nucs[strchr(acgt, a0) - acgt] += 2 * gt_cnts[GenotypeMatrix::gt_hom0] + gt_cnts[GenotypeMatrix::gt_het];
+        if (a1 != 0)
+            nucs[strchr(acgt, a1) - acgt] += 2 * gt_cnts[GenotypeMatrix::gt_hom1] + gt_cnts[GenotypeMatrix::gt_het];
+    } else {
+        gts = NULL;
+    }
+
     //
     // Iterate over each individual in this sub-population.
     //
-    for (i = start; i <= end; i++) {
+    for (i = start; gts == NULL && i <= end; i++) {
         if (d[i] == NULL || pos >= d[i]->len || d[i]->model[pos] == 'U') continue;
 
         //
@@ -270,7 +287,15 @@ LocPopSum::tally_heterozygous_pos(const CSLocus *cloc, Datum const*const* d, Loc
     double obs_p    = 0.0;
     double obs_q    = 0.0;
 
-    for (i = start; i <= end; i++) {
+    if (gts != NULL) {
+        char a0 = gts->allele0(snp_index);
+        num_indv = gt_cnts[GenotypeMatrix::gt_hom0] + gt_cnts[GenotypeMatrix::gt_het] + gt_cnts[GenotypeMatrix::gt_hom1];
+        obs_het  = gt_cnts[GenotypeMatrix::gt_het];
+        obs_p    = p_allele == a0 ? gt_cnts[GenotypeMatrix::gt_hom0] : gt_cnts[GenotypeMatrix::gt_hom1];
+        obs_q    = q_allele == 0  ? 0.0 : gt_cnts[GenotypeMatrix::gt_hom1];
+    }
+
+    for (i = start; gts == NULL && i <= end; i++) {
         if (d[i] == NULL || pos >= d[i]->len) continue;
         //
         // Before counting this individual, make sure the model definitively called this
@@ -738,13 +763,13 @@ LocPopSum::tally_observed_haplotypes(const vector<char *> &obshap, int snp_index
 }
 
 int
-LocPopSum::calc_hapstats(const CSLocus *cloc, const Datum **d, const MetaPopInfo &mpopi)
+LocPopSum::calc_hapstats(const CSLocus *cloc, const Datum **d, const MetaPopInfo &mpopi, const GenotypeMatrix *gts)
 {
     const vector<Pop>  &pops = mpopi.pops();
 
     for (uint j = 0; j < pops.size(); j++) {
 
-        if ( (this->_hapstats_per_pop[j] = this->haplotype_diversity(pops[j].first_sample, pops[j].last_sample, d)) != NULL) {
+        if ( (this->_hapstats_per_pop[j] = this->haplotype_diversity(pops[j].first_sample, pops[j].last_sample, d, gts)) != NULL) {
             this->_hapstats_per_pop[j]->loc_id = cloc->id;
             this->_hapstats_per_pop[j]->bp     = cloc->sort_bp();
 
@@ -768,7 +793,7 @@ LocPopSum::calc_hapstats(const CSLocus *cloc, const Datum **d, const MetaPopInfo
 }
 
 LocStat *
-LocPopSum::haplotype_diversity(int start, int end, Datum const*const* d)
+LocPopSum::haplotype_diversity(int start, int end, Datum const*const* d, const GenotypeMatrix *gts)
 {
     map<string, double>::iterator hit;
     vector<string>      haplotypes;
@@ -782,7 +807,16 @@ LocPopSum::haplotype_diversity(int start, int end, Datum const*const* d)
     //
     // Tabulate the haplotypes in this population.
     //
-    double n = count_haplotypes_at_locus(start, end, d, hap_freq);
+    double n;
+    if (gts != NULL && gts->haps_indexed()) {
+        vector<double> hap_cnts;
+        n = count_haplotypes_at_locus(start, end, *gts, hap_cnts);
+        for (size_t h = 0; h < hap_cnts.size(); h++)
+            if (hap_cnts[h] > 0)
+                hap_freq.emplace_hint(hap_freq.end(), gts->hap_str(h), hap_cnts[h]);
+    } else {
+        n = count_haplotypes_at_locus(start, end, d, hap_freq);
+    }
 
     //
     // If this haplotype is fixed, don't calculate any statistics.
@@ -953,6 +987,30 @@ count_haplotypes_at_locus(int start, int end, Datum const*const* d, map<string,
     return n;
 }
 
+double
+count_haplotypes_at_locus(int start, int end, const GenotypeMatrix &gts, vector<double> &hap_cnts)
+{
+    //
+    // As above, but tallying the haplotypes by their index in the dictionary.
+    //
+    assert(gts.haps_indexed());
+    hap_cnts.assign(gts.n_haps(), 0.0);
+
+    double n = 0.0;
+    for (int i = start; i <= end; i++) {
+        if (!gts.has_haps(i))
+            continue;
+        for (size_t j = 0; j < 2; j++) {
+            uint16_t h = gts.hap(i, j);
+            if (gts.called(h)) {
+                n++;
+                hap_cnts[h]++;
+            }
+        }
+    }
+    return n;
+}
+
 LocusDivergence::LocusDivergence(const MetaPopInfo *mpopi)
 {
     this->_mpopi = mpopi;
@@ -1021,7 +1079,7 @@ LocusDivergence::snp_divergence(const vector<LocBin *> &loci)
             {
                 vector<PopPair **> *pairs = &this->_snps.back();
 
-                #pragma omp for schedule(dynamic, 1) reduction(+:fmean, fcnt)
+                #pragma omp for schedule(dynamic, 1)
                 for (uint k = 0; k < loci.size(); k++) {
 
                     const LocBin *loc = (const LocBin *) loci[k];
@@ -1066,14 +1124,26 @@ LocusDivergence::snp_divergence(const vector<LocBin *> &loci)
                             break;
                         }
 
-                        fmean += pp[pos]->amova_fst;
-                        fcnt++;
                     }
 
                     pairs->at(k) = pp;
                 }
             }
 
+            //
+            // Sum the values in the order of the loci, so that the means do not
+            // depend on the scheduling of the threads.
+            //
+            for (uint k = 0; k < loci.size(); k++) {
+                PopPair **pp = this->_snps.back()[k];
+                for (uint pos = 0; pos < loci[k]->cloc->len; pos++) {
+                    if (pp[pos] == NULL)
+                        continue;
+                    fmean += pp[pos]->amova_fst;
+                    fcnt++;
+                }
+            }
+
             this->_mean_fst[i]     += fmean;
             this->_mean_fst_cnt[i] += fcnt;
             i++;
@@ -1465,18 +1535,19 @@ LocusDivergence::haplotype_divergence_pairwise(const vector<LocBin *> &loci)
             {
                 vector<HapStat *> *haps = &this->_haplotypes.back();
 
-                #pragma omp for schedule(dynamic, 1) reduction(+:pmean, fmean, cnt)
+                #pragma omp for schedule(dynamic, 1)
                 for (uint k = 0; k < loci.size(); k++) {
                     const CSLocus *loc = (const CSLocus *) loci[k]->cloc;
                     const LocSum **s   = loci[k]->s->all_pops();
                     const Datum  **d   = (const Datum **) loci[k]->d;
+                    const GenotypeMatrix *gts = loci[k]->gts != NULL && loci[k]->gts->haps_indexed() ? loci[k]->gts : NULL;
 
                     HapStat *h;
                     //
                     // If this locus only appears in one population or there is only a single haplotype,
                     // do not calculate haplotype F stats.
                     //
-                    if (loc->snps.size() == 0 || fixed_locus(d, subpop_ids))
+                    if (loc->snps.size() == 0 || (gts != NULL ? fixed_locus(*gts, subpop_ids) : fixed_locus(d, subpop_ids)))
                         h = NULL;
                     else
                         h = this->haplotype_amova(d, s, subpop_ids);
@@ -1484,22 +1555,29 @@ LocusDivergence::haplotype_divergence_pairwise(const vector<LocBin *> &loci)
                     if (h != NULL) {
                         h->pop_1   = pop_1;
                         h->pop_2   = pop_2;
-                        h->stat[4] = haplotype_d_est(d, s, subpop_ids);
-                        h->stat[5] = haplotype_dxy(d, loc->len, subpop_ids);
+                        h->stat[4] = gts != NULL ? haplotype_d_est(*gts, subpop_ids) : haplotype_d_est(d, s, subpop_ids);
+                        h->stat[5] = gts != NULL ? haplotype_dxy(*gts, loc->len, subpop_ids) : haplotype_dxy(d, loc->len, subpop_ids);
 
                         h->loc_id = loc->id;
                         h->bp     = loc->sort_bp();
-
-                        pmean   += h->stat[0];
-                        fmean   += h->stat[3];
-                        dxymean += h->stat[5];
-                        cnt++;
                     }
 
                     haps->at(k) = h;
                 }
             }
 
+            //
+            // Sum the values in the order of the loci (see snp_divergence()).
+            //
+            for (const HapStat *h : this->_haplotypes.back()) {
+                if (h == NULL)
+                    continue;
+                pmean   += h->stat[0];
+                fmean   += h->stat[3];
+                dxymean += h->stat[5];
+                cnt++;
+            }
+
             this->_mean_phist[i]     += pmean;
             this->_mean_phist_cnt[i] += cnt;
             this->_mean_fstp[i]      += fmean;
@@ -1534,19 +1612,20 @@ LocusDivergence::haplotype_divergence(const vector<LocBin *> &loci)
             const CSLocus *loc = (const CSLocus *) loci[k]->cloc;
             const LocSum **s   = loci[k]->s->all_pops();
             const Datum  **d   = (const Datum **) loci[k]->d;
+            const GenotypeMatrix *gts = loci[k]->gts != NULL && loci[k]->gts->haps_indexed() ? loci[k]->gts : NULL;
 
             HapStat *h;
             //
             // If this locus only appears in one population or there is only a single haplotype,
             // do not calculate haplotype F stats.
             //
-            if (loc->snps.size() == 0 || fixed_locus(d, pop_ids))
+            if (loc->snps.size() == 0 || (gts != NULL ? fixed_locus(*gts, pop_ids) : fixed_locus(d, pop_ids)))
                 h = NULL;
             else
                 h = this->haplotype_amova(d, s, pop_ids);
 
             if (h != NULL) {
-                h->stat[4] = this->haplotype_d_est(d, s, pop_ids);
+                h->stat[4] = gts != NULL ? this->haplotype_d_est(*gts, pop_ids) : this->haplotype_d_est(d, s, pop_ids);
 
                 h->loc_id  = loc->id;
                 h->bp      = loc->sort_bp();
@@ -2109,6 +2188,64 @@ LocusDivergence::haplotype_d_est(const Datum **d, const LocSum **s, vector<int>
     return d_est;
 }
 
+double
+LocusDivergence::haplotype_d_est(const GenotypeMatrix &gts, vector<int> &pop_ids)
+{
+    //
+    // As above, with the haplotypes tallied by their index in the dictionary.
+    //
+    size_t pop_cnt = pop_ids.size();
+    size_t hap_cnt = gts.n_haps();
+
+    vector<double>         loc_haplotypes(hap_cnt, 0.0);
+    vector<vector<double>> pop_haplotypes(pop_cnt, vector<double>(hap_cnt, 0.0));
+    vector<double>         pop_totals(pop_cnt, 0.0);
+
+    for (size_t p = 0; p < pop_cnt; p++) {
+        const Pop& pop = this->_mpopi->pops()[pop_ids[p]];
+        for (size_t i = pop.first_sample; i <= pop.last_sample; i++) {
+            if (!gts.has_haps(i))
+                continue;
+            for (size_t j = 0; j < 2; j++) {
+                loc_haplotypes[gts.hap(i, j)]++;
+                pop_haplotypes[p][gts.hap(i, j)]++;
+            }
+        }
+        for (double c : pop_haplotypes[p])
+            pop_totals[p] += c;
+    }
+
+    double x = 0.0;
+    for (size_t h = 0; h < hap_cnt; h++) {
+        if (loc_haplotypes[h] == 0)
+            continue;
+
+        double freq_sum_sq = 0.0;
+        double freq_sq_sum = 0.0;
+        for (size_t p = 0; p < pop_cnt; p++) {
+            freq_sum_sq += (pop_haplotypes[p][h] / pop_totals[p]);
+            freq_sq_sum += pow((pop_haplotypes[p][h] / pop_totals[p]), 2);
+        }
+        freq_sum_sq = pow(freq_sum_sq, 2);
+
+        x += (freq_sum_sq - freq_sq_sum) / (pop_cnt - 1);
+    }
+
+    double y = 0.0;
+    for (size_t h = 0; h < hap_cnt; h++) {
+        if (loc_haplotypes[h] == 0)
+            continue;
+        for (size_t p = 0; p < pop_cnt; p++) {
+            y += (pop_haplotypes[p][h] * (pop_haplotypes[p][h] - 1)) /
+                (pop_totals[p] * (pop_totals[p] - 1));
+        }
+    }
+
+    double d_est = 1.0 - (x / y);
+
+    return d_est;
+}
+
 double
 LocusDivergence::haplotype_dxy(const Datum **d, size_t loc_len, vector<int> &pop_ids)
 {
@@ -2186,6 +2323,66 @@ LocusDivergence::haplotype_dxy(const Datum **d, size_t loc_len, vector<int> &pop
     return dxy;
 }
 
+double
+LocusDivergence::haplotype_dxy(const GenotypeMatrix &gts, size_t loc_len, vector<int> &pop_ids)
+{
+    //
+    // As above, with the haplotypes tallied by their index in the dictionary.
+    //
+    assert(pop_ids.size() == 2);
+    size_t hap_cnt = gts.n_haps();
+
+    vector<double>         loc_haplotypes(hap_cnt, 0.0);
+    vector<vector<double>> pop_haplotypes(2, vector<double>(hap_cnt, 0.0));
+    vector<double>         pop_totals(2, 0.0);
+
+    for (size_t p = 0; p < 2; p++) {
+        const Pop& pop = this->_mpopi->pops()[pop_ids[p]];
+        for (size_t i = pop.first_sample; i <= pop.last_sample; i++) {
+            if (!gts.has_haps(i))
+                continue;
+            for (size_t j = 0; j < 2; j++) {
+                loc_haplotypes[gts.hap(i, j)]++;
+                pop_haplotypes[p][gts.hap(i, j)]++;
+            }
+        }
+        for (double c : pop_haplotypes[p])
+            pop_totals[p] += c;
+    }
+
+    vector<size_t> haps;
+    for (size_t h = 0; h < hap_cnt; h++)
+        if (loc_haplotypes[h] > 0)
+            haps.push_back(h);
+
+    double popx_freq, popy_freq, nuc_diff;
+    const char *p, *q;
+
+    double dxy = 0.0;
+    for (uint i = 0; i < haps.size(); i++) {
+        popx_freq = pop_haplotypes[0][haps[i]] / pop_totals[0];
+
+        for (uint j = 0; j < haps.size(); j++) {
+            popy_freq = pop_haplotypes[1][haps[j]] / pop_totals[1];
+
+            nuc_diff  = 0;
+            p = gts.hap_str(haps[i]).c_str();
+            q = gts.hap_str(haps[j]).c_str();
+            for (; *p != '\0'; p++, q++)
+                nuc_diff += *p != *q ? 1 : 0;
+            nuc_diff = nuc_diff / (double) loc_len;
+
+            // Nei 1987, Equation 5.3
+            nuc_diff = -1 * (3.0 / 4.0) * log(1 - ((4.0 / 3.0) * nuc_diff));
+
+            // Nei 1987, Equation 10.20
+            dxy += popx_freq * popy_freq * nuc_diff;
+        }
+    }
+
+    return dxy;
+}
+
 bool
 LocusDivergence::fixed_locus(const Datum **d, vector<int> &pop_ids)
 {
@@ -2421,3 +2618,47 @@ LocusDivergence::write_summary(string path)
 
     return 0;
 }
+
+bool
+LocusDivergence::fixed_locus(const GenotypeMatrix &gts, vector<int> &pop_ids)
+{
+    //
+    // As above, with the haplotypes tallied by their index in the dictionary.
+    //
+    vector<bool> loc_haplotypes(gts.n_haps(), false);
+    size_t       loc_hap_cnt = 0;
+    uint         valid_pops  = 0;
+
+    for (int pop_id : pop_ids) {
+        const Pop& pop = this->_mpopi->pops()[pop_id];
+        bool valid = false;
+        for (size_t i = pop.first_sample; i <= pop.last_sample; i++) {
+            if (!gts.has_haps(i) || !gts.called(gts.hap(i, 0)))
+                continue;
+            valid = true;
+            for (size_t j = 0; j < 2; j++) {
+                uint16_t h = gts.hap(i, j);
+                if (!loc_haplotypes[h]) {
+                    loc_haplotypes[h] = true;
+                    loc_hap_cnt++;
+                }
+            }
+        }
+        if (valid)
+            valid_pops++;
+    }
+
+    //
+    // Check that more than one population has data for this locus.
+    //
+    if (valid_pops <= 1)
+        return true;
+
+    //
+    // Check that there is more than one haplotype at this locus.
+    //
+    if (loc_hap_cnt == 1)
+        return true;
+
+    return false;
+}
@@ -34,6 +34,7 @@
 #include "stacks.h"
 #include "locus.h"
 #include "PopMap.h"
+#include "GenotypeMatrix.h"
 #include "MetaPopInfo.h"
 #include "Hwp.h"
 
@@ -296,9 +297,10 @@ public:
     LocPopSum(size_t cloc_len, const MetaPopInfo& mpopi);
     ~LocPopSum();
 
-    int             sum_pops(const CSLocus *, Datum const*const*, const MetaPopInfo&, bool, ostream &);
+    // The genotype matrix, if given, is used instead of the Datums where possible.
+    int             sum_pops(const CSLocus *, Datum const*const*, const MetaPopInfo&, bool, ostream &, const GenotypeMatrix * = NULL);
     int             tally_metapop(const CSLocus *);
-    int             calc_hapstats(const CSLocus *, const Datum **, const MetaPopInfo&);
+    int             calc_hapstats(const CSLocus *, const Datum **, const MetaPopInfo&, const GenotypeMatrix * = NULL);
     const LocSum  **all_pops()                         { return (const LocSum **) this->_per_pop; }
     const LocSum   *per_pop(size_t pop_index)          const { return this->_per_pop[pop_index]; }
     const LocTally *meta_pop()                         const { return this->_meta_pop; }
@@ -309,21 +311,22 @@ public:
     double          hwe(double, double, double, double, double, double);
 
 private:
-    int      tally_heterozygous_pos(const CSLocus *, Datum const*const*, LocSum *, int, int, uint, uint);
+    int      tally_heterozygous_pos(const CSLocus *, Datum const*const*, const GenotypeMatrix *, LocSum *, int, int, uint, uint);
     int      tally_fixed_pos(const CSLocus *, Datum const*const*, LocSum *, int, uint, uint);
     int      tally_ref_alleles(int, uint16_t &, char &, char &, uint16_t &, uint16_t &);
     int      tally_observed_haplotypes(const vector<char *> &, int);
-    LocStat *haplotype_diversity(int, int, Datum const*const*);
+    LocStat *haplotype_diversity(int, int, Datum const*const*, const GenotypeMatrix *);
     double   log_hwp_pr(double, double, double, double, double, double);
 };
 
 struct LocBin {
-    size_t     sample_cnt;
-    CSLocus   *cloc;
-    Datum    **d;
-    LocPopSum *s;
+    size_t          sample_cnt;
+    CSLocus        *cloc;
+    Datum         **d;
+    LocPopSum      *s;
+    GenotypeMatrix *gts; // Once the locus has been filtered; may share its haplotypes with `d`.
 
-    LocBin(size_t cnt): sample_cnt(cnt), cloc(NULL), d(NULL), s(NULL) {}
+    LocBin(size_t cnt): sample_cnt(cnt), cloc(NULL), d(NULL), s(NULL), gts(NULL) {}
     ~LocBin() {
         if (this->cloc != NULL) delete cloc;
         if (this->d    != NULL) {
@@ -332,6 +335,7 @@ struct LocBin {
             delete [] d;
         }
         if (this->s    != NULL) delete s;
+        if (this->gts  != NULL) delete gts;
     }
 };
 
@@ -377,6 +381,7 @@ private:
     // Haplotype-level F statistics
     //
     double   haplotype_d_est(const Datum **, const LocSum **, vector<int> &);
+    double   haplotype_d_est(const GenotypeMatrix &, vector<int> &);
     HapStat *haplotype_amova(const Datum **, const LocSum **, vector<int> &);
     double   amova_ssd_total(vector<string> &, map<string, int> &, double **);
     double   amova_ssd_wp(vector<int> &, map<int, vector<int>> &, map<string, int> &, map<int, vector<string>> &, double **);
@@ -387,8 +392,10 @@ private:
     // Haplotype-level Dxy
     //
     double   haplotype_dxy(const Datum **, size_t,  vector<int> &);
+    double   haplotype_dxy(const GenotypeMatrix &, size_t,  vector<int> &);
 
     bool     fixed_locus(const Datum **, vector<int> &);
+    bool     fixed_locus(const GenotypeMatrix &, vector<int> &);
     int      nuc_substitution_identity(map<string, int> &, double **);
     int      nuc_substitution_identity_max(map<string, int> &, double **);
 };
@@ -398,6 +405,7 @@ private:
 //
 bool     uncalled_haplotype(const char *);
 double   count_haplotypes_at_locus(int, int, Datum const*const*, map<string, double> &);
+double   count_haplotypes_at_locus(int, int, const GenotypeMatrix &, vector<double> &);
 int      nuc_substitution_dist(map<string, int> &, double **);
 
 
@@ -20,33 +20,48 @@
 
 #include "SuffixTree.h"
 
-STNode::~STNode()
+STNode *
+STNode::add_suffix_link(STNode *node)
 {
-    for (uint i = 0; i < NT4cnt; i++) {
-        if (this->edges_[i] != NULL)
-            delete this->edges_[i];
-    }
-    this->suffix_link_ = NULL;
+    this->suffix_link_ = node;
+    return this->suffix_link_;
 }
 
-STEdge *
-STNode::add_edge(Nt4 nuc, int pos)
+void
+SuffixTree::reset(const DNASeq4& s)
 {
-    size_t n = nuc.index();
+    this->seq_     = s;
+    this->seq_str_ = this->seq_.str();
 
-    if (this->edges_[n] != NULL)
-        delete this->edges_[n];
-
-    this->edges_[n] = new STEdge(pos);
+    //
+    // A tree of n characters has at most n internal nodes (including the root),
+    // n leaves and 2n - 1 edges.
+    //
+    size_t n = this->seq_.length();
+    this->nodes_.clear();
+    this->edges_.clear();
+    this->nodes_.reserve(n + 1);
+    this->edges_.reserve(2 * n + 1);
 
-    return this->edges_[n];
+    this->root = this->add_node(1);
 }
 
 STNode *
-STNode::add_suffix_link(STNode *node)
+SuffixTree::add_node(size_t id)
 {
-    this->suffix_link_ = node;
-    return this->suffix_link_;
+    if (this->nodes_.size() == this->nodes_.capacity())
+        DOES_NOT_HAPPEN;
+    this->nodes_.push_back(STNode(id));
+    return &this->nodes_.back();
+}
+
+STEdge *
+SuffixTree::add_edge(STNode *node, Nt4 nuc, int pos)
+{
+    if (this->edges_.size() == this->edges_.capacity())
+        DOES_NOT_HAPPEN;
+    this->edges_.push_back(STEdge(pos));
+    return node->set_edge(nuc, &this->edges_.back());
 }
 
 size_t
@@ -286,7 +301,7 @@ SuffixTree::build_tree()
                 //
                 if (active_edge == Nt4::$) {
                     // cerr << "    Adding edge " << char(this->seq_[i]) << " to node " << active_node->id() << "\n";
-                    active_node->add_edge(this->seq_[i], i);
+                    this->add_edge(active_node, this->seq_[i], i);
                     if (active_node == this->root)
                         active_len++;
                     remainder--;
@@ -304,10 +319,10 @@ SuffixTree::build_tree()
                     //
                     // cerr << "      Splitting node " << active_node->id() << " at active edge: " << char(active_edge) << "; active len: " << active_len << " (created node " << id << ")\n";
                     next_pos   = active_node->edge(active_edge)->start() + active_len;
-                    split_node = new STNode(id);
+                    split_node = this->add_node(id);
                     old_edge   = active_node->edge(active_edge);
-                    split_node->add_edge(this->seq_[next_pos], next_pos);
-                    split_node->add_edge(this->seq_[i], i);
+                    this->add_edge(split_node, this->seq_[next_pos], next_pos);
+                    this->add_edge(split_node, this->seq_[i], i);
 
                     //
                     // Does the edge being split already point to an internal node? If so, reconnect the new node to the existing nodes.
@@ -39,13 +39,12 @@ class STNode {
 
 public:
     STNode(size_t id): id_(id), suffix_link_(NULL) { for (uint i = 0; i < NT4cnt; i++) this->edges_[i] = NULL; }
-    ~STNode();
 
     size_t  id()          { return this->id_; }
     STEdge *edge(Nt4 n)   { return this->edges_[n.index()]; }
     STEdge *edge(uint i)  { return this->edges_[i]; }
     STNode *suffix_link() { return this->suffix_link_; }
-    STEdge *add_edge(Nt4 n, int pos);
+    STEdge *set_edge(Nt4 n, STEdge *e) { this->edges_[n.index()] = e; return e; }
     STNode *add_suffix_link(STNode *);
 };
 
@@ -59,7 +58,6 @@ public:
     STEdge() : s_(-1), e_(-1), succ_(NULL) {}
     STEdge(int s) : s_(s), e_(-1), succ_(NULL) {}
     STEdge(int s, int e, STNode *succ) : s_(s), e_(e), succ_(succ) {}
-    ~STEdge() { delete this->succ_; }
 
     int     start()         { return this->s_; }
     int     start(int s)    { this->s_ = s; return this->s_; }
@@ -108,17 +106,29 @@ public:
     }
 };
 
+//
+// SuffixTree: a suffix tree of a contig, built with Ukkonen's algorithm.
+//
+// The nodes and edges live in two flat arrays that are reserved for the
+// sequence length up front (so that the pointers between them stay valid).
+// reset() discards the tree but keeps this memory, so that one tree can be
+// reused for locus after locus.
+//
 class SuffixTree {
     DNASeq4 seq_;
     string seq_str_;
+    vector<STNode> nodes_;
+    vector<STEdge> edges_;
     STNode *root;
     const size_t min_align_ = 11;
 
 public:
-    SuffixTree(const DNASeq4& s): seq_(s), seq_str_(seq_.str()) { this->root = new STNode(1); }
-    SuffixTree()  { this->root = new STNode(1); }
-    ~SuffixTree() { delete this->root; }
+    SuffixTree(const DNASeq4& s): seq_(), root(NULL) { this->reset(s); }
+    SuffixTree(): seq_(), root(NULL) { this->reset(DNASeq4()); }
+    SuffixTree(const SuffixTree&) = delete;
+    SuffixTree& operator= (const SuffixTree&) = delete;
 
+    void    reset(const DNASeq4& s);
     size_t  build_tree();
     size_t  align(const char *, vector<pair<size_t, size_t> > &);
     size_t  write_dot(ofstream &);
@@ -129,6 +139,8 @@ public:
     size_t  min_aln() { return this->min_align_; }
 
 private:
+    STNode *add_node(size_t id);
+    STEdge *add_edge(STNode *node, Nt4 n, int pos);
     size_t find_leaf_dist(STNode *);
     size_t find_all_leaf_dists(STNode *, vector<size_t> &, size_t);
     size_t write_suffix(vector<string> &, string&, STNode *);
@@ -130,6 +130,11 @@ parse_input_record(Seq *s, RawRead *r)
         hash_cnt  += *q == '#' ? 1 : 0;
     }
 
+    //
+    // Only CASAVA 1.8+ headers carry the chastity filter flag.
+    //
+    r->filter = false;
+
     if (colon_cnt == 9 && hash_cnt == 0) {
         r->fastq_type = illv2_fastq;
         //
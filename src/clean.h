@@ -178,6 +178,7 @@ public:
         this->read          = read;
 
         this->retain        = 1;
+        this->filter        = false;
         this->inline_bc_len = 0;
         this->tile          = 0;
         this->run           = 0;
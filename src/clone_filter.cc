@@ -45,6 +45,8 @@ bool     retain_oligo  = false;
 barcodet barcode_type  = null_null;
 int      oligo_len_1   = 0;
 int      oligo_len_2   = 0;
+size_t   max_memory    = 0;
+int      num_threads   = 1;
 
 //
 // These variables are required for other linked objects, but we won't use them in clone_filter.
@@ -64,6 +66,10 @@ int main (int argc, char* argv[]) {
 
     parse_command_line(argc, argv);
 
+    #ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+    #endif
+
     if (oligo_len_2 == 0) oligo_len_2 = oligo_len_1;
     min_bc_size_1 = oligo_len_1;
     max_bc_size_1 = oligo_len_1;
@@ -133,33 +139,40 @@ int main (int argc, char* argv[]) {
     vector<char *> clone_map_keys;
 
     int result = 1;
-    for (uint i = 0; i < files.size(); i++) {
-        cerr << "Processing file " << i+1 << " of " << files.size() << " [" << files[i].first.c_str() << "]\n";
+    if (max_memory > 0) {
+        result = filter_clones_external(files, counters, clone_dist);
+        if (!result)
+            cerr << "Error processing reads.\n";
 
-        result = 1;
-        if (paired) {
-            if (barcode_type == null_null)
-                result = process_paired_reads_by_sequence(files[i].first, files[i].second, counters, clone_map, clone_map_keys);
-            else
-                result = process_paired_reads(files[i].first, files[i].second, counters, oligo_map);
+    } else {
+        for (uint i = 0; i < files.size(); i++) {
+            cerr << "Processing file " << i+1 << " of " << files.size() << " [" << files[i].first.c_str() << "]\n";
 
-        } else {
-            result = process_reads(files[i].first, counters, oligo_map);
-        }
+            result = 1;
+            if (paired) {
+                if (barcode_type == null_null)
+                    result = process_paired_reads_by_sequence(files[i].first, files[i].second, counters, clone_map, clone_map_keys);
+                else
+                    result = process_paired_reads(files[i].first, files[i].second, counters, oligo_map);
 
-        if (!result) {
-            cerr << "Error processing reads.\n";
-            break;
+            } else {
+                result = process_reads(files[i].first, counters, oligo_map);
+            }
+
+            if (!result) {
+                cerr << "Error processing reads.\n";
+                break;
+            }
         }
-    }
 
-    if (barcode_type == null_null && result) {
-        write_clonereduced_sequence(files[0].first, files[0].second, clone_map, clone_dist, counters);
+        if (barcode_type == null_null && result) {
+            write_clonereduced_sequence(files[0].first, files[0].second, clone_map, clone_dist, counters);
 
-    } else {
-        for (OligoHash::iterator i = oligo_map.begin(); i != oligo_map.end(); i++)
-            for (map<string, uint16_t>::iterator j = i->second.begin(); j != i->second.end(); j++)
-                clone_dist[j->second]++;
+        } else {
+            for (OligoHash::iterator i = oligo_map.begin(); i != oligo_map.end(); i++)
+                for (map<string, uint16_t>::iterator j = i->second.begin(); j != i->second.end(); j++)
+                    clone_dist[j->second]++;
+        }
     }
 
     if (clone_map_keys.size() > 0) {
@@ -209,20 +222,20 @@ process_paired_reads_by_sequence(string prefix_1, string prefix_2, map<string, l
 
     switch (in_file_type) {
     case FileT::fastq:
-        fh_1 = new Fastq(path_1);
-        fh_2 = interleaved ? fh_1 : new Fastq(path_2);
+        fh_1 = new Fastx(path_1, true);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, true);
         break;
     case FileT::gzfastq:
-        fh_1 = new GzFastq(path_1);
-        fh_2 = interleaved ? fh_1 : new GzFastq(path_2);
+        fh_1 = new Fastx(path_1, true);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, true);
         break;
     case FileT::fasta:
-        fh_1 = new Fasta(path_1);
-        fh_2 = interleaved ? fh_1 : new Fasta(path_2);
+        fh_1 = new Fastx(path_1, false);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, false);
         break;
     case FileT::gzfasta:
-        fh_1 = new GzFasta(path_1);
-        fh_2 = interleaved ? fh_1 : new GzFasta(path_2);
+        fh_1 = new Fastx(path_1, false);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, false);
         break;
     case FileT::bam:
         fh_1 = new BamUnAln(path_1);
@@ -295,7 +308,7 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
                             map<string, long> &counters)
 {
     ofstream  out_fh_1,   out_fh_2, discard_fh_1, discard_fh_2;
-    gzFile    out_gzfh_1=NULL, out_gzfh_2=NULL, discard_gzfh_1=NULL, discard_gzfh_2=NULL;
+    BgzfWriter out_gzfh_1, out_gzfh_2, discard_gzfh_1, discard_gzfh_2;
 
     int return_val = 1;
 
@@ -327,8 +340,8 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
     string file_1 = remove_suffix(in_file_type, prefix_1);
     path_1 = out_path + file_1 + suffix_1;
     if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {
-        out_gzfh_1 = gzopen(path_1.c_str(), "wb");
-        if (!(out_gzfh_1)) {
+        out_gzfh_1.open(path_1);
+        if (!out_gzfh_1.is_open()) {
             cerr << "Error opening output file '" << path_1 << "'\n";
             return -1;
         }
@@ -343,8 +356,8 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
     string file_2 = remove_suffix(in_file_type, prefix_2);
     path_2 = out_path + file_2 + suffix_2;
     if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {
-        out_gzfh_2 = gzopen(path_2.c_str(), "wb");
-        if (!(out_gzfh_2)) {
+        out_gzfh_2.open(path_2);
+        if (!out_gzfh_2.is_open()) {
             cerr << "Error opening output file '" << path_2 << "'\n";
             return -1;
         }
@@ -362,8 +375,8 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
     if (discards) {
         path_1 = out_path + file_1 + ".discards" + suffix_1;
         if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {
-            discard_gzfh_1 = gzopen(path_1.c_str(), "wb");
-            if (!(discard_gzfh_1)) {
+            discard_gzfh_1.open(path_1);
+            if (!discard_gzfh_1.is_open()) {
                 cerr << "Error opening output file '" << path_1 << "'\n";
                 return -1;
             }
@@ -377,8 +390,8 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
 
         path_2 = out_path + file_2 + ".discards" + suffix_2;
         if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {
-            discard_gzfh_2 = gzopen(path_2.c_str(), "wb");
-            if (!(discard_gzfh_2)) {
+            discard_gzfh_2.open(path_2);
+            if (!discard_gzfh_2.is_open()) {
                 cerr << "Error opening output file '" << path_2 << "'\n";
                 return -1;
             }
@@ -422,8 +435,8 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
             switch(out_file_type) {
             case FileT::gzfastq:
             case FileT::gzfasta:
-                gzputs(out_gzfh_1, sstr_1.str().c_str());
-                gzputs(out_gzfh_2, sstr_2.str().c_str());
+                gzputs_throwing(out_gzfh_1, sstr_1.str().c_str());
+                gzputs_throwing(out_gzfh_2, sstr_2.str().c_str());
                 break;
             case FileT::fastq:
             case FileT::fasta:
@@ -462,8 +475,8 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
                     switch(out_file_type) {
                     case FileT::gzfastq:
                     case FileT::gzfasta:
-                        gzputs(discard_gzfh_1, sstr_1.str().c_str());
-                        gzputs(discard_gzfh_2, sstr_2.str().c_str());
+                        gzputs_throwing(discard_gzfh_1, sstr_1.str().c_str());
+                        gzputs_throwing(discard_gzfh_2, sstr_2.str().c_str());
                         break;
                     case FileT::fastq:
                     case FileT::fasta:
@@ -480,11 +493,11 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
     cerr << "done.\n";
 
     if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {
-        gzclose(out_gzfh_1);
-        gzclose(out_gzfh_2);
+        out_gzfh_1.close();
+        out_gzfh_2.close();
         if (discards) {
-            gzclose(discard_gzfh_1);
-            gzclose(discard_gzfh_2);
+            discard_gzfh_1.close();
+            discard_gzfh_2.close();
         }
     } else {
         out_fh_1.close();
@@ -497,13 +510,751 @@ write_clonereduced_sequence(string prefix_1, string prefix_2,
 
     return return_val;
 }
+
+//
+// Bounded-memory clone detection (--max-memory)
+// =============================================
+//
+namespace {
+
+FILE *
+open_tmp(const string &path, const char *mode)
+{
+    FILE *fh = fopen(path.c_str(), mode);
+    if (fh == NULL) {
+        cerr << "Error: Failed to open temporary file '" << path << "': " << strerror(errno) << "\n";
+        exit(1);
+    }
+    return fh;
+}
+
+void
+write_tmp(FILE *fh, vector<char> &buf)
+{
+    if (!buf.empty() && fwrite(buf.data(), 1, buf.size(), fh) != buf.size()) {
+        cerr << "Error: Failed to write to a temporary file (is the disk full?).\n";
+        exit(1);
+    }
+    buf.clear();
+}
+
+Input *
+open_input(const string &path)
+{
+    switch (in_file_type) {
+    case FileT::fastq:
+    case FileT::gzfastq:
+        return new Fastx(path, true);
+    case FileT::fasta:
+    case FileT::gzfasta:
+        return new Fastx(path, false);
+    case FileT::bam:
+        return new BamUnAln(path);
+    case FileT::bustard:
+        return new Bustard(path);
+    default:
+        return NULL;
+    }
+}
+
+//
+// How much sequence to trim to remove the oligo sequence(s) before printing.
+//
+void
+clone_offsets(int &offset_1, int &offset_2)
+{
+    offset_1 = 0;
+    offset_2 = 0;
+
+    if (!paired) {
+        if (barcode_type == inline_null || barcode_type == inline_index || barcode_type == index_inline)
+            offset_1 = oligo_len_1;
+        return;
+    }
+
+    switch (barcode_type) {
+    case null_inline:
+        offset_2 = oligo_len_1;
+        break;
+    case inline_null:
+    case inline_index:
+        offset_1 = oligo_len_1;
+        break;
+    case inline_inline:
+        offset_1 = oligo_len_1;
+        offset_2 = oligo_len_2;
+        break;
+    case index_inline:
+        offset_2 = oligo_len_2;
+        break;
+    default:
+        break;
+    }
+}
+
+//
+// Appends the randomized oligo sequence(s) of the read (pair) to `key`.
+//
+void
+append_oligo(string &key, const RawRead *r_1, const RawRead *r_2)
+{
+    if (!paired) {
+        if (barcode_type == inline_null)
+            key += r_1->inline_bc;
+        else if (barcode_type == index_null)
+            key += r_1->index_bc;
+        return;
+    }
+
+    switch (barcode_type) {
+    case null_inline:
+        key += r_2->inline_bc;
+        break;
+    case inline_null:
+        key += r_1->inline_bc;
+        break;
+    case index_null:
+        key += r_1->index_bc;
+        break;
+    case null_index:
+        key += r_2->index_bc;
+        break;
+    case inline_inline:
+        key += r_1->inline_bc;
+        key += r_2->inline_bc;
+        break;
+    case index_index:
+        key += r_1->index_bc;
+        key += r_2->index_bc;
+        break;
+    case inline_index:
+        key += r_1->inline_bc;
+        key += r_2->index_bc;
+        break;
+    case index_inline:
+        key += r_1->index_bc;
+        key += r_2->inline_bc;
+        break;
+    default:
+        break;
+    }
+}
+
+//
+// The output files, named as in the in-memory modes.
+//
+void
+clone_output_paths(const pair<string, string> &prefixes, bool discard, string &path_1, string &path_2)
+{
+    string suffix = out_file_type == FileT::fastq || out_file_type == FileT::gzfastq ? ".fq" : ".fa";
+    if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta)
+        suffix += ".gz";
+
+    if (paired) {
+        path_1 = out_path + remove_suffix(in_file_type, prefixes.first)  + (discard ? ".discards" : "") + ".1" + suffix;
+        path_2 = out_path + remove_suffix(in_file_type, prefixes.second) + (discard ? ".discards" : "") + ".2" + suffix;
+    } else {
+        string file = prefixes.first;
+        size_t pos  = file.find_last_of(".");
+        if ((in_file_type == FileT::gzfastq || in_file_type == FileT::gzfasta) &&
+            pos != string::npos && file.substr(pos) == ".gz") {
+            file = file.substr(0, pos);
+            pos  = file.find_last_of(".");
+        }
+        path_1 = discard ? out_path + file + ".discards" + suffix : out_path + file.substr(0, pos) + suffix;
+        path_2.clear();
+    }
+}
+
+class CloneOutput {
+    ofstream   fh_;
+    BgzfWriter gzfh_;
+    bool       gz_;
+
+public:
+    CloneOutput() : gz_(out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {}
+
+    bool open(const string &path) {
+        if (gz_) {
+            gzfh_.open(path);
+            return gzfh_.is_open();
+        }
+        fh_.open(path.c_str(), ofstream::out);
+        return !fh_.fail();
+    }
+    int write(const string &s) {return gz_ ? write_string(&gzfh_, s) : write_string(&fh_, s);}
+    int close() {
+        if (gz_)
+            return gzfh_.close() < 0 ? -1 : 1;
+        fh_.close();
+        return fh_.fail() ? -1 : 1;
+    }
+};
+
+void
+format_clone_read(string &buf, const CloneRec &rec, uint i, size_t offset)
+{
+    if (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) {
+        buf += '@';
+        buf += rec.id[i];
+        buf += '\n';
+        buf.append(rec.seq[i], std::min(offset, rec.seq[i].length()), string::npos);
+        buf += "\n+\n";
+        buf.append(rec.qual[i], std::min(offset, rec.qual[i].length()), string::npos);
+        buf += '\n';
+    } else {
+        buf += '>';
+        buf += rec.id[i];
+        buf += '\n';
+        buf.append(rec.seq[i], std::min(offset, rec.seq[i].length()), string::npos);
+        buf += '\n';
+    }
+}
+
+//
+// Writes the records of the runs, in input order, to the kept (or discard)
+// output files.
+//
+int
+write_clone_runs(const vector<string> &runs, const vector<pair<string, string> > &files, bool discard)
+{
+    const size_t buf_limit = 1 << 16;
+
+    int offset_1 = 0;
+    int offset_2 = 0;
+    if (!discard && !retain_oligo)
+        clone_offsets(offset_1, offset_2);
+
+    CloneRunMerger merger (runs);
+
+    size_t n_out = barcode_type == null_null ? 1 : files.size();
+    string buf_1, buf_2;
+
+    for (uint32_t i = 0; i < n_out; i++) {
+        string path_1, path_2;
+        clone_output_paths(files[i], discard, path_1, path_2);
+
+        CloneOutput out_1, out_2;
+        if (!out_1.open(path_1)) {
+            cerr << "Error opening output file '" << path_1 << "'\n";
+            return -1;
+        }
+        if (paired && !out_2.open(path_2)) {
+            cerr << "Error opening output file '" << path_2 << "'\n";
+            return -1;
+        }
+
+        const CloneRec *rec;
+        while ((rec = merger.peek()) != NULL && rec->file == i) {
+            format_clone_read(buf_1, *rec, 0, offset_1);
+            if (paired)
+                format_clone_read(buf_2, *rec, 1, offset_2);
+            merger.pop();
+
+            if (buf_1.length() >= buf_limit || merger.peek() == NULL || merger.peek()->file != i) {
+                if (out_1.write(buf_1) < 0 || (paired && out_2.write(buf_2) < 0)) {
+                    cerr << "Error writing to output file '" << path_1 << "'\n";
+                    return -1;
+                }
+                buf_1.clear();
+                buf_2.clear();
+            }
+        }
+
+        if (out_1.close() < 0 || (paired && out_2.close() < 0)) {
+            cerr << "Error writing to output file '" << path_1 << "'\n";
+            return -1;
+        }
+    }
+
+    return 1;
+}
+
+}
+
+Fingerprint
+fingerprint(const char *s, size_t len)
+{
+    //
+    // MurmurHash3, x64 128-bit variant.
+    //
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    auto rotl = [](uint64_t x, int r) {return (x << r) | (x >> (64 - r));};
+    auto fmix = [](uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    };
+
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    uint64_t k1, k2;
+
+    size_t n_blocks = len / 16;
+    for (size_t i = 0; i < n_blocks; i++) {
+        memcpy(&k1, s + 16 * i, 8);
+        memcpy(&k2, s + 16 * i + 8, 8);
+
+        k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const unsigned char *tail = (const unsigned char *) s + 16 * n_blocks;
+    size_t rem = len % 16;
+    k1 = 0;
+    k2 = 0;
+    for (size_t i = rem; i > 8; i--)
+        k2 = (k2 << 8) | tail[i - 1];
+    for (size_t i = std::min(rem, size_t(8)); i > 0; i--)
+        k1 = (k1 << 8) | tail[i - 1];
+    if (rem > 8) {
+        k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (rem > 0) {
+        k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    return Fingerprint {h1, h2};
+}
+
+void
+CloneRec::assign(uint i, const Seq *s)
+{
+    id[i]  = s->id;
+    seq[i] = s->seq;
+    if (s->qual != NULL)
+        qual[i] = s->qual;
+    else
+        qual[i].clear();
+}
+
+void
+CloneRec::append_to(vector<char> &buf) const
+{
+    auto put = [&buf](const void *p, size_t n) {
+        const char *c = (const char *) p;
+        buf.insert(buf.end(), c, c + n);
+    };
+    auto put_str = [&put](const string &str) {
+        uint32_t len = str.length();
+        put(&len, sizeof(len));
+        put(str.data(), len);
+    };
+
+    put(&fp,      sizeof(fp));
+    put(&ordinal, sizeof(ordinal));
+    put(&file,    sizeof(file));
+    put(&n_reads, sizeof(n_reads));
+    for (uint i = 0; i < n_reads; i++) {
+        put_str(id[i]);
+        put_str(seq[i]);
+        put_str(qual[i]);
+    }
+}
+
+bool
+CloneRec::read(FILE *fh)
+{
+    auto get_str = [fh](string &str) {
+        uint32_t len;
+        if (fread(&len, sizeof(len), 1, fh) != 1)
+            return false;
+        str.resize(len);
+        return len == 0 || fread(&str[0], 1, len, fh) == len;
+    };
+
+    if (fread(&fp, sizeof(fp), 1, fh) != 1)
+        return false;
+
+    bool ok = fread(&ordinal, sizeof(ordinal), 1, fh) == 1
+        && fread(&file,    sizeof(file),    1, fh) == 1
+        && fread(&n_reads, sizeof(n_reads), 1, fh) == 1
+        && n_reads <= 2;
+    for (uint i = 0; ok && i < n_reads; i++)
+        ok = get_str(id[i]) && get_str(seq[i]) && get_str(qual[i]);
+
+    if (!ok) {
+        cerr << "Error: Temporary file is truncated or corrupted.\n";
+        exit(1);
+    }
+    return true;
+}
+
+CloneSorter::CloneSorter(const string &dir, size_t max_memory, int n_threads, bool discards)
+    : dir_(dir), max_memory_(max_memory), n_threads_(std::max(n_threads, 1)), discards_(discards), n_tmp_(0),
+      parts_(n_parts), part_fhs_(n_parts, NULL), bufs_(n_parts), part_sizes_(n_parts, 0)
+{
+    // Half of the memory goes to the partition buffers.
+    buf_limit_ = std::max(max_memory_ / 2 / n_parts, size_t(1) << 16);
+
+    for (size_t p = 0; p < n_parts; p++) {
+        parts_[p]    = tmp_path();
+        part_fhs_[p] = open_tmp(parts_[p], "wb");
+    }
+}
+
+CloneSorter::~CloneSorter()
+{
+    for (size_t p = 0; p < n_parts; p++) {
+        if (part_fhs_[p] != NULL)
+            fclose(part_fhs_[p]);
+        remove(parts_[p].c_str());
+    }
+    for (const string &path : kept_runs_)
+        remove(path.c_str());
+    for (const string &path : discard_runs_)
+        remove(path.c_str());
+    rmdir(dir_.c_str());
+}
+
+string
+CloneSorter::tmp_path()
+{
+    size_t n;
+    #pragma omp critical(clone_tmp_path)
+    n = n_tmp_++;
+    return dir_ + "/" + to_string(n) + ".run";
+}
+
+void
+CloneSorter::add(const CloneRec &rec)
+{
+    int p = part_of(rec.fp, 0);
+    rec.append_to(bufs_[p]);
+    part_sizes_[p]++;
+    if (bufs_[p].size() >= buf_limit_)
+        write_tmp(part_fhs_[p], bufs_[p]);
+}
+
+size_t
+CloneSorter::dedup(map<int, int> &clone_dist)
+{
+    for (size_t p = 0; p < n_parts; p++) {
+        write_tmp(part_fhs_[p], bufs_[p]);
+        fclose(part_fhs_[p]);
+        part_fhs_[p] = NULL;
+        vector<char>().swap(bufs_[p]);
+    }
+
+    size_t n_kept = 0;
+
+    #pragma omp parallel
+    {
+        map<int, int> dist;
+        size_t kept = 0;
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t p = 0; p < n_parts; p++)
+            kept += dedup_part(parts_[p], part_sizes_[p], 0, dist);
+
+        #pragma omp critical(clone_dist)
+        {
+            for (auto &d : dist)
+                clone_dist[d.first] += d.second;
+            n_kept += kept;
+        }
+    }
+
+    return n_kept;
+}
+
+size_t
+CloneSorter::dedup_part(const string &path, size_t n_recs, int depth, map<int, int> &clone_dist)
+{
+    const size_t out_buf_limit = 1 << 16;
+
+    if (n_recs == 0) {
+        remove(path.c_str());
+        return 0;
+    }
+
+    CloneRec rec;
+    size_t   budget = max_memory_ / n_threads_;
+
+    if (n_recs * rec_bytes > budget && depth + 1 < max_depth) {
+        //
+        // The partition is too large, split it on the next bits of the fingerprint.
+        //
+        vector<string>       paths (n_parts);
+        vector<FILE *>       fhs (n_parts);
+        vector<vector<char>> bufs (n_parts);
+        vector<size_t>       sizes (n_parts, 0);
+        size_t buf_limit = std::max(budget / 2 / n_parts, out_buf_limit);
+
+        for (size_t p = 0; p < n_parts; p++) {
+            paths[p] = tmp_path();
+            fhs[p]   = open_tmp(paths[p], "wb");
+        }
+
+        FILE *in_fh = open_tmp(path, "rb");
+        while (rec.read(in_fh)) {
+            int p = part_of(rec.fp, depth + 1);
+            rec.append_to(bufs[p]);
+            sizes[p]++;
+            if (bufs[p].size() >= buf_limit)
+                write_tmp(fhs[p], bufs[p]);
+        }
+        fclose(in_fh);
+        remove(path.c_str());
+
+        for (size_t p = 0; p < n_parts; p++) {
+            write_tmp(fhs[p], bufs[p]);
+            fclose(fhs[p]);
+        }
+        bufs.clear();
+
+        size_t n_kept = 0;
+        for (size_t p = 0; p < n_parts; p++)
+            n_kept += dedup_part(paths[p], sizes[p], depth + 1, clone_dist);
+        return n_kept;
+    }
+
+    //
+    // Records are stored in input order, so the first record of each set of
+    // clones is the one we keep. Find it and count the clones.
+    //
+    unordered_map<Fingerprint, pair<size_t, size_t>, hash_fingerprint> clones;
+
+    FILE *in_fh = open_tmp(path, "rb");
+    size_t i = 0;
+    while (rec.read(in_fh)) {
+        auto c = clones.emplace(rec.fp, make_pair(i, size_t(0)));
+        c.first->second.second++;
+        i++;
+    }
+
+    string kept_path = tmp_path();
+    FILE  *kept_fh   = open_tmp(kept_path, "wb");
+    string discard_path;
+    FILE  *discard_fh = NULL;
+    if (discards_) {
+        discard_path = tmp_path();
+        discard_fh   = open_tmp(discard_path, "wb");
+    }
+
+    vector<char> kept_buf, discard_buf;
+    size_t n_kept = 0;
+
+    rewind(in_fh);
+    i = 0;
+    while (rec.read(in_fh)) {
+        const pair<size_t, size_t> &c = clones.at(rec.fp);
+        if (c.first == i) {
+            clone_dist[c.second]++;
+            n_kept++;
+            rec.append_to(kept_buf);
+            if (kept_buf.size() >= out_buf_limit)
+                write_tmp(kept_fh, kept_buf);
+        } else if (discard_fh != NULL) {
+            rec.append_to(discard_buf);
+            if (discard_buf.size() >= out_buf_limit)
+                write_tmp(discard_fh, discard_buf);
+        }
+        i++;
+    }
+    fclose(in_fh);
+    remove(path.c_str());
+
+    write_tmp(kept_fh, kept_buf);
+    fclose(kept_fh);
+    if (discard_fh != NULL) {
+        write_tmp(discard_fh, discard_buf);
+        fclose(discard_fh);
+    }
+
+    #pragma omp critical(clone_runs)
+    {
+        kept_runs_.push_back(kept_path);
+        if (discards_)
+            discard_runs_.push_back(discard_path);
+    }
+
+    return n_kept;
+}
+
+CloneRunMerger::CloneRunMerger(const vector<string> &paths)
+    : fhs_(paths.size(), NULL), recs_(paths.size())
+{
+    for (size_t i = 0; i < paths.size(); i++) {
+        fhs_[i] = open_tmp(paths[i], "rb");
+        if (recs_[i].read(fhs_[i]))
+            q_.push(Head(recs_[i].ordinal, i));
+    }
+}
+
+CloneRunMerger::~CloneRunMerger()
+{
+    for (FILE *fh : fhs_)
+        fclose(fh);
+}
+
+void
+CloneRunMerger::pop()
+{
+    size_t i = q_.top().second;
+    q_.pop();
+    if (recs_[i].read(fhs_[i]))
+        q_.push(Head(recs_[i].ordinal, i));
+}
+
+int
+filter_clones_external(vector<pair<string, string> > &files, map<string, long> &counters, map<int, int> &clone_dist)
+{
+    string tmp_dir = out_path + "clone_filter.tmp.XXXXXX";
+    if (mkdtemp(&tmp_dir[0]) == NULL) {
+        cerr << "Error: Failed to create a temporary directory in '" << out_path << "': " << strerror(errno) << "\n";
+        return 0;
+    }
+
+    CloneSorter sorter (tmp_dir, max_memory, num_threads, discards);
+
+    uint64_t ordinal = 0;
+    for (uint i = 0; i < files.size(); i++) {
+        cerr << "Processing file " << i+1 << " of " << files.size() << " [" << files[i].first.c_str() << "]\n";
+
+        uint32_t out_file = barcode_type == null_null ? 0 : i;
+        if (!distribute_reads(files[i].first, files[i].second, out_file, counters, sorter, ordinal))
+            return 0;
+    }
+
+    cerr << "Finding clones in the temporary files...\n";
+    size_t n_kept = sorter.dedup(clone_dist);
+
+    counters["red_reads"] += n_kept;
+    if (barcode_type == null_null || discards)
+        counters["dis_reads"] += counters["total"] - n_kept;
+
+    cerr << "Writing filtered data...";
+    if (write_clone_runs(sorter.kept_runs(), files, false) < 0)
+        return 0;
+    if (discards && write_clone_runs(sorter.discard_runs(), files, true) < 0)
+        return 0;
+    cerr << "done.\n";
+
+    return 1;
+}
+
+int
+distribute_reads(string prefix_1, string prefix_2, uint32_t out_file, map<string, long> &counters,
+                 CloneSorter &sorter, uint64_t &ordinal)
+{
+    string path_1 = in_path_1 + prefix_1;
+    string path_2 = in_path_2 + prefix_2;
+
+    bool one_input = !paired || interleaved || in_file_type == FileT::bam;
+
+    if (one_input)
+        cerr << "  Reading data from:\n  " << path_1 << "\n";
+    else
+        cerr << "  Reading data from:\n  " << path_1 << " and\n  " << path_2 << "\n";
+
+    Input *fh_1 = open_input(path_1);
+    Input *fh_2 = !paired ? NULL : one_input ? fh_1 : open_input(path_2);
+    if (fh_1 == NULL || (paired && fh_2 == NULL)) {
+        cerr << "Error: Unable to open the input file(s).\n";
+        return 0;
+    }
+
+    Seq *s_1 = fh_1->next_seq();
+    Seq *s_2 = paired ? fh_2->next_seq() : NULL;
+    if (s_1 == NULL || (paired && s_2 == NULL)) {
+        cerr << "Attempting to read first pair of input records, unable to allocate "
+             << "Seq object (Was the correct input type specified?).\n";
+        return 0;
+    }
+
+    RawRead *r_1 = NULL;
+    RawRead *r_2 = NULL;
+    if (barcode_type != null_null) {
+        r_1 = new RawRead(strlen(s_1->seq), 1, min_bc_size_1, win_size);
+        if (paired)
+            r_2 = new RawRead(strlen(s_2->seq), 2, min_bc_size_2, win_size);
+    }
+
+    int offset_1, offset_2;
+    clone_offsets(offset_1, offset_2);
+
+    CloneRec rec;
+    rec.file    = out_file;
+    rec.n_reads = paired ? 2 : 1;
+
+    string key;
+    long   i = 1;
+
+    do {
+        if (i % 10000 == 0) cerr << "  Processing RAD-Tag " << i << "       \r";
+
+        counters["total"]++;
+
+        //
+        // Clones share the sequence of both reads or, if there are oligos, the
+        // trimmed sequence and the oligo(s).
+        //
+        key.clear();
+        if (barcode_type == null_null) {
+            key += s_1->seq;
+            key += '\0';
+            key += s_2->seq;
+        } else {
+            parse_input_record(s_1, r_1);
+            key += s_1->seq + offset_1;
+            if (paired) {
+                parse_input_record(s_2, r_2);
+                key += s_2->seq + offset_2;
+            }
+            key += '\0';
+            append_oligo(key, r_1, r_2);
+        }
+
+        rec.fp      = fingerprint(key.c_str(), key.length());
+        rec.ordinal = ordinal++;
+        rec.assign(0, s_1);
+        if (paired)
+            rec.assign(1, s_2);
+        sorter.add(rec);
+
+        delete s_1;
+        delete s_2;
+        s_2 = NULL;
+
+        i++;
+    } while ((s_1 = fh_1->next_seq()) != NULL &&
+             (!paired || (s_2 = fh_2->next_seq()) != NULL));
+
+    cerr << "\n";
+
+    if (fh_2 != fh_1)
+        delete fh_2;
+    delete fh_1;
+    delete r_1;
+    delete r_2;
+
+    return 1;
+}
+
 int
 process_paired_reads(string prefix_1, string prefix_2, map<string, long> &counters, OligoHash &oligo_map)
 {
     Input    *fh_1, *fh_2;
     RawRead  *r_1,  *r_2;
     ofstream  out_fh_1,   out_fh_2, discard_fh_1, discard_fh_2;
-    gzFile    out_gzfh_1, out_gzfh_2, discard_gzfh_1, discard_gzfh_2;
+    BgzfWriter out_gzfh_1, out_gzfh_2, discard_gzfh_1, discard_gzfh_2;
 
     int return_val = 1;
 
@@ -520,20 +1271,20 @@ process_paired_reads(string prefix_1, string prefix_2, map<string, long> &counte
 
     switch (in_file_type) {
     case FileT::fastq:
-        fh_1 = new Fastq(path_1);
-        fh_2 = interleaved ? fh_1 : new Fastq(path_2);
+        fh_1 = new Fastx(path_1, true);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, true);
         break;
     case FileT::gzfastq:
-        fh_1 = new GzFastq(path_1);
-        fh_2 = interleaved ? fh_1 : new GzFastq(path_2);
+        fh_1 = new Fastx(path_1, true);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, true);
         break;
     case FileT::fasta:
-        fh_1 = new Fasta(path_1);
-        fh_2 = interleaved ? fh_1 : new Fasta(path_2);
+        fh_1 = new Fastx(path_1, false);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, false);
         break;
     case FileT::gzfasta:
-        fh_1 = new GzFasta(path_1);
-        fh_2 = interleaved ? fh_1 : new GzFasta(path_2);
+        fh_1 = new Fastx(path_1, false);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, false);
         break;
     case FileT::bam:
         fh_1 = new BamUnAln(path_1);
@@ -570,8 +1321,8 @@ process_paired_reads(string prefix_1, string prefix_2, map<string, long> &counte
     string file_1 = remove_suffix(in_file_type, prefix_1);
     path_1 = out_path + file_1 + suffix_1;
     if (in_file_type == FileT::gzfastq || in_file_type == FileT::gzfasta) {
-        out_gzfh_1 = gzopen(path_1.c_str(), "wb");
-        if (!(out_gzfh_1)) {
+        out_gzfh_1.open(path_1);
+        if (!out_gzfh_1.is_open()) {
             cerr << "Error opening output file '" << path_1 << "'\n";
             return -1;
         }
@@ -586,8 +1337,8 @@ process_paired_reads(string prefix_1, string prefix_2, map<string, long> &counte
     string file_2 = remove_suffix(in_file_type, prefix_2);
     path_2 = out_path + file_2 + suffix_2;
     if (in_file_type == FileT::gzfastq || in_file_type == FileT::gzfasta) {
-        out_gzfh_2 = gzopen(path_2.c_str(), "wb");
-        if (!(out_gzfh_2)) {
+        out_gzfh_2.open(path_2);
+        if (!out_gzfh_2.is_open()) {
             cerr << "Error opening output file '" << path_2 << "'\n";
             return -1;
         }
@@ -606,8 +1357,8 @@ process_paired_reads(string prefix_1, string prefix_2, map<string, long> &counte
         path_1 = out_path + file_1 + ".discards" + suffix_1;
 
         if (in_file_type == FileT::gzfastq || in_file_type == FileT::gzfasta) {
-            discard_gzfh_1 = gzopen(path_1.c_str(), "wb");
-            if (!(discard_gzfh_1)) {
+            discard_gzfh_1.open(path_1);
+            if (!discard_gzfh_1.is_open()) {
                 cerr << "Error opening discard file '" << path_1 << "'\n";
                 return -1;
             }
@@ -622,8 +1373,8 @@ process_paired_reads(string prefix_1, string prefix_2, map<string, long> &counte
         path_2 = out_path + file_2 + ".discards" + suffix_2;
 
         if (in_file_type == FileT::gzfastq || in_file_type == FileT::gzfasta) {
-            discard_gzfh_2 = gzopen(path_2.c_str(), "wb");
-            if (!(discard_gzfh_2)) {
+            discard_gzfh_2.open(path_2);
+            if (!discard_gzfh_2.is_open()) {
                 cerr << "Error opening discard file '" << path_2 << "'\n";
                 return -1;
             }
@@ -824,11 +1575,11 @@ process_paired_reads(string prefix_1, string prefix_2, map<string, long> &counte
              (s_2 = fh_2->next_seq()) != NULL);
 
     if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {
-        gzclose(out_gzfh_1);
-        gzclose(out_gzfh_2);
+        out_gzfh_1.close();
+        out_gzfh_2.close();
         if (discards) {
-            gzclose(discard_gzfh_1);
-            gzclose(discard_gzfh_2);
+            discard_gzfh_1.close();
+            discard_gzfh_2.close();
         }
     } else {
         out_fh_1.close();
@@ -854,7 +1605,7 @@ process_reads(string prefix_1, map<string, long> &counters, OligoHash &oligo_map
     Input   *fh_1 = NULL;
     RawRead *r_1;
     ofstream out_fh_1, discard_fh_1;
-    gzFile   out_gzfh_1, discard_gzfh_1;
+    BgzfWriter out_gzfh_1, discard_gzfh_1;
 
     int return_val = 1;
 
@@ -867,16 +1618,16 @@ process_reads(string prefix_1, map<string, long> &counters, OligoHash &oligo_map
 
     switch(in_file_type) {
     case FileT::fastq:
-        fh_1 = new Fastq(path_1);
+        fh_1 = new Fastx(path_1, true);
         break;
     case FileT::gzfastq:
-        fh_1 = new GzFastq(path_1.c_str());
+        fh_1 = new Fastx(path_1.c_str(), true);
         break;
     case FileT::fasta:
-        fh_1 = new Fasta(path_1);
+        fh_1 = new Fastx(path_1, false);
         break;
     case FileT::gzfasta:
-        fh_1 = new GzFasta(path_1);
+        fh_1 = new Fastx(path_1, false);
         break;
     case FileT::bam:
         fh_1 = new BamUnAln(path_1);
@@ -910,8 +1661,8 @@ process_reads(string prefix_1, map<string, long> &counters, OligoHash &oligo_map
     }
     path_1 = out_path + file_1.substr(0, pos) + suffix_1;
     if (in_file_type == FileT::gzfastq || in_file_type == FileT::gzfasta) {
-        out_gzfh_1 = gzopen(path_1.c_str(), "wb");
-        if (!(out_gzfh_1)) {
+        out_gzfh_1.open(path_1);
+        if (!out_gzfh_1.is_open()) {
             cerr << "Error opening output file '" << path_1 << "'\n";
             return -1;
         }
@@ -930,8 +1681,8 @@ process_reads(string prefix_1, map<string, long> &counters, OligoHash &oligo_map
         path_1 = out_path + file_1 + ".discards" + suffix_1;
 
         if (in_file_type == FileT::gzfastq || in_file_type == FileT::gzfasta) {
-            discard_gzfh_1 = gzopen(path_1.c_str(), "wb");
-            if (!(discard_gzfh_1)) {
+            discard_gzfh_1.open(path_1);
+            if (!discard_gzfh_1.is_open()) {
                 cerr << "Error opening discard file '" << path_1 << "'\n";
                 return -1;
             }
@@ -1067,8 +1818,8 @@ process_reads(string prefix_1, map<string, long> &counters, OligoHash &oligo_map
     } while ((s_1 = fh_1->next_seq()) != NULL);
 
     if (out_file_type == FileT::gzfastq || out_file_type == FileT::gzfasta) {
-        gzclose(out_gzfh_1);
-        if (discards) gzclose(discard_gzfh_1);
+        out_gzfh_1.close();
+        if (discards) discard_gzfh_1.close();
     } else {
         out_fh_1.close();
         if (discards) discard_fh_1.close();
@@ -1120,13 +1871,15 @@ int parse_command_line(int argc, char* argv[]) {
             {"oligo-len-1",   required_argument, NULL, 'O'}, {"oligo_len_1",   required_argument, NULL, 'O'},
             {"oligo-len-2",   required_argument, NULL, 'L'}, {"oligo_len_2",   required_argument, NULL, 'L'},
             {"retain-oligo",  required_argument, NULL, 'R'}, {"retain_oligo",  required_argument, NULL, 'R'},
+            {"threads",       required_argument, NULL, 't'},
+            {"max-memory",    required_argument, NULL, 1001}, {"max_memory",    required_argument, NULL, 1001},
             {0, 0, 0, 0}
         };
 
         // getopt_long stores the option index here.
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "hvDPuUVWXxYZi:y:f:p:1:2:o:O:L:R:", long_options, &option_index);
+        c = getopt_long(argc, argv, "hvDPuUVWXxYZi:y:f:p:1:2:o:O:L:R:t:", long_options, &option_index);
 
         // Detect the end of the options.
         if (c == -1)
@@ -1219,6 +1972,20 @@ int parse_command_line(int argc, char* argv[]) {
         case 'R':
             retain_oligo = true;
             break;
+        case 't':
+            num_threads = is_integer(optarg);
+            if (num_threads < 1) {
+                cerr << "Error: Illegal number of threads: '" << optarg << "'.\n";
+                help();
+            }
+            break;
+        case 1001:
+            max_memory = parse_memory_size(optarg);
+            if (max_memory < (size_t(16) << 20)) {
+                cerr << "Error: Illegal memory size: '" << optarg << "' (at least 16M is required).\n";
+                help();
+            }
+            break;
         case 'v':
             version();
             break;
@@ -1282,6 +2049,36 @@ int parse_command_line(int argc, char* argv[]) {
     return 0;
 }
 
+size_t parse_memory_size(const char *arg) {
+    char  *end;
+    double n = strtod(arg, &end);
+
+    if (end == arg || n <= 0)
+        return 0;
+
+    // Megabytes by default.
+    double unit = 1 << 20;
+    switch (toupper(*end)) {
+    case 'K':
+        unit = 1 << 10;
+        end++;
+        break;
+    case 'M':
+        end++;
+        break;
+    case 'G':
+        unit = 1 << 30;
+        end++;
+        break;
+    default:
+        break;
+    }
+    if (*end != '\0')
+        return 0;
+
+    return (size_t) (n * unit);
+}
+
 void version() {
     std::cerr << "clone_filter " << VERSION << "\n\n";
 
@@ -1290,7 +2087,7 @@ void version() {
 
 void help() {
     std::cerr << "clone_filter " << VERSION << "\n"
-              << "clone_filter [-f in_file | -p in_dir [-P] [-I] | -1 pair_1 -2 pair_2] -o out_dir [-i type] [-y type] [-D] [-h]\n"
+              << "clone_filter [-f in_file | -p in_dir [-P] [-I] | -1 pair_1 -2 pair_2] -o out_dir [-i type] [-y type] [-D] [-t threads] [--max-memory size] [-h]\n"
               << "  f: path to the input file if processing single-end sequences.\n"
               << "  p: path to a directory of files.\n"
               << "  P: files contained within directory specified by '-p' are paired.\n"
@@ -1300,10 +2097,13 @@ void help() {
               << "  o: path to output the processed files.\n"
               << "  y: output type, either 'fastq', 'fasta', 'gzfasta', or 'gzfastq' (default same as input type).\n"
               << "  D: capture discarded reads to a file.\n"
+              << "  t: number of threads to use to find clones with --max-memory (default 1).\n"
               << "  h: display this help messsage.\n"
               << "  --oligo-len-1 len: length of the single-end oligo sequence in data set.\n"
               << "  --oligo-len-2 len: length of the paired-end oligo sequence in data set.\n"
-              << "  --retain-oligo: do not trim off the random oligo sequence (if oligo is inline).\n\n"
+              << "  --retain-oligo: do not trim off the random oligo sequence (if oligo is inline).\n"
+              << "  --max-memory size: find clones in temporary files written to the output directory, using about this much memory\n"
+              << "                     (e.g. '4G'; in megabytes if no unit is given). Reads are then written in input order.\n\n"
               << "  Oligo sequence options:\n"
               << "    --inline-null:   random oligo is inline with sequence, occurs only on single-end read (default).\n"
               << "    --null-inline:   random oligo is inline with sequence, occurs only on the paired-end read.\n"
@@ -24,6 +24,7 @@
 #include "constants.h"
 
 #include <cstdlib>
+#include <cstdio>
 #include <getopt.h> // Process command-line options
 #include <dirent.h> // Open/Read contents of a directory
 #include <cstring>
@@ -37,8 +38,13 @@
 #include <map>
 #include <set>
 #include <utility>
+#include <queue>
 #include <unordered_map>
 
+#ifdef _OPENMP
+#include <omp.h>    // OpenMP library
+#endif
+
 #ifdef HAVE_SPARSEHASH
 #include <sparsehash/sparse_hash_map>
 using google::sparse_hash_map;
@@ -50,6 +56,7 @@ using google::sparse_hash_map;
 #include "FastaI.h"     // Reading input files in FASTA format
 #include "gzFasta.h"    // Reading gzipped input files in FASTA format
 #include "gzFastq.h"    // Reading gzipped input files in FASTQ format
+#include "FastxI.h"    // Reading input files in FASTQ/FASTA format, by batches
 #include "BamUnalignedI.h"
 #include "utils.h"
 #include "clean.h"
@@ -83,6 +90,117 @@ typedef unordered_map<char *, map<string, vector<Pair> >, hash_charptr, eqstr> C
 typedef unordered_map<string, map<string, uint16_t> > OligoHash;
 #endif
 
+//
+// Bounded-memory clone detection (--max-memory)
+// =============================================
+//
+// Each read (pair) is reduced to a 128-bit fingerprint of the sequence that
+// defines its clones (the two reads, or the trimmed reads and the oligo(s)).
+// Records are written to temporary run files partitioned by fingerprint
+// prefix; each partition is then deduplicated on its own, the partitions
+// being processed in parallel and split further if they don't fit in memory.
+// Within a set of clones, the record that came first in the input is kept, and
+// the kept (and discarded) records are merged back in input order.
+//
+struct Fingerprint {
+    uint64_t hi;
+    uint64_t lo;
+
+    bool operator==(const Fingerprint &other) const {return hi == other.hi && lo == other.lo;}
+};
+
+struct hash_fingerprint {
+    size_t operator()(const Fingerprint &fp) const {return fp.lo;}
+};
+
+Fingerprint fingerprint(const char *, size_t);
+
+//
+// A read (pair) as stored in the run files.
+//
+struct CloneRec {
+    Fingerprint fp;
+    uint64_t    ordinal; // Position in the input, over all files.
+    uint32_t    file;    // Index of the output files.
+    uint32_t    n_reads;
+    string      id[2];
+    string      seq[2];
+    string      qual[2];
+
+    CloneRec() : fp(), ordinal(0), file(0), n_reads(0) {}
+
+    void assign(uint i, const Seq *s);
+    void append_to(vector<char> &buf) const;
+    bool read(FILE *fh);
+};
+
+class CloneSorter {
+    static const int    part_bits = 6;
+    static const size_t n_parts   = size_t(1) << part_bits;
+    static const int    max_depth = 64 / part_bits;
+    // Upper bound on the memory used per record of a partition being deduplicated.
+    static const size_t rec_bytes = 64;
+
+    string dir_;
+    size_t max_memory_;
+    int    n_threads_;
+    bool   discards_;
+    size_t n_tmp_;
+
+    vector<string>       parts_;
+    vector<FILE *>       part_fhs_;
+    vector<vector<char>> bufs_;
+    vector<size_t>       part_sizes_;
+    size_t               buf_limit_;
+
+    vector<string> kept_runs_;
+    vector<string> discard_runs_;
+
+    string tmp_path();
+    size_t dedup_part(const string &path, size_t n_recs, int depth, map<int, int> &clone_dist);
+
+public:
+    CloneSorter(const string &dir, size_t max_memory, int n_threads, bool discards);
+    CloneSorter(const CloneSorter&) = delete;
+    CloneSorter& operator= (const CloneSorter&) = delete;
+    ~CloneSorter();
+
+    // Appends a record to its partition.
+    void add(const CloneRec &rec);
+    // Deduplicates the partitions, in parallel. Returns the number of records
+    // kept; the discarded records are only saved if `discards` was set.
+    size_t dedup(map<int, int> &clone_dist);
+
+    const vector<string> &kept_runs()    const {return kept_runs_;}
+    const vector<string> &discard_runs() const {return discard_runs_;}
+
+    static int part_of(const Fingerprint &fp, int depth) {return (fp.hi >> (64 - part_bits * (depth + 1))) & (n_parts - 1);}
+};
+
+//
+// Merges run files sorted by ordinal.
+//
+class CloneRunMerger {
+    typedef pair<uint64_t, size_t> Head;
+
+    vector<FILE *>   fhs_;
+    vector<CloneRec> recs_;
+    std::priority_queue<Head, vector<Head>, std::greater<Head>> q_;
+
+public:
+    CloneRunMerger(const vector<string> &paths);
+    CloneRunMerger(const CloneRunMerger&) = delete;
+    CloneRunMerger& operator= (const CloneRunMerger&) = delete;
+    ~CloneRunMerger();
+
+    // The next record, or NULL at the end of the runs.
+    const CloneRec *peek() const {return q_.empty() ? NULL : &recs_[q_.top().second];}
+    void pop();
+};
+
+int  filter_clones_external(vector<pair<string, string> > &, map<string, long> &, map<int, int> &);
+int  distribute_reads(string, string, uint32_t, map<string, long> &, CloneSorter &, uint64_t &);
+
 int  process_paired_reads(string, string, map<string, long> &, OligoHash &);
 int  process_reads(string, map<string, long> &, OligoHash &);
 int  process_paired_reads_by_sequence(string, string, map<string, long> &, CloneHash &, vector<char *> &);
@@ -93,5 +211,6 @@ int  free_hash(vector<char *> &);
 void help( void );
 void version( void );
 int  parse_command_line(int, char**);
+size_t parse_memory_size(const char *);
 
 #endif // __CLONE_FILTER_H__
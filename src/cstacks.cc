@@ -38,6 +38,7 @@ int     num_threads       = 1;
 bool    report_mmatches   = false;
 bool    require_uniq_haplotypes = false;
 bool    gapped_alignments = true;
+bool    merge_catalogs    = false;
 double  min_match_len     = 0.80;
 double  max_gaps          = 2.0;
 
@@ -56,7 +57,8 @@ int main (int argc, char* argv[]) {
          << "  Loci matched based on sequence identity.\n"
          << "  Number of mismatches allowed between stacks: " << ctag_dist << "\n"
          << "  Gapped alignments: " << (gapped_alignments ? "enabled" : "disabled") << "\n"
-         << "Constructing catalog from " << sample_cnt << " samples.\n";
+         << (merge_catalogs ? "Merging " : "Constructing catalog from ") << sample_cnt
+         << (merge_catalogs ? " partial catalogs.\n" : " samples.\n");
 
     //
     // Set the number of OpenMP parallel threads to execute.
@@ -64,15 +66,25 @@ int main (int argc, char* argv[]) {
     #ifdef _OPENMP
     omp_set_num_threads(num_threads);
     #endif
+    BgzfWriter::set_n_threads(num_threads);
 
     map<int, CLocus *> catalog;
     pair<int, string>  s;
-    bool compressed = false;
-    int  i;
+    int  i = 1;
 
     set<int> seen_sample_ids; // For checking sample ID unicity.
 
-    if (catalog_path.length() > 0) {
+    //
+    // The k-mer indexes of the catalog are updated with the loci that were
+    // modified by each sample, rather than rebuilt.
+    //
+    CatalogKmerIndex kmer_index, gap_index;
+    set<int>         updated;
+
+    if (merge_catalogs) {
+        merge_partial_catalogs(catalog);
+
+    } else if (catalog_path.length() > 0) {
         cerr << "\nInitializing existing catalog...\n";
         if (!initialize_existing_catalog(catalog_path, catalog)) {
             cerr << "Error: Failed to initialize the catalog.\n";
@@ -93,15 +105,37 @@ int main (int argc, char* argv[]) {
         seen_sample_ids.insert(catalog.begin()->second->sample_id);
     }
 
-    while (!samples.empty()) {
-        map<int, QLocus *> sample;
+    //
+    // When running with several threads, the next sample is loaded in the
+    // background while the current one is matched against the catalog. The
+    // strings of the loci of a sample are held in an arena, which is freed
+    // once its loci have been deleted.
+    //
+    typedef pair<unique_ptr<LocusArena>, map<int, QLocus *>> LoadedSample;
+    auto load_sample = [] (string path, bool verbose) {
+        LoadedSample loaded (unique_ptr<LocusArena>(new LocusArena()), map<int, QLocus *>());
+        bool compressed = false;
+        if (!load_loci(path, loaded.second, 0, false, compressed, verbose, loaded.first.get()))
+            loaded.second.clear();
+        return loaded;
+    };
+    bool prefetch = num_threads > 1;
+    std::future<LoadedSample> next_sample;
+    if (prefetch && !samples.empty())
+        next_sample = std::async(std::launch::async, load_sample, samples.front().second, false);
 
+    while (!samples.empty()) {
         s = samples.front();
         samples.pop();
 
         cerr << "\nProcessing sample " << s.second << " [" << i << " of " << sample_cnt << "]\n";
 
-        if (!load_loci(s.second, sample, 0, false, compressed)) {
+        LoadedSample loaded = prefetch ? next_sample.get() : load_sample(s.second, true);
+        map<int, QLocus *> &sample = loaded.second;
+        if (prefetch && !samples.empty())
+            next_sample = std::async(std::launch::async, load_sample, samples.front().second, false);
+
+        if (sample.empty()) {
             cerr << "Failed to load sample " << i << "\n";
             continue;
         }
@@ -119,35 +153,7 @@ int main (int argc, char* argv[]) {
 
         //dump_loci(sample);
 
-        cerr << "Searching for sequence matches...\n";
-        find_kmer_matches_by_sequence(catalog, sample, ctag_dist);
-
-        if (gapped_alignments) {
-            cerr << "Searching for gapped alignments...\n";
-            search_for_gaps(catalog, sample, min_match_len, ctag_dist);
-        }
-
-        cerr << "Merging matches into catalog...\n";
-        uint mmatches = 0;
-        uint gmatches = 0;
-        uint umatches = 0;
-        uint nmatches = 0;
-        uint merge_cloci   = 0;
-        uint reduced_cloci = 0;
-        merge_matches(catalog, sample, s, ctag_dist, nmatches, umatches, gmatches, mmatches, merge_cloci, reduced_cloci);
-        cerr << "  " << umatches << " loci were matched to a catalog locus.\n"
-             << "  " << gmatches << " loci were matched to a catalog locus using gapped alignments.\n"
-             << "  " << nmatches << " loci were newly added to the catalog.\n"
-             << "  " << mmatches << " loci matched more than one catalog locus, linking them.\n"
-             << "    " << merge_cloci << " linked catalog loci were merged into " << reduced_cloci << " loci.\n";
-
-        //
-        // Regenerate the alleles for the catalog tags after merging the new sample into the catalog.
-        //
-        for (auto cat_it = catalog.begin(); cat_it != catalog.end(); cat_it++) {
-            cat_it->second->populate_alleles();
-            cat_it->second->match_cnt = 0;
-        }
+        merge_sample(catalog, sample, s, kmer_index, gap_index, updated);
 
         i++;
 
@@ -173,6 +179,163 @@ int main (int argc, char* argv[]) {
     IF_NDEBUG_CATCH_ALL_EXCEPTIONS
 }
 
+int
+merge_sample(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, pair<int, string> &sample_file,
+             CatalogKmerIndex &kmer_index, CatalogKmerIndex &gap_index, set<int> &updated)
+{
+    //
+    // On entry, `updated` lists the catalog loci modified since the k-mer indexes
+    // were last brought up to date; on return, those modified by this sample.
+    //
+    kmer_index.update(catalog, updated);
+    gap_index.update(catalog, updated);
+    updated.clear();
+
+    cerr << "Searching for sequence matches...\n";
+    find_kmer_matches_by_sequence(catalog, sample, ctag_dist, kmer_index);
+
+    if (gapped_alignments) {
+        cerr << "Searching for gapped alignments...\n";
+        search_for_gaps(catalog, sample, min_match_len, ctag_dist, gap_index);
+    }
+
+    cerr << "Merging matches into catalog...\n";
+    uint mmatches = 0;
+    uint gmatches = 0;
+    uint umatches = 0;
+    uint nmatches = 0;
+    uint merge_cloci   = 0;
+    uint reduced_cloci = 0;
+    merge_matches(catalog, sample, sample_file, ctag_dist, nmatches, umatches, gmatches, mmatches, merge_cloci, reduced_cloci, updated);
+    cerr << "  " << umatches << " loci were matched to a catalog locus.\n"
+         << "  " << gmatches << " loci were matched to a catalog locus using gapped alignments.\n"
+         << "  " << nmatches << " loci were newly added to the catalog.\n"
+         << "  " << mmatches << " loci matched more than one catalog locus, linking them.\n"
+         << "    " << merge_cloci << " linked catalog loci were merged into " << reduced_cloci << " loci.\n";
+
+    //
+    // Regenerate the alleles of the catalog tags that were modified by merging the new sample into the catalog.
+    //
+    vector<CLocus *> modified;
+    for (int id : updated) {
+        auto cat_it = catalog.find(id);
+        if (cat_it != catalog.end())
+            modified.push_back(cat_it->second);
+    }
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (size_t j = 0; j < modified.size(); j++) {
+        modified[j]->populate_alleles();
+        modified[j]->match_cnt = 0;
+    }
+
+    return 0;
+}
+
+int
+merge_partial_catalogs(map<int, CLocus *> &catalog)
+{
+    //
+    // The partial catalogs listed in `samples` are merged pairwise, in a binary
+    // tree: ((1+2)+(3+4))+5 ... Pending catalogs are kept on a stack with their
+    // height, and the newest two are merged while they are of the same height,
+    // so that at most a logarithmic number of them are in memory.
+    //
+    vector<pair<map<int, CLocus *>, int>> pending;
+    size_t n = samples.size();
+    size_t i = 1;
+
+    while (!samples.empty()) {
+        string path = samples.front().second;
+        samples.pop();
+
+        cerr << "\nLoading partial catalog " << path << " [" << i << " of " << n << "]\n";
+        pending.push_back(make_pair(map<int, CLocus *>(), 0));
+        if (!initialize_existing_catalog(path, pending.back().first) || pending.back().first.empty()) {
+            cerr << "Error: Failed to load partial catalog '" << path << "'.\n";
+            throw exception();
+        }
+        i++;
+
+        while (pending.size() >= 2
+               && (pending[pending.size() - 2].second == pending.back().second || samples.empty())) {
+            auto &a = pending[pending.size() - 2];
+            auto &b = pending.back();
+
+            cerr << "\nMerging partial catalogs (" << a.first.size() << " and " << b.first.size() << " loci)\n";
+            merge_catalog_pair(a.first, b.first);
+            a.second++;
+            pending.pop_back();
+        }
+    }
+
+    assert(pending.size() == 1);
+    catalog.swap(pending.back().first);
+
+    return 0;
+}
+
+int
+merge_catalog_pair(map<int, CLocus *> &catalog, map<int, CLocus *> &other)
+{
+    //
+    // The loci of `other` are matched and merged into `catalog` as if they came
+    // from a sample, under a placeholder sample ID; the placeholder sources are
+    // then replaced by the sources of the merged loci. Loci of `other` that do
+    // not match are numbered after the loci of `catalog`, so that the result
+    // only depends on the order of the partial catalogs.
+    //
+    const int placeholder_id = -1;
+
+    set<int> sample_ids;
+    for (auto it = catalog.begin(); it != catalog.end(); it++)
+        for (auto &src : it->second->sources)
+            sample_ids.insert(src.first);
+    for (auto it = other.begin(); it != other.end(); it++)
+        for (auto &src : it->second->sources)
+            if (sample_ids.count(src.first) > 0) {
+                cerr << "Error: Sample ID '" << src.first << "' occurs in more than one partial catalog. Sample IDs must be unique." << endl;
+                throw exception();
+            }
+
+    map<int, QLocus *>                  query;
+    map<int, vector<pair<int, int>>>    query_sources;
+    for (auto it = other.begin(); it != other.end(); it++) {
+        query[it->first] = new QLocus(*it->second);
+        query_sources[it->first].swap(it->second->sources);
+        delete it->second;
+    }
+    other.clear();
+
+    next_catalog_id = catalog.rbegin()->first + 1;
+
+    CatalogKmerIndex  kmer_index, gap_index;
+    set<int>          updated;
+    pair<int, string> query_file (placeholder_id, "partial catalog");
+    merge_sample(catalog, query, query_file, kmer_index, gap_index, updated);
+
+    for (int id : updated) {
+        auto cat_it = catalog.find(id);
+        if (cat_it == catalog.end())
+            continue;
+
+        vector<pair<int, int>> sources;
+        for (auto &src : cat_it->second->sources) {
+            if (src.first == placeholder_id) {
+                const vector<pair<int, int>> &q_src = query_sources.at(src.second);
+                sources.insert(sources.end(), q_src.begin(), q_src.end());
+            } else {
+                sources.push_back(src);
+            }
+        }
+        cat_it->second->sources.swap(sources);
+    }
+
+    for (auto it = query.begin(); it != query.end(); it++)
+        delete it->second;
+
+    return 0;
+}
+
 int update_catalog_index(map<int, CLocus *> &catalog, map<string, int> &cat_index) {
     map<int, CLocus *>::iterator j;
     char id[id_len];
@@ -252,7 +415,7 @@ characterize_mismatch_snps(CLocus *catalog_tag, QLocus *query_tag)
 int
 merge_matches(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, pair<int, string> &sample_file, int ctag_dist,
               uint &new_matches, uint &unique_matches, uint &gapped_matches, uint &multiple_matches,
-              uint &merge_cloci, uint &reduced_cloci)
+              uint &merge_cloci, uint &reduced_cloci, set<int> &updated)
 {
     map<int, QLocus *>::iterator i;
     CLocus *ctag;
@@ -276,7 +439,7 @@ merge_matches(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, pair<int,
         // catalog as a new stack.
         //
         if (qtag->matches.size() == 0) {
-            add_unique_tag(sample_file, catalog, qtag);
+            updated.insert(add_unique_tag(sample_file, catalog, qtag));
             new_matches++;
             continue;
         }
@@ -322,6 +485,7 @@ merge_matches(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, pair<int,
 
             assert(ctag != NULL);
             catalog_ids.insert(cat_id);
+            updated.insert(cat_id);
 
             for (uint k = 0; k < qtag_merge->matches.size(); k++)
                 if ((int) qtag_merge->matches[k]->cat_id == cat_id) {
@@ -517,7 +681,7 @@ add_unique_tag(pair<int, string> &sample_file, map<int, CLocus *> &catalog, QLoc
 
     c->populate_alleles();
 
-    return 0;
+    return c->id;
 }
 
 int
@@ -592,22 +756,17 @@ merge_catalog_loci(map<int, CLocus *> &catalog, vector<int> &merge_list)
     return 0;
 }
 
-int find_kmer_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, int ctag_dist) {
+int find_kmer_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, int ctag_dist, CatalogKmerIndex &kmer_index) {
     //
     // Calculate the distance (number of mismatches) between each pair
     // of Radtags. We expect all radtags to be the same length;
     //
-    KmerHashMap                      kmer_map;
-    map<int, pair<allele_type, int>> allele_map;
-    vector<char *>                   kmer_map_keys;
     QLocus *tag_1;
     CLocus *tag_2;
 
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
-    vector<int> keys;
-    for (auto it = sample.begin(); it != sample.end(); it++)
-        keys.push_back(it->first);
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
+    LociIndex<QLocus> queries (sample);
 
     //
     // Calculate the number of k-mers we will generate. If specified,
@@ -615,10 +774,8 @@ int find_kmer_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *
     // to use as a base to set the kmer size.
     //
     uint con_len = UINT_MAX;
-    for (uint i = 0; i < keys.size(); i++) {
-        tag_1 = sample[keys[i]];
-        con_len = sample[keys[i]]->len < con_len ? sample[keys[i]]->len : con_len;
-    }
+    for (QLocus *loc : queries.loci())
+        con_len = loc->len < con_len ? loc->len : con_len;
     if (set_kmer_len) kmer_len = determine_kmer_length(con_len, ctag_dist);
 
     //
@@ -626,56 +783,36 @@ int find_kmer_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *
     //
     int min_hits = calc_min_kmer_matches(kmer_len, ctag_dist, con_len, set_kmer_len ? true : false);
 
-    populate_kmer_hash(catalog, kmer_map, kmer_map_keys, allele_map, kmer_len);
+    if (kmer_index.kmer_len() != size_t(kmer_len))
+        kmer_index.reset(catalog, kmer_len);
 
-    cerr << "  " << catalog.size() << " loci in the catalog, " << kmer_map.size() << " kmers in the catalog hash.\n";
+    cerr << "  " << catalog.size() << " loci in the catalog, " << kmer_index.n_alleles() << " alleles in the catalog k-mer index.\n";
 
     #pragma omp parallel private(tag_1, tag_2)
     {
-        KmerHashMap::iterator  h;
-        vector<char *>         kmers;
-        set<string>            uniq_kmers;
+        vector<uint32_t>       kmer_ids;
         vector<int>            hits;
         vector<pair<int, int>> ordered_hits;
         uint                   hit_cnt, index, prev_id, allele_id, hits_size;
         int                    d;
         pair<allele_type, int> cat_hit;
-        int                    num_kmers = con_len - kmer_len + 1;
-
-        initialize_kmers(kmer_len, num_kmers, kmers);
 
         #pragma omp for
-        for (uint i = 0; i < keys.size(); i++) {
-            tag_1 = sample[keys[i]];
+        for (uint i = 0; i < queries.size(); i++) {
+            tag_1 = queries[i];
 
             for (auto allele = tag_1->strings.begin(); allele != tag_1->strings.end(); allele++) {
                 assert(size_t(kmer_len) <= allele->second.length());
 
-                num_kmers = allele->second.length() - kmer_len + 1;
-                generate_kmers_lazily(allele->second.c_str(), kmer_len, num_kmers, kmers);
-
-                //
-                // We want to create a list of unique kmers to search with; otherwise, repetitive kmers will
-                // generate, multiple, spurious hits in sequences with multiple copies of the same kmer.
-                //
-                uniq_kmers.clear();
-                for (int j = 0; j < num_kmers; j++)
-                    uniq_kmers.insert(kmers[j]);
-
                 hits.clear();
                 ordered_hits.clear();
 
                 //
-                // Lookup the occurances of each k-mer in the kmer_map
+                // Lookup the occurances of each k-mer in the kmer_map. We want to search with
+                // unique kmers; otherwise, repetitive kmers will generate, multiple, spurious
+                // hits in sequences with multiple copies of the same kmer.
                 //
-                for (auto j = uniq_kmers.begin(); j != uniq_kmers.end(); j++) {
-
-                    h = kmer_map.find(j->c_str());
-
-                    if (h != kmer_map.end())
-                        for (uint k = 0; k <  h->second.size(); k++)
-                            hits.push_back(h->second[k]);
-                }
+                kmer_index.lookup(allele->second.c_str(), allele->second.length(), hits, kmer_ids);
 
                 //
                 // Sort the vector of indexes; provides the number of hits to each allele/locus
@@ -711,8 +848,15 @@ int find_kmer_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *
 
                 } while (index < hits_size);
 
+                //
+                // Visit the catalog alleles in catalog order.
+                //
+                sort(ordered_hits.begin(), ordered_hits.end(), [&kmer_index] (const pair<int, int> &a, const pair<int, int> &b) {
+                    return kmer_index.precedes(a.first, b.first);
+                });
+
                 for (uint j = 0; j < ordered_hits.size(); j++) {
-                    cat_hit = allele_map.at(ordered_hits[j].first);
+                    cat_hit = kmer_index.allele(ordered_hits[j].first);
                     hit_cnt = ordered_hits[j].second;
 
                     tag_2 = catalog[cat_hit.second];
@@ -724,7 +868,7 @@ int find_kmer_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *
                     if (tag_1->len != tag_2->len)
                         continue;
 
-                    d = dist(allele->second.c_str(), tag_2, cat_hit.first);
+                    d = dist(allele->second.c_str(), tag_2, cat_hit.first, ctag_dist);
 
                     assert(d >= 0);
 
@@ -748,55 +892,36 @@ int find_kmer_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *
             // Sort the vector of distances.
             sort(tag_1->matches.begin(), tag_1->matches.end(), compare_matches);
         }
-
-        //
-        // Free the allocated k-mers.
-        //
-        for (uint j = 0; j < kmers.size(); j++)
-            delete [] kmers[j];
-        kmers.clear();
     }
 
-    free_kmer_hash(kmer_map, kmer_map_keys);
-
     return 0;
 }
 
 int
-search_for_gaps(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, double min_match_len, double ctag_dist)
+search_for_gaps(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, double min_match_len, double ctag_dist,
+                CatalogKmerIndex &kmer_index)
 {
     //
     // Search for loci that can be merged with a gapped alignment.
     //
-    KmerHashMap                      kmer_map;
-    map<int, pair<allele_type, int>> allele_map;
-    vector<char *>                   kmer_map_keys;
     QLocus *tag_1;
     CLocus *tag_2;
 
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
     //
-    vector<int> keys;
-    for (auto it = sample.begin(); it != sample.end(); it++)
-        keys.push_back(it->first);
+    LociIndex<QLocus> queries (sample);
 
-    //
-    // Calculate the number of k-mers we will generate. If kmer_len == 0,
-    // determine the optimal length for k-mers.
-    //
-    int con_len   = strlen(sample[keys[0]]->con);
-    int kmer_len  = 19;
+    int kmer_len = 19;
 
-    populate_kmer_hash(catalog, kmer_map, kmer_map_keys, allele_map, kmer_len);
+    if (kmer_index.kmer_len() != size_t(kmer_len))
+        kmer_index.reset(catalog, kmer_len);
 
     #pragma omp parallel private(tag_1, tag_2)
     {
-        KmerHashMap::iterator    h;
         AlignRes                 aln_res;
-        vector<char *>           kmers;
-        set<string>              uniq_kmers;
+        vector<uint32_t>         kmer_ids;
         vector<int>              hits;
         vector<pair<int, int>>   ordered_hits;
         uint                     hit_cnt, index, prev_id, allele_id, hits_size, stop, top_hit;
@@ -804,15 +929,12 @@ search_for_gaps(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, double
         vector<pair<char, uint>> cigar;
         pair<allele_type, int>   cat_hit;
         string                   cat_seq;
-        int                      num_kmers = con_len - kmer_len + 1;
 
         GappedAln *aln = new GappedAln();
 
-        initialize_kmers(kmer_len, num_kmers, kmers);
-
         #pragma omp for schedule(dynamic)
-        for (uint i = 0; i < keys.size(); i++) {
-            tag_1 = sample[keys[i]];
+        for (uint i = 0; i < queries.size(); i++) {
+            tag_1 = queries[i];
 
             //
             // If we already matched this locus to the catalog without using gapped alignments, skip it now.
@@ -822,31 +944,15 @@ search_for_gaps(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, double
 
             for (auto allele = tag_1->strings.begin(); allele != tag_1->strings.end(); allele++) {
 
-                num_kmers = allele->second.length() - kmer_len + 1;
-                generate_kmers_lazily(allele->second.c_str(), kmer_len, num_kmers, kmers);
-
-                //
-                // We want to create a list of unique kmers to search with; otherwise, repetitive kmers will
-                // generate, multiple, spurious hits in sequences with multiple copies of the same kmer.
-                //
-                uniq_kmers.clear();
-                for (int j = 0; j < num_kmers; j++)
-                    uniq_kmers.insert(kmers[j]);
-
                 hits.clear();
                 ordered_hits.clear();
 
                 //
-                // Lookup the occurances of each k-mer in the kmer_map
+                // Lookup the occurances of each k-mer in the kmer_map. We want to search with
+                // unique kmers; otherwise, repetitive kmers will generate, multiple, spurious
+                // hits in sequences with multiple copies of the same kmer.
                 //
-                for (auto j = uniq_kmers.begin(); j != uniq_kmers.end(); j++) {
-
-                    h = kmer_map.find(j->c_str());
-
-                    if (h != kmer_map.end())
-                        for (uint k = 0; k <  h->second.size(); k++)
-                            hits.push_back(h->second[k]);
-                }
+                kmer_index.lookup(allele->second.c_str(), allele->second.length(), hits, kmer_ids);
 
                 //
                 // Sort the vector of indexes; provides the number of hits to each allele/locus
@@ -885,8 +991,11 @@ search_for_gaps(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, double
                     continue;
 
                 //
-                // Process the hits from most kmer hits to least kmer hits.
+                // Process the hits from most kmer hits to least kmer hits (ties in catalog order).
                 //
+                sort(ordered_hits.begin(), ordered_hits.end(), [&kmer_index] (const pair<int, int> &a, const pair<int, int> &b) {
+                    return kmer_index.precedes(a.first, b.first);
+                });
                 sort(ordered_hits.begin(), ordered_hits.end(), compare_pair_intint);
 
                 //
@@ -901,7 +1010,7 @@ search_for_gaps(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, double
                     }
 
                 for (uint j = 0; j < stop; j++) {
-                    cat_hit = allele_map.at(ordered_hits[j].first);
+                    cat_hit = kmer_index.allele(ordered_hits[j].first);
                     tag_2   = catalog[cat_hit.second];
                     cat_seq = "";
 
@@ -937,18 +1046,9 @@ search_for_gaps(map<int, CLocus *> &catalog, map<int, QLocus *> &sample, double
             }
         }
 
-        //
-        // Free the k-mers we generated for this query
-        //
-        for (uint j = 0; j < kmers.size(); j++)
-            delete [] kmers[j];
-        kmers.clear();
-
         delete aln;
     }
 
-    free_kmer_hash(kmer_map, kmer_map_keys);
-
     return 0;
 }
 
@@ -961,29 +1061,27 @@ int find_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *> &sa
     // Calculate the distance (number of mismatches) between each pair
     // of Radtags. We expect all radtags to be the same length;
     //
-    map<int, QLocus *>::iterator i;
+    QLocus *query;
     map<int, CLocus *>::iterator j;
     int k;
 
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
-    vector<int> keys;
-    for (i = sample.begin(); i != sample.end(); i++)
-        keys.push_back(i->first);
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
+    LociIndex<QLocus> queries (sample);
 
-    #pragma omp parallel private(i, j, k)
+    #pragma omp parallel private(query, j, k)
     {
         #pragma omp for schedule(dynamic)
-        for (k = 0; k < (int) keys.size(); k++) {
+        for (k = 0; k < (int) queries.size(); k++) {
 
-            i = sample.find(keys[k]);
+            query = queries[k];
 
             vector<pair<allele_type, string>>::iterator r, s;
 
             //
             // Iterate through the possible SAMPLE alleles
             //
-            for (r = i->second->strings.begin(); r != i->second->strings.end(); r++) {
+            for (r = query->strings.begin(); r != query->strings.end(); r++) {
 
                 for (j = catalog.begin(); j != catalog.end(); j++) {
                     //
@@ -991,9 +1089,9 @@ int find_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *> &sa
                     //
                     for (s = j->second->strings.begin(); s != j->second->strings.end(); s++) {
                         if (r->second == s->second) {
-                            //cerr << "Found a match between " << i->first << " (" << r->first << ") and " << j->first << " (" << s->first << ")\n";
+                            //cerr << "Found a match between " << query->id << " (" << r->first << ") and " << j->first << " (" << s->first << ")\n";
 
-                            i->second->add_match(j->second->id, s->first, r->first, 0);
+                            query->add_match(j->second->id, s->first, r->first, 0);
                         }
                     }
                 }
@@ -1005,33 +1103,30 @@ int find_matches_by_sequence(map<int, CLocus *> &catalog, map<int, QLocus *> &sa
 }
 
 int find_matches_by_genomic_loc(map<string, int> &cat_index, map<int, QLocus *> &sample) {
-    map<int, QLocus *>::iterator i;
-    map<int, CLocus *>::iterator j;
+    QLocus *query;
 
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
     //
-    vector<int> keys;
-    for (i = sample.begin(); i != sample.end(); i++)
-        keys.push_back(i->first);
+    LociIndex<QLocus> queries (sample);
 
-    #pragma omp parallel private(i, j)
+    #pragma omp parallel private(query)
     {
         char id[id_len];
 
         #pragma omp for
-        for (int k = 0; k < (int) keys.size(); k++) {
+        for (int k = 0; k < (int) queries.size(); k++) {
 
-            i = sample.find(keys[k]);
+            query = queries[k];
 
             snprintf(id, id_len - 1, "%s|%d|%c",
-                     i->second->loc.chr(),
-                     i->second->loc.bp,
-                     i->second->loc.strand == strand_plus ? '+' : '-');
+                     query->loc.chr(),
+                     query->loc.bp,
+                     query->loc.strand == strand_plus ? '+' : '-');
 
             if (cat_index.count(id) > 0)
-                i->second->add_match(cat_index[id], "", "", 0);
+                query->add_match(cat_index[id], "", "", 0);
         }
     }
 
@@ -1059,33 +1154,24 @@ int write_catalog(map<int, CLocus *> &catalog) {
     //
     // Open the output files for writing.
     //
-    gzFile   gz_tags, gz_snps, gz_alle;
+    BgzfWriter gz_tags, gz_snps, gz_alle;
     ofstream tags, snps, alle;
     if (gzip) {
-        gz_tags = gzopen(tag_file.c_str(), "wb");
-        if (!gz_tags) {
+        gz_tags.open(tag_file);
+        if (!gz_tags.is_open()) {
             cerr << "Error: Unable to open gzipped catalog tag file '" << tag_file << "': " << strerror(errno) << ".\n";
             exit(1);
         }
-        #if ZLIB_VERNUM >= 0x1240
-        gzbuffer(gz_tags, libz_buffer_size);
-        #endif
-        gz_snps = gzopen(snp_file.c_str(), "wb");
-        if (!gz_snps) {
+        gz_snps.open(snp_file);
+        if (!gz_snps.is_open()) {
             cerr << "Error: Unable to open gzipped catalog snps file '" << snp_file << "': " << strerror(errno) << ".\n";
             exit(1);
         }
-        #if ZLIB_VERNUM >= 0x1240
-        gzbuffer(gz_snps, libz_buffer_size);
-        #endif
-        gz_alle = gzopen(all_file.c_str(), "wb");
-        if (!gz_alle) {
+        gz_alle.open(all_file);
+        if (!gz_alle.is_open()) {
             cerr << "Error: Unable to open gzipped catalog alleles file '" << all_file << "': " << strerror(errno) << ".\n";
             exit(1);
         }
-        #if ZLIB_VERNUM >= 0x1240
-        gzbuffer(gz_alle, libz_buffer_size);
-        #endif
     } else {
         tags.open(tag_file.c_str());
         snps.open(snp_file.c_str());
@@ -1137,6 +1223,21 @@ int write_catalog(map<int, CLocus *> &catalog) {
         alle.close();
     }
 
+    //
+    // Write the catalog store, which gives the downstream programs random access to the catalog.
+    //
+    CatalogStoreWriter store;
+    store.open(out_path + "catalog.store", catalog.size());
+    vector<string> comps;
+    for (i = catalog.begin(); i != catalog.end(); i++) {
+        tag = i->second;
+        comps.clear();
+        for (auto src_it = tag->sources.begin(); src_it != tag->sources.end(); src_it++)
+            comps.push_back(to_string(src_it->first) + "_" + to_string(src_it->second));
+        store.write(*tag, comps);
+    }
+    store.close();
+
     return 0;
 }
 
@@ -1646,7 +1747,7 @@ write_simple_output(CLocus *tag, ofstream &cat_file, ofstream &snp_file, ofstrea
 }
 
 int
-write_gzip_output(CLocus *tag, gzFile &cat_file, gzFile &snp_file, gzFile &all_file)
+write_gzip_output(CLocus *tag, BgzfWriter &cat_file, BgzfWriter &snp_file, BgzfWriter &all_file)
 {
     string       sources;
     stringstream sstr;
@@ -1669,7 +1770,7 @@ write_gzip_output(CLocus *tag, gzFile &cat_file, gzFile &snp_file, gzFile &all_f
          << 0           << "\t"
          << 0           << "\n";
 
-    gzputs(cat_file, sstr.str().c_str());
+    gzputs_throwing(cat_file, sstr.str().c_str());
     sstr.str("");
 
     //
@@ -1700,7 +1801,7 @@ write_gzip_output(CLocus *tag, gzFile &cat_file, gzFile &snp_file, gzFile &all_f
             ((*snp_it)->rank_4 == 0 ? '-' : (*snp_it)->rank_4) << "\n";
     }
 
-    gzputs(snp_file, sstr.str().c_str());
+    gzputs_throwing(snp_file, sstr.str().c_str());
     sstr.str("");
 
     //
@@ -1713,7 +1814,7 @@ write_gzip_output(CLocus *tag, gzFile &cat_file, gzFile &snp_file, gzFile &all_f
              << 0       << "\t"
              << 0       << "\n";
 
-    gzputs(all_file, sstr.str().c_str());
+    gzputs_throwing(all_file, sstr.str().c_str());
 
     return 0;
 }
@@ -1828,6 +1929,7 @@ int parse_command_line(int argc, char* argv[]) {
             {"sample",          required_argument, NULL, 's'},
             {"out-path",        required_argument, NULL, 'o'}, {"out_path",        required_argument, NULL, 'o'},
             {"threads",         required_argument, NULL, 'p'},
+            {"merge-catalogs",  no_argument,       NULL, 1001},
             {0, 0, 0, 0}
         };
 
@@ -1876,6 +1978,9 @@ int parse_command_line(int argc, char* argv[]) {
         case 1000:
             version();
             break;
+        case 1001:
+            merge_catalogs = true;
+            break;
         case 'p':
             num_threads = is_integer(optarg);
             break;
@@ -1909,6 +2014,11 @@ int parse_command_line(int argc, char* argv[]) {
         help();
     }
 
+    if (merge_catalogs && (samples.size() < 2 || !catalog_path.empty())) {
+        cerr << "Error: --merge-catalogs requires two or more partial catalogs, given with -s/-o (and not -c).\n";
+        help();
+    }
+
     if (!in_dir.empty()) {
         if (popmap_path.empty()) {
             cerr << "Error: Please specify a population map (-M).\n";
@@ -1953,6 +2063,7 @@ void help() {
     cerr << "cstacks " << VERSION << "\n"
               << "cstacks -P in_dir -M popmap [-n num_mismatches] [-p num_threads]" << "\n"
               << "cstacks -s sample1_path [-s sample2_path ...] -o path [-n num_mismatches] [-p num_threads]" << "\n"
+              << "cstacks --merge-catalogs -s catalog1_path -s catalog2_path [...] -o path [-n num_mismatches] [-p num_threads]" << "\n"
               << "\n"
               << "  -P,--in-path: path to the directory containing Stacks files.\n"
               << "  -M,--popmap: path to a population map file.\n"
@@ -1961,6 +2072,7 @@ void help() {
               << "  -s: sample prefix from which to load loci into the catalog." << "\n"
               << "  -o,--outpath: output path to write results." << "\n"
               << "  -c,--catalog <path>: add to an existing catalog.\n"
+              << "  --merge-catalogs: merge the partial catalogs given with -s (as path/catalog), e.g. built from disjoint sets of samples.\n"
               << "\n"
               << "Gapped assembly options:\n"
               << "  --max-gaps: number of gaps allowed between stacks before merging (default: 2).\n"
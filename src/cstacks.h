@@ -43,6 +43,7 @@
 #include <map>
 #include <set>
 #include <queue>
+#include <future>
 using std::queue;
 #include <algorithm>
 
@@ -62,19 +63,22 @@ int  initialize_new_catalog(pair<int, string> &, map<int, CLocus *> &);
 int  initialize_existing_catalog(string, map<int, CLocus *> &);
 int  update_catalog_index(map<int, CLocus *> &, map<string, int> &);
 int  merge_catalog_loci(map<int, CLocus *> &, vector<int> &);
-int  find_kmer_matches_by_sequence(map<int, CLocus *> &, map<int, QLocus *> &, int);
-int  search_for_gaps(map<int, CLocus *> &, map<int, QLocus *> &, double, double);
+int  merge_sample(map<int, CLocus *> &, map<int, QLocus *> &, pair<int, string> &, CatalogKmerIndex &, CatalogKmerIndex &, set<int> &);
+int  merge_partial_catalogs(map<int, CLocus *> &);
+int  merge_catalog_pair(map<int, CLocus *> &, map<int, CLocus *> &);
+int  find_kmer_matches_by_sequence(map<int, CLocus *> &, map<int, QLocus *> &, int, CatalogKmerIndex &);
+int  search_for_gaps(map<int, CLocus *> &, map<int, QLocus *> &, double, double, CatalogKmerIndex &);
 int  find_matches_by_sequence(map<int, CLocus *> &, map<int, QLocus *> &);
 int  find_matches_by_genomic_loc(map<string, int> &, map<int, QLocus *> &);
 int  characterize_mismatch_snps(CLocus *, QLocus *);
 int  merge_allele(Locus *, SNP *);
-int  merge_matches(map<int, CLocus *> &, map<int, QLocus *> &, pair<int, string> &, int, uint &, uint &, uint &, uint &, uint &, uint &);
+int  merge_matches(map<int, CLocus *> &, map<int, QLocus *> &, pair<int, string> &, int, uint &, uint &, uint &, uint &, uint &, uint &, set<int> &);
 int  add_unique_tag(pair<int, string> &, map<int, CLocus *> &, QLocus *);
 bool compare_dist(pair<int, int>, pair<int, int>);
 
 int  write_catalog(map<int, CLocus *> &);
 int  write_simple_output(CLocus *, ofstream &, ofstream &, ofstream &);
-int  write_gzip_output(CLocus *, gzFile &, gzFile &, gzFile &);
+int  write_gzip_output(CLocus *, BgzfWriter &, BgzfWriter &, BgzfWriter &);
 
 bool compare_matches(Match *, Match *);
 
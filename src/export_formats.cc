@@ -102,59 +102,117 @@ bool Export::is_hap_export()
     return hap_exports.count(typeid(*this));
 }
 
-int
-Export::transpose(ifstream &ifh, vector<string> &transposed)
+Transposer::~Transposer()
+{
+    if (this->_tmp_fh != NULL) {
+        fclose(this->_tmp_fh);
+        remove(this->_tmp_path.c_str());
+    }
+}
+
+void
+Transposer::flush_block()
+{
+    if (this->_tmp_fh == NULL) {
+        this->_tmp_fh = fopen(this->_tmp_path.c_str(), "w+b");
+        if (this->_tmp_fh == NULL) {
+            cerr << "Error: Failed to open '" << this->_tmp_path << "' for writing.\n";
+            throw exception();
+        }
+    }
+
+    this->_segments.push_back(vector<pair<uint64_t, uint64_t>>());
+    vector<pair<uint64_t, uint64_t>> &segments = this->_segments.back();
+    for (string &col : this->_cols) {
+        if (fwrite(col.data(), 1, col.size(), this->_tmp_fh) != col.size()) {
+            cerr << "Error: Failed to write to '" << this->_tmp_path << "'.\n";
+            throw exception();
+        }
+        segments.push_back({this->_tmp_size, col.size()});
+        this->_tmp_size += col.size();
+        col.clear();
+    }
+}
+
+bool
+Transposer::read(istream &is)
 {
     vector<string> fields;
     string buf;
-    size_t len;
-    char   line[max_len];
+    size_t block_size = 0;
 
-    transposed.clear();
+    this->_n_cols = 0;
+    this->_next   = 0;
+    this->_cols.clear();
 
-    do {
-        buf.clear();
+    while (std::getline(is, buf)) {
+        if (!buf.empty() && buf.back() == '\r')
+            buf.pop_back();
+        if (buf.empty())
+            break;
 
         //
-        // Read the one line from the file.
+        // Break the line up by tabs.
         //
-        ifh.getline(line, max_len);
+        parse_tsv(buf.c_str(), fields);
+
+        if (this->_n_cols == 0) {
+            this->_n_cols = fields.size();
+            this->_cols.resize(this->_n_cols);
+        } else if (fields.size() != this->_n_cols) {
+            cerr << "Error: Inconsistent number of columns while transposing '" << this->_tmp_path << "'.\n";
+            throw exception();
+        }
 
         //
-        // Check if we read a full line.
+        // Append the fields to the lines of the transposed block. Fields are
+        // separated by tabs, including those of successive blocks.
         //
-        while (ifh.fail() && !ifh.eof()) {
-            buf += line;
-            ifh.clear();
-            ifh.getline(line, max_len);
+        bool first = block_size == 0 && this->_segments.empty();
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (!first)
+                this->_cols[i] += '\t';
+            this->_cols[i] += fields[i];
         }
+        block_size += buf.size() + 1;
 
-        len = strlen(line);
-        if (len > 0 && line[len - 1] == '\r') line[len - 1] = '\0';
-
-        buf += line;
+        if (block_size >= this->_mem_limit) {
+            this->flush_block();
+            block_size = 0;
+        }
+    }
 
-        if (!ifh.good() || buf.length() == 0)
-            return 0;
+    if (this->_tmp_fh != NULL && fflush(this->_tmp_fh) != 0) {
+        cerr << "Error: Failed to write to '" << this->_tmp_path << "'.\n";
+        throw exception();
+    }
 
-        //
-        // Break the line up by tabs.
-        //
-        parse_tsv(buf.c_str(), fields);
+    return this->_n_cols > 0;
+}
 
-        if (transposed.size() == 0) {
-            for (uint i = 0; i < fields.size(); i++)
-                transposed.push_back(fields[i]);
+bool
+Transposer::next(string &line)
+{
+    if (this->_next == this->_n_cols)
+        return false;
 
-        } else {
-            assert(fields.size() == transposed.size());
-            for (uint i = 0; i < fields.size(); i++)
-                transposed.at(i) += "\t" + fields[i];
+    size_t col = this->_next++;
+    line.clear();
+    for (auto &block : this->_segments) {
+        const pair<uint64_t, uint64_t> &seg = block[col];
+        size_t len = line.size();
+        line.resize(len + seg.second);
+        if (fseeko(this->_tmp_fh, seg.first, SEEK_SET) != 0
+            || fread(&line[len], 1, seg.second, this->_tmp_fh) != seg.second) {
+            cerr << "Error: Failed to read '" << this->_tmp_path << "'.\n";
+            throw exception();
         }
+    }
+    line += this->_cols[col];
+    // Free the memory of the in-memory block as we go.
+    string().swap(this->_cols[col]);
 
-    } while (!ifh.eof());
-
-    return 1;
+    return true;
 }
 
 int
@@ -215,7 +273,7 @@ SumstatsExport::write_header()
 }
 
 int
-SumstatsExport::write_batch(const vector<LocBin *> &loci)
+SumstatsExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     CSLocus        *cloc;
     const LocSum   *s;
@@ -338,7 +396,7 @@ HapstatsExport::write_header()
 }
 
 int
-HapstatsExport::write_batch(const vector<LocBin *> &loci)
+HapstatsExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     const LocStat *l;
 
@@ -868,7 +926,7 @@ GenotypesExport::write_header()
 }
 
 int
-GenotypesExport::write_batch(const vector<LocBin *> &loci)
+GenotypesExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     CSLocus *cloc;
 
@@ -948,7 +1006,7 @@ MarkersExport::write_header()
 }
 
 int
-MarkersExport::write_batch(const vector<LocBin *> &loci)
+MarkersExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     stringstream gtype_map;
 
@@ -1016,7 +1074,7 @@ FastaLociExport::write_header()
 }
 
 int
-FastaLociExport::write_batch(const vector<LocBin *> &loci)
+FastaLociExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     for (uint i = 0; i < loci.size(); i++) {
         LocBin* loc = loci[i];
@@ -1071,7 +1129,7 @@ FastaRawExport::open(const MetaPopInfo *mpopi)
 }
 
 int
-FastaRawExport::write_batch(const vector<LocBin *> &loci)
+FastaRawExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     //
     // Write a FASTA file containing each allele from each locus from
@@ -1148,7 +1206,7 @@ FastaSamplesExport::open(const MetaPopInfo *mpopi)
 }
 
 int
-FastaSamplesExport::write_batch(const vector<LocBin *> &loci)
+FastaSamplesExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     LocBin *loc;
     Datum **d;
@@ -1220,8 +1278,10 @@ FastaSamplesExport::write_batch(const vector<LocBin *> &loci)
 }
 
 int
-OrderableExport::write_batch(const vector<LocBin*> &loci)
+OrderableExport::write_batch(const vector<LocBin*> &loci, bool ordered)
 {
+    this->_loci_ordered = ordered;
+
     if (ordered_export) {
         //
         // We need to order the SNPs to take into account overlapping loci.
@@ -1399,33 +1459,32 @@ GenePopExport::post_processing()
     ifstream intmpfh (this->tmp_path());
     check_open(intmpfh, this->tmp_path());
 
-    vector<string> transposed_lines;
-
-    Export::transpose(intmpfh, transposed_lines);
+    Transposer transposed (this->tmp_path() + ".t");
+    transposed.read(intmpfh);
 
-    assert(transposed_lines.size() == this->_mpopi->samples().size() + 1);
+    assert(transposed.size() == this->_mpopi->samples().size() + 1);
 
-    size_t line_cnt = 0;
+    string line;
     size_t pos;
     //
     // The first line has a list of locus IDs, convert these to comma-separated.
     //
-    for (uint i = 1; i < transposed_lines[line_cnt].size(); i++)
-        if (transposed_lines[line_cnt][i] == '\t')
-            transposed_lines[line_cnt][i] = ',';
+    transposed.next(line);
+    for (uint i = 1; i < line.size(); i++)
+        if (line[i] == '\t')
+            line[i] = ',';
 
-    this->_fh << transposed_lines[line_cnt].substr(1) << "\n";
-    line_cnt++;
+    this->_fh << line.substr(1) << "\n";
 
     for (const Pop& pop : this->_mpopi->pops()) {
         this->_fh << "pop\n";
         for (size_t j = pop.first_sample; j <= pop.last_sample; j++) {
-            pos = transposed_lines[line_cnt].find_first_of('\t');
-            transposed_lines[line_cnt][pos] = ',';
+            transposed.next(line);
+            pos = line.find_first_of('\t');
+            line[pos] = ',';
             this->_fh
-                << transposed_lines[line_cnt].substr(0, pos + 1) << "\t"
-                << transposed_lines[line_cnt].substr(pos + 1) << "\n";
-            line_cnt++;
+                << line.substr(0, pos + 1) << "\t"
+                << line.substr(pos + 1) << "\n";
         }
     }
 
@@ -1457,7 +1516,7 @@ GenePopHapsExport::write_header()
 }
 
 int
-GenePopHapsExport::write_batch(const vector<LocBin*>& loci)
+GenePopHapsExport::write_batch(const vector<LocBin*>& loci, bool)
 {
     for (const LocBin* locbin : loci) {
         const CSLocus* cloc = locbin->cloc;
@@ -1526,13 +1585,12 @@ GenePopHapsExport::post_processing()
     //
     ifstream intmpfh (this->tmp_path());
     check_open(intmpfh, this->tmp_path());
-    vector<string> transposed_lines;
-    Export::transpose(intmpfh, transposed_lines);
-    if (transposed_lines.empty()) {
+    Transposer transposed (this->tmp_path() + ".t");
+    if (!transposed.read(intmpfh)) {
         cerr << "Error: Temporary file '" << this->tmp_path()
              << "' is corrupt (no data).\n";
         throw exception();
-    } else if (transposed_lines.size() != this->_mpopi->samples().size() + 1) {
+    } else if (transposed.size() != this->_mpopi->samples().size() + 1) {
         cerr << "Error: Temporary file '" << this->tmp_path()
              << "' is corrupt (wrong number of columns).\n";
         throw exception();
@@ -1541,27 +1599,27 @@ GenePopHapsExport::post_processing()
     //
     // The first line has a list of locus IDs, convert these to comma-separated.
     //
-    vector<string>::iterator line = transposed_lines.begin();
-    for (auto ch = ++line->begin(); ch != line->end(); ++ch) {
+    string line;
+    transposed.next(line);
+    for (auto ch = ++line.begin(); ch != line.end(); ++ch) {
         if (*ch == '\t')
             this->_fh << ',';
         else
             this->_fh << *ch;
     }
     this->_fh << '\n';
-    line++;
 
     //
     // Output every sample.
     //
     for (const Pop& pop : this->_mpopi->pops()) {
         this->_fh << "pop\n";
-        for (size_t i = pop.first_sample; i <= pop.last_sample; i++, line++) {
-            assert(line != transposed_lines.end());
-            this->_fh << *line << '\n';
+        for (size_t i = pop.first_sample; i <= pop.last_sample; i++) {
+            transposed.next(line);
+            this->_fh << line << '\n';
         }
     }
-    assert(line == transposed_lines.end());
+    assert(!transposed.next(line));
 
     return 0;
 }
@@ -1706,14 +1764,14 @@ StructureExport::post_processing()
     this->_intmpfh.open(this->_tmp_path.c_str(), ofstream::in);
     check_open(this->_intmpfh, this->_tmp_path);
 
-    vector<string> transposed_lines;
+    Transposer transposed (this->_tmp_path + ".t");
+    transposed.read(this->_intmpfh);
 
-    Export::transpose(this->_intmpfh, transposed_lines);
+    assert(transposed.size() == (this->_mpopi->samples().size() * 2) + 1);
 
-    assert(transposed_lines.size() == (this->_mpopi->samples().size() * 2) + 1);
-
-    for (size_t line_cnt = 0; line_cnt < transposed_lines.size(); line_cnt++)
-        this->_fh << transposed_lines[line_cnt] << "\n";
+    string line;
+    while (transposed.next(line))
+        this->_fh << line << "\n";
 
     return 1;
 }
@@ -1760,7 +1818,7 @@ FineRADStructureExport::write_header()
 }
 
 int
-FineRADStructureExport::write_batch(const vector<LocBin *> &loci)
+FineRADStructureExport::write_batch(const vector<LocBin *> &loci, bool)
 {
     const CSLocus*     cloc;
     Datum const*const* d;
@@ -2129,24 +2187,22 @@ PhylipExport::post_processing()
     this->_intmpfh.open(this->_tmp_path.c_str(), ofstream::in);
     check_open(this->_intmpfh, this->_tmp_path);
 
-    vector<string> transposed_lines;
-
-    Export::transpose(this->_intmpfh, transposed_lines);
-
-    if (transposed_lines.size() == 0)
+    Transposer transposed (this->_tmp_path + ".t");
+    if (!transposed.read(this->_intmpfh))
         return 0;
 
-    assert(transposed_lines.size() == this->_mpopi->pops().size());
+    assert(transposed.size() == this->_mpopi->pops().size());
 
     this->_fh << this->_mpopi->pops().size() << "\t" << this->_site_index << "\n";
 
-    for (size_t line_cnt = 0; line_cnt < transposed_lines.size(); line_cnt++) {
-        size_t pos = transposed_lines[line_cnt].find_first_of("\t");
-        this->_fh << transposed_lines[line_cnt].substr(0, pos + 1);
+    string line;
+    while (transposed.next(line)) {
+        size_t pos = line.find_first_of("\t");
+        this->_fh << line.substr(0, pos + 1);
 
-        for (size_t i = pos + 1; i < transposed_lines[line_cnt].length(); i++)
-            if (transposed_lines[line_cnt][i] != '\t')
-                this->_fh << transposed_lines[line_cnt][i];
+        for (size_t i = pos + 1; i < line.length(); i++)
+            if (line[i] != '\t')
+                this->_fh << line[i];
         this->_fh << "\n";
     }
 
@@ -2242,7 +2298,7 @@ PhylipVarAllExport::write_header()
 }
 
 int
-PhylipVarAllExport::write_batch(const vector<LocBin*>& loci)
+PhylipVarAllExport::write_batch(const vector<LocBin*>& loci, bool ordered)
 {
     //
     // We want to write all nucleotides per locus per population in Phylip sequential format. Polymorphic
@@ -2289,7 +2345,7 @@ PhylipVarAllExport::write_batch(const vector<LocBin*>& loci)
         delete [] seq;
 
         this->_logfh << cloc->id << "\t" << this->_loc_cnt << "\t" << this->_site_index << "\t" << cloc->len;
-        if (loci_ordered) this->_logfh << "\t" << cloc->loc.chr() << "\t" << cloc->sort_bp() + 1;
+        if (ordered) this->_logfh << "\t" << cloc->loc.chr() << "\t" << cloc->sort_bp() + 1;
         this->_logfh << "\n";
 
         this->_parfh << "DNA, p" << this->_loc_cnt << "=" << this->_site_index << "-" << this->_site_index + cloc->len - 1 << "\n";
@@ -2580,7 +2636,7 @@ VcfExport::write_site(const CSLocus* cloc,
     sprintf(freq_alt, "%0.3f", 1 - t->nucs[col].p_freq);
 
     VcfRecord rec;
-    if (loci_ordered) {
+    if (this->_loci_ordered) {
         rec.append_chrom(string(cloc->loc.chr()));
         rec.append_pos(cloc->sort_bp(col));
         rec.append_id(to_string(cloc->id) + ":" + to_string(col + 1)
@@ -2621,18 +2677,19 @@ VcfExport::write_site(const CSLocus* cloc,
             }
 
             // DP.
-            sample << ":" << d[s]->snpdata[index].tot_depth;
+            const Datum::SNPData& snpdata = d[s]->snpdata[index];
+            sample << ":" << snpdata.tot_depth();
             // AD.
-            if (d[s]->snpdata[index].nt_depths.sum() > 0)
-                sample << ":" << d[s]->snpdata[index].nt_depths[Nt2(ref)]
-                       << "," << d[s]->snpdata[index].nt_depths[Nt2(alt)];
+            if (snpdata.nt_depths_sum() > 0)
+                sample << ":" << snpdata.nt_depth(Nt2(ref))
+                       << "," << snpdata.nt_depth(Nt2(alt));
             else
                 sample << ":.";
             // GQ.
-            assert(d[s]->snpdata[index].gq != UINT8_MAX);
-            sample << ':' << int(d[s]->snpdata[index].gq);
+            assert(snpdata.gq != UINT8_MAX);
+            sample << ':' << int(snpdata.gq);
             // GL.
-            sample << ':' << VcfRecord::util::fmt_gt_gl(alleles, d[s]->snpdata[index].gtliks);
+            sample << ':' << VcfRecord::util::fmt_gt_gl(alleles, snpdata.gtliks());
         }
         rec.append_sample(sample.str());
     }
@@ -2660,7 +2717,7 @@ VcfHapsExport::open(const MetaPopInfo *mpopi)
     return 0;
 }
 
-int VcfHapsExport::write_batch(const vector<LocBin*>& loci){
+int VcfHapsExport::write_batch(const vector<LocBin*>& loci, bool ordered){
     VcfRecord rec;
     for (const LocBin* locbin : loci) {
         const CSLocus* cloc = locbin->cloc;
@@ -2680,7 +2737,7 @@ int VcfHapsExport::write_batch(const vector<LocBin*>& loci){
 
         // Create the record.
         rec.clear();
-        if (loci_ordered) {
+        if (ordered) {
             rec.append_chrom(string(cloc->loc.chr()));
             rec.append_pos(cloc->loc.bp);
             rec.append_id(to_string(cloc->id) + ":1:" + (cloc->loc.strand == strand_plus ? '+' : '-'));
@@ -2796,7 +2853,7 @@ PlinkExport::write_header()
 }
 
 int
-PlinkExport::write_batch(const vector<LocBin*> &loci)
+PlinkExport::write_batch(const vector<LocBin*> &loci, bool ordered)
 {
     if (ordered_export) {
         //
@@ -2844,7 +2901,7 @@ PlinkExport::write_batch(const vector<LocBin*> &loci)
         }
     }//
 
-    return OrderableExport::write_batch(loci);
+    return OrderableExport::write_batch(loci, ordered);
 }
 
 int
@@ -2964,19 +3021,18 @@ PlinkExport::post_processing()
     ifstream intmpfh (this->tmp_path());
     check_open(intmpfh, this->tmp_path());
 
-    vector<string> transposed_lines;
-    Export::transpose(intmpfh, transposed_lines);
-    assert(transposed_lines.size() == this->_mpopi->samples().size() + 1);
+    Transposer transposed (this->tmp_path() + ".t");
+    transposed.read(intmpfh);
+    assert(transposed.size() == this->_mpopi->samples().size() + 1);
 
     //
     // The first line has a list of locus IDs, they are unnecessary in this
     // format, so ignore them.
     //
-    auto line = transposed_lines.begin();
-    assert(!transposed_lines.empty());
-    ++line;
-    for (; line != transposed_lines.end(); ++line)
-        this->_fh << *line << '\n';
+    string line;
+    transposed.next(line);
+    while (transposed.next(line))
+        this->_fh << line << '\n';
 
     return true;
 }
@@ -49,22 +49,67 @@ class Export {
     virtual ~Export() {}
     virtual int  open(const MetaPopInfo *) = 0;
     virtual int  write_header()    = 0;
-    virtual int  write_batch(const vector<LocBin *> &) = 0;
+    // Writes a batch of loci; `ordered` is the value `loci_ordered` had for
+    // this batch (batches are exported while the next one is read).
+    virtual int  write_batch(const vector<LocBin *> &, bool ordered) = 0;
     virtual int  post_processing() {return 0;}
     virtual void close()           {this->_fh.close();}
 
     bool is_hap_export();
     string tmp_path() const {return this->_path + ".part";}
-    static int transpose(ifstream &ifh, vector<string> &transposed);
+};
+
+//
+// Transposer: transposes a tab-separated table, e.g. the loci x samples
+// temporary file of a sample-major export, within a bounded amount of memory.
+//
+// The rows are read by blocks of about `mem_limit` bytes. Each block is
+// transposed in memory and, unless the whole table fits in a single block,
+// written out to a temporary file as one segment per column. The lines of the
+// transposed table are then assembled one at a time from the segments of all
+// the blocks.
+//
+class Transposer {
+    static const size_t default_mem_limit = 256 << 20;
+
+    string   _tmp_path;
+    size_t   _mem_limit;
+    size_t   _n_cols;   // Of the table, i.e. lines of the transposed table.
+    size_t   _next;     // Next line to return.
+    FILE    *_tmp_fh;
+    uint64_t _tmp_size;
+    // The last block, or the whole table.
+    vector<string> _cols;
+    // For each block written to the temporary file, the (offset, length) of
+    // the segment of each column.
+    vector<vector<pair<uint64_t, uint64_t>>> _segments;
+
+    void flush_block();
+
+ public:
+    Transposer(const string &tmp_path, size_t mem_limit = default_mem_limit)
+        : _tmp_path(tmp_path), _mem_limit(mem_limit), _n_cols(0), _next(0), _tmp_fh(NULL), _tmp_size(0) {}
+    Transposer(const Transposer&) = delete;
+    Transposer& operator= (const Transposer&) = delete;
+    ~Transposer();
+
+    // Reads the table, up to the first empty line. Returns false if it is empty.
+    bool read(istream &is);
+    // The number of lines of the transposed table.
+    size_t size() const {return this->_n_cols;}
+    // Gets the next line of the transposed table; returns false at the end.
+    bool next(string &line);
 };
 
 class OrderableExport : public Export {
  public:
-    OrderableExport() {}
+    OrderableExport() : _loci_ordered(false) {}
     virtual ~OrderableExport() {}
-    int write_batch(const vector<LocBin*>& loci);
+    int write_batch(const vector<LocBin*>& loci, bool ordered);
 
  protected:
+    bool _loci_ordered; // Of the batch being written.
+
     virtual int write_site(const CSLocus* cloc, const LocPopSum* psum, Datum const*const* datums, size_t col, size_t index) = 0;
 };
 
@@ -102,7 +147,7 @@ class MarkersExport: public Export {
     ~MarkersExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &);
+    int  write_batch(const vector<LocBin *> &, bool);
 };
 
 class GenotypesExport: public Export {
@@ -116,7 +161,7 @@ class GenotypesExport: public Export {
     ~GenotypesExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &);
+    int  write_batch(const vector<LocBin *> &, bool);
 };
 
 class SumstatsExport: public Export {
@@ -131,7 +176,7 @@ class SumstatsExport: public Export {
     ~SumstatsExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &);
+    int  write_batch(const vector<LocBin *> &, bool);
 };
 
 class HapstatsExport: public Export {
@@ -146,7 +191,7 @@ class HapstatsExport: public Export {
     ~HapstatsExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &);
+    int  write_batch(const vector<LocBin *> &, bool);
 };
 
 class SnpDivergenceExport: public Export {
@@ -166,7 +211,7 @@ class SnpDivergenceExport: public Export {
     }
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &) { return 0; }
+    int  write_batch(const vector<LocBin *> &, bool) { return 0; }
     int  write_batch_pairwise(const vector<LocBin *> &, const vector<vector<PopPair **>> &);
     void close() {
         for (uint i = 0; i < this->_fhs.size(); i++)
@@ -194,7 +239,7 @@ class HapDivergenceExport: public Export {
     }
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &) { return 0; }
+    int  write_batch(const vector<LocBin *> &, bool) { return 0; }
     int  write_batch_pairwise(const vector<LocBin *> &, const vector<vector<HapStat *>> &, const vector<HapStat *> &);
     void close() {
         for (uint i = 0; i < this->_fhs.size(); i++)
@@ -215,7 +260,7 @@ class PlinkExport: public OrderableExport {
     ~PlinkExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &loci);
+    int  write_batch(const vector<LocBin *> &loci, bool ordered);
     int  post_processing();
     void close();
 
@@ -249,7 +294,7 @@ class GenePopHapsExport: public Export {
     ~GenePopHapsExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin*>& loci);
+    int  write_batch(const vector<LocBin*>& loci, bool ordered);
     int  post_processing();
     void close() {this->_fh.close(); remove(this->tmp_path().c_str());}
 
@@ -288,7 +333,7 @@ class FineRADStructureExport: public Export {
     ~FineRADStructureExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &);
+    int  write_batch(const vector<LocBin *> &, bool);
 };
 
 class PhylipExport: public OrderableExport {
@@ -339,7 +384,7 @@ public:
     PhylipVarAllExport() : _mpopi(NULL), _seq_len(0), _site_index(1), _loc_cnt(1) {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &);
+    int  write_batch(const vector<LocBin *> &, bool);
     int  post_processing();
     void close();
 };
@@ -373,7 +418,7 @@ class FastaLociExport: public Export {
     ~FastaLociExport() {}
     int  open(const MetaPopInfo *mpopi);
     int  write_header();
-    int  write_batch(const vector<LocBin *> &);
+    int  write_batch(const vector<LocBin *> &, bool);
 };
 
 class FastaRawExport: public Export {
@@ -387,7 +432,7 @@ class FastaRawExport: public Export {
     ~FastaRawExport() {}
     int open(const MetaPopInfo *mpopi);
     int write_header();
-    int write_batch(const vector<LocBin *> &);
+    int write_batch(const vector<LocBin *> &, bool);
 };
 
 class FastaSamplesExport: public Export {
@@ -401,7 +446,7 @@ class FastaSamplesExport: public Export {
     ~FastaSamplesExport() {}
     int open(const MetaPopInfo *mpopi);
     int write_header();
-    int write_batch(const vector<LocBin *> &);
+    int write_batch(const vector<LocBin *> &, bool);
 };
 
 class VcfExport: public OrderableExport {
@@ -426,7 +471,7 @@ class VcfHapsExport: public Export {
     VcfHapsExport() : _mpopi(NULL), _writer(NULL) {}
     ~VcfHapsExport() { delete this->_writer; }
     int open(const MetaPopInfo *mpopi);
-    int write_batch(const vector<LocBin*>& loci);
+    int write_batch(const vector<LocBin*>& loci, bool ordered);
     int write_header() { return 0; }
 };
 
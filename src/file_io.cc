@@ -296,10 +296,10 @@ open_files(vector<pair<string, string> > &files,
 int
 open_files(vector<pair<string, string> > &files,
            vector<BarcodePair> &barcodes,
-           map<BarcodePair, gzFile *> &pair_1_fhs,
-           map<BarcodePair, gzFile *> &pair_2_fhs,
-           map<BarcodePair, gzFile *> &rem_1_fhs,
-           map<BarcodePair, gzFile *> &rem_2_fhs,
+           map<BarcodePair, BgzfWriter *> &pair_1_fhs,
+           map<BarcodePair, BgzfWriter *> &pair_2_fhs,
+           map<BarcodePair, BgzfWriter *> &rem_1_fhs,
+           map<BarcodePair, BgzfWriter *> &rem_2_fhs,
            map<string, map<string, long> > &counters) {
     string path, suffix_1, suffix_2, filepath, file;
 
@@ -316,7 +316,7 @@ open_files(vector<pair<string, string> > &files,
     }
 
     uint        pos;
-    gzFile     *fh;
+    BgzfWriter *fh;
     BarcodePair bc;
     //
     // If the size of the barcodes vector is 0, then no barcodes
@@ -361,11 +361,10 @@ open_files(vector<pair<string, string> > &files,
                 help();
             }
 
-            fh  = new gzFile;
-            *fh = gzopen(path.c_str(), "wb");
+            fh  = new BgzfWriter(path);
             pair_1_fhs[bc] = fh;
 
-            if (!(*fh)) {
+            if (!fh->is_open()) {
                 cerr << "Error opening output file '" << path << "'\n";
                 exit(1);
             }
@@ -397,11 +396,10 @@ open_files(vector<pair<string, string> > &files,
                     help();
                 }
 
-                fh  = new gzFile;
-                *fh = gzopen(path.c_str(), "wb");
+                fh  = new BgzfWriter(path);
                 pair_2_fhs[bc] = fh;
 
-                if (!(*fh)) {
+                if (!fh->is_open()) {
                     cerr << "Error opening output file '" << path << "'\n";
                     exit(1);
                 }
@@ -417,11 +415,10 @@ open_files(vector<pair<string, string> > &files,
                 }
                 path = out_path + filepath + ".rem" + suffix_1;
 
-                fh  = new gzFile;
-                *fh = gzopen(path.c_str(), "wb");
+                fh  = new BgzfWriter(path);
                 rem_1_fhs[bc] = fh;
 
-                if (!*(fh)) {
+                if (!fh->is_open()) {
                     cerr << "Error opening remainder output file '" << path << "'\n";
                     exit(1);
                 }
@@ -437,11 +434,10 @@ open_files(vector<pair<string, string> > &files,
                 }
                 path = out_path + filepath + ".rem" + suffix_2;
 
-                fh  = new gzFile;
-                *fh = gzopen(path.c_str(), "wb");
+                fh  = new BgzfWriter(path);
                 rem_2_fhs[bc] = fh;
 
-                if (!(*fh)) {
+                if (!fh->is_open()) {
                     cerr << "Error opening remainder output file '" << path << "'\n";
                     exit(1);
                 }
@@ -452,10 +448,9 @@ open_files(vector<pair<string, string> > &files,
     } else if (barcodes.size() == 0 && merge == true) {
 
         path = out_path + "sample_unbarcoded" + suffix_1;
-        fh   = new gzFile;
-        *fh  = gzopen(path.c_str(), "wb");
+        fh   = new BgzfWriter(path);
 
-        if (!(*fh)) {
+        if (!fh->is_open()) {
             cerr << "Error opening output file '" << path << "'\n";
             exit(1);
         }
@@ -469,10 +464,9 @@ open_files(vector<pair<string, string> > &files,
 
         if (paired) {
             path = out_path + "sample_unbarcoded" + suffix_2;
-            fh   = new gzFile;
-            *fh  = gzopen(path.c_str(), "wb");
+            fh   = new BgzfWriter(path);
 
-            if (!(*fh)) {
+            if (!fh->is_open()) {
                 cerr << "Error opening output file '" << path << "'\n";
                 exit(1);
             }
@@ -484,10 +478,9 @@ open_files(vector<pair<string, string> > &files,
             }
 
             path = out_path + "sample_unbarcoded.rem" + suffix_1;
-            fh   = new gzFile;
-            *fh  = gzopen(path.c_str(), "wb");
+            fh   = new BgzfWriter(path);
 
-            if (!(*fh)) {
+            if (!fh->is_open()) {
                 cerr << "Error opening remainder output file '" << path << "'\n";
                 exit(1);
             }
@@ -499,10 +492,9 @@ open_files(vector<pair<string, string> > &files,
             }
 
             path = out_path + "sample_unbarcoded.rem" + suffix_2;
-            fh   = new gzFile;
-            *fh  = gzopen(path.c_str(), "wb");
+            fh   = new BgzfWriter(path);
 
-            if (!(*fh)) {
+            if (!fh->is_open()) {
                 cerr << "Error opening remainder output file '" << path << "'\n";
                 exit(1);
             }
@@ -524,42 +516,38 @@ open_files(vector<pair<string, string> > &files,
         filename = barcodes[i].name_exists() ? barcodes[i].name : "sample_" + barcodes[i].str();
 
         path = out_path + filename + suffix_1;
-        fh   = new gzFile;
-        *fh  = gzopen(path.c_str(), "wb");
+        fh   = new BgzfWriter(path);
         pair_1_fhs[barcodes[i]] = fh;
 
-        if (!(*pair_1_fhs[barcodes[i]])) {
+        if (!pair_1_fhs[barcodes[i]]->is_open()) {
             cerr << "Error opening output file '" << path << "'\n";
             exit(1);
         }
 
         if (paired) {
             path = out_path + filename + suffix_2;
-            fh   = new gzFile;
-            *fh  = gzopen(path.c_str(), "wb");
+            fh   = new BgzfWriter(path);
             pair_2_fhs[barcodes[i]] = fh;
 
-            if (!(*pair_2_fhs[barcodes[i]])) {
+            if (!pair_2_fhs[barcodes[i]]->is_open()) {
                 cerr << "Error opening output file '" << path << "'\n";
                 exit(1);
             }
 
             path = out_path + filename + ".rem" + suffix_1;
-            fh   = new gzFile;
-            *fh  = gzopen(path.c_str(), "wb");
+            fh   = new BgzfWriter(path);
             rem_1_fhs[barcodes[i]] = fh;
 
-            if (!(*rem_1_fhs[barcodes[i]])) {
+            if (!rem_1_fhs[barcodes[i]]->is_open()) {
                 cerr << "Error opening remainder output file '" << path << "'\n";
                 exit(1);
             }
 
             path = out_path + filename + ".rem" + suffix_2;
-            fh   = new gzFile;
-            *fh  = gzopen(path.c_str(), "wb");
+            fh   = new BgzfWriter(path);
             rem_2_fhs[barcodes[i]] = fh;
 
-            if (!(*rem_2_fhs[barcodes[i]])) {
+            if (!rem_2_fhs[barcodes[i]]->is_open()) {
                 cerr << "Error opening remainder output file '" << path << "'\n";
                 exit(1);
             }
@@ -589,18 +577,21 @@ close_file_handles(map<BarcodePair, ofstream *> &fhs)
 }
 
 int
-close_file_handles(map<BarcodePair, gzFile *> &fhs)
+close_file_handles(map<BarcodePair, BgzfWriter *> &fhs)
 {
-    map<BarcodePair, gzFile *>::iterator i;
-    set<gzFile *> ptrs;
-    set<gzFile *>::iterator j;
+    map<BarcodePair, BgzfWriter *>::iterator i;
+    set<BgzfWriter *> ptrs;
+    set<BgzfWriter *>::iterator j;
 
-    for (i = fhs.begin(); i != fhs.end(); i++) {
-        gzclose(*(i->second));
+    for (i = fhs.begin(); i != fhs.end(); i++)
         ptrs.insert(i->second);
-    }
 
+    //
+    // Several barcodes may share a file (e.g. with --merge); close each once.
+    //
     for (j = ptrs.begin(); j != ptrs.end(); j++) {
+        if ((*j)->close() != 0)
+            cerr << "Error: Failed to close output file '" << (*j)->path() << "'.\n";
         delete *j;
     }
 
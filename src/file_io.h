@@ -40,6 +40,7 @@
 #include "constants.h"
 #include "clean.h"
 #include "input.h"
+#include "BgzfWriter.h"
 
 //
 // Command line options defined in process_radtags and process_shortreads.
@@ -75,12 +76,12 @@ int    open_files(vector<pair<string, string> > &,
                   map<string, map<string, long> > &);
 int    open_files(vector<pair<string, string> > &,
                   vector<BarcodePair> &,
-                  map<BarcodePair, gzFile *> &,
-                  map<BarcodePair, gzFile *> &,
-                  map<BarcodePair, gzFile *> &,
-                  map<BarcodePair, gzFile *> &,
+                  map<BarcodePair, BgzfWriter *> &,
+                  map<BarcodePair, BgzfWriter *> &,
+                  map<BarcodePair, BgzfWriter *> &,
+                  map<BarcodePair, BgzfWriter *> &,
                   map<string, map<string, long> > &);
 int    close_file_handles(map<BarcodePair, ofstream *> &);
-int    close_file_handles(map<BarcodePair, gzFile *> &);
+int    close_file_handles(map<BarcodePair, BgzfWriter *> &);
 
 #endif // __FILE_IO_H__
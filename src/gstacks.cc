@@ -19,6 +19,11 @@
 //
 #include <getopt.h>
 #include <zlib.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "gstacks.h"
 
@@ -28,6 +33,7 @@
 #include "catalog_utils.h"
 #include "locus.h"
 #include "locus_readers.h"
+#include "pipeline.h"
 #include "debruijn.h"
 #include "aln_utils.h"
 #include "Alignment.h"
@@ -86,7 +92,8 @@ size_t dbg_denovo_min_loc_samples = 0;
 //
 const string prog_name = "gstacks";
 unique_ptr<LogAlterator> logger;
-gzFile o_gzfasta_f = NULL;
+unique_ptr<HtsThreadPool> hts_pool; // (Declared before the writers, which use it.)
+BgzfWriter o_gzfasta_f;
 unique_ptr<VcfWriter> o_vcf_f;
 unique_ptr<VersatileWriter> o_details_f;
 
@@ -122,6 +129,18 @@ try {
     //
     string opts_report = parse_command_line(argc, argv);
 
+    //
+    // Split the `-t` budget between the stages of the pipeline (below): the
+    // worker team, the reader thread(s), and a pool of htslib threads that
+    // compresses the gzipped outputs and, if there are few of them, helps
+    // decompress the input BAMs. (The writer threads mostly wait on the pool or
+    // on the disk, and are not counted.)
+    //
+    const int n_pool_threads = num_threads >= 4 ? num_threads / 4 : 0;
+    int n_worker_threads = std::max(1, num_threads - n_pool_threads - 1);
+    hts_pool.reset(new HtsThreadPool(n_pool_threads));
+    BgzfWriter::set_thread_pool(hts_pool->hts());
+
     //
     // Open the BAM file(s).
     //
@@ -129,6 +148,13 @@ try {
 try {
     for (const string& in_bam : in_bams)
         bam_f_ptrs.push_back(new Bam(in_bam));
+    // htslib starts a read-ahead thread for each file that uses the pool, so
+    // it is only used for reading when there are no more files than threads.
+    if (bam_f_ptrs.size() <= hts_pool->n_threads()) {
+        int hts_qsize = std::max(2, int(2 * hts_pool->n_threads() / bam_f_ptrs.size()));
+        for (Bam* bam_f : bam_f_ptrs)
+            bam_f->set_thread_pool(*hts_pool, hts_qsize);
+    }
 } catch(exception& e) {
     if (bam_f_ptrs.size() >= 250)
         cerr << "Error: You might need to increase your system's max-open-files limit,"
@@ -162,11 +188,41 @@ try {
         DOES_NOT_HAPPEN;
     }
 
+    //
+    // In reference-based mode, if the BAM files are indexed, the genome is
+    // split in regions that are read in parallel, each by its own builder.
+    // (Not with the detailed/debug outputs, which are keyed by locus ID.)
+    // Building loci is lighter than processing them: the readers get a third
+    // of the threads that are not in the pool, and the workers the rest. The
+    // regions are small enough that the few that are read ahead of the
+    // writers (c.f. `max_ahead` below) don't hold much output.
+    //
+    vector<BamCLocBuilder::Region> regions;
+    size_t n_region_readers = 0;
+    if (bam_cloc_builder && num_threads > 1
+            && !detailed_output && !dbg_write_alns && !dbg_write_hapgraphs && !dbg_write_gfa && !dbg_print_cloc_ids) {
+        regions = BamCLocBuilder::plan_regions(bam_cloc_builder->bam_fs(), 16 * num_threads);
+        // Each reader has all the files open.
+        size_t n_readers = size_t(num_threads - n_pool_threads) / 3;
+        long max_open = sysconf(_SC_OPEN_MAX);
+        size_t max_readers = max_open > 0 ? max_open / 2 / in_bams.size() : n_readers;
+        n_region_readers = std::min({n_readers, regions.size(), max_readers});
+        if (n_region_readers < 2) {
+            regions.clear();
+            n_region_readers = 0;
+        } else {
+            n_worker_threads = std::max(1, num_threads - n_pool_threads - int(n_region_readers));
+            bam_cloc_builder->close();
+            cout << "Found BAM indexes; reading " << regions.size() << " regions of the genome with "
+                 << n_region_readers << " threads.\n";
+        }
+    }
+
     //
     // Open the output files.
     //
     string o_gzfasta_path = out_dir + "catalog.fa.gz";
-    o_gzfasta_f = gzopen(o_gzfasta_path.c_str(), "wb");
+    o_gzfasta_f.open(o_gzfasta_path);
     check_open(o_gzfasta_f, o_gzfasta_path);
 
     VcfHeader vcf_header;
@@ -231,21 +287,11 @@ try {
 
     // For clocking.
     Timers t_threads_totals;
+    Timer t_reader;
     Timer t_parallel;
-    Timer t_writing_vcf;
-    size_t n_writes = 0;
-    size_t max_size_before_write = 0;
 
     // For parallelization.
     int omp_return = 0;
-    std::deque<pair<bool,string>> fa_outputs;
-    std::deque<pair<bool,string>> vcf_outputs;
-    std::deque<pair<bool,string>> det_outputs; // (details)
-    std::deque<pair<bool,vector<vector<BamRecord>>>> bam_outputs;
-    size_t next_fa_to_write = 0; // locus index, in the input BAM file.
-    size_t next_vcf_to_write = 0;
-    size_t next_det_to_write = 0;
-    size_t next_bam_to_write = 0;
 
     cout << "Processing all loci...\n" << flush;
     ProgressMeter progress =
@@ -253,32 +299,214 @@ try {
             ProgressMeter(cout, true, bam_cloc_reader->tally_n_components())
             : ProgressMeter(cout, false, 1000);
 
-    bool eof = false;
-    #pragma omp parallel num_threads(num_threads)
+    //
+    // The writer stage: each output is written in locus order by its own
+    // thread. Loci are indexed by their rank in the input BAM file(s), or by
+    // their rank in the queue when regions are read in parallel (then the
+    // outputs are reordered by region, c.f. `ShardedOutput`).
+    //
+    const size_t n_shards = regions.empty() ? 1 : regions.size();
+    vector<std::atomic<size_t>> shard_n_loci (n_shards);
+    for (auto& n : shard_n_loci)
+        n = SIZE_MAX;
+    ShardedOutput fa_out (shard_n_loci,
+        [] (const string& fa) {
+            if (o_gzfasta_f.write(fa) == -1)
+                throw std::ios::failure("bgzf_write");
+        });
+    ShardedOutput vcf_out (shard_n_loci,
+        [] (const string& vcf) { o_vcf_f->file() << vcf; });
+
+    typedef pair<size_t,string> ShardText; // (shard, text)
+    const size_t write_window = std::max(size_t(64), size_t(16 * n_worker_threads));
+    auto str_size = [] (const string& str) { return str.capacity(); };
+    auto text_size = [] (const ShardText& t) { return t.second.capacity(); };
+    OrderedWriter<ShardText> fa_writer (write_window,
+        [&] (size_t, ShardText& fa) { fa_out.put(fa.first, fa.second); }, text_size);
+    OrderedWriter<ShardText> vcf_writer (write_window,
+        [&] (size_t loc_i, ShardText& vcf) {
+            vcf_out.put(vcf.first, vcf.second);
+            if (input_type == GStacksInputT::denovo_popmap || input_type == GStacksInputT::denovo_merger)
+                progress += bam_cloc_reader->n_catalog_components_of(loc_i);
+            else
+                ++progress;
+        }, text_size);
+    unique_ptr<OrderedWriter<string>> det_writer; // (details)
+    if (detailed_output)
+        det_writer.reset(new OrderedWriter<string>(write_window,
+            [] (size_t, string& det) { *o_details_f << det; }, str_size));
+    unique_ptr<OrderedWriter<vector<vector<BamRecord>>>> bam_writer;
+    if (bam_output)
+        bam_writer.reset(new OrderedWriter<vector<vector<BamRecord>>>(write_window,
+            [&] (size_t, vector<vector<BamRecord>>& recs) {
+                if (!recs.empty()) {
+                    assert(recs.size() == bam_of_ptrs.size());
+                    for (size_t i=0; i<recs.size(); ++i)
+                        for (const BamRecord& r : recs[i])
+                            bam_of_ptrs[i]->write(r);
+                }
+            },
+            [] (const vector<vector<BamRecord>>& recs) {
+                size_t n = 0;
+                for (auto& sample_recs : recs)
+                    for (const BamRecord& r : sample_recs)
+                        n += sizeof(bam1_t) + r.hts()->m_data;
+                return n;
+            }));
+    auto abort_writers = [&] () {
+        fa_writer.abort();
+        vcf_writer.abort();
+        if (det_writer)
+            det_writer->abort();
+        if (bam_writer)
+            bam_writer->abort();
+    };
+
+    //
+    // The reader stage: a dedicated thread decodes the input BAM(s) and queues
+    // loci for the worker threads. The queue is closed on EOF, on error, or
+    // by a worker that failed.
+    //
+    // When regions are read in parallel, several threads take the regions in
+    // order and queue their loci, which are then indexed in queue order. (Each
+    // decompresses its own blocks.) The writers buffer the outputs of the
+    // regions that follow the one they are writing, so a reader does not start
+    // a region more than `max_ahead` regions past the first one that is still
+    // being read.
+    //
+    struct RegionLoc {
+        size_t shard; // (The region.)
+        size_t i;     // For the writers.
+        CLocAlnSet loc;
+    };
+    const bool denovo = input_type == GStacksInputT::denovo_popmap || input_type == GStacksInputT::denovo_merger;
+    const size_t queue_size = 4 * n_worker_threads;
+    BoundedQueue<CLocReadSet> loc_queue (queue_size); // For denovo.
+    BoundedQueue<RegionLoc> aln_loc_queue (queue_size); // For ref-based.
+    vector<unique_ptr<BamCLocBuilder>> region_builders (regions.size()); // (Loci refer to their MetaPopInfo.)
+    int reader_return = 0;
+    auto read_regions = [&] () {
+        const size_t max_ahead = 2 * n_region_readers;
+        std::mutex regions_mtx;
+        std::condition_variable region_done;
+        size_t next_region = 0;
+        size_t first_unread = 0;
+        vector<char> read_done (regions.size(), false);
+        bool stop = false;
+        auto stop_readers = [&] () {
+            {
+                std::lock_guard<std::mutex> lock (regions_mtx);
+                stop = true;
+            }
+            region_done.notify_all();
+        };
+        auto read = [&] () {
+        try {
+            RegionLoc rloc;
+            Timer t;
+            while (true) {
+                size_t r;
+                {
+                    std::unique_lock<std::mutex> lock (regions_mtx);
+                    if (stop || next_region == regions.size())
+                        break;
+                    r = next_region++;
+                    region_done.wait(lock, [&] {return stop || r < first_unread + max_ahead;});
+                    if (stop)
+                        break;
+                }
+                vector<Bam*> bam_fs;
+                for (const string& in_bam : in_bams)
+                    bam_fs.push_back(new Bam(in_bam));
+                region_builders[r].reset(new BamCLocBuilder(move(bam_fs), refbased_cfg, regions[r], sample_names));
+                BamCLocBuilder& builder = *region_builders[r];
+                while (true) {
+                    t.restart();
+                    bool got_locus = builder.build_one_locus(rloc.loc);
+                    t.update();
+                    if (!got_locus)
+                        break;
+                    rloc.shard = r;
+                    if (!aln_loc_queue.push(move(rloc))) {
+                        stop_readers();
+                        return;
+                    }
+                }
+                builder.close();
+                shard_n_loci[r] = builder.loc_stats().n_loci_built;
+                {
+                    std::lock_guard<std::mutex> lock (regions_mtx);
+                    read_done[r] = true;
+                    while (first_unread < regions.size() && read_done[first_unread])
+                        ++first_unread;
+                }
+                region_done.notify_all();
+            }
+            #pragma omp critical(stats)
+            t_reader += t;
+        } catch (exception& e) {
+            #pragma omp critical(exc)
+            reader_return = stacks_handle_exceptions(e);
+            stop_readers();
+            aln_loc_queue.close();
+        }};
+        vector<std::thread> threads;
+        for (size_t i=1; i<n_region_readers; ++i)
+            threads.emplace_back(read);
+        read();
+        for (std::thread& thread : threads)
+            thread.join();
+    };
+    std::thread reader ([&] () {
+        try {
+            if (!regions.empty()) {
+                read_regions();
+            } else {
+                CLocReadSet loc (*bam_mpopi);
+                RegionLoc rloc {0, 0, CLocAlnSet()};
+                size_t n_loci = 0;
+                while (true) {
+                    t_reader.restart();
+                    bool got_locus = denovo ? bam_cloc_reader->read_one_locus(loc) : bam_cloc_builder->build_one_locus(rloc.loc);
+                    t_reader.update();
+                    if (!got_locus) {
+                        shard_n_loci[0] = n_loci;
+                        break;
+                    }
+                    ++n_loci;
+                    if (!denovo) {
+                        assert(rloc.loc.id() >= 1);
+                        rloc.i = rloc.loc.id() - 1;
+                    }
+                    if (!(denovo ? loc_queue.push(move(loc)) : aln_loc_queue.push(move(rloc))))
+                        break;
+                }
+            }
+        } catch (exception& e) {
+            #pragma omp critical(exc)
+            reader_return = stacks_handle_exceptions(e);
+        }
+        loc_queue.close();
+        aln_loc_queue.close();
+    });
+
+    #pragma omp parallel num_threads(n_worker_threads)
     { try {
         LocusProcessor loc_proc (bam_mpopi->samples().size());
         Timers& t = loc_proc.timers();
 
         CLocReadSet loc (*bam_mpopi); // For denovo.
-        CLocAlnSet aln_loc; // For ref-based.
-        bool thread_eof = false;
+        RegionLoc rloc {0, 0, CLocAlnSet()}; // For ref-based.
+        CLocAlnSet& aln_loc = rloc.loc;
         while(omp_return == 0) {
             t.reading.restart();
-            #pragma omp critical(read)
-            { try {
-                if (!eof && omp_return == 0) {
-                    if (input_type == GStacksInputT::denovo_popmap || input_type == GStacksInputT::denovo_merger)
-                        eof = !bam_cloc_reader->read_one_locus(loc);
-                    else
-                        eof = !bam_cloc_builder->build_one_locus(aln_loc);
-                }
-                thread_eof = eof;
-            } catch (exception& e) {
-                omp_return = stacks_handle_exceptions(e);
-            }}
+            size_t rank = 0;
+            bool got_locus = denovo ? loc_queue.pop(loc) : aln_loc_queue.pop(rloc, rank);
             t.reading.update();
-            if (thread_eof || omp_return != 0)
+            if (!got_locus || omp_return != 0)
                 break;
+            if (!regions.empty())
+                rloc.i = rank;
 
             // Process it.
             t.processing.restart();
@@ -291,8 +519,7 @@ try {
                     loc.pe_reads().clear();
                 loc_proc.process(loc);
             } else {
-                assert(aln_loc.id() >= 1);
-                loc_i = aln_loc.id() - 1;
+                loc_i = rloc.i;
                 if (dbg_print_cloc_ids)
                     cerr << (to_string(aln_loc.id()) + '\n') << flush;
                 if (refbased_cfg.paired)
@@ -301,92 +528,30 @@ try {
             }
             t.processing.update();
 
-            // Write the FASTA output.
+            // Hand the outputs over to the writers. (A writer only refuses
+            // them if it, or another stage, failed.)
+            bool ok = true;
             t.writing_fa.restart();
-            #pragma omp critical(write_fa)
-            {
-                for (size_t i=next_fa_to_write+fa_outputs.size(); i<=loc_i; ++i)
-                    fa_outputs.push_back( {false, string()} );
-                fa_outputs[loc_i - next_fa_to_write] = {true, move(loc_proc.fasta_out())};
-
-                while (!fa_outputs.empty() && fa_outputs.front().first) {
-                    const string& fa = fa_outputs.front().second;
-                    if (!fa.empty() && gzwrite(o_gzfasta_f, fa.c_str(), fa.length()) <= 0)
-                        throw std::ios::failure("gzwrite");
-                    fa_outputs.pop_front();
-                    ++next_fa_to_write;
-                }
-            }
+            ok &= fa_writer.put(loc_i, ShardText(rloc.shard, move(loc_proc.fasta_out())));
             t.writing_fa.update();
 
-            // Write the VCF output.
             t.writing_vcf.restart();
-            #pragma omp critical(write_vcf)
-            {
-                for (size_t i=next_vcf_to_write+vcf_outputs.size(); i<=loc_i; ++i)
-                    vcf_outputs.push_back( {false, string()} );
-                vcf_outputs[loc_i - next_vcf_to_write] = {true, move(loc_proc.vcf_out()) };
-
-                if (vcf_outputs.front().first) {
-                    ++n_writes;
-                    if (vcf_outputs.size() > max_size_before_write)
-                        max_size_before_write = vcf_outputs.size();
-                    t_writing_vcf.restart();
-                    do {
-                        o_vcf_f->file() << vcf_outputs.front().second;
-                        vcf_outputs.pop_front();
-                        if (input_type == GStacksInputT::denovo_popmap || input_type == GStacksInputT::denovo_merger)
-                            progress += bam_cloc_reader->n_catalog_components_of(next_vcf_to_write);
-                        else
-                            ++progress;
-                        ++next_vcf_to_write;
-                    } while (!vcf_outputs.empty() && vcf_outputs.front().first);
-                    t_writing_vcf.update();
-                }
-            }
+            ok &= vcf_writer.put(loc_i, ShardText(rloc.shard, move(loc_proc.vcf_out())));
             t.writing_vcf.update();
 
-            // Write the alignments.
             if (bam_output) {
                 t.writing_bams.restart();
-                #pragma omp critical(write_bams)
-                {
-                    for (size_t i=next_bam_to_write+bam_outputs.size(); i<=loc_i; ++i)
-                        bam_outputs.push_back( make_pair(false, vector<vector<BamRecord>>()) );
-                    bam_outputs[loc_i - next_bam_to_write] = make_pair(true, move(loc_proc.bam_out()));
-
-                    while (!bam_outputs.empty() && bam_outputs.front().first) {
-                        vector<vector<BamRecord>>& recs = bam_outputs.front().second;
-                        if (!recs.empty()) {
-                            assert(recs.size() == bam_of_ptrs.size());
-                            for (size_t i=0; i<recs.size(); ++i)
-                                for (const BamRecord& r : recs[i])
-                                    bam_of_ptrs[i]->write(r);
-                        }
-                        bam_outputs.pop_front();
-                        ++next_bam_to_write;
-                    }
-                }
+                ok &= bam_writer->put(loc_i, move(loc_proc.bam_out()));
                 t.writing_bams.update();
             }
 
-            // Write the detailed output.
             if (detailed_output) {
                 t.writing_details.restart();
-                #pragma omp critical(write_details)
-                {
-                    for (size_t i=next_det_to_write+det_outputs.size(); i<=loc_i; ++i)
-                        det_outputs.push_back( {false, string()} );
-                    det_outputs[loc_i - next_det_to_write] = {true, move(loc_proc.details_out())};
-
-                    while (!det_outputs.empty() && det_outputs.front().first) {
-                        *o_details_f << det_outputs.front().second;
-                        det_outputs.pop_front();
-                        ++next_det_to_write;
-                    }
-                }
+                ok &= det_writer->put(loc_i, move(loc_proc.details_out()));
                 t.writing_details.update();
             }
+            if (!ok)
+                break;
         }
 
         // Tally the per-thread statistics.
@@ -400,9 +565,29 @@ try {
     } catch (exception& e) {
         #pragma omp critical(exc)
         omp_return = stacks_handle_exceptions(e);
+        // Unblock the reader and the other workers.
+        loc_queue.close();
+        aln_loc_queue.close();
+        abort_writers();
     }}
+    // (Unblocks the reader if the workers stopped early, e.g. on a write error.)
+    loc_queue.close();
+    aln_loc_queue.close();
+    reader.join();
+    if (reader_return != 0 || omp_return != 0)
+        abort_writers();
+    if (reader_return != 0)
+        return reader_return;
     if (omp_return != 0)
         return omp_return;
+    fa_writer.close();
+    vcf_writer.close();
+    fa_out.finish();
+    vcf_out.finish();
+    if (det_writer)
+        det_writer->close();
+    if (bam_writer)
+        bam_writer->close();
     t_parallel.update();
     progress.done();
 
@@ -451,8 +636,16 @@ try {
 
     } else if (input_type == GStacksInputT::refbased_popmap || input_type == GStacksInputT::refbased_list) {
         // Report statistics on the input BAM(s).
+        // (When regions were read in parallel, records and loci were counted
+        // in the builder of their region.)
+        vector<BamCLocBuilder::BamStats> bam_stats_s = bam_cloc_builder->bam_stats_per_sample();
+        BamCLocBuilder::LocStats loc_stats = bam_cloc_builder->loc_stats();
+        for (auto& builder : region_builders) {
+            for (size_t sample=0; sample<bam_stats_s.size(); ++sample)
+                bam_stats_s[sample] += builder->bam_stats_per_sample()[sample];
+            loc_stats += builder->loc_stats();
+        }
         BamCLocBuilder::BamStats bam_stats {};
-        const vector<BamCLocBuilder::BamStats>& bam_stats_s = bam_cloc_builder->bam_stats_per_sample();
         for (auto& bstats : bam_stats_s)
             bam_stats += bstats;
         size_t tot = bam_stats.n_primary + bam_stats.n_unmapped;
@@ -528,7 +721,6 @@ try {
               << as_percentage(max_keep_rate) << " of these\n";
 
         // Report statistics on the loci that were built.
-        const BamCLocBuilder::LocStats& loc_stats = bam_cloc_builder->loc_stats();
         cout << "\n"
              << "Built " << loc_stats.n_loci_built << " loci comprising "
              << loc_stats.n_fw_reads;
@@ -685,62 +877,63 @@ try {
     // Report clockings.
     {
         double ll  = t_parallel.elapsed();
-        double v   = t_writing_vcf.elapsed();
-
-        double r   = t_threads_totals.reading.elapsed() / num_threads;
-        double p   = t_threads_totals.processing.elapsed() / num_threads;
-        double w_f = t_threads_totals.writing_fa.elapsed() / num_threads;
-        double w_v = t_threads_totals.writing_vcf.elapsed() / num_threads;
-        double w_d = t_threads_totals.writing_details.elapsed() / num_threads;
-        double w_b = t_threads_totals.writing_bams.elapsed() / num_threads;
-
-        double ppr = t_threads_totals.processing_pre_alns.elapsed() / num_threads;
-        double rn   = t_threads_totals.rm_Ns.elapsed() / num_threads;
-        double as   = t_threads_totals.assembling.elapsed() / num_threads;
-        double ia   = t_threads_totals.init_alignments.elapsed() / num_threads;
-        double al   = t_threads_totals.aligning.elapsed() / num_threads;
-        double me   = t_threads_totals.merge_paired_reads.elapsed() / num_threads;
-        double ppo = t_threads_totals.processing_post_alns.elapsed() / num_threads;
-        double rr = t_threads_totals.rm_reads.elapsed() / num_threads;
-        double cnt = t_threads_totals.counting_nts.elapsed() / num_threads;
-        double g   = t_threads_totals.genotyping.elapsed() / num_threads;
-        double h   = t_threads_totals.haplotyping.elapsed() / num_threads;
-        double u   = t_threads_totals.cpt_consensus.elapsed() / num_threads;
-        double b_v = t_threads_totals.building_vcf.elapsed() / num_threads;
-        double b_f = t_threads_totals.building_fa.elapsed() / num_threads;
-        double b_b = t_threads_totals.building_bams.elapsed() / num_threads;
+        double v   = vcf_writer.t_writing().elapsed();
+
+        double r   = t_threads_totals.reading.elapsed() / n_worker_threads;
+        double p   = t_threads_totals.processing.elapsed() / n_worker_threads;
+        double w_f = t_threads_totals.writing_fa.elapsed() / n_worker_threads;
+        double w_v = t_threads_totals.writing_vcf.elapsed() / n_worker_threads;
+        double w_d = t_threads_totals.writing_details.elapsed() / n_worker_threads;
+        double w_b = t_threads_totals.writing_bams.elapsed() / n_worker_threads;
+
+        double ppr = t_threads_totals.processing_pre_alns.elapsed() / n_worker_threads;
+        double rn   = t_threads_totals.rm_Ns.elapsed() / n_worker_threads;
+        double as   = t_threads_totals.assembling.elapsed() / n_worker_threads;
+        double ia   = t_threads_totals.init_alignments.elapsed() / n_worker_threads;
+        double al   = t_threads_totals.aligning.elapsed() / n_worker_threads;
+        double me   = t_threads_totals.merge_paired_reads.elapsed() / n_worker_threads;
+        double ppo = t_threads_totals.processing_post_alns.elapsed() / n_worker_threads;
+        double rr = t_threads_totals.rm_reads.elapsed() / n_worker_threads;
+        double cnt = t_threads_totals.counting_nts.elapsed() / n_worker_threads;
+        double g   = t_threads_totals.genotyping.elapsed() / n_worker_threads;
+        double h   = t_threads_totals.haplotyping.elapsed() / n_worker_threads;
+        double u   = t_threads_totals.cpt_consensus.elapsed() / n_worker_threads;
+        double b_v = t_threads_totals.building_vcf.elapsed() / n_worker_threads;
+        double b_f = t_threads_totals.building_fa.elapsed() / n_worker_threads;
+        double b_b = t_threads_totals.building_bams.elapsed() / n_worker_threads;
 
         double c = t_parallel.consumed()
-                 + t_threads_totals.reading.consumed() / num_threads
-                 + t_threads_totals.processing.consumed() / num_threads
-                 + t_threads_totals.writing_fa.consumed() / num_threads
-                 + t_threads_totals.writing_vcf.consumed() / num_threads
-                 + t_threads_totals.writing_details.consumed() / num_threads
-                 + t_threads_totals.writing_bams.consumed() / num_threads
-                 + t_threads_totals.processing_pre_alns.consumed() / num_threads
-                 + t_threads_totals.rm_Ns.consumed() / num_threads
-                 + t_threads_totals.assembling.consumed() / num_threads
-                 + t_threads_totals.init_alignments.consumed() / num_threads
-                 + t_threads_totals.aligning.consumed() / num_threads
-                 + t_threads_totals.merge_paired_reads.consumed() / num_threads
-                 + t_threads_totals.processing_post_alns.consumed() / num_threads
-                 + t_threads_totals.rm_reads.consumed() / num_threads
-                 + t_threads_totals.counting_nts.consumed() / num_threads
-                 + t_threads_totals.genotyping.consumed() / num_threads
-                 + t_threads_totals.haplotyping.consumed() / num_threads
-                 + t_threads_totals.cpt_consensus.consumed() / num_threads
-                 + t_threads_totals.building_vcf.consumed() / num_threads
-                 + t_threads_totals.building_fa.consumed() / num_threads
-                 + t_threads_totals.building_bams.consumed() / num_threads
-                 + t_writing_vcf.consumed()
+                 + t_threads_totals.reading.consumed() / n_worker_threads
+                 + t_threads_totals.processing.consumed() / n_worker_threads
+                 + t_threads_totals.writing_fa.consumed() / n_worker_threads
+                 + t_threads_totals.writing_vcf.consumed() / n_worker_threads
+                 + t_threads_totals.writing_details.consumed() / n_worker_threads
+                 + t_threads_totals.writing_bams.consumed() / n_worker_threads
+                 + t_threads_totals.processing_pre_alns.consumed() / n_worker_threads
+                 + t_threads_totals.rm_Ns.consumed() / n_worker_threads
+                 + t_threads_totals.assembling.consumed() / n_worker_threads
+                 + t_threads_totals.init_alignments.consumed() / n_worker_threads
+                 + t_threads_totals.aligning.consumed() / n_worker_threads
+                 + t_threads_totals.merge_paired_reads.consumed() / n_worker_threads
+                 + t_threads_totals.processing_post_alns.consumed() / n_worker_threads
+                 + t_threads_totals.rm_reads.consumed() / n_worker_threads
+                 + t_threads_totals.counting_nts.consumed() / n_worker_threads
+                 + t_threads_totals.genotyping.consumed() / n_worker_threads
+                 + t_threads_totals.haplotyping.consumed() / n_worker_threads
+                 + t_threads_totals.cpt_consensus.consumed() / n_worker_threads
+                 + t_threads_totals.building_vcf.consumed() / n_worker_threads
+                 + t_threads_totals.building_fa.consumed() / n_worker_threads
+                 + t_threads_totals.building_bams.consumed() / n_worker_threads
+                 + vcf_writer.t_writing().consumed()
                  ;
 
         x_fp1 << "\n"
            << "BEGIN clockings\n"
-           << "Num. threads: " << num_threads << "\n"
+           << "Num. threads: " << num_threads << " (" << n_worker_threads << " workers, "
+               << (regions.empty() ? 1 : n_region_readers) << " readers, " << hts_pool->n_threads() << " BGZF threads)\n"
            << "Parallel time: " << ll << "\n"
            << "Average thread time spent:\n"
-           << std::setw(8) << r  << "  reading (" << as_percentage(r / ll) << ")\n"
+           << std::setw(8) << r  << "  waiting for the reader (" << as_percentage(r / ll) << ")\n"
            << std::setw(8) << p << "  processing (" << as_percentage(p / ll) << ")\n";
         if (as != 0.0)
             // De novo mode & paired-ends.
@@ -763,15 +956,24 @@ try {
            << std::setw(16) << b_v << "  building_vcf (" << as_percentage(b_v / ll) << ")\n";
         if (bam_output)
             x_fp1 << std::setw(16) << b_b << "  building_bam (" << as_percentage(b_b / ll) << ")\n"
-                << std::setw(8) << w_b << "  writing_bam (" << as_percentage(w_b / ll) << ")\n";
-        x_fp1 << std::setw(8) << w_f << "  writing_fa (" << as_percentage(w_f / ll) << ")\n"
-           << std::setw(8) << w_v << "  writing_vcf (" << as_percentage(w_v / ll) << ")\n";
+                << std::setw(8) << w_b << "  handing over bam (" << as_percentage(w_b / ll) << ")\n";
+        x_fp1 << std::setw(8) << w_f << "  handing over fa (" << as_percentage(w_f / ll) << ")\n"
+           << std::setw(8) << w_v << "  handing over vcf (" << as_percentage(w_v / ll) << ")\n";
         if (detailed_output)
-            x_fp1 << std::setw(8) << w_d << "  writing_details (" << as_percentage(w_d / ll) << ")\n";
+            x_fp1 << std::setw(8) << w_d << "  handing over details (" << as_percentage(w_d / ll) << ")\n";
         x_fp1 << std::setw(8) << c << "  clocking (" << as_percentage(c / ll) << ")\n"
            << "Total time spent writing vcf: " << v << " (" << as_percentage(v / ll) << ")\n"
-           << "VCFwrite block size: mean=" << (double) gt_stats.n_genotyped_loci / n_writes
-               << "(n=" << n_writes << "); max=" << max_size_before_write << "\n"
+           << "Reader thread: " << t_reader.elapsed() << " reading (" << as_percentage(t_reader.elapsed() / ll)
+               << "); max. queue size "
+               << (denovo ? loc_queue.max_size() : aln_loc_queue.max_size()) << "/" << queue_size << "\n"
+           << "Writer threads (window=" << write_window << " loci): peak buffered loci (bytes):"
+               << " fa " << fa_writer.max_buffered() << " (" << fa_writer.max_bytes() << ");"
+               << " vcf " << vcf_writer.max_buffered() << " (" << vcf_writer.max_bytes() << ")";
+        if (detailed_output)
+            x_fp1 << "; details " << det_writer->max_buffered() << " (" << det_writer->max_bytes() << ")";
+        if (bam_output)
+            x_fp1 << "; bam " << bam_writer->max_buffered() << " (" << bam_writer->max_bytes() << ")";
+        x_fp1 << "\n"
            << "END clockings\n";
     }
 
@@ -794,7 +996,8 @@ try {
     // Cleanup & return.
     //
 
-    gzclose(o_gzfasta_f);
+    if (o_gzfasta_f.close() != 0)
+        throw std::ios::failure("bgzf_close");
     o_vcf_f->file().close();
     o_vcf_f.reset();
     for (unique_ptr<Bam>& b : bam_of_ptrs) {
@@ -985,9 +1188,10 @@ LocusProcessor::process(CLocReadSet& loc)
     timers_.assembling.update();
 
     timers_.init_alignments.restart();
-    SuffixTree* stree = new SuffixTree(aln_loc.ref());
+    SuffixTree* stree = &this->stree_;
+    stree->reset(aln_loc.ref());
     stree->build_tree();
-    GappedAln aligner;
+    GappedAln* aligner = &this->aligner_;
     AlignRes aln_res;
     if (!loc.pe_reads().empty()) {
         //
@@ -995,7 +1199,7 @@ LocusProcessor::process(CLocReadSet& loc)
         // adapter), by aligning one FW read.
         //
         for (SRead& r : loc.reads()) {
-            if (!align_reads_to_contig(stree, &aligner, r.seq, aln_res))
+            if (!align_reads_to_contig(stree, aligner, r.seq, aln_res))
                 continue;
             // Read did align. Check start position & break.
             if (aln_res.subj_pos > 0) {
@@ -1011,8 +1215,7 @@ LocusProcessor::process(CLocReadSet& loc)
                         << "orig_contig\t" << aln_loc.ref() << '\n'
                         << "first_fw_read_aln\t" << r.name << "\tpos:" << aln_res.subj_pos << '\n';
                 aln_loc.ref(move(new_ctg));
-                delete stree;
-                stree = new SuffixTree(aln_loc.ref());
+                stree->reset(aln_loc.ref());
                 stree->build_tree();
             }
             break;
@@ -1033,7 +1236,7 @@ LocusProcessor::process(CLocReadSet& loc)
     if (detailed_output)
         loc_.details_ss << "BEGIN pe_alns\n";
     for (SRead& r : loc.reads()) { // FORWARD READS
-        if(add_read_to_aln(aln_loc, aln_res, move(r), &aligner, stree)) {
+        if(add_read_to_aln(aln_loc, aln_res, move(r), aligner, stree)) {
             this->ctg_stats_.n_aln_reads++;
             if (detailed_output)
                 loc_.details_ss << "fw_aln_local"
@@ -1047,7 +1250,7 @@ LocusProcessor::process(CLocReadSet& loc)
         }
     }
     for (SRead& r : loc.pe_reads()) {
-        if (add_read_to_aln(aln_loc, aln_res, move(r), &aligner, stree)) {
+        if (add_read_to_aln(aln_loc, aln_res, move(r), aligner, stree)) {
             this->ctg_stats_.n_aln_reads++;
             if (loc_.ctg_status == LocData::overlapped) {
                 // Record the insert length. (Insert lengths are just based on
@@ -1077,7 +1280,6 @@ LocusProcessor::process(CLocReadSet& loc)
     }
     if (detailed_output)
         loc_.details_ss << "END pe_alns\n";
-    delete stree;
     timers_.aligning.update();
 
     if (bam_output) {
@@ -1781,16 +1983,14 @@ LocusProcessor::assemble_locus_contig(
                 //
                 // Try to overlap the two contigs.
                 //
-                SuffixTree stree {pe_contig};
-                stree.build_tree();
-                GappedAln aligner;
-                AlignRes  aln_res;
+                this->stree_.reset(pe_contig);
+                this->stree_.build_tree();
                 string overlap_cigar;
                 int overlap;
                 if (dbg_no_overlaps)
                     overlap = 0;
                 else
-                    overlap = this->find_locus_overlap(&stree, &aligner, fw_contig, overlap_cigar);
+                    overlap = this->find_locus_overlap(&this->stree_, &this->aligner_, fw_contig, overlap_cigar);
                 if (overlap > 0) {
                     if(detailed_output)
                         loc_.details_ss << "overlap\t" << overlap << '\t' << overlap_cigar << "\n";
@@ -2747,6 +2947,106 @@ Timers& Timers::operator+= (const Timers& other) {
     return *this;
 }
 
+ShardedOutput::ShardedOutput(const vector<std::atomic<size_t>>& shard_n_loci, WriteF write)
+:
+    shard_n_loci_(shard_n_loci),
+    write_(write),
+    head_(0),
+    head_offset_(0),
+    n_put_(shard_n_loci.size(), 0),
+    tmp_fs_(shard_n_loci.size(), NULL),
+    buf_()
+{}
+
+ShardedOutput::~ShardedOutput() {
+    for (FILE* f : tmp_fs_)
+        if (f != NULL)
+            fclose(f);
+}
+
+void ShardedOutput::put(size_t shard, const string& text) {
+    assert(shard >= head_ && shard < n_put_.size());
+    if (shard == head_) {
+        if (head_offset_ == 0) {
+            write_(text);
+        } else {
+            const char* p = text.c_str();
+            const char* end = p + text.length();
+            while (p != end) {
+                const char* eol = (const char*) memchr(p, '\n', end - p);
+                const char* q = eol == NULL ? end : eol + 1;
+                append_renumbered(p, q - p);
+                p = q;
+            }
+            flush_buf();
+        }
+    } else {
+        FILE*& f = tmp_fs_[shard];
+        if (f == NULL) {
+            f = tmpfile();
+            if (f == NULL) {
+                cerr << "Error: Failed to create a temporary file.\n";
+                throw exception();
+            }
+        }
+        if (fwrite(text.c_str(), 1, text.length(), f) != text.length())
+            throw std::ios::failure("fwrite");
+    }
+    ++n_put_[shard];
+    advance();
+}
+
+void ShardedOutput::finish() {
+    advance();
+    if (head_ != n_put_.size())
+        DOES_NOT_HAPPEN;
+}
+
+void ShardedOutput::advance() {
+    while (head_ < n_put_.size() && n_put_[head_] == shard_n_loci_[head_]) {
+        head_offset_ += n_put_[head_];
+        ++head_;
+        if (head_ == n_put_.size() || tmp_fs_[head_] == NULL)
+            continue;
+
+        // Write what was buffered for the new head shard.
+        FILE* f = tmp_fs_[head_];
+        rewind(f);
+        char* line = NULL;
+        size_t line_cap = 0;
+        ssize_t len;
+        while ((len = getline(&line, &line_cap, f)) > 0) {
+            append_renumbered(line, len);
+            if (buf_.size() >= 1<<16)
+                flush_buf();
+        }
+        free(line);
+        if (ferror(f))
+            throw std::ios::failure("getline");
+        flush_buf();
+        fclose(f);
+        tmp_fs_[head_] = NULL;
+    }
+}
+
+void ShardedOutput::append_renumbered(const char* line, size_t len) {
+    const char* end = line + len;
+    const char* p = line;
+    if (p != end && *p == '>')
+        ++p;
+    const char* q = p;
+    size_t id = 0;
+    while (q != end && *q >= '0' && *q <= '9')
+        id = 10 * id + (*q++ - '0');
+    if (q == p) {
+        buf_.append(line, len);
+        return;
+    }
+    buf_.append(line, p);
+    buf_ += to_string(id + head_offset_);
+    buf_.append(q, end);
+}
+
 //
 // Arguments
 // ==========
@@ -2775,6 +3075,8 @@ const string help_string = string() +
         "  (gstacks uses the ID/identifier and SM/sample name fields). Read groups\n"
         "  must be consistent if repeated different files. Note that with -I, read\n"
         "  groups are unneeded and ignored.\n"
+        "  If the files are indexed (.bai/.csi), regions of the genome are read\n"
+        "  in parallel (with -t).\n"
         "\n"
         "For both modes:\n"
         "  -M: path to a population map giving the list of samples\n"
@@ -20,6 +20,9 @@
 #ifndef GSTACKS_H
 #define GSTACKS_H
 
+#include <atomic>
+#include <functional>
+
 #include "constants.h"
 #include "nucleotides.h"
 #include "models.h"
@@ -257,6 +260,10 @@ private:
     Timers timers_;
     mutable LocData loc_;
 
+    // Reused from locus to locus.
+    SuffixTree stree_;
+    GappedAln  aligner_;
+
     DNASeq4 assemble_locus_contig(
         const vector<SRead>& fw_reads,
         const vector<SRead>& pe_reads);
@@ -352,4 +359,43 @@ private:
     void using_true_reference(CLocAlnSet& aln_loc, CLocReadSet&& loc);
 };
 
+//
+// ShardedOutput
+// ----------
+// Concatenates the text outputs (fasta/vcf) of the loci of several shards of
+// the genome, which are built in parallel and numbered from 1 in each shard.
+// The loci of the first unfinished shard are written right away; those of the
+// following shards are buffered in temporary files until their turn. The
+// locus IDs at the beginning of the lines (after a '>' for fasta) are offset
+// by the number of loci in the previous shards.
+//
+// `put()` and `finish()` must be called from a single thread, with the loci of
+// each shard in order. `shard_n_loci[s]` must be set (it is SIZE_MAX until
+// then) once all the loci of shard `s` are known.
+//
+class ShardedOutput {
+public:
+    typedef std::function<void(const string&)> WriteF;
+
+    ShardedOutput(const vector<std::atomic<size_t>>& shard_n_loci, WriteF write);
+    ~ShardedOutput();
+
+    void put(size_t shard, const string& text);
+    // Writes what remains, once all the shards have been received.
+    void finish();
+
+private:
+    const vector<std::atomic<size_t>>& shard_n_loci_;
+    WriteF write_;
+    size_t head_;           // The shard being written.
+    size_t head_offset_;    // The number of loci before it.
+    vector<size_t> n_put_;  // Per shard.
+    vector<FILE*> tmp_fs_;  // Per shard, if buffered.
+    string buf_;
+
+    void advance();
+    void append_renumbered(const char* line, size_t len);
+    void flush_buf() {if (!buf_.empty()) {write_(buf_); buf_.clear();}}
+};
+
 #endif
@@ -46,6 +46,77 @@ Input::~Input() {
     this->fh.close();
 }
 
+size_t
+Input::next_batch(SeqBatch &batch, size_t max_n)
+{
+    batch.clear();
+
+    Seq *s;
+    while (batch.size() < max_n && (s = this->next_seq()) != NULL) {
+        batch.add(s->id, s->seq, s->qual, s->comment.empty() ? NULL : s->comment.c_str());
+        delete s;
+    }
+    batch.seal();
+
+    return batch.size();
+}
+
+SeqBatch::~SeqBatch()
+{
+    for (Seq *s : this->seqs_) {
+        // The strings belong to the arena.
+        s->id   = NULL;
+        s->seq  = NULL;
+        s->qual = NULL;
+        delete s;
+    }
+}
+
+void
+SeqBatch::swap(SeqBatch &other)
+{
+    this->arena_.swap(other.arena_);
+    this->recs_.swap(other.recs_);
+    this->seqs_.swap(other.seqs_);
+}
+
+void
+SeqBatch::add(const char *id, const char *seq, const char *qual, const char *comment)
+{
+    auto append = [this] (const char *str) {
+        size_t off = this->arena_.size();
+        this->arena_.insert(this->arena_.end(), str, str + strlen(str) + 1);
+        return off;
+    };
+
+    Rec r;
+    r.id      = append(id);
+    r.seq     = append(seq);
+    r.qual    = qual    == NULL ? -1 : append(qual);
+    r.comment = comment == NULL ? -1 : append(comment);
+    this->recs_.push_back(r);
+}
+
+void
+SeqBatch::seal()
+{
+    while (this->seqs_.size() < this->recs_.size())
+        this->seqs_.push_back(new Seq());
+
+    char *a = this->arena_.data();
+    for (size_t i = 0; i < this->recs_.size(); i++) {
+        const Rec &r = this->recs_[i];
+        Seq       &s = *this->seqs_[i];
+        s.id   = a + r.id;
+        s.seq  = a + r.seq;
+        s.qual = r.qual < 0 ? NULL : a + r.qual;
+        if (r.comment < 0)
+            s.comment.clear();
+        else
+            s.comment.assign(a + r.comment);
+    }
+}
+
 int
 parse_tsv(const char *line, vector<string> &parts)
 {
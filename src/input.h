@@ -33,6 +33,54 @@
 #include "constants.h"
 #include "stacks.h"
 
+// Default number of records per batch.
+const size_t read_batch_size = 10000;
+
+//
+// SeqBatch: a batch of records, as filled by Input::next_batch().
+//
+// The records are views: their id, seq and qual members point into an arena
+// owned by the batch. Both the arena and the Seq objects are recycled when the
+// batch is refilled, so that reading does not allocate once the batch has
+// reached its working size. Records must not be deleted by the caller, and
+// are invalidated by the next refill.
+//
+class SeqBatch {
+    // Offsets of the record's strings in the arena (-1 if absent).
+    struct Rec {
+        size_t id;
+        size_t seq;
+        long   qual;
+        long   comment;
+    };
+
+    vector<char>  arena_;
+    vector<Rec>   recs_;
+    vector<Seq *> seqs_;
+
+public:
+    SeqBatch() {}
+    SeqBatch(const SeqBatch&) = delete;
+    SeqBatch& operator= (const SeqBatch&) = delete;
+    SeqBatch(SeqBatch&& other) {swap(other);}
+    SeqBatch& operator= (SeqBatch&& other) {swap(other); return *this;}
+    ~SeqBatch();
+
+    size_t size()  const {return recs_.size();}
+    bool   empty() const {return recs_.empty();}
+    Seq   *operator[] (size_t i) const {return seqs_[i];}
+
+    void clear() {arena_.clear(); recs_.clear();}
+    void swap(SeqBatch& other);
+
+    // Appends a record, copying its strings into the arena.
+    void add(const char *id, const char *seq, const char *qual = NULL, const char *comment = NULL);
+    // Points the Seq objects at the arena; to be called once the batch is full.
+    void seal();
+
+    friend class Fastx;
+};
+
 //
 // The base class for all of our Input classes, such as Tsv, Fastq, Fasta, etc.
 //
@@ -47,6 +95,13 @@ class Input {
     virtual ~Input();
     virtual Seq *next_seq() = 0;
     virtual int  next_seq(Seq &) = 0;
+
+    //
+    // Refills `batch` with the next `max_n` records; fewer are returned only
+    // at the end of the input. The default implementation copies the records
+    // returned by next_seq().
+    //
+    virtual size_t next_batch(SeqBatch &batch, size_t max_n);
 };
 
 int   parse_tsv(const char *, vector<string> &);
@@ -52,6 +52,7 @@ double min_k_pct      = 0.15;
 int    min_lim        = 0;
 int    max_lim        = 0;
 int    num_threads    = 1;
+bool   canonical_k    = false;
 
 int main (int argc, char* argv[]) {
     IF_NDEBUG_TRY
@@ -85,10 +86,13 @@ int main (int argc, char* argv[]) {
     else
         cerr << "Normalizing read depth: Off.\n";
 
+    #ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+    #endif
+
     vector<pair<string, string> >   files, pair_files;
     map<string, map<string, long> > counters;
-    SeqKmerHash    kmers;
-    vector<char *> kmers_keys;
+    KmerCounter kmers(kmer_len, canonical_k);
 
     build_file_list(in_files, files);
     cerr << "Found " << files.size() << " input file(s).\n";
@@ -100,9 +104,9 @@ int main (int argc, char* argv[]) {
         cerr << "Generating kmer distribution...\n";
 
         if (read_k_freq)
-            read_kmer_freq(k_freq_path, kmers, kmers_keys);
+            read_kmer_freq(k_freq_path, kmers);
         else
-            populate_kmers(pair_files, files, kmers, kmers_keys);
+            populate_kmers(pair_files, files, kmers);
 
         // double kmer_med, kmer_mad;
         // calc_kmer_median(kmers, kmer_med, kmer_mad);
@@ -163,7 +167,7 @@ int main (int argc, char* argv[]) {
                  << counters[files[i].second]["retained"] << " retained reads.\n";
         }
 
-        free_kmer_hash(kmers, kmers_keys);
+        kmers.reset(kmer_len, canonical_k);
 
         print_results(counters);
     }
@@ -201,7 +205,7 @@ int main (int argc, char* argv[]) {
                                    pair_files[i].second,
                                    pair_files[i+1].first,
                                    pair_files[i+1].second,
-                                   kmers, kmers_keys,
+                                   kmers,
                                    counters[pair_files[i].second]);
 
             cerr << "  "
@@ -219,7 +223,7 @@ int main (int argc, char* argv[]) {
 
             normalize_reads(files[i].first,
                             files[i].second,
-                            kmers, kmers_keys,
+                            kmers,
                             counters[files[i].second]);
 
             cerr << "  "
@@ -228,7 +232,7 @@ int main (int argc, char* argv[]) {
                  << counters[files[i].second]["retained"] << " retained reads.\n";
         }
 
-        free_kmer_hash(kmers, kmers_keys);
+        kmers.reset(kmer_len, canonical_k);
     }
 
     return 0;
@@ -239,7 +243,7 @@ int process_paired_reads(string in_path_1,
                          string in_file_1,
                          string in_path_2,
                          string in_file_2,
-                         SeqKmerHash &kmers,
+                         KmerCounter &kmers,
                          map<string, long> &counter) {
     Input    *fh_1=NULL, *fh_2=NULL;
     ofstream *discard_fh_1=NULL, *discard_fh_2=NULL;
@@ -250,17 +254,17 @@ int process_paired_reads(string in_path_1,
     string path_2 = in_path_2 + in_file_2;
 
     if (in_file_type == FileT::fastq) {
-        fh_1 = new Fastq(path_1);
-        fh_2 = new Fastq(path_2);
+        fh_1 = new Fastx(path_1, true);
+        fh_2 = new Fastx(path_2, true);
     } else if (in_file_type == FileT::fasta) {
-        fh_1 = new Fasta(path_1);
-        fh_2 = new Fasta(path_2);
+        fh_1 = new Fastx(path_1, false);
+        fh_2 = new Fastx(path_2, false);
     } else if (in_file_type == FileT::gzfasta) {
-        fh_1 = new GzFasta(path_1 + ".gz");
-        fh_2 = new GzFasta(path_2 + ".gz");
+        fh_1 = new Fastx(path_1 + ".gz", false);
+        fh_2 = new Fastx(path_2 + ".gz", false);
     } else if (in_file_type == FileT::gzfastq) {
-        fh_1 = new GzFastq(path_1 + ".gz");
-        fh_2 = new GzFastq(path_2 + ".gz");
+        fh_1 = new Fastx(path_1 + ".gz", true);
+        fh_2 = new Fastx(path_2 + ".gz", true);
     } else if (in_file_type == FileT::bustard) {
         fh_1 = new Bustard(path_1);
         fh_2 = new Bustard(path_2);
@@ -334,7 +338,7 @@ int process_paired_reads(string in_path_1,
 
     int   rare_k, abundant_k, num_kmers, max_kmer_lim;
     bool  retain_1, retain_2;
-    char *kmer = new char[kmer_len + 1];
+    vector<int> cnts;
 
     long i = 1;
     do {
@@ -350,7 +354,7 @@ int process_paired_reads(string in_path_1,
         //
         // Drop the first sequence if it has too many rare or abundant kmers.
         //
-        kmer_lookup(kmers, s_1->seq, kmer, num_kmers, rare_k, abundant_k);
+        kmer_lookup(kmers, s_1->seq, num_kmers, cnts, rare_k, abundant_k);
 
         if (filter_mare_k && rare_k > 0) {
             counter["rare_k"]++;
@@ -372,7 +376,7 @@ int process_paired_reads(string in_path_1,
         //
         // Drop the second sequence if it has too many rare or abundant kmers.
         //
-        kmer_lookup(kmers, s_2->seq, kmer, num_kmers, rare_k, abundant_k);
+        kmer_lookup(kmers, s_2->seq, num_kmers, cnts, rare_k, abundant_k);
 
         if (filter_mare_k && rare_k > 0) {
             counter["rare_k"]++;
@@ -420,8 +424,6 @@ int process_paired_reads(string in_path_1,
     } while ((s_1 = fh_1->next_seq()) != NULL &&
              (s_2 = fh_2->next_seq()) != NULL);
 
-    delete [] kmer;
-
     if (discards) {
         delete discard_fh_1;
         delete discard_fh_2;
@@ -441,7 +443,7 @@ int process_paired_reads(string in_path_1,
 
 int process_reads(string in_path,
                   string in_file,
-                  SeqKmerHash &kmers,
+                  KmerCounter &kmers,
                   map<string, long> &counter) {
     Input    *fh=NULL;
     ofstream *discard_fh=NULL;
@@ -450,13 +452,13 @@ int process_reads(string in_path,
     string path = in_path + in_file;
 
     if (in_file_type == FileT::fastq)
-        fh = new Fastq(path);
+        fh = new Fastx(path, true);
     else if (in_file_type == FileT::fasta)
-        fh = new Fasta(path);
+        fh = new Fastx(path, false);
     else if (in_file_type == FileT::gzfastq)
-        fh = new GzFastq(path + ".gz");
+        fh = new Fastx(path + ".gz", true);
     else if (in_file_type == FileT::gzfasta)
-        fh = new GzFasta(path + ".gz");
+        fh = new Fastx(path + ".gz", false);
     else if (in_file_type == FileT::bustard)
         fh = new Bustard(path);
 
@@ -498,7 +500,7 @@ int process_reads(string in_path,
 
     int   rare_k, abundant_k, num_kmers, max_kmer_lim;
     bool  retain;
-    char *kmer  = new char[kmer_len + 1];
+    vector<int> cnts;
     long  i     = 1;
 
     do {
@@ -513,7 +515,7 @@ int process_reads(string in_path,
         num_kmers    = strlen(s->seq) - kmer_len + 1;
         max_kmer_lim = max_lim == 0 ? (int) round((double) num_kmers * max_k_pct) : max_lim;
 
-        kmer_lookup(kmers, s->seq, kmer, num_kmers, rare_k, abundant_k);
+        kmer_lookup(kmers, s->seq, num_kmers, cnts, rare_k, abundant_k);
 
         if (filter_mare_k && rare_k > 0) {
             counter["rare_k"]++;
@@ -542,8 +544,6 @@ int process_reads(string in_path,
         i++;
     } while ((s = fh->next_seq()) != NULL);
 
-    delete [] kmer;
-
     if (discards) delete discard_fh;
 
     //
@@ -560,7 +560,7 @@ normalize_paired_reads(string in_path_1,
                        string in_file_1,
                        string in_path_2,
                        string in_file_2,
-                       SeqKmerHash &kmers, vector<char *> &kmer_keys,
+                       KmerCounter &kmers,
                        map<string, long> &counter)
 {
     Input    *fh_1=NULL, *fh_2=NULL;
@@ -581,17 +581,17 @@ normalize_paired_reads(string in_path_1,
         path_2 = out_path + in_file_2.substr(0, pos) + ".fil" + in_file_2.substr(pos);
 
         if (in_file_type == FileT::fastq) {
-            fh_1 = new Fastq(path_1);
-            fh_2 = new Fastq(path_2);
+            fh_1 = new Fastx(path_1, true);
+            fh_2 = new Fastx(path_2, true);
         } else if (in_file_type == FileT::gzfastq) {
-            fh_1 = new Fastq(path_1);
-            fh_2 = new Fastq(path_2);
+            fh_1 = new Fastx(path_1, true);
+            fh_2 = new Fastx(path_2, true);
         } else if (in_file_type == FileT::fasta) {
-            fh_1 = new Fasta(path_1);
-            fh_2 = new Fasta(path_2);
+            fh_1 = new Fastx(path_1, false);
+            fh_2 = new Fastx(path_2, false);
         } else if (in_file_type == FileT::gzfasta) {
-            fh_1 = new Fasta(path_1);
-            fh_2 = new Fasta(path_2);
+            fh_1 = new Fastx(path_1, false);
+            fh_2 = new Fastx(path_2, false);
         }
     } else {
         //
@@ -601,17 +601,17 @@ normalize_paired_reads(string in_path_1,
         path_2 = in_path_2 + in_file_2;
 
         if (in_file_type == FileT::fastq) {
-            fh_1 = new Fastq(path_1);
-            fh_2 = new Fastq(path_2);
+            fh_1 = new Fastx(path_1, true);
+            fh_2 = new Fastx(path_2, true);
         } else if (in_file_type == FileT::gzfastq) {
-            fh_1 = new GzFastq(path_1 + ".gz");
-            fh_2 = new GzFastq(path_2 + ".gz");
+            fh_1 = new Fastx(path_1 + ".gz", true);
+            fh_2 = new Fastx(path_2 + ".gz", true);
         } else if (in_file_type == FileT::fasta) {
-            fh_1 = new Fasta(path_1);
-            fh_2 = new Fasta(path_2);
+            fh_1 = new Fastx(path_1, false);
+            fh_2 = new Fastx(path_2, false);
         } else if (in_file_type == FileT::gzfasta) {
-            fh_1 = new GzFasta(path_1 + ".gz");
-            fh_2 = new GzFasta(path_2 + ".gz");
+            fh_1 = new Fastx(path_1 + ".gz", false);
+            fh_2 = new Fastx(path_2 + ".gz", false);
         } else if (in_file_type == FileT::bustard) {
             fh_1 = new Bustard(path_1);
             fh_2 = new Bustard(path_2);
@@ -724,7 +724,7 @@ normalize_paired_reads(string in_path_1,
 
     int   num_kmers;
     bool  retain_1, retain_2;
-    char *kmer = new char[kmer_len + 1];
+    vector<int> cnts;
 
     long i = 1;
     do {
@@ -738,14 +738,14 @@ normalize_paired_reads(string in_path_1,
         //
         // Drop the first sequence if it has too many rare or abundant kmers.
         //
-        retain_1 = normalize_kmer_lookup(kmers, s_1->seq, kmer, num_kmers, kmer_keys);
+        retain_1 = normalize_kmer_lookup(kmers, s_1->seq, num_kmers, cnts);
 
         num_kmers = strlen(s_2->seq) - kmer_len + 1;
 
         //
         // Drop the second sequence if it has too many rare or abundant kmers.
         //
-        retain_2 = normalize_kmer_lookup(kmers, s_2->seq, kmer, num_kmers, kmer_keys);
+        retain_2 = normalize_kmer_lookup(kmers, s_2->seq, num_kmers, cnts);
 
         if (retain_1 && retain_2) {
             counter["retained"] += 2;
@@ -785,8 +785,6 @@ normalize_paired_reads(string in_path_1,
     } while ((s_1 = fh_1->next_seq()) != NULL &&
              (s_2 = fh_2->next_seq()) != NULL);
 
-    delete [] kmer;
-
     if (discards) {
         delete discard_fh_1;
         delete discard_fh_2;
@@ -807,7 +805,7 @@ normalize_paired_reads(string in_path_1,
 int
 normalize_reads(string in_path,
                 string in_file,
-                SeqKmerHash &kmers, vector<char *> &kmer_keys,
+                KmerCounter &kmers,
                 map<string, long> &counter)
 {
     Input    *fh=NULL;
@@ -823,13 +821,13 @@ normalize_reads(string in_path,
             path = out_path + in_file.substr(0, pos) + ".fil" + in_file.substr(pos);
 
         if (in_file_type == FileT::fastq)
-            fh = new Fastq(path);
+            fh = new Fastx(path, true);
         else if (in_file_type == FileT::gzfastq)
-            fh = new Fastq(path);
+            fh = new Fastx(path, true);
         else if (in_file_type == FileT::fasta)
-            fh = new Fasta(path);
+            fh = new Fastx(path, false);
         else if (in_file_type == FileT::gzfasta)
-            fh = new Fasta(path);
+            fh = new Fastx(path, false);
         else if (in_file_type == FileT::bustard)
             fh = new Bustard(path);
 
@@ -837,13 +835,13 @@ normalize_reads(string in_path,
         path = in_path + in_file;
 
         if (in_file_type == FileT::fastq)
-            fh = new Fastq(path);
+            fh = new Fastx(path, true);
         else if (in_file_type == FileT::gzfastq)
-            fh = new GzFastq(path + ".gz");
+            fh = new Fastx(path + ".gz", true);
         else if (in_file_type == FileT::fasta)
-            fh = new Fasta(path);
+            fh = new Fastx(path, false);
         else if (in_file_type == FileT::gzfasta)
-            fh = new GzFasta(path + ".gz");
+            fh = new Fastx(path + ".gz", false);
         else if (in_file_type == FileT::bustard)
             fh = new Bustard(path);
     }
@@ -892,7 +890,7 @@ normalize_reads(string in_path,
 
     int   num_kmers;
     bool  retain;
-    char *kmer  = new char[kmer_len + 1];
+    vector<int> cnts;
     long  i     = 1;
 
     do {
@@ -905,7 +903,7 @@ normalize_reads(string in_path,
         retain    = true;
         num_kmers = strlen(s->seq) - kmer_len + 1;
 
-        retain = normalize_kmer_lookup(kmers, s->seq, kmer, num_kmers, kmer_keys);
+        retain = normalize_kmer_lookup(kmers, s->seq, num_kmers, cnts);
 
         if (retain) {
             counter["retained"]++;
@@ -924,8 +922,6 @@ normalize_reads(string in_path,
         i++;
     } while ((s = fh->next_seq()) != NULL);
 
-    delete [] kmer;
-
     if (discards) delete discard_fh;
 
     //
@@ -940,24 +936,22 @@ normalize_reads(string in_path,
 int
 populate_kmers(vector<pair<string, string> > &pair_files,
                vector<pair<string, string> > &files,
-               SeqKmerHash &kmers,
-               vector<char *> &kmers_keys)
+               KmerCounter &kmers)
 {
     //
-    // Break each read down into k-mers and create a hash map of those k-mers
-    // recording in which sequences they occur.
+    // Break each read down into k-mers and count them.
     //
     uint j   = 1;
     uint cnt = files.size() + pair_files.size();
     for (uint i = 0; i < files.size(); i++) {
         cerr << "Generating kmers from file " << j << " of " << cnt << " [" << files[i].second << "]\n";
-        process_file_kmers(files[i].first + files[i].second, kmers, kmers_keys);
+        process_file_kmers(files[i].first + files[i].second, kmers);
         j++;
     }
 
     for (uint i = 0; i < pair_files.size(); i++) {
         cerr << "Generating kmers from file " << j << " of " << cnt << " [" << pair_files[i].second << "]\n";
-        process_file_kmers(pair_files[i].first + pair_files[i].second, kmers, kmers_keys);
+        process_file_kmers(pair_files[i].first + pair_files[i].second, kmers);
         j++;
     }
 
@@ -967,7 +961,7 @@ populate_kmers(vector<pair<string, string> > &pair_files,
 }
 
 int
-read_kmer_freq(string in_path, SeqKmerHash &kmer_map, vector<char *> &kmer_map_keys)
+read_kmer_freq(string in_path, KmerCounter &kmer_map)
 {
     cerr << "Reading kmer frequencies from '" << in_path.c_str() << "'...\n";
 
@@ -977,8 +971,6 @@ read_kmer_freq(string in_path, SeqKmerHash &kmer_map, vector<char *> &kmer_map_k
         exit(1);
     }
 
-    char *hash_key;
-    bool  exists;
     int   len, cnt;
     char  kmer[id_len];
     char  line[max_len];
@@ -1022,19 +1014,24 @@ read_kmer_freq(string in_path, SeqKmerHash &kmer_map, vector<char *> &kmer_map_k
             exit(1);
         }
 
-        strcpy(kmer, parts[0].c_str());
-        exists = kmer_map.count(kmer) == 0 ? false : true;
-
-        if (exists) {
-            cerr << "Warning: kmer '" << kmer << "' already exists in the kmer hash map.\n";
-            hash_key = kmer;
-            kmer_map[hash_key] += cnt;
-        } else {
-            hash_key = new char [strlen(kmer) + 1];
-            strcpy(hash_key, kmer);
-            kmer_map_keys.push_back(hash_key);
-            kmer_map[hash_key]  = cnt;
+        //
+        // The k-mer length is set by the first k-mer of the file.
+        //
+        if (i == 1) {
+            kmer_len = parts[0].length();
+            if (kmer_len < 1) {
+                cerr << "Error: found an empty kmer.\n";
+                exit(1);
+            }
+            kmer_map.reset(kmer_len, canonical_k);
+        } else if ((int) parts[0].length() != kmer_len) {
+            cerr << "Error: kmer '" << parts[0] << "' is not " << kmer_len << "bp long.\n";
+            exit(1);
         }
+
+        if (kmer_map.add_kmer(parts[0].c_str(), cnt) > 0)
+            cerr << "Warning: kmer '" << parts[0] << "' already exists in the kmer hash map.\n";
+
         i++;
     }
 
@@ -1042,14 +1039,13 @@ read_kmer_freq(string in_path, SeqKmerHash &kmer_map, vector<char *> &kmer_map_k
 
     cerr << kmer_map.size() << " unique k-mers read.\n";
 
-    kmer_len = strlen(kmer_map.begin()->first);
     cerr << "Setting kmer length to " << kmer_len << "bp.\n";
 
     return 0;
 }
 
 int
-write_kmer_freq(string path, SeqKmerHash &kmer_map)
+write_kmer_freq(string path, KmerCounter &kmer_map)
 {
     cerr << "Writing kmer frequencies to '" << path.c_str() << "'...";
 
@@ -1059,13 +1055,11 @@ write_kmer_freq(string path, SeqKmerHash &kmer_map)
         exit(1);
     }
 
-    SeqKmerHash::iterator i;
-
     out_fh << "# Kmer\tCount\n";
 
-    for (i = kmer_map.begin(); i != kmer_map.end(); i++) {
-        out_fh << i->first << "\t" << i->second << "\n";
-    }
+    kmer_map.for_each([&out_fh] (const char *kmer, size_t cnt) {
+        out_fh << kmer << "\t" << cnt << "\n";
+    });
 
     out_fh.close();
 
@@ -1075,70 +1069,57 @@ write_kmer_freq(string path, SeqKmerHash &kmer_map)
 }
 
 int
-process_file_kmers(string path, SeqKmerHash &kmer_map, vector<char *> &kmer_map_keys)
+process_file_kmers(string path, KmerCounter &kmer_map)
 {
-    vector<char *> kmers;
-    char          *hash_key;
-    bool           exists;
-    int            j;
-    Input         *fh = NULL;
+    Input *fh = NULL;
 
     if (in_file_type == FileT::fastq)
-        fh = new Fastq(path);
+        fh = new Fastx(path, true);
     else if (in_file_type == FileT::gzfastq)
-        fh = new GzFastq(path + ".gz");
+        fh = new Fastx(path + ".gz", true);
     else if (in_file_type == FileT::fasta)
-        fh = new Fasta(path);
+        fh = new Fastx(path, false);
     else if (in_file_type == FileT::gzfasta)
-        fh = new GzFasta(path + ".gz");
+        fh = new Fastx(path + ".gz", false);
     else if (in_file_type == FileT::bustard)
         fh = new Bustard(path.c_str());
 
     //
-    // Read in the first record, initializing the Seq object s.
+    // The threads take turns reading batches of records from the file, and
+    // count the k-mers of their batch concurrently.
     //
-    Seq *s = fh->next_seq();
-    if (s == NULL) {
-        cerr << "Unable to allocate Seq object.\n";
-        exit(1);
-    }
-
-    int   num_kmers;
-    char *kmer = new char [kmer_len + 1];
-
-    long i = 1;
-    do {
-        if (i % 10000 == 0) cerr << "  Processing short read " << i << "       \r";
-
-        num_kmers = strlen(s->seq) - kmer_len + 1;
-
-        //
-        // Generate and hash the kmers for this raw read
-        //
-        kmer[kmer_len] = '\0';
-
-        for (j = 0; j < num_kmers; j++) {
-            strncpy(kmer, s->seq + j, kmer_len);
-
-            exists = kmer_map.count(kmer) == 0 ? false : true;
-
-            if (exists) {
-                    hash_key = kmer;
-            } else {
-                    hash_key = new char [kmer_len + 1];
-                    strcpy(hash_key, kmer);
-                kmer_map_keys.push_back(hash_key);
+    size_t n_reads = 0;
+
+    #pragma omp parallel
+    {
+        SeqBatch           batch;
+        KmerCounter::Batch kmers;
+
+        while (true) {
+            size_t n;
+
+            #pragma omp critical(kmer_reader)
+            {
+                n = fh->next_batch(batch, read_batch_size);
+                if (n > 0 && (n_reads + n) / 100000 > n_reads / 100000)
+                    cerr << "  Processing short read " << n_reads + n << "       \r";
+                n_reads += n;
             }
 
-            kmer_map[hash_key]++;
-        }
+            if (n == 0)
+                break;
 
-        delete s;
+            for (size_t i = 0; i < batch.size(); i++)
+                kmer_map.add(kmers, batch[i]->seq, strlen(batch[i]->seq));
+        }
 
-        i++;
-    } while ((s = fh->next_seq()) != NULL);
+        kmer_map.flush(kmers);
+    }
 
-    delete [] kmer;
+    if (n_reads == 0) {
+        cerr << "Error: Unable to read any records from '" << path << "'.\n";
+        exit(1);
+    }
 
     //
     // Close the file and delete the Input object.
@@ -1149,15 +1130,15 @@ process_file_kmers(string path, SeqKmerHash &kmer_map, vector<char *> &kmer_map_
 }
 
 int
-generate_kmer_dist(SeqKmerHash &kmer_map)
+generate_kmer_dist(KmerCounter &kmer_map)
 {
-    SeqKmerHash::iterator i;
     map<uint, uint> bins;
 
     cerr << "Generating kmer distribution...\n";
 
-    for (i = kmer_map.begin(); i != kmer_map.end(); i++)
-        bins[i->second]++;
+    kmer_map.for_each([&bins] (const char *, size_t cnt) {
+        bins[cnt]++;
+    });
 
     map<uint, uint>::iterator j;
     vector<pair<uint, uint> > sorted_kmers;
@@ -1174,7 +1155,7 @@ generate_kmer_dist(SeqKmerHash &kmer_map)
 }
 
 int
-calc_kmer_median(SeqKmerHash &kmers, double &kmer_med, double &kmer_mad)
+calc_kmer_median(KmerCounter &kmers, double &kmer_med, double &kmer_mad)
 {
     kmer_med = 0.0;
     kmer_mad = 0.0;
@@ -1183,10 +1164,9 @@ calc_kmer_median(SeqKmerHash &kmers, double &kmer_med, double &kmer_mad)
     vector<int> freqs, residuals;
     freqs.reserve(num_kmers);
 
-    SeqKmerHash::iterator i;
-
-    for (i = kmers.begin(); i != kmers.end(); i++)
-        freqs.push_back(i->second);
+    kmers.for_each([&freqs] (const char *, size_t cnt) {
+        freqs.push_back(cnt);
+    });
 
     sort(freqs.begin(), freqs.end());
 
@@ -1217,30 +1197,16 @@ kmer_map_cmp(pair<char *, long> a, pair<char *, long> b)
 }
 
 inline bool
-normalize_kmer_lookup(SeqKmerHash &kmer_map,
-                      char *read, char *kmer,
+normalize_kmer_lookup(KmerCounter &kmer_map,
+                      char *read,
                       int num_kmers,
-                      vector<char *> &kmer_keys)
+                      vector<int> &sorted_cnts)
 {
-    kmer[kmer_len] = '\0';
-    int  cnt       = 0;
-    bool retain    = true;
+    bool retain = true;
     //
-    // Generate kmers from this read, increment kmer frequency in dataset.
+    // Look up the frequency of the kmers of this read in the dataset so far.
     //
-    vector<int> sorted_cnts;
-    sorted_cnts.reserve(num_kmers);
-
-    // cout << "# " << read << "\n";
-
-    for (int j = 0; j < num_kmers; j++) {
-        strncpy(kmer, read + j, kmer_len);
-
-        cnt = kmer_map.count(kmer) > 0 ? kmer_map[kmer] : 0;
-        sorted_cnts.push_back(cnt);
-
-        // cout << kmer << "\t" << j << "\t" << cnt << "\n";
-    }
+    kmer_map.counts(read, strlen(read), sorted_cnts);
 
     //
     // Calculate the median kmer frequency along the read.
@@ -1255,66 +1221,35 @@ normalize_kmer_lookup(SeqKmerHash &kmer_map,
         retain = false;
 
     //
-    // Generate and hash the kmers for this raw read
+    // Record the kmers of this read.
     //
-    bool  exists;
-    char *hash_key;
-    kmer[kmer_len] = '\0';
-
-    for (int j = 0; j < num_kmers; j++) {
-        strncpy(kmer, read + j, kmer_len);
-
-        exists = kmer_map.count(kmer) == 0 ? false : true;
-
-        if (exists) {
-            hash_key = kmer;
-        } else {
-            hash_key = new char [kmer_len + 1];
-            strcpy(hash_key, kmer);
-            kmer_keys.push_back(hash_key);
-        }
-
-        kmer_map[hash_key]++;
-    }
+    kmer_map.add(read, strlen(read));
 
     return retain;
 }
 
 inline int
-kmer_lookup(SeqKmerHash &kmer_map,
-            char *read, char *kmer,
+kmer_lookup(KmerCounter &kmer_map,
+            char *read,
             int num_kmers,
+            vector<int> &cnts,
             int &rare_k, int &abundant_k)
 {
     //
     // Generate kmers from this read, lookup kmer frequency in dataset.
     //
-    rare_k         = 0;
-    abundant_k     = 0;
-    kmer[kmer_len] = '\0';
-    int cnt        = 0;
-
-    vector<int> cnts, sorted_cnts;
-    cnts.reserve(num_kmers);
-    sorted_cnts.reserve(num_kmers);
-
-    // cout << "# " << read << "\n";
-
-    for (int j = 0; j < num_kmers; j++) {
-        strncpy(kmer, read + j, kmer_len);
+    rare_k     = 0;
+    abundant_k = 0;
 
-        cnt = kmer_map[kmer];
-        cnts.push_back(cnt);
-        sorted_cnts.push_back(cnt);
+    kmer_map.counts(read, strlen(read), cnts);
 
-        // cout << kmer << "\t" << j << "\t" << cnt << "\n";
-
-        if (cnt >= max_k_freq) abundant_k++;
-    }
+    for (int j = 0; j < num_kmers; j++)
+        if (cnts[j] >= max_k_freq) abundant_k++;
 
     //
     // Calculate the median kmer frequency along the read.
     //
+    vector<int> sorted_cnts (cnts);
     sort(sorted_cnts.begin(), sorted_cnts.end());
     double median = num_kmers % 2 == 0 ?
         (double) (sorted_cnts[num_kmers / 2 - 1] + sorted_cnts[num_kmers / 2]) / 2.0 :
@@ -1484,19 +1419,6 @@ kmer_lookup(SeqKmerHash &kmer_map,
 //     return 0;
 // }
 
-int
-free_kmer_hash(SeqKmerHash &kmer_map, vector<char *> &kmer_map_keys)
-{
-    for (uint i = 0; i < kmer_map_keys.size(); i++) {
-        delete [] kmer_map_keys[i];
-    }
-    kmer_map_keys.clear();
-
-    kmer_map.clear();
-
-    return 0;
-}
-
 int print_results(map<string, map<string, long> > &counters) {
     map<string, map<string, long> >::iterator it;
 
@@ -1649,13 +1571,15 @@ int parse_command_line(int argc, char* argv[]) {
             {"min-k-pct",    required_argument, NULL, 'P'}, {"min_k_pct",    required_argument, NULL, 'P'},
             {"read-k-freq",  required_argument, NULL, 'r'}, {"read_k_freq",  required_argument, NULL, 'r'},
             {"write-k-freq", required_argument, NULL, 'w'}, {"write_k_freq", required_argument, NULL, 'w'},
+            {"canonical",    no_argument,       NULL, 'C'},
+            {"threads",      required_argument, NULL, 't'},
             {0, 0, 0, 0}
         };
 
         // getopt_long stores the option index here.
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "hvRADkP:N:I:w:r:K:F:G:M:m:i:y:f:o:t:p:1:2:", long_options, &option_index);
+        c = getopt_long(argc, argv, "hvRADCkP:N:I:w:r:K:F:G:M:m:i:y:f:o:t:p:1:2:", long_options, &option_index);
 
         // Detect the end of the options.
         if (c == -1)
@@ -1740,6 +1664,12 @@ int parse_command_line(int argc, char* argv[]) {
             write_k_freq = true;
             k_freq_path = optarg;
             break;
+        case 'C':
+            canonical_k = true;
+            break;
+        case 't':
+            num_threads = is_integer(optarg);
+            break;
         case 'v':
             version();
             break;
@@ -1782,6 +1712,16 @@ int parse_command_line(int argc, char* argv[]) {
         help();
     }
 
+    if (kmer_len < 1) {
+        cerr << "Kmer length must be at least 1bp.\n";
+        help();
+    }
+
+    if (num_threads < 1) {
+        cerr << "The number of threads must be at least 1.\n";
+        help();
+    }
+
     if (min_k_pct < 0.0 || min_k_pct > 1.0) {
         cerr << "Percentage to consider a kmer rare must be between 0 and 1.0.\n";
         help();
@@ -1831,7 +1771,10 @@ void help() {
               << "    --write-k-freq: write kmers along with their frequency of occurrence and exit.\n"
               << "    --k-dist: print k-mer frequency distribution and exit.\n\n"
               << "  Advanced input options:\n"
-              << "    --read-k-freq <path>: read a set of kmers along with their frequencies of occurrence instead of reading raw input files.\n"
+              << "    --read-k-freq <path>: read a set of kmers along with their frequencies of occurrence instead of reading raw input files.\n\n"
+              << "  Other options:\n"
+              << "    -t,--threads <num>: number of threads used to count kmers (default 1).\n"
+              << "    --canonical: count each kmer together with its reverse complement.\n"
               << "\n";
 
     exit(1);
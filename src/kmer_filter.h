@@ -23,6 +23,10 @@
 
 #include "constants.h"
 
+#ifdef _OPENMP
+#include <omp.h>    // OpenMP library
+#endif
+
 #include <cstdlib>
 #include <getopt.h> // Process command-line options
 #include <dirent.h> // Open/Read contents of a directory
@@ -41,11 +45,6 @@
 #include <utility>
 #include <unordered_map>
 
-#ifdef HAVE_SPARSEHASH
-#include <sparsehash/sparse_hash_map>
-using google::sparse_hash_map;
-#endif
-
 #include "clean.h"
 #include "utils.h"
 #include "kmers.h"
@@ -55,40 +54,34 @@ using google::sparse_hash_map;
 #include "FastqI.h"     // Reading input files in FASTQ format
 #include "gzFasta.h"    // Reading gzipped input files in FASTA format
 #include "gzFastq.h"    // Reading gzipped input files in FASTQ format
-
-#ifdef HAVE_SPARSEHASH
-typedef sparse_hash_map<char *, long, hash_charptr, eqstr> SeqKmerHash;
-#else
-typedef unordered_map<char *, long, hash_charptr, eqstr> SeqKmerHash;
-#endif
+#include "FastxI.h"    // Reading input files in FASTQ/FASTA format, by batches
 
 void help( void );
 void version( void );
 int  parse_command_line(int, char**);
 int  build_file_list(vector<string> &, vector<pair<string, string> > &);
-int  process_reads(string, string, SeqKmerHash &, map<string, long> &);
-int  process_paired_reads(string, string, string, string, SeqKmerHash &, map<string, long> &);
+int  process_reads(string, string, KmerCounter &, map<string, long> &);
+int  process_paired_reads(string, string, string, string, KmerCounter &, map<string, long> &);
 int  print_results(map<string, map<string, long> > &);
 
 //
 // Functions to normalize read depth
 //
-int  normalize_reads(string, string, SeqKmerHash &, vector<char *> &, map<string, long> &);
-int  normalize_paired_reads(string, string, string, string, SeqKmerHash &, vector<char *> &, map<string, long> &);
-bool normalize_kmer_lookup(SeqKmerHash &, char *, char *, int, vector<char *> &);
+int  normalize_reads(string, string, KmerCounter &, map<string, long> &);
+int  normalize_paired_reads(string, string, string, string, KmerCounter &, map<string, long> &);
+bool normalize_kmer_lookup(KmerCounter &, char *, int, vector<int> &);
 
 //
 // Functions for finding and removing reads with rare kmers
 //
-int  populate_kmers(vector<pair<string, string> > &, vector<pair<string, string> > &, SeqKmerHash &, vector<char *> &);
-int  process_file_kmers(string, SeqKmerHash &, vector<char *> &);
-int  generate_kmer_dist(SeqKmerHash &);
-int  calc_kmer_median(SeqKmerHash &, double &, double &);
+int  populate_kmers(vector<pair<string, string> > &, vector<pair<string, string> > &, KmerCounter &);
+int  process_file_kmers(string, KmerCounter &);
+int  generate_kmer_dist(KmerCounter &);
+int  calc_kmer_median(KmerCounter &, double &, double &);
 int  kmer_map_cmp(pair<char *, long>, pair<char *, long>);
-int  kmer_lookup(SeqKmerHash &, char *, char *, int, int &, int &);
-int  free_kmer_hash(SeqKmerHash &, vector<char *> &);
+int  kmer_lookup(KmerCounter &, char *, int, vector<int> &, int &, int &);
 
-int  read_kmer_freq(string, SeqKmerHash &, vector<char *> &);
-int  write_kmer_freq(string, SeqKmerHash &);
+int  read_kmer_freq(string, KmerCounter &);
+int  write_kmer_freq(string, KmerCounter &);
 
 #endif // __KMER_FILTER_H__
@@ -23,6 +23,10 @@
 //
 #include "kmers.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 int determine_kmer_length(int read_len, int dist) {
     int kmer_len, span, min_matches;
 
@@ -189,19 +193,508 @@ int generate_permutations(map<int, char **> &pstrings, int width) {
     return 0;
 }
 
+//
+// 2-bit codes for unambiguous nucleotides; -1 for everything else (including
+// lower case characters, which are distinct k-mers in the original sequence).
+//
+static const int8_t kmer_nt_codes[256] = {
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1, 0,-1, 1,-1,-1,-1, 2,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1, 3,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+
+void
+KmerIndex::reset(size_t kmer_len)
+{
+    this->k_      = kmer_len;
+    this->nw_     = kmer_len == 0 ? 1 : (kmer_len + 31) / 32;
+    size_t rem    = kmer_len % 32;
+    this->mask_   = rem == 0 ? ~uint64_t(0) : (uint64_t(1) << (2 * rem)) - 1;
+    this->n_keys_ = 0;
+
+    this->keys_.clear();
+    this->slots_.assign(1024, 0);
+    this->amb_.clear();
+    this->occ_ids_.clear();
+    this->occ_vals_.clear();
+    this->offsets_.assign(1, 0);
+    this->postings_.clear();
+}
+
+//
+// Calls f(words, kmer) for each k-mer of `seq`, in order; `words` is the packed
+// k-mer, or NULL if the k-mer contains ambiguous characters.
+//
+template<typename F>
+void
+KmerIndex::for_each_kmer(const char *seq, size_t len, F f) const
+{
+    if (this->k_ == 0 || len < this->k_)
+        return;
+
+    const size_t k = this->k_;
+    vector<uint64_t> words(this->nw_);
+    uint64_t *w   = words.data();
+    size_t    run = 0; // Number of consecutive unambiguous nucleotides.
+
+    if (this->nw_ == 1) {
+        //
+        // Rolling update of the packed k-mer.
+        //
+        w[0] = 0;
+        for (size_t i = 0; i < len; i++) {
+            int8_t c = kmer_nt_codes[(uchar) seq[i]];
+            if (c < 0) {
+                run  = 0;
+                w[0] = 0;
+            } else {
+                run++;
+                w[0] = ((w[0] << 2) | uint64_t(c)) & this->mask_;
+            }
+            if (i + 1 >= k)
+                f(run >= k ? w : NULL, seq + i + 1 - k);
+        }
+    } else {
+        for (size_t i = 0; i < len; i++) {
+            run = kmer_nt_codes[(uchar) seq[i]] < 0 ? 0 : run + 1;
+            if (i + 1 < k)
+                continue;
+            if (run < k) {
+                f(NULL, seq + i + 1 - k);
+                continue;
+            }
+            const char *p = seq + i + 1 - k;
+            for (size_t j = 0; j < this->nw_; j++) {
+                size_t stop = std::min(k, (j + 1) * 32);
+                w[j] = 0;
+                for (size_t n = j * 32; n < stop; n++)
+                    w[j] = (w[j] << 2) | uint64_t(kmer_nt_codes[(uchar) p[n]]);
+            }
+            f(w, p);
+        }
+    }
+}
+
+uint64_t
+KmerIndex::hash(const uint64_t *w) const
+{
+    uint64_t h = 0;
+    for (size_t j = 0; j < this->nw_; j++) {
+        h ^= w[j];
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+    }
+    return h;
+}
+
+size_t
+KmerIndex::find_slot(const uint64_t *w) const
+{
+    size_t m = this->slots_.size() - 1;
+    size_t i = this->hash(w) & m;
+
+    while (this->slots_[i] != 0) {
+        const uint64_t *key = this->keys_.data() + (this->slots_[i] - 1) * this->nw_;
+        if (memcmp(key, w, this->nw_ * sizeof(uint64_t)) == 0)
+            break;
+        i = (i + 1) & m;
+    }
+
+    return i;
+}
+
+void
+KmerIndex::grow()
+{
+    vector<uint32_t> slots(this->slots_.size() * 2, 0);
+    size_t m = slots.size() - 1;
+
+    for (uint32_t slot : this->slots_) {
+        if (slot == 0)
+            continue;
+        size_t i = this->hash(this->keys_.data() + (slot - 1) * this->nw_) & m;
+        while (slots[i] != 0)
+            i = (i + 1) & m;
+        slots[i] = slot;
+    }
+
+    this->slots_.swap(slots);
+}
+
+uint32_t
+KmerIndex::insert(const uint64_t *w)
+{
+    size_t i = this->find_slot(w);
+
+    if (this->slots_[i] != 0)
+        return this->slots_[i] - 1;
+
+    uint32_t id = this->n_keys_++;
+    this->keys_.insert(this->keys_.end(), w, w + this->nw_);
+    this->slots_[i] = id + 1;
+
+    if (2 * this->n_keys_ > this->slots_.size())
+        this->grow();
+
+    return id;
+}
+
+uint32_t
+KmerIndex::insert(const char *kmer)
+{
+    auto r = this->amb_.insert(make_pair(string(kmer, this->k_), this->n_keys_));
+
+    if (r.second) {
+        //
+        // Ambiguous k-mers share the ID space of packed ones, but are not in the
+        // open-addressing table; their entry in `keys_` is unused.
+        //
+        this->n_keys_++;
+        this->keys_.insert(this->keys_.end(), this->nw_, ~uint64_t(0));
+    }
+
+    return r.first->second;
+}
+
+int64_t
+KmerIndex::find(const uint64_t *w) const
+{
+    size_t i = this->find_slot(w);
+    return int64_t(this->slots_[i]) - 1;
+}
+
+int64_t
+KmerIndex::find(const char *kmer) const
+{
+    if (this->amb_.empty())
+        return -1;
+    auto it = this->amb_.find(string(kmer, this->k_));
+    return it == this->amb_.end() ? -1 : int64_t(it->second);
+}
+
+void
+KmerIndex::add(const char *seq, size_t len, int value)
+{
+    assert(this->offsets_.size() == 1);
+
+    this->for_each_kmer(seq, len, [&] (const uint64_t *w, const char *kmer) {
+        this->occ_ids_.push_back(w != NULL ? this->insert(w) : this->insert(kmer));
+        this->occ_vals_.push_back(value);
+    });
+}
+
+void
+KmerIndex::finalize()
+{
+    //
+    // Lay the values of each k-mer out contiguously, preserving the order in
+    // which they were added.
+    //
+    this->offsets_.assign(this->n_keys_ + 1, 0);
+    for (uint32_t id : this->occ_ids_)
+        this->offsets_[id + 1]++;
+    for (uint32_t id = 0; id < this->n_keys_; id++)
+        this->offsets_[id + 1] += this->offsets_[id];
+
+    vector<size_t> pos(this->offsets_.begin(), this->offsets_.end() - 1);
+    this->postings_.resize(this->occ_ids_.size());
+    for (size_t i = 0; i < this->occ_ids_.size(); i++)
+        this->postings_[pos[this->occ_ids_[i]]++] = this->occ_vals_[i];
+
+    vector<uint32_t>().swap(this->occ_ids_);
+    vector<int>().swap(this->occ_vals_);
+}
+
+void
+KmerIndex::lookup(const char *seq, size_t len, bool uniq, vector<int> &hits, vector<uint32_t> &ids) const
+{
+    ids.clear();
+
+    this->for_each_kmer(seq, len, [&] (const uint64_t *w, const char *kmer) {
+        int64_t id = w != NULL ? this->find(w) : this->find(kmer);
+        if (id >= 0)
+            ids.push_back(id);
+    });
+
+    if (uniq) {
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    }
+
+    for (uint32_t id : ids)
+        hits.insert(hits.end(), this->postings_begin(id), this->postings_end(id));
+}
+
+void
+KmerCounter::reset(size_t kmer_len, bool canonical)
+{
+    this->k_         = kmer_len;
+    this->canonical_ = canonical;
+    this->mask_      = kmer_len >= max_packed ? ~uint64_t(0) : (uint64_t(1) << (2 * kmer_len)) - 1;
+
+    for (Part &part : this->parts_) {
+        part.keys.assign(1024, 0);
+        part.cnts.assign(1024, 0);
+        part.n = 0;
+    }
+    this->amb_.clear();
+}
+
+size_t
+KmerCounter::size() const
+{
+    size_t n = this->amb_.size();
+    for (const Part &part : this->parts_)
+        n += part.n;
+    return n;
+}
+
+//
+// Calls f(packed, key, kmer) for each k-mer of `seq`, in order. `key` is the
+// packed (and if requested, canonical) k-mer; if `packed` is false the k-mer
+// contains ambiguous characters or is too long to be packed, and `kmer` must
+// be used instead.
+//
+template<typename F>
+void
+KmerCounter::for_each_kmer(const char *seq, size_t len, F f) const
+{
+    if (this->k_ == 0 || len < this->k_)
+        return;
+
+    const size_t k     = this->k_;
+
+    if (k > max_packed) {
+        for (size_t i = 0; i + k <= len; i++)
+            f(false, 0, seq + i);
+        return;
+    }
+
+    const size_t shift = 2 * (k - 1);
+    uint64_t fw  = 0;
+    uint64_t rc  = 0;
+    size_t   run = 0; // Number of consecutive unambiguous nucleotides.
+
+    for (size_t i = 0; i < len; i++) {
+        int8_t c = kmer_nt_codes[(uchar) seq[i]];
+        if (c < 0) {
+            run = 0;
+            fw  = 0;
+            rc  = 0;
+        } else {
+            run++;
+            fw = ((fw << 2) | uint64_t(c)) & this->mask_;
+            rc = (rc >> 2) | (uint64_t(3 - c) << shift);
+        }
+        if (i + 1 < k)
+            continue;
+        if (run >= k)
+            f(true, this->canonical_ && rc < fw ? rc : fw, seq + i + 1 - k);
+        else
+            f(false, 0, seq + i + 1 - k);
+    }
+}
+
+string
+KmerCounter::canonical_string(const char *kmer) const
+{
+    string fw(kmer, this->k_);
+    if (!this->canonical_)
+        return fw;
+
+    string rc(fw.rbegin(), fw.rend());
+    for (char &c : rc)
+        switch (c) {
+        case 'A': c = 'T'; break;
+        case 'C': c = 'G'; break;
+        case 'G': c = 'C'; break;
+        case 'T': c = 'A'; break;
+        default: break;
+        }
+
+    return rc < fw ? rc : fw;
+}
+
+uint64_t
+KmerCounter::hash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+size_t
+KmerCounter::find_slot(const Part &part, uint64_t key, uint64_t h)
+{
+    size_t m = part.keys.size() - 1;
+    size_t i = h & m;
+
+    while (part.cnts[i] != 0 && part.keys[i] != key)
+        i = (i + 1) & m;
+
+    return i;
+}
+
+uint32_t
+KmerCounter::incr(Part &part, uint64_t key, uint64_t h, size_t n)
+{
+    size_t i = find_slot(part, key, h);
+
+    if (part.cnts[i] == 0) {
+        if (10 * (part.n + 1) > 7 * part.keys.size()) {
+            grow(part);
+            i = find_slot(part, key, h);
+        }
+        part.keys[i] = key;
+        part.n++;
+    }
+
+    // Saturate rather than wrap around.
+    uint32_t prev = part.cnts[i];
+    uint64_t cnt  = uint64_t(prev) + n;
+    part.cnts[i]  = cnt > UINT32_MAX ? UINT32_MAX : uint32_t(cnt);
+
+    return prev;
+}
+
+void
+KmerCounter::grow(Part &part)
+{
+    vector<uint64_t> keys(part.keys.size() * 2, 0);
+    vector<uint32_t> cnts(part.cnts.size() * 2, 0);
+    size_t m = keys.size() - 1;
+
+    for (size_t j = 0; j < part.keys.size(); j++) {
+        if (part.cnts[j] == 0)
+            continue;
+        size_t i = hash(part.keys[j]) & m;
+        while (cnts[i] != 0)
+            i = (i + 1) & m;
+        keys[i] = part.keys[j];
+        cnts[i] = part.cnts[j];
+    }
+
+    part.keys.swap(keys);
+    part.cnts.swap(cnts);
+}
+
+void
+KmerCounter::add(const char *seq, size_t len)
+{
+    this->for_each_kmer(seq, len, [this] (bool packed, uint64_t key, const char *kmer) {
+        if (packed) {
+            uint64_t h = this->hash(key);
+            incr(this->parts_[this->part_of(h)], key, h, 1);
+        } else {
+            this->amb_[this->canonical_string(kmer)]++;
+        }
+    });
+}
+
+void
+KmerCounter::add(Batch &batch, const char *seq, size_t len)
+{
+    if (batch.keys_.empty())
+        batch.keys_.resize(n_parts);
+
+    this->for_each_kmer(seq, len, [this, &batch] (bool packed, uint64_t key, const char *kmer) {
+        if (packed)
+            batch.keys_[this->part_of(this->hash(key))].push_back(key);
+        else
+            batch.amb_.push_back(this->canonical_string(kmer));
+        batch.n_++;
+    });
+
+    if (batch.n_ >= batch_limit)
+        this->flush(batch);
+}
+
+void
+KmerCounter::flush(Batch &batch)
+{
+    for (size_t p = 0; p < batch.keys_.size(); p++) {
+        vector<uint64_t> &keys = batch.keys_[p];
+        if (keys.empty())
+            continue;
+
+        Part &part = this->parts_[p];
+        std::lock_guard<std::mutex> lock (part.mtx);
+        for (uint64_t key : keys)
+            incr(part, key, this->hash(key), 1);
+        keys.clear();
+    }
+
+    if (!batch.amb_.empty()) {
+        std::lock_guard<std::mutex> lock (this->amb_mtx_);
+        for (const string &kmer : batch.amb_)
+            this->amb_[kmer]++;
+        batch.amb_.clear();
+    }
+
+    batch.n_ = 0;
+}
+
+size_t
+KmerCounter::add_kmer(const char *kmer, size_t n)
+{
+    size_t prev = 0;
+
+    this->for_each_kmer(kmer, this->k_, [&] (bool packed, uint64_t key, const char *kmer) {
+        if (packed) {
+            uint64_t h = this->hash(key);
+            prev = incr(this->parts_[this->part_of(h)], key, h, n);
+        } else {
+            uint32_t &cnt = this->amb_[this->canonical_string(kmer)];
+            prev = cnt;
+            cnt += n;
+        }
+    });
+
+    return prev;
+}
+
+void
+KmerCounter::counts(const char *seq, size_t len, vector<int> &cnts) const
+{
+    cnts.clear();
+
+    this->for_each_kmer(seq, len, [this, &cnts] (bool packed, uint64_t key, const char *kmer) {
+        size_t cnt = 0;
+        if (packed) {
+            uint64_t    h    = this->hash(key);
+            const Part &part = this->parts_[this->part_of(h)];
+            cnt = part.cnts[find_slot(part, key, h)];
+        } else if (!this->amb_.empty()) {
+            auto it = this->amb_.find(this->canonical_string(kmer));
+            if (it != this->amb_.end())
+                cnt = it->second;
+        }
+        cnts.push_back(cnt > INT_MAX ? INT_MAX : int(cnt));
+    });
+}
+
 int
-populate_kmer_hash(map<int, MergedStack *> &merged, KmerHashMap &kmer_map, vector<char *> &kmer_map_keys, int kmer_len)
+populate_kmer_hash(map<int, MergedStack *> &merged, KmerIndex &kmer_map, int kmer_len)
 {
     map<int, MergedStack *>::iterator it;
-    MergedStack    *tag;
-    vector<char *>  kmers;
-    bool            exists;
+    MergedStack *tag;
 
     //
     // Break each stack down into k-mers and create a hash map of those k-mers
     // recording in which sequences they occur.
     //
-    int num_kmers = strlen(merged.begin()->second->con) - kmer_len + 1;
+    kmer_map.reset(kmer_len);
 
     for (it = merged.begin(); it != merged.end(); it++) {
         tag = it->second;
@@ -209,22 +702,11 @@ populate_kmer_hash(map<int, MergedStack *> &merged, KmerHashMap &kmer_map, vecto
         // Don't compute distances for masked tags
         if (tag->masked) continue;
 
-        generate_kmers(tag->con, kmer_len, num_kmers, kmers);
-
-        // Hash the kmers
-        for (int j = 0; j < num_kmers; j++) {
-            exists = kmer_map.count(kmers[j]) == 0 ? false : true;
-
-            kmer_map[kmers[j]].push_back(tag->id);
-
-            if (exists)
-                delete [] kmers[j];
-            else
-                kmer_map_keys.push_back(kmers[j]);
-        }
-        kmers.clear();
+        kmer_map.add(tag->con, tag->len, tag->id);
     }
 
+    kmer_map.finalize();
+
     //dump_kmer_map(kmer_map);
 
     return 0;
@@ -280,30 +762,25 @@ populate_kmer_hash(map<int, Locus *> &catalog, CatKmerHashMap &kmer_map, vector<
 }
 
 int
-populate_kmer_hash(map<int, Locus *> &catalog, KmerHashMap &kmer_map, vector<char *> &kmer_map_keys, map<int, pair<allele_type, int> > &allele_map, int kmer_len)
+populate_kmer_hash(map<int, Locus *> &catalog, KmerIndex &kmer_map, map<int, pair<allele_type, int> > &allele_map, int kmer_len)
 {
     map<int, Locus *>::iterator it;
-    KmerHashMap::iterator   map_it;
     vector<pair<allele_type, string> >::iterator allele;
     map<int, pair<allele_type, int> >::iterator  allele_it;
-    vector<char *> kmers;
-    Locus         *tag;
-    char          *hash_key;
+    Locus *tag;
 
     //
     // Break each stack down into k-mers and create a hash map of those k-mers
     // recording in which sequences they occur.
     //
-    int num_kmers;
     int allele_index = 0;
 
+    kmer_map.reset(kmer_len);
     allele_it = allele_map.begin();
 
     for (it = catalog.begin(); it != catalog.end(); it++) {
         tag = it->second;
 
-        num_kmers = strlen(tag->con) - kmer_len + 1;
-
         //
         // Iterate through the possible Catalog alleles
         //
@@ -311,59 +788,41 @@ populate_kmer_hash(map<int, Locus *> &catalog, KmerHashMap &kmer_map, vector<cha
             //
             // Generate and hash the kmers for this allele string
             //
-            generate_kmers(allele->second.c_str(), kmer_len, num_kmers, kmers);
-
             allele_it = allele_map.insert(allele_it, make_pair(allele_index, make_pair(allele->first, tag->id)));
 
-            for (int j = 0; j < num_kmers; j++) {
-                hash_key = kmers[j];
-
-                map_it = kmer_map.find(hash_key);
-
-                if (map_it != kmer_map.end()) {
-                    map_it->second.push_back(allele_index);
-                    delete [] kmers[j];
-                } else {
-                    kmer_map[hash_key].push_back(allele_index);
-                    kmer_map_keys.push_back(hash_key);
-                }
-            }
-            kmers.clear();
+            kmer_map.add(allele->second.c_str(), allele->second.length(), allele_index);
 
             allele_index++;
         }
     }
 
+    kmer_map.finalize();
+
     //dump_kmer_map(kmer_map);
 
     return 0;
 }
 
 int
-populate_kmer_hash(map<int, CLocus *> &catalog, KmerHashMap &kmer_map, vector<char *> &kmer_map_keys, map<int, pair<allele_type, int> > &allele_map, int kmer_len)
+populate_kmer_hash(map<int, CLocus *> &catalog, KmerIndex &kmer_map, map<int, pair<allele_type, int> > &allele_map, int kmer_len)
 {
     map<int, CLocus *>::iterator it;
-    KmerHashMap::iterator   map_it;
     vector<pair<allele_type, string> >::iterator allele;
     map<int, pair<allele_type, int> >::iterator  allele_it;
-    vector<char *> kmers;
-    Locus         *tag;
-    char          *hash_key;
+    Locus *tag;
 
     //
     // Break each stack down into k-mers and create a hash map of those k-mers
     // recording in which sequences they occur.
     //
-    int num_kmers;
     int allele_index = 0;
 
+    kmer_map.reset(kmer_len);
     allele_it = allele_map.begin();
 
     for (it = catalog.begin(); it != catalog.end(); it++) {
         tag = it->second;
 
-        num_kmers = strlen(tag->con) - kmer_len + 1;
-
         //
         // Iterate through the possible Catalog alleles
         //
@@ -371,34 +830,167 @@ populate_kmer_hash(map<int, CLocus *> &catalog, KmerHashMap &kmer_map, vector<ch
             //
             // Generate and hash the kmers for this allele string
             //
-            generate_kmers(allele->second.c_str(), kmer_len, num_kmers, kmers);
-
             allele_it = allele_map.insert(allele_it, make_pair(allele_index, make_pair(allele->first, tag->id)));
 
-            for (int j = 0; j < num_kmers; j++) {
-                hash_key = kmers[j];
-
-                map_it = kmer_map.find(hash_key);
-
-                if (map_it != kmer_map.end()) {
-                    map_it->second.push_back(allele_index);
-                    delete [] kmers[j];
-                } else {
-                    kmer_map[hash_key].push_back(allele_index);
-                    kmer_map_keys.push_back(hash_key);
-                }
-            }
-            kmers.clear();
+            kmer_map.add(allele->second.c_str(), allele->second.length(), allele_index);
 
             allele_index++;
         }
     }
 
+    kmer_map.finalize();
+
     //dump_kmer_map(kmer_map);
 
     return 0;
 }
 
+void
+CatalogKmerIndex::reset(const map<int, CLocus *> &catalog, size_t kmer_len)
+{
+    this->k_ = kmer_len;
+    this->segments_.clear();
+    this->alleles_.clear();
+    this->ranks_.clear();
+    this->n_kmers_.clear();
+    this->live_.clear();
+    this->loci_.clear();
+    this->n_live_         = 0;
+    this->n_dead_         = 0;
+    this->n_live_alleles_ = 0;
+
+    for (auto it = catalog.begin(); it != catalog.end(); it++)
+        this->add_locus(it->second);
+
+    this->segments_.push_back(Segment());
+    Segment &seg = this->segments_.back();
+    seg.begin = 0;
+    seg.end   = this->alleles_.size();
+    this->build_segment(seg, catalog);
+}
+
+void
+CatalogKmerIndex::update(const map<int, CLocus *> &catalog, const set<int> &changed)
+{
+    if (this->k_ == 0 || changed.empty())
+        return;
+
+    int first = this->alleles_.size();
+
+    for (int id : changed)
+        this->retire_locus(id);
+
+    for (int id : changed) {
+        auto it = catalog.find(id);
+        if (it != catalog.end())
+            this->add_locus(it->second);
+    }
+
+    if (this->n_dead_ > this->n_live_) {
+        this->reset(catalog, this->k_);
+        return;
+    }
+
+    Segment seg;
+    seg.begin = first;
+    seg.end   = this->alleles_.size();
+    this->build_segment(seg, catalog);
+    this->segments_.push_back(move(seg));
+
+    //
+    // Merge the newest segments while they are of comparable sizes.
+    //
+    while (this->segments_.size() >= 2) {
+        Segment &prev = this->segments_[this->segments_.size() - 2];
+        Segment &last = this->segments_.back();
+        if (prev.n_occ > 2 * last.n_occ)
+            break;
+
+        Segment merged;
+        merged.begin = prev.begin;
+        merged.end   = last.end;
+        this->build_segment(merged, catalog);
+        this->segments_.pop_back();
+        this->segments_.back() = move(merged);
+    }
+}
+
+void
+CatalogKmerIndex::lookup(const char *seq, size_t len, vector<int> &hits, vector<uint32_t> &ids) const
+{
+    for (const Segment &seg : this->segments_) {
+        size_t n = hits.size();
+        seg.index.lookup(seq, len, true, hits, ids);
+
+        //
+        // Drop the alleles that were retired since the segment was built.
+        //
+        auto end = std::remove_if(hits.begin() + n, hits.end(), [this] (int v) {return !this->live_[v];});
+        hits.erase(end, hits.end());
+    }
+}
+
+void
+CatalogKmerIndex::add_locus(const CLocus *loc)
+{
+    int first = this->alleles_.size();
+
+    for (uint32_t r = 0; r < loc->strings.size(); r++) {
+        size_t len = loc->strings[r].second.length();
+
+        this->alleles_.push_back(make_pair(loc->strings[r].first, loc->id));
+        this->ranks_.push_back(r);
+        this->n_kmers_.push_back(len >= this->k_ ? len - this->k_ + 1 : 0);
+        this->live_.push_back(true);
+
+        this->n_live_ += this->n_kmers_.back();
+        this->n_live_alleles_++;
+    }
+
+    this->loci_[loc->id] = make_pair(first, int(this->alleles_.size()));
+}
+
+void
+CatalogKmerIndex::retire_locus(int loc_id)
+{
+    auto it = this->loci_.find(loc_id);
+    if (it == this->loci_.end())
+        return;
+
+    for (int v = it->second.first; v < it->second.second; v++) {
+        this->live_[v] = false;
+        this->n_live_ -= this->n_kmers_[v];
+        this->n_dead_ += this->n_kmers_[v];
+        this->n_live_alleles_--;
+    }
+
+    this->loci_.erase(it);
+}
+
+void
+CatalogKmerIndex::build_segment(Segment &seg, const map<int, CLocus *> &catalog)
+{
+    seg.index.reset(this->k_);
+    seg.n_occ = 0;
+
+    for (int v = seg.begin; v < seg.end; v++) {
+        if (!this->live_[v]) {
+            //
+            // The postings of this allele are dropped from the index.
+            //
+            this->n_dead_ -= this->n_kmers_[v];
+            this->n_kmers_[v] = 0;
+            continue;
+        }
+
+        const string &s = catalog.at(this->alleles_[v].second)->strings[this->ranks_[v]].second;
+        seg.index.add(s.c_str(), s.length(), v);
+        seg.n_occ += this->n_kmers_[v];
+    }
+
+    seg.index.finalize();
+}
+
 int
 free_kmer_hash(CatKmerHashMap &kmer_map, vector<char *> &kmer_map_keys)
 {
@@ -415,48 +1007,125 @@ free_kmer_hash(CatKmerHashMap &kmer_map, vector<char *> &kmer_map_keys)
     return 0;
 }
 
-int
-free_kmer_hash(KmerHashMap &kmer_map, vector<char *> &kmer_map_keys)
+namespace {
+
+//
+// Mismatch kernels. Sequences are compared 16 bytes at a time with SSE2 byte
+// compares, then 8 bytes at a time on 64-bit words (a byte of `a ^ b` is
+// non-zero iff the characters differ), then one character at a time.
+//
+
+const uint64_t low7_bytes = 0x7f7f7f7f7f7f7f7fULL;
+const uint64_t high_bytes = 0x8080808080808080ULL;
+const uint64_t n_bytes    = 0x4e4e4e4e4e4e4e4eULL; // 'N' x 8
+
+// Sets the high bit of each non-zero byte of `x`, and clears all other bits.
+inline uint64_t nonzero_bytes(uint64_t x) {
+    return (((x & low7_bytes) + low7_bytes) | x) & high_bytes;
+}
+
+inline uint64_t load_word(const char *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+//
+// Counts the positions at which the first `len` characters of `p` and `q`
+// differ. Stops early, returning a count greater than `max`, once the count
+// exceeds `max`.
+//
+size_t
+count_mismatches(const char *p, const char *q, size_t len, size_t max = SIZE_MAX)
 {
-    for (uint i = 0; i < kmer_map_keys.size(); i++) {
-        kmer_map[kmer_map_keys[i]].clear();
+    size_t cnt = 0;
+    size_t i   = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (q + i));
+        cnt += 16 - __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+        if (cnt > max)
+            return cnt;
     }
-    kmer_map.clear();
+#endif
+    for (; i + 8 <= len; i += 8) {
+        cnt += __builtin_popcountll(nonzero_bytes(load_word(p + i) ^ load_word(q + i)));
+        if (cnt > max)
+            return cnt;
+    }
+    for (; i < len; i++)
+        cnt += p[i] != q[i];
 
-    for (uint i = 0; i < kmer_map_keys.size(); i++) {
-        delete [] kmer_map_keys[i];
+    return cnt;
+}
+
+//
+// Same as count_mismatches(), except that Ns match any character.
+//
+size_t
+count_mismatches_n(const char *p, const char *q, size_t len)
+{
+    size_t cnt = 0;
+    size_t i   = 0;
+#ifdef __SSE2__
+    const __m128i n = _mm_set1_epi8('N');
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (q + i));
+        __m128i skip = _mm_or_si128(_mm_cmpeq_epi8(a, b),
+                                    _mm_or_si128(_mm_cmpeq_epi8(a, n), _mm_cmpeq_epi8(b, n)));
+        cnt += 16 - __builtin_popcount(_mm_movemask_epi8(skip));
     }
-    kmer_map_keys.clear();
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a = load_word(p + i);
+        uint64_t b = load_word(q + i);
+        cnt += __builtin_popcountll(nonzero_bytes(a ^ b) & nonzero_bytes(a ^ n_bytes) & nonzero_bytes(b ^ n_bytes));
+    }
+    for (; i < len; i++)
+        cnt += p[i] != 'N' && q[i] != 'N' && p[i] != q[i];
 
-    return 0;
+    return cnt;
+}
+
+//
+// Counts the mismatches between the `n` last characters of the ranges ending
+// at `p_end` and `q_end` (inclusive), `n` being at most `max_n` and bounded by
+// the ranges beginning at `p` and `q`.
+//
+size_t
+count_end_mismatches(const char *p, const char *p_end, const char *q, const char *q_end, ptrdiff_t max_n)
+{
+    ptrdiff_t n = std::min(max_n, std::min(p_end - p + 1, q_end - q + 1));
+    if (n <= 0)
+        return 0;
+    return count_mismatches(p_end - n + 1, q_end - n + 1, n);
+}
+
+// The matching string of `allele` at `loc`, or NULL.
+const string *
+allele_string(Locus *loc, const allele_type &allele)
+{
+    const string *q = NULL;
+    for (auto it = loc->strings.begin(); it != loc->strings.end(); it++)
+        if (it->first == allele)
+            q = &it->second;
+    return q;
 }
 
-int dist(const char *tag_1, Locus *tag_2, allele_type allele) {
-    int   dist = 0;
-    const char *p     = tag_1;
-    const char *p_end = p + strlen(p);
-    const char *q     = NULL;
+}
+
+int dist(const char *tag_1, Locus *tag_2, allele_type allele, int max_dist) {
     //
     // Identify which matching string has the proper allele
     //
-    vector<pair<allele_type, string> >::iterator it;
-
-    for (it = tag_2->strings.begin(); it != tag_2->strings.end(); it++)
-        if (it->first == allele)
-            q = it->second.c_str();
+    const string *q = allele_string(tag_2, allele);
     if (q == NULL) return -1;
 
-    const char *q_end = q + strlen(q);
-
     // Count the number of characters that are different
     // between the two sequences.
-    while (p < p_end && q < q_end) {
-        dist += (*p == *q) ? 0 : 1;
-        p++;
-        q++;
-    }
-
-    return dist;
+    return count_mismatches(tag_1, q->c_str(), std::min(strlen(tag_1), q->length()), max_dist);
 }
 
 int
@@ -464,7 +1133,7 @@ dist(const char *tag_1, const char *tag_2, vector<pair<char, uint> > &cigar)
 {
     uint  size = cigar.size();
     char  op;
-    uint  dist, len_1, len_2, pos_1, pos_2, stop;
+    uint  dist, len_1, len_2, pos_1, pos_2, n;
     int   mismatches = 0;
 
     len_1 = strlen(tag_1);
@@ -490,13 +1159,15 @@ dist(const char *tag_1, const char *tag_2, vector<pair<char, uint> > &cigar)
             pos_1 += dist;
             break;
         case 'M':
-            stop = pos_1 + dist;
-            while (pos_1 < stop && pos_1 < len_1 && pos_2 < len_2) {
-                if (tag_1[pos_1] != 'N' && tag_2[pos_2] != 'N' && tag_1[pos_1] != tag_2[pos_2])
-                    mismatches++;
-                pos_1++;
-                pos_2++;
-            }
+            //
+            // Ns are not counted as mismatches.
+            //
+            if (pos_1 >= len_1 || pos_2 >= len_2)
+                break;
+            n = std::min(dist, std::min(len_1 - pos_1, len_2 - pos_2));
+            mismatches += count_mismatches_n(tag_1 + pos_1, tag_2 + pos_2, n);
+            pos_1 += n;
+            pos_2 += n;
             break;
         default:
             break;
@@ -509,11 +1180,7 @@ dist(const char *tag_1, const char *tag_2, vector<pair<char, uint> > &cigar)
 int
 dist(Locus *tag_1, Locus *tag_2)
 {
-    int   dist  = 0;
-    char *p     = tag_1->con;
-    char *q     = tag_2->con;
-    char *p_end = p + tag_1->len;
-    char *q_end = q + tag_2->len;
+    int dist = 0;
 
     if (tag_1->len != tag_2->len) {
         if (tag_1->len < tag_2->len)
@@ -526,23 +1193,15 @@ dist(Locus *tag_1, Locus *tag_2)
     // Count the number of characters that are different
     // between the two sequences.
     //
-    while (p < p_end && q < q_end) {
-        dist += (*p == *q) ? 0 : 1;
-        p++;
-        q++;
-    }
+    dist += count_mismatches(tag_1->con, tag_2->con, std::min(tag_1->len, tag_2->len));
 
     return dist;
 }
 
 int
-dist(MergedStack *tag_1, MergedStack *tag_2)
+dist(MergedStack *tag_1, MergedStack *tag_2, int max_dist)
 {
-    int   dist  = 0;
-    char *p     = tag_1->con;
-    char *q     = tag_2->con;
-    char *p_end = p + tag_1->len;
-    char *q_end = q + tag_2->len;
+    int dist = 0;
 
     //
     // If the sequences are of different lengths, count the missing
@@ -554,29 +1213,23 @@ dist(MergedStack *tag_1, MergedStack *tag_2)
         else if (tag_1->len > tag_2->len)
             dist += tag_1->len - tag_2->len;
     }
+    if (dist > max_dist)
+        return dist;
 
     //
     // Count the number of characters that are different
     // between the two sequences.
     //
-    while (p < p_end && q < q_end) {
-        dist += (*p == *q) ? 0 : 1;
-        p++;
-        q++;
-    }
+    dist += count_mismatches(tag_1->con, tag_2->con, std::min(tag_1->len, tag_2->len), max_dist - dist);
 
     return dist;
 }
 
 int
-dist(MergedStack *tag_1, char *seq)
+dist(MergedStack *tag_1, char *seq, int max_dist)
 {
-    int   dist  = 0;
-    char *p     = tag_1->con;
-    char *q     = seq;
-    uint  q_len = strlen(q);
-    char *p_end = p + tag_1->len;
-    char *q_end = q + q_len;
+    int  dist  = 0;
+    uint q_len = strlen(seq);
 
     //
     // If the sequences are of different lengths, count the missing
@@ -588,16 +1241,14 @@ dist(MergedStack *tag_1, char *seq)
         else if (tag_1->len > q_len)
             dist += tag_1->len - q_len;
     }
+    if (dist > max_dist)
+        return dist;
 
     //
     // Count the number of characters that are different
     // between the two sequences.
     //
-    while (p < p_end && q < q_end) {
-        dist += (*p == *q) ? 0 : 1;
-        p++;
-        q++;
-    }
+    dist += count_mismatches(tag_1->con, seq, std::min(tag_1->len, q_len), max_dist - dist);
 
     return dist;
 }
@@ -609,7 +1260,6 @@ bool compare_dist(pair<int, int> a, pair<int, int> b) {
 int
 check_frameshift(MergedStack *tag_1, MergedStack *tag_2, size_t mismatches)
 {
-    size_t cnt  = 0;
     size_t diff = 0;
     char const* p     = tag_1->con;
     char const* q     = tag_2->con;
@@ -628,60 +1278,36 @@ check_frameshift(MergedStack *tag_1, MergedStack *tag_2, size_t mismatches)
             q_end -= diff;
         }
     }
+    if (diff >= mismatches)
+        return 0;
 
     //
     // Count the number of characters that are different
     // at the 3' end of the sequence to test for possible frameshifts.
     //
-    size_t i = diff;
-    while (p_end >= p && q_end >= q && i < mismatches) {
-        cnt += (*p_end != *q_end) ? 1 : 0;
-        p_end--;
-        q_end--;
-        i++;
-    }
-
-    return cnt;
+    return count_end_mismatches(p, p_end, q, q_end, mismatches - diff);
 }
 
 int
 check_frameshift(const char *tag_1, Locus *tag_2, allele_type allele, size_t mismatches)
 {
-    size_t cnt = 0;
-    const char *p     = tag_1;
-    const char *q     = NULL;
     //
     // Identify which matching string has the proper allele
     //
-    vector<pair<allele_type, string> >::iterator it;
-
-    for (it = tag_2->strings.begin(); it != tag_2->strings.end(); it++)
-        if (it->first == allele)
-            q = it->second.c_str();
+    const string *q = allele_string(tag_2, allele);
     if (q == NULL) return -1;
 
-    const char *p_end = p + strlen(p) - 1;
-    const char *q_end = q + strlen(q) - 1;
-
     //
     // Count the number of characters that are different
     // at the 3' end of the sequence to test for possible frameshifts.
     //
-    size_t i = 0;
-    while (p_end >= p && q_end >= q && i < mismatches) {
-        cnt += (*p_end != *q_end) ? 1 : 0;
-        p_end--;
-        q_end--;
-        i++;
-    }
-
-    return cnt;
+    const char *q_str = q->c_str();
+    return count_end_mismatches(tag_1, tag_1 + strlen(tag_1) - 1, q_str, q_str + q->length() - 1, mismatches);
 }
 
 int
 check_frameshift(MergedStack *tag_1, const char *seq, size_t mismatches)
 {
-    int   cnt     = 0;
     const char *p = tag_1->con;
     const char *q = seq;
     uint  q_len   = strlen(q);
@@ -703,32 +1329,17 @@ check_frameshift(MergedStack *tag_1, const char *seq, size_t mismatches)
     // Count the number of characters that are different
     // at the 3' end of the sequence to test for possible frameshifts.
     //
-    size_t i = 0;
-    while (p_end >= p && q_end >= q && i < mismatches) {
-        cnt += (*p_end != *q_end) ? 1 : 0;
-        p_end--;
-        q_end--;
-        i++;
-    }
-
-    return cnt;
+    return count_end_mismatches(p, p_end, q, q_end, mismatches);
 }
 
-int dump_kmer_map(KmerHashMap &kmer_map) {
-    KmerHashMap::iterator kit;
-    vector<int>::iterator vit;
-
+int dump_kmer_map(const KmerIndex &kmer_map) {
     cerr << kmer_map.size() << " keys in the map.\n";
 
-    int i = 1;
-    for (kit = kmer_map.begin(); kit != kmer_map.end(); kit++) {
-        cerr << "Key #" << i << " " << kit->first << ": ";
-        for (vit = (kit->second).begin(); vit != (kit->second).end(); vit++)
-            cerr << " " << *vit;
+    for (uint i = 0; i < kmer_map.size() && i < 1000; i++) {
+        cerr << "Key #" << i + 1 << ": ";
+        for (const int *v = kmer_map.postings_begin(i); v != kmer_map.postings_end(i); v++)
+            cerr << " " << *v;
         cerr << "\n";
-        i++;
-
-        if (i > 1000) break;
     }
 
     return 0;
@@ -23,13 +23,16 @@
 
 #include "constants.h"
 
+#include <climits>
 #include <cmath>
 #include <cstring>
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <utility>
 #include <iostream>
+#include <mutex>
 #include <unordered_map>
 
 #include "stacks.h"
@@ -56,21 +59,248 @@ struct eqstr {
     }
 };
 
-typedef unordered_map<const char *, vector<int>, hash_charptr, eqstr> KmerHashMap;
 typedef unordered_map<const char *, vector<pair<string, int> >, hash_charptr, eqstr> CatKmerHashMap;
 
+//
+// KmerIndex -- maps fixed-length k-mers to the integer values (locus or allele
+// indexes) of the sequences they occur in.
+//
+// K-mers are packed two bits per nucleotide into uint64_t words (rolling, for
+// k <= 32) and stored in an open-addressing table; the values of all k-mers are
+// kept in one contiguous posting array. K-mers containing anything else than
+// A/C/G/T are kept as strings in a side table, so lookups remain exact.
+//
+// Values are added with add(), then finalize() builds the posting lists. Once
+// finalized, lookup() can be called concurrently from several threads.
+//
+class KmerIndex {
+public:
+    KmerIndex(size_t kmer_len = 0) {this->reset(kmer_len);}
+
+    void   reset(size_t kmer_len);
+    size_t kmer_len() const {return this->k_;}
+    size_t size()     const {return this->n_keys_;}
+
+    // Records all the k-mers of `seq` (of length `len`) as occurring in `value`.
+    void add(const char *seq, size_t len, int value);
+    void finalize();
+
+    // Appends to `hits` the values of each k-mer of `seq` found in the index.
+    // If `uniq` is true, repeated k-mers of the query are only looked up once.
+    // `ids` is scratch space, to be reused across calls by the same thread.
+    void lookup(const char *seq, size_t len, bool uniq, vector<int> &hits, vector<uint32_t> &ids) const;
+
+    // The values recorded for k-mer `id`, as [begin, end).
+    const int *postings_begin(uint32_t id) const {return this->postings_.data() + this->offsets_[id];}
+    const int *postings_end(uint32_t id)   const {return this->postings_.data() + this->offsets_[id + 1];}
+
+private:
+    size_t   k_;       // K-mer length.
+    size_t   nw_;      // Number of uint64_t words per packed k-mer.
+    uint64_t mask_;    // Mask for the last (or only) word of a k-mer.
+    uint32_t n_keys_;
+
+    vector<uint64_t>  keys_;  // Packed k-mers, `nw_` words each, by k-mer ID.
+    vector<uint32_t>  slots_; // Open-addressing table; 0 is empty, otherwise ID + 1.
+    unordered_map<string, uint32_t> amb_; // K-mers with non-ACGT characters.
+
+    vector<uint32_t> occ_ids_;  // Staged (k-mer ID, value) occurrences.
+    vector<int>      occ_vals_;
+    vector<size_t>   offsets_;  // Posting list of ID i is postings_[offsets_[i], offsets_[i+1]).
+    vector<int>      postings_;
+
+    template<typename F> void for_each_kmer(const char *seq, size_t len, F f) const;
+    uint64_t hash(const uint64_t *w) const;
+    size_t   find_slot(const uint64_t *w) const;
+    uint32_t insert(const uint64_t *w);
+    uint32_t insert(const char *kmer);
+    int64_t  find(const uint64_t *w) const;
+    int64_t  find(const char *kmer) const;
+    void     grow();
+};
+
+//
+// CatalogKmerIndex -- the k-mers of the alleles of a cstacks catalog, kept up
+// to date from sample to sample rather than rebuilt each time.
+//
+// Each allele gets an integer value; the alleles of a locus that changed are
+// retired and the locus is re-added under new values. Values are indexed in
+// immutable KmerIndex segments: the alleles added by one update form a new
+// segment, and segments of similar sizes are merged (dropping the retired
+// alleles), so that there are only a logarithmic number of them. The whole
+// index is rebuilt once retired postings outnumber live ones.
+//
+// As values are not in catalog order, callers that depend on the order of the
+// hits sort them with precedes().
+//
+class CatalogKmerIndex {
+public:
+    CatalogKmerIndex() : k_(0), n_live_(0), n_dead_(0), n_live_alleles_(0) {}
+
+    size_t kmer_len()   const {return this->k_;}
+    size_t n_segments() const {return this->segments_.size();}
+    size_t n_alleles()  const {return this->n_live_alleles_;}
+
+    // Indexes all the alleles of the catalog, with k-mers of length `kmer_len`.
+    void reset(const map<int, CLocus *> &catalog, size_t kmer_len);
+
+    // Re-indexes the loci listed in `changed`, which may have been removed from
+    // the catalog since the last update. Does nothing if the index is empty.
+    void update(const map<int, CLocus *> &catalog, const set<int> &changed);
+
+    // Appends to `hits` the values of the live alleles containing each (unique)
+    // k-mer of `seq`. Thread-safe.
+    void lookup(const char *seq, size_t len, vector<int> &hits, vector<uint32_t> &ids) const;
+
+    // The (allele, catalog locus ID) of value `v`.
+    const pair<allele_type, int> &allele(int v) const {return this->alleles_[v];}
+    // Whether value `a` comes before value `b` in catalog (locus ID, allele) order.
+    bool precedes(int a, int b) const {
+        return this->alleles_[a].second != this->alleles_[b].second
+            ? this->alleles_[a].second < this->alleles_[b].second
+            : this->ranks_[a] < this->ranks_[b];
+    }
+
+private:
+    struct Segment {
+        KmerIndex index;
+        int       begin, end; // Values [begin, end).
+        size_t    n_occ;      // Number of k-mer occurrences, when it was built.
+    };
+
+    size_t k_;
+    vector<Segment> segments_;
+
+    vector<pair<allele_type, int>>      alleles_; // By value.
+    vector<uint32_t>                    ranks_;   // Index of the allele in CLocus::strings.
+    vector<uint32_t>                    n_kmers_;
+    vector<char>                        live_;
+    unordered_map<int, pair<int, int>>  loci_;    // Locus ID -> its values [first, last).
+    size_t n_live_; // Postings of live and of retired alleles.
+    size_t n_dead_;
+    size_t n_live_alleles_;
+
+    void add_locus(const CLocus *loc);
+    void retire_locus(int loc_id);
+    void build_segment(Segment &seg, const map<int, CLocus *> &catalog);
+};
+
+//
+// KmerCounter -- counts the occurrences of fixed-length k-mers, e.g. over all
+// the reads of a dataset (kmer_filter).
+//
+// K-mers are packed two bits per nucleotide, optionally in canonical form (the
+// smaller of the k-mer and of its reverse complement), in open-addressing
+// tables of (k-mer, count) pairs; k-mers containing anything else than A/C/G/T
+// are counted as strings in a side table. K-mers longer than 32bp do not fit
+// in one word, and are all counted in the side table. The k-mer space is split into
+// partitions that each have their own lock, so that several threads can count
+// concurrently: each thread accumulates k-mers in a Batch, which add() flushes
+// partition by partition when it fills up.
+//
+class KmerCounter {
+public:
+    // A per-thread buffer of k-mers to count.
+    class Batch {
+        friend class KmerCounter;
+        vector<vector<uint64_t>> keys_; // By partition.
+        vector<string>           amb_;
+        size_t                   n_;
+    public:
+        Batch() : n_(0) {}
+    };
+
+    KmerCounter(size_t kmer_len = 0, bool canonical = false) : parts_(n_parts) {this->reset(kmer_len, canonical);}
+    KmerCounter(const KmerCounter &) = delete;
+    KmerCounter &operator= (const KmerCounter &) = delete;
+
+    // Empties the counter.
+    void   reset(size_t kmer_len, bool canonical);
+    size_t kmer_len()  const {return this->k_;}
+    bool   canonical() const {return this->canonical_;}
+    // The number of distinct k-mers.
+    size_t size() const;
+
+    // Counts the k-mers of `seq` (of length `len`). Not thread-safe.
+    void add(const char *seq, size_t len);
+    // Counts the k-mers of `seq` via `batch`. Thread-safe, as long as each
+    // thread uses its own batch; flush() must be called once done.
+    void add(Batch &batch, const char *seq, size_t len);
+    void flush(Batch &batch);
+    // Adds `n` to the count of k-mer `kmer`, and returns its previous count.
+    // Not thread-safe.
+    size_t add_kmer(const char *kmer, size_t n);
+
+    // Sets `cnts` to the count of each k-mer of `seq`, in order. Can be called
+    // concurrently, in the absence of additions.
+    void counts(const char *seq, size_t len, vector<int> &cnts) const;
+
+    // Calls f(kmer, count) for each distinct k-mer, in no particular order.
+    template<typename F> void for_each(F f) const;
+
+private:
+    static const size_t n_parts     = 64;
+    static const size_t batch_limit = 1 << 16;
+    static const size_t max_packed  = 32; // Longest k-mer that can be packed.
+
+    struct Part {
+        std::mutex       mtx;
+        vector<uint64_t> keys;
+        vector<uint32_t> cnts;  // 0 for an empty slot.
+        size_t           n;
+    };
+
+    size_t   k_;
+    bool     canonical_;
+    uint64_t mask_;
+
+    vector<Part> parts_;
+    std::mutex   amb_mtx_;
+    unordered_map<string, uint32_t> amb_;
+
+    template<typename F> void for_each_kmer(const char *seq, size_t len, F f) const;
+    string   canonical_string(const char *kmer) const;
+    static uint64_t hash(uint64_t key);
+    static size_t   part_of(uint64_t h) {return h >> 58;}
+    static size_t   find_slot(const Part &part, uint64_t key, uint64_t h);
+    static uint32_t incr(Part &part, uint64_t key, uint64_t h, size_t n); // Returns the previous count.
+    static void     grow(Part &part);
+};
+
+template<typename F>
+void
+KmerCounter::for_each(F f) const
+{
+    string kmer(this->k_, 'N');
+
+    for (const Part &part : this->parts_) {
+        for (size_t i = 0; i < part.keys.size(); i++) {
+            if (part.cnts[i] == 0)
+                continue;
+            uint64_t key = part.keys[i];
+            for (size_t j = this->k_; j > 0; j--) {
+                kmer[j - 1] = "ACGT"[key & 3];
+                key >>= 2;
+            }
+            f(kmer.c_str(), size_t(part.cnts[i]));
+        }
+    }
+
+    for (auto &it : this->amb_)
+        f(it.first.c_str(), size_t(it.second));
+}
+
 int  determine_kmer_length(int, int);
 int  calc_min_kmer_matches(int, int, int, bool);
 int  initialize_kmers(int, int, vector<char *> &);
 int  generate_kmers(const char *, int, int, vector<char *> &);
 int  generate_kmers_lazily(const char *, uint, uint, vector<char *> &);
 
-int  populate_kmer_hash(map<int, MergedStack *> &, KmerHashMap &, vector<char *> &, int);
+int  populate_kmer_hash(map<int, MergedStack *> &, KmerIndex &, int);
 int  populate_kmer_hash(map<int, Locus *> &, CatKmerHashMap &, vector<char *> &, int);
-int  populate_kmer_hash(map<int, Locus *> &, KmerHashMap &, vector<char *> &, map<int, pair<allele_type, int> > &, int);
-int  populate_kmer_hash(map<int, CLocus *> &, KmerHashMap &, vector<char *> &, map<int, pair<allele_type, int> > &, int);
+int  populate_kmer_hash(map<int, Locus *> &, KmerIndex &, map<int, pair<allele_type, int> > &, int);
+int  populate_kmer_hash(map<int, CLocus *> &, KmerIndex &, map<int, pair<allele_type, int> > &, int);
 
-int  free_kmer_hash(KmerHashMap &, vector<char *> &);
 int  free_kmer_hash(CatKmerHashMap &, vector<char *> &);
 
 int  generate_permutations(map<int, char **> &, int);
@@ -78,11 +308,16 @@ int  generate_permutations(map<int, char **> &, int);
 //
 // Utilities
 //
+//
+// The dist() functions count mismatches (for the CIGAR variant, ignoring Ns).
+// Given `max_dist`, they may stop counting once the distance exceeds it, and
+// then return a value greater than `max_dist` but not the exact distance.
+//
 int dist(const char *, const char *, vector<pair<char, uint> > &);
-int dist(const char *, Locus *, allele_type);
+int dist(const char *, Locus *, allele_type, int max_dist = INT_MAX);
 int dist(Locus *, Locus *);
-int dist(MergedStack *, MergedStack *);
-int dist(MergedStack *, char *);
+int dist(MergedStack *, MergedStack *, int max_dist = INT_MAX);
+int dist(MergedStack *, char *, int max_dist = INT_MAX);
 int check_frameshift(MergedStack *, MergedStack *, size_t);
 int check_frameshift(const char *, Locus *, allele_type, size_t);
 int check_frameshift(MergedStack *, const char *, size_t);
@@ -95,6 +330,6 @@ bool compare_dist(pair<int, int>, pair<int, int>);
 //
 // Debugging
 //
-int  dump_kmer_map(KmerHashMap &);
+int  dump_kmer_map(const KmerIndex &);
 
 #endif // __KMERS_H__
@@ -34,6 +34,7 @@ Locus::Locus(const Locus &templ)
     this->blacklisted     = templ.blacklisted;
     this->deleveraged     = templ.deleveraged;
     this->lumberjackstack = templ.lumberjackstack;
+    this->arena           = NULL;
 
     this->model = NULL;
     this->con   = NULL;
@@ -83,7 +84,7 @@ Locus::snp_index(uint col) const
 int
 Locus::add_consensus(const char *seq)
 {
-    if (this->con != NULL)
+    if (this->con != NULL && this->owns(this->con))
         delete [] this->con;
 
     this->len = strlen(seq);
@@ -96,7 +97,7 @@ Locus::add_consensus(const char *seq)
 int
 Locus::add_model(const char *seq)
 {
-    if (this->model != NULL)
+    if (this->model != NULL && this->owns(this->model))
         delete [] this->model;
 
     this->model = new char[this->len + 1];
@@ -262,7 +263,8 @@ remove_snps_from_gaps(Cigar &cigar, Locus *loc)
         case 'D':
             stop = bp + dist;
             while (bp < stop) {
-                delete loc->snps[bp];
+                if (loc->owns(loc->snps[bp]))
+                    delete loc->snps[bp];
                 bp++;
             }
             break;
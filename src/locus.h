@@ -33,6 +33,7 @@
 #include "MetaPopInfo.h"
 #include "Alignment.h"
 #include "aln_utils.h"
+#include "LocusArena.h"
 
 class Match {
  public:
@@ -84,6 +85,7 @@ class Locus {
     vector<SNP *>           snps;   // Single Nucleotide Polymorphisms in this stack.
     map<string, int>     alleles;   // Map of the allelic configuration of SNPs in this stack along with the count of each
     vector<pair<allele_type, string>> strings; // Strings for matching (representing the various allele combinations)
+    LocusArena              *arena; // If set, owns the strings and SNPs of this locus that it contains.
 
     Locus()  {
         id              = 0;
@@ -95,18 +97,21 @@ class Locus {
         blacklisted     = false;
         deleveraged     = false;
         lumberjackstack = false;
+        arena           = NULL;
     }
     Locus(const Locus &other);
     virtual ~Locus() {
-        delete [] con;
-        delete [] model;
+        if (owns(con))   delete [] con;
+        if (owns(model)) delete [] model;
         for (uint i = 0; i < snps.size(); i++)
-            delete snps[i];
+            if (owns(snps[i])) delete snps[i];
         for (uint i = 0; i < comp.size(); i++)
-            delete [] comp[i];
+            if (owns(comp[i])) delete [] comp[i];
         for (uint i = 0; i < reads.size(); i++)
-            delete [] reads[i];
+            if (owns(reads[i])) delete [] reads[i];
     }
+    // Whether `p` should be deleted by the locus (i.e. is not in its arena).
+    bool owns(const void *p) const {return arena == NULL || !arena->contains(p);}
     uint sort_bp() const {return this->loc.bp;}
     uint sort_bp(uint col0) const {return this->loc.bp + (this->loc.strand==strand_plus ? col0 : -col0);}
     int snp_index(uint) const;
@@ -115,6 +120,59 @@ class Locus {
     virtual int populate_alleles();
 };
 
+//
+// LociIndex: array-based access to the loci of a map, once it is complete.
+//
+// OpenMP loops iterate over `loci()` (in ID order) instead of collecting the
+// keys of the map and looking each of them up, and find() looks IDs up in a
+// dense ID -> rank vector (for sparse IDs, by binary search).
+//
+template<class LocusT>
+class LociIndex {
+    vector<LocusT *> loci_;
+    vector<uint32_t> rank_; // rank + 1 of ID `min_id_ + i`, or 0.
+    int              min_id_;
+
+public:
+    LociIndex() : loci_(), rank_(), min_id_(0) {}
+    explicit LociIndex(const map<int, LocusT *> &m) : LociIndex() {build(m);}
+
+    void build(const map<int, LocusT *> &m) {
+        loci_.clear();
+        rank_.clear();
+        loci_.reserve(m.size());
+        for (auto &l : m)
+            loci_.push_back(l.second);
+        if (m.empty())
+            return;
+        min_id_ = m.begin()->first;
+        size_t range = size_t(int64_t(m.rbegin()->first) - min_id_) + 1;
+        if (range > 4 * m.size() + 1024)
+            return;
+        rank_.assign(range, 0);
+        uint32_t r = 0;
+        for (auto &l : m)
+            rank_[l.first - min_id_] = ++r;
+    }
+
+    size_t size() const {return loci_.size();}
+    const vector<LocusT *> &loci() const {return loci_;}
+    LocusT *operator[](size_t rank) const {return loci_[rank];}
+
+    // Returns NULL if there is no locus with this ID.
+    LocusT *find(int id) const {
+        if (!rank_.empty()) {
+            if (id < min_id_ || size_t(int64_t(id) - min_id_) >= rank_.size())
+                return NULL;
+            uint32_t r = rank_[id - min_id_];
+            return r == 0 ? NULL : loci_[r - 1];
+        }
+        auto it = std::lower_bound(loci_.begin(), loci_.end(), id,
+                                   [] (const LocusT *l, int id) {return l->id < id;});
+        return it != loci_.end() && (*it)->id == id ? *it : NULL;
+    }
+};
+
 //
 // Query Locus Class
 //
@@ -123,6 +181,7 @@ class QLocus : public Locus {
     vector<Match *> matches;   // Matching tags found for the catalog.
 
     QLocus(): Locus() {}
+    QLocus(const Locus &other): Locus(other) {}
     QLocus(const QLocus &other);
     ~QLocus();
 
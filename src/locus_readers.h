@@ -91,16 +91,44 @@ public:
         OnlineMeanVar insert_lengths_mv;
 
         size_t n_read_pairs() const {return insert_lengths_mv.n();}
+
+        LocStats& operator+= (const LocStats&);
+    };
+
+    // A section of the genome, from `first` (included) to `last` (excluded),
+    // as (chromosome, bp) pairs; c.f. `plan_regions()`. If `unplaced` is set,
+    // it also comprises the unplaced records at the end of the files.
+    struct Region {
+        pair<int32_t,int32_t> first;
+        pair<int32_t,int32_t> last;
+        bool unplaced;
+
+        bool contains(int32_t chrom, int32_t bp) const
+            {return chrom < 0 ? unplaced : (pair<int32_t,int32_t>(chrom, bp) >= first && pair<int32_t,int32_t>(chrom, bp) < last);}
     };
 
     // Constructs the object from a list of BAM file objects. If `samples` is
     // given, its size must be the same as that of `bam_fs`, and
     BamCLocBuilder(vector<Bam*>&& bam_fs, const Config& cfg, const vector<string>& samples={});
-    ~BamCLocBuilder() {for(Bam* bam_f : bam_fs_) delete bam_f;}
+    // Constructs a builder for the loci whose cutsite lies in `region` only,
+    // for regions to be processed in parallel. The files must be indexed.
+    // Records are counted in the statistics of the region of their position,
+    // and loci are numbered from 1 in each region.
+    BamCLocBuilder(vector<Bam*>&& bam_fs, const Config& cfg, const Region& region, const vector<string>& samples={});
+    ~BamCLocBuilder() {close();}
 
     // Reads one locus. Returns false on EOF.
     bool build_one_locus(CLocAlnSet& readset);
 
+    // Closes the files once all the loci have been built. (The statistics and
+    // `mpopi()`, which the loci refer to, remain available.)
+    void close() {for(Bam* bam_f : bam_fs_) delete bam_f; bam_fs_.clear();}
+
+    // Splits the genome in about `n` regions of similar numbers of records,
+    // based on the indexes of the files. Large chromosomes are divided in
+    // several regions. Returns an empty vector if a file has no index.
+    static vector<Region> plan_regions(const vector<Bam*>& bam_fs, size_t n);
+
     const MetaPopInfo& mpopi() const {return bpopi_.mpopi();}
     const vector<Bam*>& bam_fs() const {return bam_fs_;}
     const vector<BamStats>& bam_stats_per_sample() const {return bam_stats_;}
@@ -132,6 +160,10 @@ private:
     vector<BamStats> bam_stats_;
     LocStats loc_stats_;
 
+    bool sharded_; // Whether we're building the loci of `region_` only.
+    Region region_;
+    BamStats margin_stats_; // (For the records outside of `region_`, which aren't counted.)
+
     bool next_record(size_t bam_f_i);
     bool next_record() {return next_record(0);}
     vector<BamRecord> next_records_; // The next record past the current window, for each file.
@@ -141,11 +173,34 @@ private:
     bool fill_window();
     void move_next_record_to_the_window(size_t bam_f_i);
     typedef size_t SampleIdx;
-    map<Pos5,vector<pair<BamRecord,SampleIdx>>> fw_reads_by_5prime_pos_;
-    std::multimap<Pos5,pair<BamRecord,SampleIdx>> pe_reads_by_5prime_pos_;
-    map<const char*,
-        std::multimap<Pos5,pair<BamRecord,SampleIdx>>::iterator,
-        LessCStrs> pe_reads_by_name_;
+    struct WindowRead {
+        Pos5 pos5;
+        size_t rank; // Order of arrival.
+        BamRecord rec; // (Empty once the read has been used.)
+        SampleIdx sample;
+    };
+    // The forward and paired-end reads of the window, in flat arrays sorted by
+    // 5prime position then order of arrival. The reads before `*_begin_` have
+    // left the window. (Reads mostly arrive in order, so insertions are near
+    // the end.)
+    vector<WindowRead> fw_window_;
+    size_t fw_begin_;
+    vector<WindowRead> pe_window_;
+    size_t pe_begin_;
+    size_t n_pe_reads_; // (Not counting those that have been used.)
+    size_t n_arrived_;
+    // Paired-end reads by name, through a hash of the name; values are the
+    // (5prime position, rank) keys of the reads in `pe_window_`.
+    unordered_map<uint64_t,pair<Pos5,size_t>> pe_reads_by_name_;
+    static uint64_t hash_qname(const char* qname);
+    static void insert_sorted(vector<WindowRead>& window, size_t begin, WindowRead&& read);
+    static void compact(vector<WindowRead>& window, size_t& begin);
+    WindowRead& find_pe_read(const pair<Pos5,size_t>& key);
+
+    vector<pair<BamRecord,SampleIdx>> loc_records_; // The forward reads of the locus being built.
+    // Records are recycled, for their buffers to be reused.
+    vector<BamRecord> spare_records_;
+    void release(BamRecord& rec);
 };
 
 class VcfCLocReader {
@@ -496,8 +551,20 @@ BamCLocBuilder::BamCLocBuilder(
     bpopi_(samples.empty() ? BamPopInfo(bam_fs_) : BamPopInfo(bam_fs_, samples)),
     bam_stats_(bpopi_.mpopi().samples().size()),
     loc_stats_(),
+    sharded_(false),
+    region_ {{0, 0}, {INT32_MAX, 0}, true},
+    margin_stats_(),
     next_records_(bam_fs_.size()),
-    treat_next_records_as_fw_(bam_fs_.size())
+    treat_next_records_as_fw_(bam_fs_.size()),
+    fw_window_(),
+    fw_begin_(0),
+    pe_window_(),
+    pe_begin_(0),
+    n_pe_reads_(0),
+    n_arrived_(0),
+    pe_reads_by_name_(),
+    loc_records_(),
+    spare_records_()
 {
     if (!cfg_.paired)
         cfg_.max_insert_refsize = 0;
@@ -516,6 +583,116 @@ BamCLocBuilder::BamCLocBuilder(
     }
 }
 
+inline
+BamCLocBuilder::BamCLocBuilder(
+        vector<Bam*>&& bam_fs,
+        const Config& cfg,
+        const Region& region,
+        const vector<string>& samples
+) :
+    BamCLocBuilder(move(bam_fs), cfg, samples)
+{
+    sharded_ = true;
+    region_ = region;
+
+    //
+    // Read the records that overlap the region and its margins: loci need the
+    // paired-end reads that are within `max_insert_refsize` of their cutsite,
+    // and the cutsites of minus strand reads are at their end.
+    //
+    vector<BamRegion> query;
+    int32_t margin = cfg_.max_insert_refsize;
+    int32_t n_chroms = bam_fs_.at(0)->h().n_ref_chroms();
+    for (int32_t chrom = region_.first.first; chrom <= region_.last.first && chrom < n_chroms; ++chrom) {
+        if (chrom == region_.last.first && region_.last.second == 0)
+            break;
+        int32_t beg = chrom == region_.first.first ? std::max(0, region_.first.second - margin) : 0;
+        int32_t end = chrom == region_.last.first ? region_.last.second + margin + 1 : INT32_MAX;
+        query.push_back({chrom, beg, end});
+    }
+    if (region_.unplaced)
+        query.push_back({HTS_IDX_NOCOOR, 0, 0});
+    assert(!query.empty());
+    for (Bam* bam_f : bam_fs_) {
+        if (!bam_f->load_index()) {
+            cerr << "Error: Failed to load the index of BAM file '" << bam_f->path << "'.\n";
+            throw exception();
+        }
+        bam_f->set_regions(vector<BamRegion>(query));
+    }
+}
+
+inline
+vector<BamCLocBuilder::Region> BamCLocBuilder::plan_regions(const vector<Bam*>& bam_fs, size_t n)
+{
+    const BamHeader& h = bam_fs.at(0)->h();
+    int32_t n_chroms = h.n_ref_chroms();
+    if (n_chroms == 0 || n == 0)
+        return {};
+
+    //
+    // Weigh the chromosomes by their number of records (or by their length, if
+    // an index lacks this information).
+    //
+    vector<double> weights (n_chroms, 0.0);
+    bool by_length = false;
+    for (Bam* bam_f : bam_fs) {
+        if (!bam_f->load_index())
+            return {};
+        for (int32_t chrom=0; chrom<n_chroms && !by_length; ++chrom) {
+            int64_t n_mapped = bam_f->index_n_mapped(chrom);
+            if (n_mapped < 0)
+                by_length = true;
+            else
+                weights[chrom] += n_mapped;
+        }
+    }
+    if (by_length)
+        for (int32_t chrom=0; chrom<n_chroms; ++chrom)
+            weights[chrom] = h.chrom_len(chrom);
+    double target = std::accumulate(weights.begin(), weights.end(), 0.0) / n;
+
+    //
+    // Group small chromosomes, split large ones.
+    //
+    vector<Region> regions;
+    pair<int32_t,int32_t> first (0, 0);
+    double acc = 0.0;
+    for (int32_t chrom=0; chrom<n_chroms; ++chrom) {
+        if (weights[chrom] > 1.5 * target) {
+            if (acc > 0.0) {
+                regions.push_back({first, {chrom, 0}, false});
+                first = {chrom, 0};
+                acc = 0.0;
+            }
+            size_t n_parts = std::round(weights[chrom] / target);
+            int32_t len = h.chrom_len(chrom);
+            for (size_t i=1; i<n_parts; ++i) {
+                pair<int32_t,int32_t> last (chrom, int32_t(double(len) * i / n_parts));
+                if (last.second > first.second) {
+                    regions.push_back({first, last, false});
+                    first = last;
+                }
+            }
+            regions.push_back({first, {chrom+1, 0}, false});
+            first = {chrom+1, 0};
+        } else {
+            acc += weights[chrom];
+            if (acc >= target) {
+                regions.push_back({first, {chrom+1, 0}, false});
+                first = {chrom+1, 0};
+                acc = 0.0;
+            }
+        }
+    }
+    if (first.first < n_chroms)
+        regions.push_back({first, {n_chroms, 0}, false});
+    regions.back().last = {INT32_MAX, 0};
+    regions.back().unplaced = true;
+
+    return regions;
+}
+
 inline
 BamCLocBuilder::BamStats& BamCLocBuilder::BamStats::operator+= (const BamCLocBuilder::BamStats& other)
 {
@@ -531,6 +708,15 @@ BamCLocBuilder::BamStats& BamCLocBuilder::BamStats::operator+= (const BamCLocBui
     return *this;
 }
 
+inline
+BamCLocBuilder::LocStats& BamCLocBuilder::LocStats::operator+= (const BamCLocBuilder::LocStats& other)
+{
+    n_loci_built += other.n_loci_built;
+    n_fw_reads += other.n_fw_reads;
+    insert_lengths_mv += other.insert_lengths_mv;
+    return *this;
+}
+
 inline
 bool BamCLocBuilder::next_record(size_t bam_f_i)
 {
@@ -538,10 +724,14 @@ bool BamCLocBuilder::next_record(size_t bam_f_i)
     BamRecord& r = next_records_[bam_f_i];
     uchar& treat_as_fw = treat_next_records_as_fw_[bam_f_i];
 
+    if (r.empty() && !spare_records_.empty()) {
+        r = move(spare_records_.back());
+        spare_records_.pop_back();
+    }
     while (true) {
         if(!bam_f->next_record_ordered(r))
             return false;
-        BamStats& bstats = bam_stats_[bpopi_.sample_of(r, bam_f_i)];
+        BamStats& bstats = region_.contains(r.chrom(), r.pos()) ? bam_stats_[bpopi_.sample_of(r, bam_f_i)] : margin_stats_;
         ++bstats.n_records;
 
         if (cfg_.ign_pe_reads && r.is_read2()) {
@@ -633,9 +823,8 @@ void BamCLocBuilder::move_next_record_to_the_window(size_t bam_f_i)
 {
     //
     // See `fill_window()`.
-    // This inserts `next_record_` into `fw_reads_by_5prime_pos_` (if it is a
-    // forward read or treated as such) or `pe_reads_by_5prime_pos_` (if it is
-    // a paired-end read).
+    // This inserts `next_record_` into `fw_window_` (if it is a forward read
+    // or treated as such) or `pe_window_` (if it is a paired-end read).
     //
 
     BamRecord& rec = next_records_[bam_f_i];
@@ -655,18 +844,72 @@ void BamCLocBuilder::move_next_record_to_the_window(size_t bam_f_i)
     size_t sample = bpopi_.sample_of(rec, bam_f_i);
 
     // Save the record.
+    size_t rank = n_arrived_++;
     if (treat_next_records_as_fw_[bam_f_i]) {
-        auto locus_itr = fw_reads_by_5prime_pos_.insert(
-                std::make_pair(move(rec_5prime_pos), vector<pair<BamRecord,SampleIdx>>())
-                ).first;
-        locus_itr->second.push_back({move(rec), sample});
+        insert_sorted(fw_window_, fw_begin_, {rec_5prime_pos, rank, move(rec), sample});
     } else {
-        auto pe_read_itr = pe_reads_by_5prime_pos_.insert(
-                std::make_pair(move(rec_5prime_pos), std::make_pair(move(rec), move(sample)))
-                );
-        // Also add an entry in the {pe_read_name : pe_record} map.
-        pe_reads_by_name_.insert( {pe_read_itr->second.first.qname(), pe_read_itr} );
+        // Also add an entry in the {pe_read_name : pe_record} map. (If there
+        // already is a read of that name, it is kept.)
+        pe_reads_by_name_.insert({hash_qname(rec.qname()), {rec_5prime_pos, rank}});
+        insert_sorted(pe_window_, pe_begin_, {rec_5prime_pos, rank, move(rec), sample});
+        ++n_pe_reads_;
+    }
+}
+
+inline
+uint64_t BamCLocBuilder::hash_qname(const char* qname)
+{
+    // FNV-1a.
+    uint64_t h = 14695981039346656037ULL;
+    for (const char* p = qname; *p; ++p) {
+        h ^= uchar(*p);
+        h *= 1099511628211ULL;
     }
+    return h;
+}
+
+inline
+void BamCLocBuilder::insert_sorted(vector<WindowRead>& window, size_t begin, WindowRead&& read)
+{
+    if (window.size() == begin || !(read.pos5 < window.back().pos5)) {
+        window.push_back(move(read));
+        return;
+    }
+    auto pos = std::upper_bound(window.begin() + begin, window.end(), read.pos5,
+            [] (const Pos5& p, const WindowRead& r) {return p < r.pos5;});
+    window.insert(pos, move(read));
+}
+
+inline
+void BamCLocBuilder::compact(vector<WindowRead>& window, size_t& begin)
+{
+    if (begin == window.size()) {
+        window.clear();
+        begin = 0;
+    } else if (begin >= 1024 && begin >= window.size() / 2) {
+        window.erase(window.begin(), window.begin() + begin);
+        begin = 0;
+    }
+}
+
+inline
+BamCLocBuilder::WindowRead& BamCLocBuilder::find_pe_read(const pair<Pos5,size_t>& key)
+{
+    auto pos = std::lower_bound(pe_window_.begin() + pe_begin_, pe_window_.end(), key.first,
+            [] (const WindowRead& r, const Pos5& p) {return r.pos5 < p;});
+    while (pos != pe_window_.end() && pos->rank != key.second)
+        ++pos;
+    assert(pos != pe_window_.end() && !pos->rec.empty());
+    return *pos;
+}
+
+inline
+void BamCLocBuilder::release(BamRecord& rec)
+{
+    if (spare_records_.size() < 4096)
+        spare_records_.push_back(move(rec));
+    else
+        rec.destroy();
 }
 
 inline
@@ -679,12 +922,12 @@ bool BamCLocBuilder::fill_window()
      * is within `max_insert_size` bases of the first base of the leftmost
      * cutsite is loaded.
      *
-     * `fw_reads_by_5prime_pos_` is a map of {[first cutsite base pos] : BamRecord}
+     * `fw_window_` holds the reads by [first cutsite base pos].
      * Cutsites can be on the left or right of the read alignment depending on the
      * strand, but this is easy to handle since `BamCLocBuilder::next_record()`
      * ensures that the BAM record's TLEN field is properly set.
      *
-     * `pe_reads_by_5prime_pos_` also uses the 5prime position (i.e. that has been
+     * `pe_window_` also uses the 5prime position (i.e. that has been
      * tlen-corrected if the strand is minus) to ease insert lengths computations.
      * Paired-end reads need to be sorted by position so that we can discard those
      * that were not matched and have become too far behind to find one at the given
@@ -699,6 +942,9 @@ bool BamCLocBuilder::fill_window()
             if (!bam_f->eof()) {
                 if (rec.empty()) {
                     if (!next_record(bam_f_i)) {
+                        if (sharded_)
+                            // (The region is empty in this file.)
+                            continue;
                         if (bam_fs_[bam_f_i]->n_records_read() == 0)
                             cerr << "Error: No BAM records.\n";
                         else
@@ -707,16 +953,16 @@ bool BamCLocBuilder::fill_window()
                     }
                     assert(!rec.empty());
                 }
-                while (!bam_f->eof() && fw_reads_by_5prime_pos_.empty()) {
+                while (!bam_f->eof() && fw_begin_ == fw_window_.size()) {
                     move_next_record_to_the_window(bam_f_i); // (Note: We may have read a paired-end read.)
                     next_record(bam_f_i);
                 }
 
                 while (!bam_f->eof()
                         && (
-                            rec.chrom() < fw_reads_by_5prime_pos_.begin()->first.chrom
-                            || (rec.chrom() == fw_reads_by_5prime_pos_.begin()->first.chrom
-                                && size_t(rec.pos()) <= fw_reads_by_5prime_pos_.begin()->first.bp + cfg_.max_insert_refsize)
+                            rec.chrom() < fw_window_[fw_begin_].pos5.chrom
+                            || (rec.chrom() == fw_window_[fw_begin_].pos5.chrom
+                                && size_t(rec.pos()) <= fw_window_[fw_begin_].pos5.bp + cfg_.max_insert_refsize)
                         )
                 ) {
                     move_next_record_to_the_window(bam_f_i);
@@ -730,7 +976,7 @@ bool BamCLocBuilder::fill_window()
         }
     }
 
-    if (fw_reads_by_5prime_pos_.empty()) {
+    if (fw_begin_ == fw_window_.size()) {
         #ifndef NDEBUG
         for (Bam* bam_f : bam_fs_)
             assert(bam_f->eof());
@@ -740,18 +986,22 @@ bool BamCLocBuilder::fill_window()
 
     if (cfg_.paired) {
         // Clean up paired-end reads that are too far behind.
-        Pos5 leftmost_cutsite = fw_reads_by_5prime_pos_.begin()->first;
-        while (!pe_reads_by_5prime_pos_.empty()
-                && (
-                    pe_reads_by_5prime_pos_.begin()->first.chrom < leftmost_cutsite.chrom
-                    || (pe_reads_by_5prime_pos_.begin()->first.chrom == leftmost_cutsite.chrom
-                        && pe_reads_by_5prime_pos_.begin()->first.bp + cfg_.max_insert_refsize < size_t(leftmost_cutsite.bp) + 1)
-                )
-        ) {
-            pe_reads_by_name_.erase(pe_reads_by_5prime_pos_.begin()->second.first.qname());
-            pe_reads_by_5prime_pos_.erase(pe_reads_by_5prime_pos_.begin());
+        Pos5 leftmost_cutsite = fw_window_[fw_begin_].pos5;
+        while (pe_begin_ < pe_window_.size()) {
+            WindowRead& pe_read = pe_window_[pe_begin_];
+            if (!pe_read.rec.empty()) {
+                if (!(pe_read.pos5.chrom < leftmost_cutsite.chrom
+                        || (pe_read.pos5.chrom == leftmost_cutsite.chrom
+                            && pe_read.pos5.bp + cfg_.max_insert_refsize < size_t(leftmost_cutsite.bp) + 1)))
+                    break;
+                pe_reads_by_name_.erase(hash_qname(pe_read.rec.qname()));
+                release(pe_read.rec);
+                --n_pe_reads_;
+            }
+            ++pe_begin_;
         }
-        // N.B. `pe_reads_by_5prime_pos_` may contain reads for further-ranked
+        compact(pe_window_, pe_begin_);
+        // N.B. `pe_window_` may contain reads for further-ranked
         // chromosomes. This happens when:
         // * we are reading from multiple BAM,
         // * the window starts out empty,
@@ -760,7 +1010,7 @@ bool BamCLocBuilder::fill_window()
         //   previous chromosome when we arrive to a sample that still has
         //   alignments there.
     } else {
-        assert(pe_reads_by_5prime_pos_.empty());
+        assert(pe_window_.empty());
     }
 
     return true;
@@ -776,20 +1026,41 @@ bool BamCLocBuilder::build_one_locus(CLocAlnSet& aln_loc)
     //
 
     vector<SampleIdx> fw_samples;
+    vector<pair<BamRecord,SampleIdx>>& loc_records = loc_records_;
+    Pos5 cutsite;
     while(true) {
         //
         // Fill the window.
         //
         if (!fill_window())
             return false;
-        assert(!fw_reads_by_5prime_pos_.empty());
+        assert(fw_begin_ < fw_window_.size());
+        cutsite = fw_window_[fw_begin_].pos5;
+
+        if (sharded_ && !region_.contains(cutsite.chrom, cutsite.bp)
+                && pair<int32_t,int32_t>(cutsite.chrom, cutsite.bp) >= region_.last)
+            return false;
+
+        // Take the reads of the putative locus out of the window.
+        assert(loc_records.empty());
+        for (; fw_begin_ < fw_window_.size() && !(cutsite < fw_window_[fw_begin_].pos5); ++fw_begin_) {
+            WindowRead& r = fw_window_[fw_begin_];
+            loc_records.push_back({move(r.rec), r.sample});
+        }
+        compact(fw_window_, fw_begin_);
+
+        if (sharded_ && !region_.contains(cutsite.chrom, cutsite.bp)) {
+            // Loci whose cutsite is in the margins belong to other regions.
+            for (auto& r : loc_records)
+                release(r.first);
+            loc_records.clear();
+            continue;
+        }
 
         //
         // Apply filters to the putative locus.
         //
 
-        vector<pair<BamRecord,SampleIdx>>& loc_records = fw_reads_by_5prime_pos_.begin()->second;
-
         // Get the samples of the records, and tally sample occurrences.
         vector<size_t> n_reads_per_sample (mpopi().samples().size(), 0);
         for (const pair<BamRecord,SampleIdx>& r : loc_records)
@@ -799,7 +1070,7 @@ bool BamCLocBuilder::build_one_locus(CLocAlnSet& aln_loc)
         for (pair<BamRecord,SampleIdx>& r : loc_records)
             if (n_reads_per_sample[r.second] < cfg_.min_reads_per_sample)
                 // Bad sample, mark the record for deletion.
-                r.first.destroy();
+                release(r.first);
         loc_records.erase(std::remove_if(
                 loc_records.begin(), loc_records.end(),
                 [] (const pair<BamRecord,SampleIdx>& r) { return r.first.empty(); }
@@ -812,14 +1083,16 @@ bool BamCLocBuilder::build_one_locus(CLocAlnSet& aln_loc)
                 fw_samples.push_back(r.second);
             std::sort(fw_samples.begin(), fw_samples.end());
             fw_samples.erase(std::unique(fw_samples.begin(), fw_samples.end()), fw_samples.end());
-            if (fw_samples.size() < cfg_.min_samples_per_locus)
+            if (fw_samples.size() < cfg_.min_samples_per_locus) {
                 // Not enough, discard the locus.
+                for (auto& r : loc_records)
+                    release(r.first);
                 loc_records.clear();
+            }
         }
 
         if (loc_records.empty()) {
             // Discard the locus; regenerate the window and retry.
-            fw_reads_by_5prime_pos_.erase(fw_reads_by_5prime_pos_.begin());
             continue;
         }
         break;
@@ -830,14 +1103,13 @@ bool BamCLocBuilder::build_one_locus(CLocAlnSet& aln_loc)
     //
 
     // Position.
-    Pos5 cutsite = fw_reads_by_5prime_pos_.begin()->first;
     PhyLoc loc_pos (bam_fs_.at(0)->h().chrom_str(cutsite.chrom),
                     cutsite.bp,
                     cutsite.strand ? strand_plus : strand_minus);
     size_t max_ref_span = 0;
 
     // Forward reads.
-    const vector<pair<BamRecord,SampleIdx>>& fw_records = fw_reads_by_5prime_pos_.begin()->second;
+    const vector<pair<BamRecord,SampleIdx>>& fw_records = loc_records;
     vector<SAlnRead> fw_reads;
     for (const pair<BamRecord,SampleIdx>& pair : fw_records) {
         const BamRecord& r = pair.first;
@@ -873,19 +1145,22 @@ bool BamCLocBuilder::build_one_locus(CLocAlnSet& aln_loc)
 
     // Paired-end reads.
     vector<SAlnRead> pe_reads;
-    if (!pe_reads_by_5prime_pos_.empty()) {
+    if (n_pe_reads_ > 0) {
         for (auto& fw_pair : fw_records) {
             const BamRecord& fw_rec = fw_pair.first;
 
             // Find a mate.
-            auto pe_name_itr = pe_reads_by_name_.find(fw_rec.qname());
+            auto pe_name_itr = pe_reads_by_name_.find(hash_qname(fw_rec.qname()));
             if (pe_name_itr == pe_reads_by_name_.end())
                 continue;
-            std::multimap<Pos5,pair<BamRecord,SampleIdx>>::iterator pe_rec_itr = pe_name_itr->second;
+            WindowRead& pe_read = find_pe_read(pe_name_itr->second);
+            if (strcmp(pe_read.rec.qname(), fw_rec.qname()) != 0)
+                // (Hash collision.)
+                continue;
 
-            Pos5 pe_pos5 = pe_rec_itr->first;
-            const BamRecord& pe_rec = pe_rec_itr->second.first;
-            size_t pe_sample = pe_rec_itr->second.second;
+            Pos5 pe_pos5 = pe_read.pos5;
+            const BamRecord& pe_rec = pe_read.rec;
+            size_t pe_sample = pe_read.sample;
 
             // Check that the mate is in the window and that the reads don't
             // extend past one another. //xxx Oct 2017 @Nick: This may actually
@@ -951,7 +1226,8 @@ bool BamCLocBuilder::build_one_locus(CLocAlnSet& aln_loc)
 
             loc_stats_.insert_lengths_mv.increment(insert_length);
             pe_reads_by_name_.erase(pe_name_itr);
-            pe_reads_by_5prime_pos_.erase(pe_rec_itr);
+            release(pe_read.rec);
+            --n_pe_reads_;
         }
     }
 
@@ -967,7 +1243,9 @@ bool BamCLocBuilder::build_one_locus(CLocAlnSet& aln_loc)
         aln_loc.add(move(read));
     }
 
-    fw_reads_by_5prime_pos_.erase(fw_reads_by_5prime_pos_.begin());
+    for (auto& r : loc_records)
+        release(r.first);
+    loc_records.clear();
     return true;
 }
 
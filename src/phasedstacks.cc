@@ -41,6 +41,8 @@ double minor_freq_lim   = 0.1;
 double min_inform_pairs = 0.90;
 uint   max_pair_dist    = 1000000;
 uint   bucket_dist      = 5000;
+uint   ld_window_bp     = 0;
+uint   ld_window_snps   = 0;
 double dprime_threshold = false;
 double dprime_threshold_level = 0.0;
 
@@ -80,6 +82,10 @@ int main (int argc, char* argv[]) {
     }
     cerr << " input files.\n"
          << "Size of buckets for binning D' values at a particular distance: " << bucket_dist / 1000 << "kb.\n";
+    if (ld_window_bp > 0)
+        cerr << "Computing D' for pairs of SNPs at most " << ld_window_bp << "bp apart.\n";
+    if (ld_window_snps > 0)
+        cerr << "Computing D' for pairs of SNPs at most " << ld_window_snps << " SNPs apart.\n";
     if (dprime_threshold)
         cerr << "D' Threshold set at " << dprime_threshold_level << ". D' values above this limit will be set to 1.0, values below will be set to 0.0.\n";
 
@@ -264,13 +270,13 @@ bucket_dprime(vector<double> &dprime_buckets, vector<double> &dprime_bucket_cnts
     // SNPs on this chromosome and add buckets as necessary.
     //
     for (uint i = 0; i < psum->size; i++) {
-        for (uint j = i+1; j < psum->size; j++) {
+        for (uint j = i+1; j < psum->pairs_end(i); j++) {
 
             if (psum->nucs[i].freq < minor_freq_lim ||
                 psum->nucs[j].freq < minor_freq_lim)
                 continue;
 
-            if (write_zeros == false && psum->dprime[i][j].chisq_p == false)
+            if (write_zeros == false && psum->dprime(i, j).chisq_p == false)
                 continue;
 
             dist     = psum->nucs[j].bp - psum->nucs[i].bp;
@@ -278,7 +284,7 @@ bucket_dprime(vector<double> &dprime_buckets, vector<double> &dprime_bucket_cnts
         }
     }
     max_bucket = max_dist / bucket_dist;
-    if (dprime_buckets.size() < max_bucket) {
+    if (dprime_buckets.size() <= max_bucket) {
         uint cnt = max_bucket + 1 - dprime_buckets.size();
         for (uint i = 0; i < cnt; i++) {
             dprime_buckets.push_back(0.0);
@@ -290,18 +296,18 @@ bucket_dprime(vector<double> &dprime_buckets, vector<double> &dprime_bucket_cnts
     // Populate buckets
     //
     for (uint i = 0; i < psum->size; i++) {
-        for (uint j = i+1; j < psum->size; j++) {
+        for (uint j = i+1; j < psum->pairs_end(i); j++) {
 
             if (psum->nucs[i].freq < minor_freq_lim ||
                 psum->nucs[j].freq < minor_freq_lim)
                 continue;
 
-            if (write_zeros == false && psum->dprime[i][j].chisq_p == false)
+            if (write_zeros == false && psum->dprime(i, j).chisq_p == false)
                 continue;
 
             bucket = ((psum->nucs[j].bp - psum->nucs[i].bp) / bucket_dist);
 
-            dprime_buckets[bucket] += (psum->dprime[i][j].chisq_p ? psum->dprime[i][j].dprime : 0.0);
+            dprime_buckets[bucket] += (psum->dprime(i, j).chisq_p ? psum->dprime(i, j).dprime : 0.0);
             dprime_bucket_cnts[bucket]++;
         }
     }
@@ -383,12 +389,16 @@ four_gamete_test(string path, map<string, int> &pop_map, PhasedSummary *psum, ma
                 continue;
             }
 
-            for (int k = j; k >= (int) start; k--) {
+            //
+            // The rows of pairs only grow along the chromosome, so once SNP k is out of
+            // the window of SNP j, so are all SNPs before it.
+            //
+            for (int k = j - 1; k >= (int) start && psum->has_pair(k, j); k--) {
 
                 if (psum->nucs[k].freq < minor_freq_lim)
                     continue;
 
-                if (psum->recomb[k][j] == true) {
+                if (psum->dprime(k, j).recomb) {
                     bound = true;
                     end   = j;
                 }
@@ -486,7 +496,7 @@ dprime_blocks(string path, map<string, int> &pop_map, PhasedSummary *psum, map<i
         if (psum->nucs[i].freq < minor_freq_lim)
             continue;
 
-        for (uint j = i+1; j < psum->size; j++) {
+        for (uint j = i+1; j < psum->pairs_end(i); j++) {
             if (psum->nucs[j].freq < minor_freq_lim)
                 continue;
 
@@ -496,10 +506,10 @@ dprime_blocks(string path, map<string, int> &pop_map, PhasedSummary *psum, map<i
             //
             // Does this pair of markers show a strong measure of LD?
             //
-            if (psum->dprime[i][j].ci_high > 0.98 &&
-                psum->dprime[i][j].ci_low  > 0.7 &&
+            if (psum->dprime(i, j).ci_high > 0.98 &&
+                psum->dprime(i, j).ci_low  > 0.7 &&
                 dist <= max_pair_dist) {
-                psum->dprime[i][j].type = strong_ld;
+                psum->dprime(i, j).type = strong_ld;
 
                 ld_pairs.push_back(make_pair(i, j));
                 ld_map[i].push_back(j);
@@ -511,8 +521,8 @@ dprime_blocks(string path, map<string, int> &pop_map, PhasedSummary *psum, map<i
             //
             // Does this pair of markers show a strong measure of historical recombination?
             //
-            if (psum->dprime[i][j].ci_high < 0.9) {
-                psum->dprime[i][j].type = recomb;
+            if (psum->dprime(i, j).ci_high < 0.9) {
+                psum->dprime(i, j).type = recomb;
                 recomb_pairs++;
             }
         }
@@ -649,13 +659,13 @@ check_adjacent_blocks(PhasedSummary *psum, HBlock *block)
         if (psum->nucs[i].freq < minor_freq_lim)
             continue;
 
-        for (uint j = i + 1; j <= end; j++) {
-            if (psum->dprime[i][j].type == uninformative ||
+        for (uint j = i + 1; j <= end && j < psum->pairs_end(i); j++) {
+            if (psum->dprime(i, j).type == uninformative ||
                 psum->nucs[j].freq < minor_freq_lim)
                 continue;
 
             tot++;
-            if (psum->dprime[i][j].type == strong_ld)
+            if (psum->dprime(i, j).type == strong_ld)
                 strong_ld++;
         }
     }
@@ -840,12 +850,147 @@ enumerate_haplotypes(ofstream &fh, map<string, int> &pop_map, PhasedSummary *psu
     return 0;
 }
 
+namespace {
+
+//
+// Counts of the four two-SNP haplotypes, from the allele bitsets of the two SNPs.
+//
+struct HapCounts {
+    uint AB, Ab, aB, ab;
+};
+
+typedef HapCounts (*HapCountF)(size_t n_words,
+                               const uint64_t *A, const uint64_t *a,
+                               const uint64_t *B, const uint64_t *b);
+
+inline __attribute__((always_inline))
+HapCounts
+count_haplotypes_impl(size_t n_words,
+                      const uint64_t *A, const uint64_t *a,
+                      const uint64_t *B, const uint64_t *b)
+{
+    HapCounts c = {0, 0, 0, 0};
+    for (size_t w = 0; w < n_words; w++) {
+        c.AB += __builtin_popcountll(A[w] & B[w]);
+        c.Ab += __builtin_popcountll(A[w] & b[w]);
+        c.aB += __builtin_popcountll(a[w] & B[w]);
+        c.ab += __builtin_popcountll(a[w] & b[w]);
+    }
+    return c;
+}
+
+HapCounts
+count_haplotypes_scalar(size_t n_words,
+                        const uint64_t *A, const uint64_t *a,
+                        const uint64_t *B, const uint64_t *b)
+{
+    return count_haplotypes_impl(n_words, A, a, B, b);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PHASEDSTACKS_X86
+
+// Same, with the hardware population count instruction.
+__attribute__((target("popcnt")))
+HapCounts
+count_haplotypes_popcnt(size_t n_words,
+                        const uint64_t *A, const uint64_t *a,
+                        const uint64_t *B, const uint64_t *b)
+{
+    return count_haplotypes_impl(n_words, A, a, B, b);
+}
+#endif
+
+HapCountF
+select_hap_count_kernel()
+{
+#ifdef PHASEDSTACKS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt"))
+        return count_haplotypes_popcnt;
+#endif
+    return count_haplotypes_scalar;
+}
+
+const HapCountF count_haplotypes = select_hap_count_kernel();
+
+} // namespace
+
+void
+PhasedSummary::init_pairs(uint max_bp, uint max_snps)
+{
+    this->pairs_end_.assign(this->size, 0);
+    this->pairs_off_.assign(this->size, 0);
+
+    //
+    // The end of the window only moves forward, so `four_gamete_test()` can stop
+    // looking back as soon as it meets a SNP out of the window.
+    //
+    size_t n_pairs = 0;
+    uint   end     = 0;
+    for (uint i = 0; i < this->size; i++) {
+        if (end <= i)
+            end = i + 1;
+        while (end < this->size &&
+               (max_snps == 0 || end - i <= max_snps) &&
+               (max_bp   == 0 || this->nucs[end].bp - this->nucs[i].bp <= max_bp))
+            end++;
+
+        this->pairs_end_[i] = end;
+        this->pairs_off_[i] = n_pairs;
+        n_pairs += end - i - 1;
+    }
+    this->pairs_.assign(n_pairs, dPrime());
+}
+
 int
 calc_dprime(PhasedSummary *psum)
 {
+    psum->init_pairs(ld_window_bp, ld_window_snps);
+
+    //
+    // Encode the haplotypes as bitsets: for each SNP, one set of the haplotypes
+    // carrying allele A and one of those carrying allele a; haplotypes with missing
+    // data are in neither. Bit k is the first chromosome of sample k, bit
+    // sample_cnt + k its second chromosome. The haplotype frequencies of a pair of
+    // SNPs are then the population counts of the intersections of their sets.
+    //
+    const size_t n_haps  = psum->sample_cnt * 2;
+    const size_t n_words = (n_haps + 63) / 64;
+
+    vector<uint64_t> bits_A(psum->size * n_words, 0);
+    vector<uint64_t> bits_a(psum->size * n_words, 0);
+    vector<double>   freqs_A(psum->size, 0.0);
+    vector<double>   freqs_a(psum->size, 0.0);
+
+    #pragma omp parallel for schedule(static)
+    for (uint i = 0; i < psum->size; i++) {
+        char allele_A, allele_a;
+
+        //
+        // Assign nucleotides to allele A, and a.
+        //
+        assign_alleles(psum->nucs[i], allele_A, allele_a, freqs_A[i], freqs_a[i]);
+
+        uint64_t *A = bits_A.data() + i * n_words;
+        uint64_t *a = bits_a.data() + i * n_words;
+
+        for (uint k = 0; k < psum->sample_cnt; k++) {
+            for (size_t h = 0; h < 2; h++) {
+                char     nuc = h == 0 ? psum->samples[k].nucs_1[i] : psum->samples[k].nucs_2[i];
+                size_t   bit = h * psum->sample_cnt + k;
+                uint64_t m   = uint64_t(1) << (bit % 64);
+
+                if (nuc == allele_A)
+                    A[bit / 64] |= m;
+                else if (nuc == allele_a)
+                    a[bit / 64] |= m;
+            }
+        }
+    }
+
     #pragma omp parallel
     {
-        char   allele_A, allele_a, allele_B, allele_b;
         double freq_A,     freq_a,   freq_B,   freq_b;
         double freq_AB,   freq_Ab,  freq_aB,  freq_ab;
         double D, min, var, chisq;
@@ -854,60 +999,29 @@ calc_dprime(PhasedSummary *psum)
 
         #pragma omp for schedule(dynamic, 1)
         for (uint i = 0; i < psum->size; i++) {
-            //
-            // Assign nucleotides to allele A, and a.
-            //
-            assign_alleles(psum->nucs[i], allele_A, allele_a, freq_A, freq_a);
+            const uint64_t *A = bits_A.data() + i * n_words;
+            const uint64_t *a = bits_a.data() + i * n_words;
 
-            for (uint j = i+1; j < psum->size; j++) {
-                //
-                // Assign nucleotides to allele B, and b.
-                //
-                assign_alleles(psum->nucs[j], allele_B, allele_b, freq_B, freq_b);
+            freq_A = freqs_A[i];
+            freq_a = freqs_a[i];
 
-                freq_AB = 0.0;
-                freq_Ab = 0.0;
-                freq_aB = 0.0;
-                freq_ab = 0.0;
-                hap_cnt = 0;
-                D       = 0.0;
+            for (uint j = i+1; j < psum->pairs_end(i); j++) {
+                const uint64_t *B = bits_A.data() + j * n_words;
+                const uint64_t *b = bits_a.data() + j * n_words;
+                dPrime         &dp = psum->dprime(i, j);
+
+                freq_B = freqs_A[j];
+                freq_b = freqs_a[j];
 
                 //
                 // Tally up haplotype frequencies.
                 //
-                for (uint k = 0; k < psum->sample_cnt; k++) {
-
-                    if (psum->samples[k].nucs_1[i] == allele_A &&
-                        psum->samples[k].nucs_1[j] == allele_B)
-                        freq_AB++;
-                    else if (psum->samples[k].nucs_1[i] == allele_A &&
-                             psum->samples[k].nucs_1[j] == allele_b)
-                        freq_Ab++;
-                    else if (psum->samples[k].nucs_1[i] == allele_a &&
-                             psum->samples[k].nucs_1[j] == allele_B)
-                        freq_aB++;
-                    else if (psum->samples[k].nucs_1[i] == allele_a &&
-                             psum->samples[k].nucs_1[j] == allele_b)
-                        freq_ab++;
-
-                    if (psum->samples[k].nucs_2[i] == allele_A &&
-                        psum->samples[k].nucs_2[j] == allele_B)
-                        freq_AB++;
-                    else if (psum->samples[k].nucs_2[i] == allele_A &&
-                             psum->samples[k].nucs_2[j] == allele_b)
-                        freq_Ab++;
-                    else if (psum->samples[k].nucs_2[i] == allele_a &&
-                             psum->samples[k].nucs_2[j] == allele_B)
-                        freq_aB++;
-                    else if (psum->samples[k].nucs_2[i] == allele_a &&
-                             psum->samples[k].nucs_2[j] == allele_b)
-                        freq_ab++;
-                }
+                HapCounts cnts = count_haplotypes(n_words, A, a, B, b);
 
-                freq_AB = freq_AB / tot;
-                freq_Ab = freq_Ab / tot;
-                freq_aB = freq_aB / tot;
-                freq_ab = freq_ab / tot;
+                freq_AB = cnts.AB / tot;
+                freq_Ab = cnts.Ab / tot;
+                freq_aB = cnts.aB / tot;
+                freq_ab = cnts.ab / tot;
 
                 //
                 // Using the four-gamete test, check whether recombination has occurred
@@ -915,33 +1029,22 @@ calc_dprime(PhasedSummary *psum)
                 //  Four-gamete test: if no recombination has occurred between any two loci (SNPs) there will
                 //  be three haplotypes present, if recombination has occurred there will be four haplotypes.
                 //
+                hap_cnt  = 0;
                 hap_cnt += freq_AB > 0 ? 1 : 0;
                 hap_cnt += freq_Ab > 0 ? 1 : 0;
                 hap_cnt += freq_aB > 0 ? 1 : 0;
                 hap_cnt += freq_ab > 0 ? 1 : 0;
 
-                if (hap_cnt == 3)
-                    psum->recomb[i][j] = false;
-                else
-                    psum->recomb[i][j] = true;
-
+                dp.recomb = hap_cnt != 3;
 
                 D = freq_AB - (freq_A * freq_B);
-                // cerr << "D_AB: " << D << "; ";
-                // D = freq_Ab - (freq_A * freq_b);
-                // cerr << "D_Ab: " << D << "; ";
-                // D = freq_aB - (freq_a * freq_B);
-                // cerr << "D_aB: " << D << "; ";
-                // D = freq_ab - (freq_a * freq_b);
-                // cerr << "D_ab: " << D << "\n";
-                // cerr << "    freq_AB: " << freq_AB << "; freq_Ab: " << freq_Ab << "; freq_aB: " << freq_aB << "; freq_ab: " << freq_ab << "\n";
 
                 if (D > 0) {
                     min = (freq_A * freq_b) < (freq_a * freq_B) ? (freq_A * freq_b) : (freq_a * freq_B);
-                    psum->dprime[i][j].dprime = min == 0 ? 0.0 : D / min;
+                    dp.dprime = min == 0 ? 0.0 : D / min;
                 } else {
                     min = (freq_A * freq_B) < (freq_a * freq_b) ? (freq_A * freq_B) : (freq_a * freq_b);
-                    psum->dprime[i][j].dprime = min == 0 ? 0.0 :(-1 * D) / min;
+                    dp.dprime = min == 0 ? 0.0 :(-1 * D) / min;
                 }
 
                 //
@@ -950,19 +1053,19 @@ calc_dprime(PhasedSummary *psum)
                 //
                 chisq = (tot * (D * D)) / (freq_A * freq_a * freq_B * freq_b);
                 if (chisq >= chi_sq_limit)
-                    psum->dprime[i][j].chisq_p = true;
+                    dp.chisq_p = true;
 
                 //
                 // Calculate variance and confidence limits.
                 //
-                if (psum->dprime[i][j].chisq_p) {
-                    var   = (1.0 / tot) * ((freq_A * freq_a * freq_B * freq_b) + ((1 - (2 * freq_A)) * (1 - (2 * freq_B)) * D) - (D * D));
-                    psum->dprime[i][j].var = var;
-                    psum->dprime[i][j].ci_high = psum->dprime[i][j].dprime + (1.96 * sqrt(var));
-                    psum->dprime[i][j].ci_low  = psum->dprime[i][j].dprime - (1.96 * sqrt(var));
+                if (dp.chisq_p) {
+                    var        = (1.0 / tot) * ((freq_A * freq_a * freq_B * freq_b) + ((1 - (2 * freq_A)) * (1 - (2 * freq_B)) * D) - (D * D));
+                    dp.var     = var;
+                    dp.ci_high = dp.dprime + (1.96 * sqrt(var));
+                    dp.ci_low  = dp.dprime - (1.96 * sqrt(var));
                 } else {
-                    psum->dprime[i][j].ci_high = 0.0;
-                    psum->dprime[i][j].ci_low  = 0.0;
+                    dp.ci_high = 0.0;
+                    dp.ci_low  = 0.0;
                 }
             }
         }
@@ -1053,27 +1156,27 @@ write_dprime(string path, PhasedSummary *psum)
     double dprime = 0.0;
 
     for (uint i = 0; i < psum->size; i++) {
-        for (uint j = i+1; j < psum->size; j++) {
+        for (uint j = i+1; j < psum->pairs_end(i); j++) {
 
             if (psum->nucs[i].freq < minor_freq_lim ||
                 psum->nucs[j].freq < minor_freq_lim)
                 continue;
 
-            dprime = psum->dprime[i][j].dprime;
+            dprime = psum->dprime(i, j).dprime;
 
             if (dprime_threshold)
                 dprime = dprime >= dprime_threshold_level ? 1.0 : 0.0;
 
-            if (write_zeros == false && (dprime == 0.0 || psum->dprime[i][j].chisq_p == false))
+            if (write_zeros == false && (dprime == 0.0 || psum->dprime(i, j).chisq_p == false))
                 continue;
 
             fh << psum->nucs[i].bp << "\t"
                << psum->nucs[j].bp << "\t"
                << std::setprecision(3) << dprime << "\t"
-               << std::setprecision(3) << (psum->dprime[i][j].chisq_p ? dprime : 0.0) << "\t"
-               << psum->dprime[i][j].var << "\t"
-               << psum->dprime[i][j].ci_low  << "\t"
-               << psum->dprime[i][j].ci_high << "\n";
+               << std::setprecision(3) << (psum->dprime(i, j).chisq_p ? dprime : 0.0) << "\t"
+               << psum->dprime(i, j).var << "\t"
+               << psum->dprime(i, j).ci_low  << "\t"
+               << psum->dprime(i, j).ci_high << "\n";
         }
     }
 
@@ -1834,6 +1937,8 @@ int parse_command_line(int argc, char* argv[]) {
             {"minor-allele-freq", required_argument, NULL, 'a'}, {"minor_allele_freq", required_argument, NULL, 'a'},
             {"min-inform-pairs",  required_argument, NULL, 'm'}, {"min_inform_pairs",  required_argument, NULL, 'm'},
             {"dprime-threshold",  required_argument, NULL, 'T'}, {"dprime_threshold",  required_argument, NULL, 'T'},
+            {"ld-window",         required_argument, NULL, 'w'}, {"ld_window",         required_argument, NULL, 'w'},
+            {"ld-window-snps",    required_argument, NULL, 'W'}, {"ld_window_snps",    required_argument, NULL, 'W'},
             {0, 0, 0, 0}
         };
 
@@ -1898,6 +2003,20 @@ int parse_command_line(int argc, char* argv[]) {
             dprime_threshold = true;
             dprime_threshold_level = atof(optarg);
             break;
+        case 'w':
+            ld_window_bp = is_integer(optarg);
+            if ((int) ld_window_bp < 0) {
+                cerr << "Error: Illegal --ld-window value '" << optarg << "'.\n";
+                help();
+            }
+            break;
+        case 'W':
+            ld_window_snps = is_integer(optarg);
+            if ((int) ld_window_snps < 0) {
+                cerr << "Error: Illegal --ld-window-snps value '" << optarg << "'.\n";
+                help();
+            }
+            break;
         case 'v':
             version();
             break;
@@ -1956,7 +2075,9 @@ void help() {
               << "  h: display this help messsage." << "\n"
               << "  --haplotypes: data were phased as RAD locus haplotypes.\n"
               << "  --dprime-bin-size: size of buckets for binning SNPs at a particular distance to calculate the mean D' value.\n"
-              << "  --dprime-threshold <val>: if D' values fall above <val>, set the D' to 1, otherwise set D' to 0.\n\n"
+              << "  --dprime-threshold <val>: if D' values fall above <val>, set the D' to 1, otherwise set D' to 0.\n"
+              << "  --ld-window <bp>: only compute D' between SNPs at most <bp> basepairs apart (default: all pairs).\n"
+              << "  --ld-window-snps <n>: only compute D' between SNPs at most <n> SNPs apart (default: all pairs).\n\n"
               << "  Filtering options:\n"
               << "  --skip-zeros: do not include D' values of zero in the D' output.\n"
               << "  --minor-allele-freq: specify a minimum minor allele frequency required to process a nucleotide site (0 < a < 0.5).\n"
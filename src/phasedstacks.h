@@ -106,6 +106,7 @@ public:
     double ci_high;
     double ci_low;
     bool   informative;
+    bool   recomb;
     loc_t  type;
 
     dPrime() {
@@ -114,49 +115,38 @@ public:
         this->var     = 0.0;
         this->ci_high = 0.0;
         this->ci_low  = 0.0;
+        this->recomb  = false;
         this->type    = uninformative;
     }
 };
 
+//
+// The D' measures are only kept for pairs of SNPs within the LD window (see
+// `init_pairs()`), one row per SNP: row i holds the pairs (i, j) with
+// i < j < pairs_end(i). Pairs outside of the window are never computed and
+// are treated as uninformative.
+//
 class PhasedSummary {
     map<string, int> sample_map;
+    vector<uint>     pairs_end_;
+    vector<size_t>   pairs_off_;
+    vector<dPrime>   pairs_;
 
 public:
     uint     size;
     uint     sample_cnt;
     NucSum  *nucs;
     PhasedSample  *samples;
-    dPrime **dprime;
-    bool   **recomb;
 
     PhasedSummary(uint num_samples, uint num_genotypes) {
         this->sample_cnt = num_samples;
         this->samples    = new PhasedSample[this->sample_cnt];
         this->size       = num_genotypes;
         this->nucs       = new NucSum[this->size];
-        this->dprime     = new dPrime *[this->size];
-        for (uint i = 0; i < this->size; i++)
-            this->dprime[i] = new dPrime[this->size];
-
-        this->recomb     = new bool *[this->size];
-        for (uint i = 0; i < this->size; i++) {
-            this->recomb[i] = new bool[this->size];
-            memset(this->recomb[i], 0, this->size);
-        }
     }
     ~PhasedSummary() {
         if (this->nucs != NULL)
             delete [] this->nucs;
-        if (this->dprime != NULL) {
-            for (uint i = 0; i < this->size; i++)
-                delete [] this->dprime[i];
-            delete [] this->dprime;
-        }
-        if (this->recomb != NULL) {
-            for (uint i = 0; i < this->size; i++)
-                delete [] this->recomb[i];
-            delete [] this->recomb;
-        }
         if (this->samples != NULL)
             delete [] this->samples;
     }
@@ -166,6 +156,13 @@ public:
         this->samples[i].name = name;
         return i;
     }
+
+    // Sizes the rows of pairs for a window of `max_bp` basepairs and `max_snps`
+    // SNPs (0 for no limit). SNPs must be sorted by basepair.
+    void init_pairs(uint max_bp, uint max_snps);
+    uint    pairs_end(uint i)       const {return this->pairs_end_[i];}
+    bool    has_pair(uint i, uint j) const {return j > i && j < this->pairs_end_[i];}
+    dPrime& dprime(uint i, uint j)        {return this->pairs_[this->pairs_off_[i] + (j - i - 1)];}
 };
 
 class HBlock {
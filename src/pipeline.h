@@ -0,0 +1,311 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+//
+// Building blocks for reader -> workers -> writer pipelines. These use
+// std::thread primitives, so that a stage can run on a dedicated thread
+// alongside an OpenMP team.
+//
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cassert>
+
+#include "constants.h"
+#include "utils.h"
+
+//
+// BoundedQueue: a blocking FIFO of at most `capacity` elements.
+//
+// Producers block in push() while the queue is full; consumers block in pop()
+// while it is empty. Once close() has been called, push() fails and pop()
+// drains the remaining elements, then fails.
+//
+template<typename T>
+class BoundedQueue {
+    std::mutex              mtx_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T>           q_;
+    size_t                  capacity_;
+    bool                    closed_;
+    size_t                  n_popped_;
+    size_t                  max_size_;
+
+public:
+    BoundedQueue(size_t capacity) : capacity_(std::max(capacity, size_t(1))), closed_(false), n_popped_(0), max_size_(0) {}
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator= (const BoundedQueue&) = delete;
+
+    // Returns false if the queue was closed (`x` is then left untouched).
+    bool push(T&& x);
+    // Returns false if the queue is closed and empty.
+    bool pop(T& x);
+    // Also gives the rank of `x` in the queue (0 for the first element pushed,
+    // 1 for the second, etc.), e.g. to number items in the order several
+    // producers pushed them.
+    bool pop(T& x, size_t& rank);
+    // Non-blocking variants; fail if the queue is full (resp. empty) or closed.
+    bool try_push(T&& x);
+    bool try_pop(T& x);
+    void close();
+
+    size_t capacity() const {return capacity_;}
+    size_t max_size() {std::lock_guard<std::mutex> lock (mtx_); return max_size_;}
+};
+
+//
+// OrderedWriter: reorders the items produced out of order by worker threads
+// (e.g. one per locus, indexed 0, 1, 2, ...) and writes them in order on a
+// dedicated writer thread.
+//
+// Items are kept in a ring buffer of `window` slots indexed by item number.
+// A producer that gets more than `window` items ahead of the writer blocks in
+// put() until the writer catches up (backpressure). Every item number must
+// eventually be put(), otherwise the writer stalls.
+//
+template<typename T>
+class OrderedWriter {
+public:
+    typedef std::function<void(size_t, T&)>      WriteF;
+    typedef std::function<size_t(const T&)>      SizeF;
+
+private:
+    WriteF write_;
+    SizeF  size_of_;
+
+    std::mutex              mtx_;
+    std::condition_variable slot_free_;
+    std::condition_variable head_ready_;
+    vector<T>               slots_;
+    vector<char>            ready_;
+    size_t                  next_;      // Next item to write.
+    bool                    closed_;
+    bool                    aborted_;
+    std::exception_ptr      exc_;
+
+    // Statistics.
+    size_t n_buffered_;
+    size_t n_bytes_;
+    size_t max_buffered_;
+    size_t max_bytes_;
+    Timer  t_writing_;
+
+    std::thread writer_;
+
+    void run();
+
+public:
+    OrderedWriter(size_t window, WriteF write, SizeF size_of = SizeF())
+        : write_(write), size_of_(size_of),
+          slots_(std::max(window, size_t(1))), ready_(slots_.size(), 0),
+          next_(0), closed_(false), aborted_(false), exc_(),
+          n_buffered_(0), n_bytes_(0), max_buffered_(0), max_bytes_(0), t_writing_(),
+          writer_(&OrderedWriter::run, this)
+        {}
+    OrderedWriter(const OrderedWriter&) = delete;
+    OrderedWriter& operator= (const OrderedWriter&) = delete;
+    ~OrderedWriter() {abort(); if (writer_.joinable()) writer_.join();}
+
+    // Hands over item `i`. Blocks while `i` is beyond the window. Returns
+    // false if the writer was aborted or failed.
+    bool put(size_t i, T&& x);
+
+    // Waits until all the items that were put have been written, then stops
+    // the writer thread. Rethrows any exception raised while writing.
+    void close();
+
+    // Wakes up blocked producers and stops the writer without waiting.
+    void abort();
+
+    size_t window()       const {return slots_.size();}
+    size_t n_written()    const {return next_;}
+    size_t max_buffered() const {return max_buffered_;}
+    size_t max_bytes()    const {return max_bytes_;}
+    const Timer& t_writing() const {return t_writing_;}
+};
+
+//
+// Inline definitions
+// ==================
+//
+
+template<typename T>
+bool BoundedQueue<T>::push(T&& x) {
+    std::unique_lock<std::mutex> lock (mtx_);
+    not_full_.wait(lock, [this] {return closed_ || q_.size() < capacity_;});
+    if (closed_)
+        return false;
+    q_.push_back(move(x));
+    if (q_.size() > max_size_)
+        max_size_ = q_.size();
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop(T& x) {
+    size_t rank;
+    return pop(x, rank);
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop(T& x, size_t& rank) {
+    std::unique_lock<std::mutex> lock (mtx_);
+    not_empty_.wait(lock, [this] {return closed_ || !q_.empty();});
+    if (q_.empty())
+        return false;
+    x = move(q_.front());
+    q_.pop_front();
+    rank = n_popped_++;
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+}
+
+template<typename T>
+bool BoundedQueue<T>::try_push(T&& x) {
+    std::unique_lock<std::mutex> lock (mtx_);
+    if (closed_ || q_.size() >= capacity_)
+        return false;
+    q_.push_back(move(x));
+    if (q_.size() > max_size_)
+        max_size_ = q_.size();
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+}
+
+template<typename T>
+bool BoundedQueue<T>::try_pop(T& x) {
+    std::unique_lock<std::mutex> lock (mtx_);
+    if (q_.empty())
+        return false;
+    x = move(q_.front());
+    q_.pop_front();
+    ++n_popped_;
+    lock.unlock();
+    not_full_.notify_one();
+    return true;
+}
+
+template<typename T>
+void BoundedQueue<T>::close() {
+    {
+        std::lock_guard<std::mutex> lock (mtx_);
+        closed_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+}
+
+template<typename T>
+bool OrderedWriter<T>::put(size_t i, T&& x) {
+    size_t n_bytes = size_of_ ? size_of_(x) : 0;
+    std::unique_lock<std::mutex> lock (mtx_);
+    assert(i >= next_);
+    slot_free_.wait(lock, [&] {return aborted_ || i < next_ + slots_.size();});
+    if (aborted_)
+        return false;
+    size_t slot = i % slots_.size();
+    assert(!ready_[slot]);
+    slots_[slot] = move(x);
+    ready_[slot] = true;
+    ++n_buffered_;
+    n_bytes_ += n_bytes;
+    if (n_buffered_ > max_buffered_)
+        max_buffered_ = n_buffered_;
+    if (n_bytes_ > max_bytes_)
+        max_bytes_ = n_bytes_;
+    bool is_head = i == next_;
+    lock.unlock();
+    if (is_head)
+        head_ready_.notify_one();
+    return true;
+}
+
+template<typename T>
+void OrderedWriter<T>::run() {
+    std::unique_lock<std::mutex> lock (mtx_);
+    while (true) {
+        size_t slot = next_ % slots_.size();
+        head_ready_.wait(lock, [&] {return aborted_ || closed_ || ready_[slot];});
+        if (aborted_ || !ready_[slot])
+            break;
+
+        // Write the item outside of the lock.
+        T x (move(slots_[slot]));
+        size_t n_bytes = size_of_ ? size_of_(x) : 0;
+        lock.unlock();
+        try {
+            t_writing_.restart();
+            write_(next_, x);
+            t_writing_.update();
+        } catch (...) {
+            lock.lock();
+            exc_ = std::current_exception();
+            aborted_ = true;
+            lock.unlock();
+            slot_free_.notify_all();
+            return;
+        }
+        x = T();
+        lock.lock();
+
+        ready_[slot] = false;
+        --n_buffered_;
+        n_bytes_ -= n_bytes;
+        ++next_;
+        slot_free_.notify_all();
+    }
+}
+
+template<typename T>
+void OrderedWriter<T>::close() {
+    {
+        std::lock_guard<std::mutex> lock (mtx_);
+        closed_ = true;
+    }
+    head_ready_.notify_one();
+    if (writer_.joinable())
+        writer_.join();
+    if (exc_)
+        std::rethrow_exception(exc_);
+}
+
+template<typename T>
+void OrderedWriter<T>::abort() {
+    {
+        std::lock_guard<std::mutex> lock (mtx_);
+        aborted_ = true;
+    }
+    head_ready_.notify_one();
+    slot_free_.notify_all();
+}
+
+#endif // PIPELINE_H
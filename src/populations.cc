@@ -240,6 +240,48 @@ try {
          << "Now processing...\n"
          << flush;
 
+    //
+    // A batch is exported on a separate thread, each export by its own OpenMP
+    // thread, while the next batch is loaded and its per-population statistics
+    // are computed. The exports of a batch are waited for before the F statistics
+    // of the next one (the divergence exports read those of their batch). Each
+    // export still writes the batches one at a time and in order, so the output
+    // files do not depend on the scheduling. (The exports do not read the global
+    // `loci_ordered`, which is updated as soon as the next batch is read.)
+    //
+    vector<LocBin *>  exp_loci;            // The batch being exported.
+    bool              exp_ordered = false; // The value of `loci_ordered` for it.
+    std::future<void> exporting;
+    auto finish_export = [&] () {
+        if (!exporting.valid())
+            return;
+        exporting.get(); // Rethrows the exceptions of the exports.
+        if (calc_fstats)
+            ldiv->clear(exp_loci);
+        for (LocBin *loc : exp_loci)
+            delete loc;
+        exp_loci.clear();
+    };
+    auto export_batch = [&] () {
+        exception_ptr error;
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < exports.size(); i++) {
+            try {
+                exports[i]->write_batch(exp_loci, exp_ordered);
+                if (exports[i] == sdiv_exp)
+                    sdiv_exp->write_batch_pairwise(exp_loci, ldiv->snp_values());
+                else if (exports[i] == hdiv_exp)
+                    hdiv_exp->write_batch_pairwise(exp_loci, ldiv->haplotype_values(), ldiv->metapop_haplotype_values());
+            } catch (...) {
+                #pragma omp critical(export_error)
+                if (!error)
+                    error = current_exception();
+            }
+        }
+        if (error)
+            rethrow_exception(error);
+    };
+
     Timer timer;
     logger->x << "\nBEGIN batch_progress\n";
     while (true) {
@@ -291,6 +333,8 @@ try {
                       << as_percentage(chr_n_multiloci_sites, chr_n_sites) << ").\n";
         }
 
+        finish_export();
+
         //
         // Calculate divergence statistics (Fst), if requested.
         //
@@ -321,16 +365,12 @@ try {
         }
 
         //
-        // Export this subset of the loci.
+        // Export this subset of the loci, in the background.
         //
-        for (uint i = 0; i < exports.size(); i++)
-            exports[i]->write_batch(bloc.loci());
+        bloc.release_loci(exp_loci);
+        exp_ordered = loci_ordered;
+        exporting = std::async(std::launch::async, export_batch);
 
-        if (calc_fstats) {
-            sdiv_exp->write_batch_pairwise(bloc.loci(), ldiv->snp_values());
-            hdiv_exp->write_batch_pairwise(bloc.loci(), ldiv->haplotype_values(), ldiv->metapop_haplotype_values());
-            ldiv->clear(bloc.loci());
-        }
         logger->x << flush;
         timer.update();
         #ifdef DEBUG
@@ -340,6 +380,7 @@ try {
         #endif
 
     }
+    finish_export();
     logger->x << "END batch_progress\n";
 
     //
@@ -519,7 +560,6 @@ BatchLocusProcessor::next_batch_stacks_loci(ostream &log_fh)
         this->_loci.push_back(this->_next_loc);
         this->_next_loc = NULL;
         this->_loc_filter.locus_seen();
-        this->_loc_filter.keep_locus(this->_loci.back());
     }
 
     Seq seq;
@@ -577,11 +617,6 @@ BatchLocusProcessor::next_batch_stacks_loci(ostream &log_fh)
         }
         assert(loc->s != NULL);
 
-        //
-        // Tabulate haplotypes present and in what combinations.
-        //
-        tabulate_locus_haplotypes(loc->cloc, loc->d, this->_mpopi->n_samples());
-
         //
         // Detect the end of batch.
         //
@@ -606,7 +641,6 @@ BatchLocusProcessor::next_batch_stacks_loci(ostream &log_fh)
                 }
             }
             this->_loci.push_back(loc);
-            this->_loc_filter.keep_locus(loc);
         } else {
             //
             // De novo.
@@ -619,16 +653,12 @@ BatchLocusProcessor::next_batch_stacks_loci(ostream &log_fh)
             loc->cloc->loc.set("un", this->_unordered_bp, strand_plus);
             this->_unordered_bp += loc->cloc->len;
             this->_loci.push_back(loc);
-            this->_loc_filter.keep_locus(loc);
             if (this->_loci.size() == this->_batch_size)
                 break;
         }
     }
 
-    //
-    // Record the post-filtering distribution of catalog loci for this batch.
-    //
-    this->_dists.accumulate(this->_loci);
+    this->batch_stats();
 
     //
     // Sort the catalog loci, if possible.
@@ -642,6 +672,37 @@ BatchLocusProcessor::next_batch_stacks_loci(ostream &log_fh)
     return this->_loci.size();
 }
 
+void
+BatchLocusProcessor::batch_stats()
+{
+    //
+    // Regenerate the summary statistics of the loci that passed the filters, now
+    // that their SNPs have been pruned, and tabulate the haplotypes present and in
+    // what combinations. Loci are independent, so this is done in parallel (unless
+    // verbose, as the statistics may then be logged).
+    //
+    // The genotypes of the loci are final at this point, so this is also where
+    // their genotype matrices are built; the Datums then share its haplotypes.
+    //
+    #pragma omp parallel for schedule(dynamic, 16) if(!verbose)
+    for (size_t i = 0; i < this->_loci.size(); i++) {
+        LocBin *loc = this->_loci[i];
+        loc->gts = new GenotypeMatrix(loc->cloc, loc->d, this->_mpopi->n_samples());
+        loc->s->sum_pops(loc->cloc, loc->d, *this->_mpopi, verbose, cout, loc->gts);
+        loc->s->tally_metapop(loc->cloc);
+        tabulate_locus_haplotypes(loc->cloc, loc->d, this->_mpopi->n_samples());
+        loc->gts->share_haplotypes(loc->d);
+    }
+
+    for (LocBin *loc : this->_loci)
+        this->_loc_filter.keep_locus(loc);
+
+    //
+    // Record the post-filtering distribution of catalog loci for this batch.
+    //
+    this->_dists.accumulate(this->_loci);
+}
+
 int
 BatchLocusProcessor::init_external_loci(string in_path, string pmap_path)
 {
@@ -719,7 +780,6 @@ BatchLocusProcessor::next_batch_external_loci(ostream &log_fh)
         this->_loci.push_back(this->_next_loc);
         this->_next_loc = NULL;
         this->_loc_filter.locus_seen();
-        this->_loc_filter.keep_locus(this->_loci.back());
     }
 
     int cloc_id = (this->_loci.empty() ? 1 : this->_loci.back()->cloc->id + 1);
@@ -771,11 +831,6 @@ BatchLocusProcessor::next_batch_external_loci(ostream &log_fh)
         }
         assert(loc->s != NULL);
 
-        //
-        // Tabulate haplotypes present and in what combinations.
-        //
-        tabulate_locus_haplotypes(loc->cloc, loc->d, this->_mpopi->n_samples());
-
         //
         // Detect the end of batch.
         //
@@ -787,13 +842,9 @@ BatchLocusProcessor::next_batch_external_loci(ostream &log_fh)
             break;
         }
         this->_loci.push_back(loc);
-        this->_loc_filter.keep_locus(loc);
     }
 
-    //
-    // Record the post-filtering distribution of catalog loci for this batch.
-    //
-    this->_dists.accumulate(this->_loci);
+    this->batch_stats();
 
     //
     // Sort the catalog loci, if possible.
@@ -834,7 +885,7 @@ BatchLocusProcessor::hapstats(ostream &log_fh)
         for (uint i = 0; i < this->_loci.size(); i++) {
             LocBin *loc = this->_loci[i];
 
-            loc->s->calc_hapstats(loc->cloc, (const Datum **) loc->d, *this->_mpopi);
+            loc->s->calc_hapstats(loc->cloc, (const Datum **) loc->d, *this->_mpopi, loc->gts);
         }
     }
 
@@ -1076,10 +1127,9 @@ LocusFilter::apply_filters_stacks(LocBin& loc, ostream& log_fh, const MetaPopInf
         this->filter_haps(loc, mpopi, log_fh);
 
     //
-    // Regenerate summary statistics after pruning SNPs.
+    // (The summary statistics are regenerated after pruning SNPs, for the whole
+    // batch; see BatchLocusProcessor::batch_stats().)
     //
-    loc.s->sum_pops(loc.cloc, loc.d, mpopi, verbose, cout);
-    loc.s->tally_metapop(loc.cloc);
     return false;
 }
 
@@ -1099,8 +1149,6 @@ LocusFilter::apply_filters_external(LocBin& loc, ostream& log_fh, const MetaPopI
     loc.s = new LocPopSum(strlen(loc.cloc->con), mpopi);
     this->filter_snps(loc, mpopi, log_fh);
 
-    loc.s->sum_pops(loc.cloc, loc.d, mpopi, verbose, cout);
-    loc.s->tally_metapop(loc.cloc);
     return false;
 }
 
@@ -1160,7 +1208,7 @@ LocusFilter::gt_depth_filter(Datum** data, const CSLocus* cloc)
             if (d->model[col] == 'U')
                 continue;
             // Check this genotype's depth.
-            if (d->snpdata[snp].tot_depth < min_gt_depth) {
+            if (d->snpdata[snp].tot_depth() < min_gt_depth) {
                 d->model[col] = 'U';
                 for(size_t i=0; i<2; ++i)
                     d->obshap[i][snp] = 'N';
@@ -39,6 +39,7 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <future>
 
 #include "constants.h"
 #include "stacks.h"
@@ -284,6 +285,9 @@ public:
 
     const LocusFilter&      filter() { return this->_loc_filter; }
     const vector<LocBin *>& loci()   { return this->_loci; }
+    // Hands the loci of the current batch over to the caller, who becomes
+    // responsible for deleting them.
+    void release_loci(vector<LocBin *> &loci) { loci.clear(); loci.swap(this->_loci); }
     const string&           chr()    { return this->_chr; }
     const CatalogDists&     dists()  { return this->_dists; }
 
@@ -323,6 +327,7 @@ private:
     int    init_external_loci(string, string);
     int    init_stacks_loci(string, string);
     void   batch_clear();
+    void   batch_stats();
     size_t next_batch_external_loci(ostream &);
     size_t next_batch_stacks_loci(ostream &);
 };
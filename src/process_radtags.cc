@@ -121,6 +121,9 @@ int main (int argc, char* argv[]) {
     cerr << "Using Phred+" << qual_offset << " encoding for quality scores.\n";
     if (truncate_seq > 0)
         cerr << "Reads will be truncated to " << truncate_seq << "bp\n";
+    if (num_threads > 1)
+        cerr << "Using " << num_threads << " threads.\n";
+    BgzfWriter::set_n_threads(num_threads);
     if (filter_illumina)
         cerr << "Discarding reads marked as 'failed' by Illumina's chastity/purity filters.\n";
     if (filter_adapter) {
@@ -141,7 +144,7 @@ int main (int argc, char* argv[]) {
     vector<BarcodePair>                  barcodes;
     set<string>                          se_bc, pe_bc;
     map<BarcodePair, ofstream *>         pair_1_fhs, pair_2_fhs, rem_1_fhs, rem_2_fhs;
-    map<BarcodePair, gzFile *>           pair_1_gzfhs, pair_2_gzfhs, rem_1_gzfhs, rem_2_gzfhs;
+    map<BarcodePair, BgzfWriter *>       pair_1_gzfhs, pair_2_gzfhs, rem_1_gzfhs, rem_2_gzfhs;
     map<string, map<string, long> >      counters;
     map<BarcodePair, map<string, long> > barcode_log;
 
@@ -210,7 +213,7 @@ int main (int argc, char* argv[]) {
             cerr << "    "
                  << counters[files[i].first]["adapter"] << " reads with adapter sequence.\n";
 
-        if (!result) {
+        if (result < 0) {
             cerr << "Error processing reads.\n";
             break;
         }
@@ -235,7 +238,7 @@ int main (int argc, char* argv[]) {
 
     print_results(argc, argv, barcodes, counters, barcode_log);
 
-    return 0;
+    return result < 0 ? 1 : 0;
     IF_NDEBUG_CATCH_ALL_EXCEPTIONS
 }
 
@@ -251,7 +254,6 @@ process_paired_reads(string prefix_1,
                      map<string, long> &counter,
                      map<BarcodePair, map<string, long> > &barcode_log) {
     Input    *fh_1=NULL, *fh_2=NULL;
-    RawRead   *r_1=NULL,  *r_2=NULL;
     ofstream *discard_fh_1=NULL, *discard_fh_2=NULL;
 
     int return_val = 1;
@@ -264,12 +266,9 @@ process_paired_reads(string prefix_1,
     else
         cerr << "  Reading data from:\n  " << path_1 << " and\n  " << path_2 << "\n";
 
-    if (in_file_type == FileT::fastq) {
-        fh_1 = new Fastq(path_1.c_str());
-        fh_2 = interleaved ? fh_1 : new Fastq(path_2.c_str());
-    } else if (in_file_type == FileT::gzfastq) {
-        fh_1 = new GzFastq(path_1.c_str());
-        fh_2 = interleaved ? fh_1 : new GzFastq(path_2.c_str());
+    if (in_file_type == FileT::fastq || in_file_type == FileT::gzfastq) {
+        fh_1 = new Fastx(path_1, true);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2, true);
     } else if (in_file_type == FileT::bam) {
         fh_1 = new BamUnAln(path_1.c_str());
         fh_2 = fh_1;
@@ -300,19 +299,30 @@ process_paired_reads(string prefix_1,
     }
 
     //
-    // Read in the first record, initializing the Seq object s. Then
-    // initialize the Read object r, then loop, using the same objects.
+    // Read in the first batch, to size the Read objects that each thread
+    // reuses for all the records it processes.
     //
-    Seq *s_1 = fh_1->next_seq();
-    Seq *s_2 = fh_2->next_seq();
-    if (s_1 == NULL || s_2 == NULL) {
+    ReadBatch first;
+    bool more;
+    try {
+        more = first.read(fh_1, fh_2);
+    } catch (exception &e) {
+        stacks_handle_exceptions(e);
+        if (discards) {
+            delete discard_fh_1;
+            delete discard_fh_2;
+        }
+        delete fh_1;
+        if (interleaved == false) delete fh_2;
+        return -1;
+    }
+    if (first.s_1.empty()) {
         cerr << "Attempting to read first pair of input records, unable to allocate "
              << "Seq object (Was the correct input type specified?).\n";
         exit(1);
     }
-
-    r_1 = new RawRead(strlen(s_1->seq), 1, min_bc_size_1, win_size);
-    r_2 = new RawRead(strlen(s_2->seq), 2, min_bc_size_2, win_size);
+    const uint buf_len_1 = strlen(first.s_1[0]->seq);
+    const uint buf_len_2 = strlen(first.s_2[0]->seq);
 
     //
     // Set len_limit so that if we encounter reads already shorter than truncate_seq limit
@@ -321,139 +331,178 @@ process_paired_reads(string prefix_1,
     if (truncate_seq > 0)
         len_limit = truncate_seq;
 
-    BarcodePair bc;
     //
-    // If no barcodes were specified, set the barcode object to be the input file names.
+    // Write the output of each batch, in input order.
     //
-    if (max_bc_size_1 == 0)
-        bc.set(prefix_1, prefix_2);
+    OrderedWriter<OutputBatch<fhType>> writer (4 * num_threads,
+        [&] (size_t, OutputBatch<fhType> &out) {
+            for (auto &f : out.records)
+                if (write_string(f.first, f.second.os.str()) < 0) {
+                    cerr << "Error writing to output file for '" << f.second.bc.str() << "'\n";
+                    throw exception();
+                }
+            if (discards &&
+                (write_string(discard_fh_1, out.discards_1.str()) < 0 ||
+                 write_string(discard_fh_2, out.discards_2.str()) < 0)) {
+                cerr << "Error writing to discard file for '" << prefix_1 << "'\n";
+                throw exception();
+            }
+        });
 
-    long i = 1;
+    //
+    // Read the input in batches on a dedicated thread.
+    //
+    BoundedQueue<ReadBatch> batches (2 * num_threads);
+    BoundedQueue<ReadBatch> free_batches (3 * num_threads);
+    bool read_ok = true;
+    std::thread reader ([&] () {
+        read_ok = read_batches(batches, free_batches, move(first), more, fh_1, fh_2);
+    });
 
     cerr << "  Processing RAD-Tags...";
-    do {
-        if (i % 1000000 == 0)
-            cerr << i/1000000 << "M...";
-
-        parse_input_record(s_1, r_1);
-        parse_input_record(s_2, r_2);
-        counter["total"] += 2;
-
-        //
-        // If a BestRAD protocol was used, check which read the barcode/restriction cutsite is on
-        // and transpose the reads if necessary.
-        //
-        if (bestrad) {
-            if (check_for_transposed_reads(r_1, r_2, renz_1))
-                transpose_reads(&r_1, &r_2);
-        }
-
-        if (barcode_type != null_null &&
-            barcode_type != inline_null &&
-            barcode_type != index_null)
-            bc.set(r_1->se_bc, r_2->pe_bc);
-        else if (barcode_type != null_null)
-            bc.set(r_1->se_bc);
-
-        process_barcode(r_1, r_2, bc, pair_1_fhs, se_bc, pe_bc, barcode_log, counter);
-
+    #pragma omp parallel num_threads(num_threads)
+    {
+        RawRead *r_1 = new RawRead(buf_len_1, 1, min_bc_size_1, win_size);
+        RawRead *r_2 = new RawRead(buf_len_2, 2, min_bc_size_2, win_size);
+        map<string, long> thr_counter;
+        map<BarcodePair, map<string, long> > thr_barcode_log;
+
+        BarcodePair bc;
         //
-        // Adjust the size of the read to accommodate truncating the sequence and variable
-        // barcode lengths. With standard Illumina data we want to output constant length
-        // reads even as the barcode size may change. Other technologies, like IonTorrent
-        // need to be truncated uniformly.
+        // If no barcodes were specified, set the barcode object to be the input file names.
         //
-        if (truncate_seq > 0) {
-            if (truncate_seq + r_1->inline_bc_len <= r_1->len)
-                r_1->set_len(truncate_seq + r_1->inline_bc_len);
-            if (truncate_seq + r_2->inline_bc_len <= r_2->len)
-                r_2->set_len(truncate_seq + r_2->inline_bc_len);
-        } else {
-            if (barcode_type == inline_null || barcode_type == inline_inline || barcode_type == inline_index)
-                r_1->set_len(r_1->len - (max_bc_size_1 - r_1->inline_bc_len));
-            if (barcode_type == index_inline || barcode_type == inline_inline)
-                r_2->set_len(r_2->len - (max_bc_size_2 - r_2->inline_bc_len));
-        }
-
-        if (r_1->retain)
-            process_singlet(r_1, renz_1, false, barcode_log[bc], counter);
-        if (r_2->retain)
-            process_singlet(r_2, renz_2, true,  barcode_log[bc], counter);
-
-        int result_1 = 1;
-        int result_2 = 1;
-
-        if (r_1->retain && r_2->retain) {
-            if (retain_header) {
-                result_1 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(pair_1_fhs[bc], s_1, r_1) :
-                    write_fasta(pair_1_fhs[bc], s_1, r_1);
-                result_2 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(pair_2_fhs[bc], s_2, r_2) :
-                    write_fasta(pair_2_fhs[bc], s_2, r_2);
-            } else {
-                result_1 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(pair_1_fhs[bc], r_1, overhang) :
-                    write_fasta(pair_1_fhs[bc], r_1, overhang);
-                result_2 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(pair_2_fhs[bc], r_2, overhang) :
-                    write_fasta(pair_2_fhs[bc], r_2, overhang);
+        if (max_bc_size_1 == 0)
+            bc.set(prefix_1, prefix_2);
+
+        try {
+            ReadBatch batch;
+            while (batches.pop(batch)) {
+                OutputBatch<fhType> out;
+
+                for (size_t j = 0; j < batch.s_1.size(); ++j) {
+                    Seq *s_1 = batch.s_1[j];
+                    Seq *s_2 = batch.s_2[j];
+
+                    parse_input_record(s_1, r_1);
+                    parse_input_record(s_2, r_2);
+                    thr_counter["total"] += 2;
+
+                    //
+                    // If a BestRAD protocol was used, check which read the barcode/restriction cutsite is on
+                    // and transpose the reads if necessary.
+                    //
+                    if (bestrad) {
+                        if (check_for_transposed_reads(r_1, r_2, renz_1))
+                            transpose_reads(&r_1, &r_2);
+                    }
+
+                    if (barcode_type != null_null &&
+                        barcode_type != inline_null &&
+                        barcode_type != index_null)
+                        bc.set(r_1->se_bc, r_2->pe_bc);
+                    else if (barcode_type != null_null)
+                        bc.set(r_1->se_bc);
+
+                    process_barcode(r_1, r_2, bc, pair_1_fhs, se_bc, pe_bc, thr_barcode_log, thr_counter);
+
+                    //
+                    // Adjust the size of the read to accommodate truncating the sequence and variable
+                    // barcode lengths. With standard Illumina data we want to output constant length
+                    // reads even as the barcode size may change. Other technologies, like IonTorrent
+                    // need to be truncated uniformly.
+                    //
+                    if (truncate_seq > 0) {
+                        if (truncate_seq + r_1->inline_bc_len <= r_1->len)
+                            r_1->set_len(truncate_seq + r_1->inline_bc_len);
+                        if (truncate_seq + r_2->inline_bc_len <= r_2->len)
+                            r_2->set_len(truncate_seq + r_2->inline_bc_len);
+                    } else {
+                        if (barcode_type == inline_null || barcode_type == inline_inline || barcode_type == inline_index)
+                            r_1->set_len(r_1->len - (max_bc_size_1 - r_1->inline_bc_len));
+                        if (barcode_type == index_inline || barcode_type == inline_inline)
+                            r_2->set_len(r_2->len - (max_bc_size_2 - r_2->inline_bc_len));
+                    }
+
+                    if (r_1->retain)
+                        process_singlet(r_1, renz_1, false, thr_barcode_log[bc], thr_counter);
+                    if (r_2->retain)
+                        process_singlet(r_2, renz_2, true,  thr_barcode_log[bc], thr_counter);
+
+                    bool fastq = out_file_type == FileT::fastq || out_file_type == FileT::gzfastq;
+
+                    if (r_1->retain && r_2->retain) {
+                        ostream *o_1 = out.to(pair_1_fhs.at(bc), bc);
+                        ostream *o_2 = out.to(pair_2_fhs.at(bc), bc);
+                        if (retain_header) {
+                            fastq ? write_fastq(o_1, s_1, r_1) : write_fasta(o_1, s_1, r_1);
+                            fastq ? write_fastq(o_2, s_2, r_2) : write_fasta(o_2, s_2, r_2);
+                        } else {
+                            fastq ? write_fastq(o_1, r_1, overhang) : write_fasta(o_1, r_1, overhang);
+                            fastq ? write_fastq(o_2, r_2, overhang) : write_fasta(o_2, r_2, overhang);
+                        }
+                    } else if (r_1->retain && !r_2->retain) {
+                        //
+                        // Write to the remainder file.
+                        //
+                        ostream *o_1 = out.to(rem_1_fhs.at(bc), bc);
+                        if (retain_header)
+                            fastq ? write_fastq(o_1, s_1, r_1) : write_fasta(o_1, s_1, r_1);
+                        else
+                            fastq ? write_fastq(o_1, r_1, overhang) : write_fasta(o_1, r_1, overhang);
+
+                    } else if (!r_1->retain && r_2->retain) {
+                        //
+                        // Write to the remainder file.
+                        //
+                        ostream *o_2 = out.to(rem_2_fhs.at(bc), bc);
+                        if (retain_header)
+                            fastq ? write_fastq(o_2, s_2, r_2) : write_fasta(o_2, s_2, r_2);
+                        else
+                            fastq ? write_fastq(o_2, r_2, overhang) : write_fasta(o_2, r_2, overhang);
+                    }
+
+                    if (discards && !r_1->retain)
+                        fastq ? write_fastq(&out.discards_1, s_1) : write_fasta(&out.discards_1, s_1);
+                    if (discards && !r_2->retain)
+                        fastq ? write_fastq(&out.discards_2, s_2) : write_fasta(&out.discards_2, s_2);
+                }
+                size_t batch_i = batch.i;
+                free_batches.try_push(move(batch));
+
+                if (!writer.put(batch_i, move(out))) {
+                    // The writer failed; stop the reader.
+                    batches.close();
+                    break;
+                }
             }
-        } else if (r_1->retain && !r_2->retain) {
-            //
-            // Write to the remainder file.
-            //
-            if (retain_header)
-                result_1 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(rem_1_fhs[bc], s_1, r_1) :
-                    write_fasta(rem_1_fhs[bc], s_1, r_1);
-            else
-                result_1 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(rem_1_fhs[bc], r_1, overhang) :
-                    write_fasta(rem_1_fhs[bc], r_1, overhang);
-
-        } else if (!r_1->retain && r_2->retain) {
-            //
-            // Write to the remainder file.
-            //
-            if (retain_header)
-                result_2 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(rem_2_fhs[bc], s_2, r_2) :
-                    write_fasta(rem_2_fhs[bc], s_2, r_2);
-            else
-                result_2 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(rem_2_fhs[bc], r_2, overhang) :
-                    write_fasta(rem_2_fhs[bc], r_2, overhang);
-        }
-
-        if (!result_1 || !result_2) {
-            cerr << "Error writing to output file for '" << bc.str() << "'\n";
-            return_val = -1;
-            break;
+        } catch (exception &e) {
+            #pragma omp critical(exc)
+            {
+                stacks_handle_exceptions(e);
+                return_val = -1;
+            }
+            batches.close();
+            writer.abort();
         }
 
-        if (discards && !r_1->retain)
-            result_1 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                write_fastq(discard_fh_1, s_1) :
-                write_fasta(discard_fh_1, s_1);
-        if (discards && !r_2->retain)
-            result_2 = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                write_fastq(discard_fh_2, s_2) :
-                write_fasta(discard_fh_2, s_2);
-
-        if (!result_1 || !result_2) {
-            cerr << "Error writing to discard file for '" << bc.str() << "'\n";
-            return_val = -1;
-            break;
+        #pragma omp critical(tally)
+        {
+            merge_counters(counter, thr_counter);
+            merge_barcode_logs(barcode_log, thr_barcode_log);
         }
-
-        delete s_1;
-        delete s_2;
-
-        i++;
-    } while ((s_1 = fh_1->next_seq()) != NULL &&
-             (s_2 = fh_2->next_seq()) != NULL);
+        delete r_1;
+        delete r_2;
+    }
+    reader.join();
     cerr << "\n";
+    if (!read_ok)
+        return_val = -1;
+
+    try {
+        writer.close();
+    } catch (exception &) {
+        return_val = -1;
+    }
 
     if (discards) {
         delete discard_fh_1;
@@ -463,9 +512,6 @@ process_paired_reads(string prefix_1,
     delete fh_1;
     if (interleaved == false) delete fh_2;
 
-    delete r_1;
-    delete r_2;
-
     return return_val;
 }
 
@@ -477,17 +523,14 @@ process_reads(string prefix,
               map<string, long> &counter,
               map<BarcodePair, map<string, long> > &barcode_log) {
     Input *fh=NULL;
-    RawRead  *r;
     ofstream *discard_fh=NULL;
 
     int return_val = 1;
 
     string path = in_path_1 + prefix;
 
-    if (in_file_type == FileT::fastq)
-        fh = new Fastq(path.c_str());
-    else if (in_file_type == FileT::gzfastq)
-        fh = new GzFastq(path.c_str());
+    if (in_file_type == FileT::fastq || in_file_type == FileT::gzfastq)
+        fh = new Fastx(path, true);
     else if (in_file_type == FileT::bam)
         fh = new BamUnAln(path.c_str());
     else if (in_file_type == FileT::bustard)
@@ -507,15 +550,25 @@ process_reads(string prefix,
     }
 
     //
-    // Read in the first record, initializing the Seq object s. Then
-    // initialize the Read object r, then loop, using the same objects.
+    // Read in the first batch, to size the Read objects that each thread
+    // reuses for all the records it processes.
     //
-    Seq *s = fh->next_seq();
-    if (s == NULL) {
+    ReadBatch first;
+    bool more;
+    try {
+        more = first.read(fh, NULL);
+    } catch (exception &e) {
+        stacks_handle_exceptions(e);
+        if (discards) delete discard_fh;
+        delete fh;
+        return -1;
+    }
+    if (first.s_1.empty()) {
         cerr << "Attempting to read first input record, unable to allocate "
              << "Seq object (Was the correct input type specified?).\n";
         exit(1);
     }
+    const uint buf_len = strlen(first.s_1[0]->seq);
 
     //
     // Set len_limit so that if we encounter reads already shorter than truncate_seq limit
@@ -524,89 +577,132 @@ process_reads(string prefix,
     if (truncate_seq > 0)
         len_limit = truncate_seq;
 
-    r = new RawRead(strlen(s->seq), 1, min_bc_size_1, win_size);
-
-    BarcodePair bc;
     //
-    // If no barcodes were specified, set the barcode object to be the input file name so
-    // that reads are written to an output file of the same name as the input file.
+    // Write the output of each batch, in input order.
     //
-    if (max_bc_size_1 == 0)
-        bc.set(prefix);
+    OrderedWriter<OutputBatch<fhType>> writer (4 * num_threads,
+        [&] (size_t, OutputBatch<fhType> &out) {
+            for (auto &f : out.records)
+                if (write_string(f.first, f.second.os.str()) < 0) {
+                    cerr << "Error writing to output file for '" << f.second.bc.str() << "'\n";
+                    throw exception();
+                }
+            if (discards && write_string(discard_fh, out.discards_1.str()) < 0) {
+                cerr << "Error writing to discard file for '" << prefix << "'\n";
+                throw exception();
+            }
+        });
 
-    //cerr << "Length: " << r->len << "; Window length: " << r->win_len << "; Stop position: " << r->stop_pos << "\n";
+    //
+    // Read the input in batches on a dedicated thread.
+    //
+    BoundedQueue<ReadBatch> batches (2 * num_threads);
+    BoundedQueue<ReadBatch> free_batches (3 * num_threads);
+    bool read_ok = true;
+    std::thread reader ([&] () {
+        read_ok = read_batches(batches, free_batches, move(first), more, fh, NULL);
+    });
 
-    long i = 1;
     cerr << "  Processing RAD-Tags...";
-    do {
-        if (i % 1000000 == 0)
-            cerr << i/1000000 << "M...";
-
-        counter["total"]++;
-
-        parse_input_record(s, r);
-
-        if (barcode_type == inline_null ||
-            barcode_type == index_null)
-            bc.set(r->se_bc);
-        else if (barcode_type == index_inline ||
-                 barcode_type == inline_index)
-            bc.set(r->se_bc, r->pe_bc);
-
-        process_barcode(r, NULL, bc, pair_1_fhs, se_bc, pe_bc, barcode_log, counter);
+    #pragma omp parallel num_threads(num_threads)
+    {
+        RawRead *r = new RawRead(buf_len, 1, min_bc_size_1, win_size);
+        map<string, long> thr_counter;
+        map<BarcodePair, map<string, long> > thr_barcode_log;
 
+        BarcodePair bc;
         //
-        // Adjust the size of the read to accommodate truncating the sequence and variable
-        // barcode lengths. With standard Illumina data we want to output constant length
-        // reads even as the barcode size may change. Other technologies, like IonTorrent
-        // need to be truncated uniformly.
+        // If no barcodes were specified, set the barcode object to be the input file name so
+        // that reads are written to an output file of the same name as the input file.
         //
-        if (truncate_seq > 0) {
-            if (truncate_seq + r->inline_bc_len <= r->len)
-                r->set_len(truncate_seq + r->inline_bc_len);
-        } else {
-            if (barcode_type == inline_null || barcode_type == inline_inline ||        barcode_type == inline_index)
-                r->set_len(r->len - (max_bc_size_1 - r->inline_bc_len));
-        }
-
-        if (r->retain)
-            process_singlet(r, renz_1, false, barcode_log[bc], counter);
-
-        int result = 1;
-
-        if (r->retain) {
-            if (retain_header)
-                result = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(pair_1_fhs[bc], s, r) :
-                    write_fasta(pair_1_fhs[bc], s, r);
-            else
-                result = (out_file_type == FileT::fastq || out_file_type == FileT::gzfastq) ?
-                    write_fastq(pair_1_fhs[bc], r, overhang) :
-                    write_fasta(pair_1_fhs[bc], r, overhang);
-        }
-
-        if (!result) {
-            cerr << "Error writing to output file for '" << bc.str() << "'\n";
-            return_val = -1;
-            break;
+        if (max_bc_size_1 == 0)
+            bc.set(prefix);
+
+        try {
+            ReadBatch batch;
+            while (batches.pop(batch)) {
+                OutputBatch<fhType> out;
+
+                for (Seq *s : batch.s_1) {
+                    thr_counter["total"]++;
+
+                    parse_input_record(s, r);
+
+                    if (barcode_type == inline_null ||
+                        barcode_type == index_null)
+                        bc.set(r->se_bc);
+                    else if (barcode_type == index_inline ||
+                             barcode_type == inline_index)
+                        bc.set(r->se_bc, r->pe_bc);
+
+                    process_barcode(r, NULL, bc, pair_1_fhs, se_bc, pe_bc, thr_barcode_log, thr_counter);
+
+                    //
+                    // Adjust the size of the read to accommodate truncating the sequence and variable
+                    // barcode lengths. With standard Illumina data we want to output constant length
+                    // reads even as the barcode size may change. Other technologies, like IonTorrent
+                    // need to be truncated uniformly.
+                    //
+                    if (truncate_seq > 0) {
+                        if (truncate_seq + r->inline_bc_len <= r->len)
+                            r->set_len(truncate_seq + r->inline_bc_len);
+                    } else {
+                        if (barcode_type == inline_null || barcode_type == inline_inline ||        barcode_type == inline_index)
+                            r->set_len(r->len - (max_bc_size_1 - r->inline_bc_len));
+                    }
+
+                    if (r->retain)
+                        process_singlet(r, renz_1, false, thr_barcode_log[bc], thr_counter);
+
+                    bool fastq = out_file_type == FileT::fastq || out_file_type == FileT::gzfastq;
+
+                    if (r->retain) {
+                        ostream *o = out.to(pair_1_fhs.at(bc), bc);
+                        if (retain_header)
+                            fastq ? write_fastq(o, s, r) : write_fasta(o, s, r);
+                        else
+                            fastq ? write_fastq(o, r, overhang) : write_fasta(o, r, overhang);
+                    }
+
+                    if (discards && !r->retain)
+                        fastq ? write_fastq(&out.discards_1, s) : write_fasta(&out.discards_1, s);
+                }
+                size_t batch_i = batch.i;
+                free_batches.try_push(move(batch));
+
+                if (!writer.put(batch_i, move(out))) {
+                    // The writer failed; stop the reader.
+                    batches.close();
+                    break;
+                }
+            }
+        } catch (exception &e) {
+            #pragma omp critical(exc)
+            {
+                stacks_handle_exceptions(e);
+                return_val = -1;
+            }
+            batches.close();
+            writer.abort();
         }
 
-        if (discards && !r->retain)
-            result = out_file_type == FileT::fastq || out_file_type == FileT::gzfastq ?
-                write_fastq(discard_fh, s) :
-                write_fasta(discard_fh, s);
-
-        if (!result) {
-            cerr << "Error writing to discard file for '" << bc.str() << "'\n";
-            return_val = -1;
-            break;
+        #pragma omp critical(tally)
+        {
+            merge_counters(counter, thr_counter);
+            merge_barcode_logs(barcode_log, thr_barcode_log);
         }
-
-        delete s;
-
-        i++;
-    } while ((s = fh->next_seq()) != NULL);
+        delete r;
+    }
+    reader.join();
     cerr << "\n";
+    if (!read_ok)
+        return_val = -1;
+
+    try {
+        writer.close();
+    } catch (exception &) {
+        return_val = -1;
+    }
 
     if (discards) delete discard_fh;
 
@@ -615,11 +711,94 @@ process_reads(string prefix,
     //
     delete fh;
 
-    delete r;
-
     return return_val;
 }
 
+bool
+ReadBatch::read(Input *fh_1, Input *fh_2)
+{
+    s_1.clear();
+    s_2.clear();
+
+    if (fh_2 == NULL) {
+        fh_1->next_batch(recs_1, read_batch_size);
+        for (size_t j = 0; j < recs_1.size(); ++j)
+            s_1.push_back(recs_1[j]);
+        return s_1.size() == read_batch_size;
+    }
+
+    if (fh_2 == fh_1) {
+        //
+        // Interleaved input, the mates follow one another.
+        //
+        size_t n = fh_1->next_batch(recs_1, 2 * read_batch_size);
+        for (size_t j = 0; j + 1 < n; j += 2) {
+            s_1.push_back(recs_1[j]);
+            s_2.push_back(recs_1[j + 1]);
+        }
+    } else {
+        size_t n = min(fh_1->next_batch(recs_1, read_batch_size),
+                       fh_2->next_batch(recs_2, read_batch_size));
+        for (size_t j = 0; j < n; ++j) {
+            s_1.push_back(recs_1[j]);
+            s_2.push_back(recs_2[j]);
+        }
+    }
+    return s_1.size() == read_batch_size;
+}
+
+//
+// Returns false if the input could not be read (e.g. a corrupt gzip file). The
+// queue is closed either way, so that the workers process the batches that
+// were read and then stop.
+//
+bool
+read_batches(BoundedQueue<ReadBatch> &batches, BoundedQueue<ReadBatch> &free_batches,
+             ReadBatch &&first, bool more, Input *fh_1, Input *fh_2)
+{
+    bool ok = true;
+    try {
+        long i = 1;
+        ReadBatch batch (move(first));
+        for (size_t batch_i = 0; !batch.s_1.empty(); ++batch_i) {
+            batch.i = batch_i;
+            for (size_t j = 0; j < batch.s_1.size(); ++j, ++i)
+                if (i % 1000000 == 0)
+                    cerr << i/1000000 << "M...";
+
+            if (!batches.push(move(batch)) || !more)
+                break;
+
+            //
+            // Refill a batch that the workers are done with, if any.
+            //
+            batch = ReadBatch();
+            free_batches.try_pop(batch);
+            more = batch.read(fh_1, fh_2);
+        }
+    } catch (exception &e) {
+        stacks_handle_exceptions(e);
+        ok = false;
+    }
+    batches.close();
+    return ok;
+}
+
+void
+merge_counters(map<string, long> &counter, const map<string, long> &thr_counter)
+{
+    for (auto &c : thr_counter)
+        counter[c.first] += c.second;
+}
+
+void
+merge_barcode_logs(map<BarcodePair, map<string, long> > &barcode_log,
+                   const map<BarcodePair, map<string, long> > &thr_barcode_log)
+{
+    for (auto &bc : thr_barcode_log)
+        merge_counters(barcode_log[bc.first], bc.second);
+}
+
 inline
 int
 process_singlet(RawRead *href,
@@ -1080,6 +1259,7 @@ int parse_command_line(int argc, char* argv[]) {
             {"filter-illumina",      no_argument, NULL, 'F'}, {"filter_illumina",      no_argument, NULL, 'F'},
             {"retain-header",        no_argument, NULL, 'H'}, {"retain_header",        no_argument, NULL, 'H'},
             {"bestrad",              no_argument, NULL, 1000},
+            {"threads",        required_argument, NULL, 1001},
             {"null-index",           no_argument, NULL, 'U'}, {"null_index",           no_argument, NULL, 'U'},
             {"index-null",           no_argument, NULL, 'u'}, {"index_null",           no_argument, NULL, 'u'},
             {"inline-null",          no_argument, NULL, 'V'}, {"inline_null",          no_argument, NULL, 'V'},
@@ -1177,6 +1357,13 @@ int parse_command_line(int argc, char* argv[]) {
         case 1000:
             bestrad = true;
             break;
+        case 1001:
+            if (is_integer(optarg) < 1) {
+                cerr << "Error: --threads requires a positive integer.\n";
+                help();
+            }
+            num_threads = is_integer(optarg);
+            break;
         case 'B':
             barcode_dist_1 = is_integer(optarg);
             break;
@@ -1460,7 +1647,8 @@ void help() {
          << "      --adapter-mm <mismatches>: number of mismatches allowed in the adapter sequence.\n\n"
          << "  Output options:\n"
          << "    --retain-header: retain unmodified FASTQ headers in the output.\n"
-         << "    --merge: if no barcodes are specified, merge all input files into a single output file.\n\n"
+         << "    --merge: if no barcodes are specified, merge all input files into a single output file.\n"
+         << "    --threads <num>: number of threads to run (default 1).\n\n"
          << "  Advanced options:\n"
          << "    --filter-illumina: discard reads that have been marked by Illumina's chastity/purity filter as failing.\n"
          << "    --disable-rad-check: disable checking if the RAD site is intact.\n"
@@ -35,6 +35,11 @@
 #include <map>
 #include <set>
 #include <utility>
+#include <thread>
+
+#ifdef _OPENMP
+#include <omp.h>    // OpenMP library
+#endif
 
 #include "constants.h"
 #include "renz.h"
@@ -46,7 +51,50 @@
 #include "BustardI.h"      // Reading input files in Tab-separated Bustard format
 #include "FastqI.h"        // Reading input files in FASTQ format
 #include "gzFastq.h"       // Reading gzipped input files in FASTQ format
+#include "FastxI.h"        // Reading input files in FASTQ/FASTA format, by batches
 #include "BamUnalignedI.h" // Reading data from unaligned BAM files
+#include "pipeline.h"
+
+//
+// Reads are processed in a pipeline: a reader thread loads batches of input
+// records, worker threads process them and format the reads to be written
+// for each output file, and a writer thread writes the batches back in input
+// order, so that the output files keep the order of the input. Processed
+// batches are handed back to the reader, which refills them in place.
+//
+struct ReadBatch {
+    size_t        i;    // Rank of the batch in the input.
+    SeqBatch      recs_1;
+    SeqBatch      recs_2;
+    vector<Seq *> s_1;  // The records, pointing into recs_1/recs_2.
+    vector<Seq *> s_2;  // (Paired-end reads.)
+
+    ReadBatch() : i(0) {}
+    ReadBatch(ReadBatch &&) = default;
+    ReadBatch &operator= (ReadBatch &&) = default;
+
+    // Reads the next `read_batch_size` records (pairs if `fh_2` isn't NULL).
+    // Returns false once the end of the input has been reached.
+    bool read(Input *fh_1, Input *fh_2);
+};
+
+template<typename fhType>
+struct OutputBatch {
+    struct Records {
+        BarcodePair  bc;
+        stringstream os;
+    };
+    map<fhType *, Records> records;
+    stringstream discards_1;
+    stringstream discards_2;
+
+    // The stream collecting the reads of this batch for output file `fh`.
+    ostream *to(fhType *fh, const BarcodePair &bc) {
+        Records &r = records[fh];
+        r.bc = bc;
+        return &r.os;
+    }
+};
 
 void help( void );
 void version( void );
@@ -64,6 +112,9 @@ int  process_paired_reads(string, string,
                           map<BarcodePair, fhType *> &,
                           map<BarcodePair, fhType *> &,
                           map<string, long> &, map<BarcodePair, map<string, long> > &);
+bool read_batches(BoundedQueue<ReadBatch> &, BoundedQueue<ReadBatch> &, ReadBatch &&, bool, Input *, Input *);
+void merge_counters(map<string, long> &, const map<string, long> &);
+void merge_barcode_logs(map<BarcodePair, map<string, long> > &, const map<BarcodePair, map<string, long> > &);
 int  process_singlet(RawRead *,
                      string, bool,
                      map<string, long> &, map<string, long> &);
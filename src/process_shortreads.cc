@@ -123,7 +123,7 @@ int main (int argc, char* argv[]) {
     vector<BarcodePair>                  barcodes;
     set<string>                          se_bc, pe_bc;
     map<BarcodePair, ofstream *>         pair_1_fhs, pair_2_fhs, rem_1_fhs, rem_2_fhs;
-    map<BarcodePair, gzFile *>           pair_1_gzfhs, pair_2_gzfhs, rem_1_gzfhs, rem_2_gzfhs;
+    map<BarcodePair, BgzfWriter *>       pair_1_gzfhs, pair_2_gzfhs, rem_1_gzfhs, rem_2_gzfhs;
     map<string, map<string, long> >      counters;
     map<BarcodePair, map<string, long> > barcode_log;
 
@@ -249,11 +249,11 @@ process_paired_reads(string prefix_1,
         cerr << "  Reading data from:\n  " << path_1 << " and\n  " << path_2 << "\n";
 
     if (in_file_type == FileT::fastq) {
-        fh_1 = new Fastq(path_1.c_str());
-        fh_2 = interleaved ? fh_1 : new Fastq(path_2.c_str());
+        fh_1 = new Fastx(path_1.c_str(), true);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2.c_str(), true);
     } else if (in_file_type == FileT::gzfastq) {
-        fh_1 = new GzFastq(path_1.c_str());
-        fh_2 = interleaved ? fh_1 : new GzFastq(path_2.c_str());
+        fh_1 = new Fastx(path_1.c_str(), true);
+        fh_2 = interleaved ? fh_1 : new Fastx(path_2.c_str(), true);
     } else if (in_file_type == FileT::bam) {
         fh_1 = new BamUnAln(path_1.c_str());
         fh_2 = fh_1;
@@ -451,9 +451,9 @@ process_reads(string prefix,
     string path = in_path_1 + prefix;
 
     if (in_file_type == FileT::fastq)
-        fh = new Fastq(path.c_str());
+        fh = new Fastx(path.c_str(), true);
     else if (in_file_type == FileT::gzfastq)
-        fh = new GzFastq(path.c_str());
+        fh = new Fastx(path.c_str(), true);
     else if (in_file_type == FileT::bam)
         fh = new BamUnAln(path.c_str());
     else if (in_file_type == FileT::bustard)
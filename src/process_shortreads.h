@@ -45,6 +45,7 @@
 #include "BustardI.h"       // Reading input files in Tab-separated Bustard format
 #include "FastqI.h"         // Reading input files in FASTQ format
 #include "gzFastq.h"        // Reading gzipped input files in FASTQ format
+#include "FastxI.h"        // Reading input files in FASTQ/FASTA format, by batches
 #include "BamUnalignedI.h"  // Reading data from unaligned BAM files
 
 void help( void );
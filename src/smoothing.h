@@ -22,13 +22,37 @@
 #define __SMOOTHING_H__
 
 #include <cmath>
+#include <algorithm>
+#include <vector>
+
 #include "smoothing_utils.h"
 
+//
+// Kernel smoothing of the statistics along an ordered chromosome.
+//
+// Two methods give the same smoothed values: the exact method sums the
+// weighted statistics of every site within the window of each site, while
+// the binned method (used when the sites are dense enough for it to pay off)
+// first gathers the sites into bins of `sigma / bins_per_sigma` bp. For a site
+// at position p in a bin centered at x, and a center c,
+//   exp(-(c - p)^2 / 2sigma^2) = weights[c - x] * exp(-(p - x)^2 / 2sigma^2) * exp((c - x) * (p - x) / sigma^2)
+// and expanding the last factor in a series of `n_terms` terms lets each bin
+// store a few moments of its sites, so that it contributes to each center in
+// constant time. Only the (two) bins crossing the ends of the window of a
+// center are summed site by site, so the windows are exactly those of the
+// exact method. As |(c - x) * (p - x)| / sigma^2 <= 3/16, the relative error
+// of the binned kernel weights is below 1e-10.
+//
 template<class StatT=PopStat>
 class KSmooth {
+    static const int bins_per_sigma = 8;
+    static const int n_terms        = 8;
+
     uint    size;    // Number of elements expected in the StatT class to smooth.
     double *weights; // Weight matrix to apply while smoothing.
 
+    int bin_width() const;
+
 public:
     KSmooth(int size)  {
         this->size    = size;
@@ -40,11 +64,56 @@ public:
     }
 
     int smooth(vector<const StatT *> &popstats);
+
+    // The two methods; smooth() picks one. (These are public for testing.)
+    int smooth_exact(vector<const StatT *> &popstats);
+    int smooth_binned(vector<const StatT *> &popstats);
 };
 
+template<class StatT>
+int
+KSmooth<StatT>::bin_width() const
+{
+    // Even, so that the bins are centered on an integer basepair.
+    int width = int(sigma / bins_per_sigma) / 2 * 2;
+    return width >= 2 ? width : 0;
+}
+
 template<class StatT>
 int
 KSmooth<StatT>::smooth(vector<const StatT *> &popstats)
+{
+    //
+    // The binned method costs about `n_terms` operations per bin of the window; use it
+    // when windows hold more sites than that on average.
+    //
+    const StatT *first = NULL, *last = NULL;
+    size_t n_sites = 0;
+    for (const StatT *p : popstats) {
+        if (p == NULL)
+            continue;
+        if (first == NULL)
+            first = p;
+        last = p;
+        n_sites++;
+    }
+
+    if (n_sites == 0)
+        return 0;
+
+    int    width = this->bin_width();
+    double span  = double(last->bp - first->bp) + 1.0;
+    double per_window = n_sites * std::min(1.0, 6.0 * sigma / span);
+
+    if (width > 0 && per_window > 6.0 * bins_per_sigma * n_terms)
+        return this->smooth_binned(popstats);
+    else
+        return this->smooth_exact(popstats);
+}
+
+template<class StatT>
+int
+KSmooth<StatT>::smooth_exact(vector<const StatT *> &popstats)
 {
     //
     // To generate smooth genome-wide distributions of Fst, we calculate a kernel-smoothing
@@ -151,4 +220,140 @@ KSmooth<StatT>::smooth(vector<const StatT *> &popstats)
     return 0;
 }
 
+template<class StatT>
+int
+KSmooth<StatT>::smooth_binned(vector<const StatT *> &popstats)
+{
+    const int    limit  = 3 * sigma;
+    const long   width  = this->bin_width();
+    const size_t n      = this->size;
+    const size_t stride = n_terms * n;
+
+    //
+    // Gather the sites into the non-empty bins of the chromosome.
+    //
+    struct Bin {
+        long   idx;      // Covers [origin + idx * width, origin + (idx + 1) * width).
+        size_t beg, end; // Range of the sites in `popstats`.
+    };
+    vector<Bin> bins;
+    long origin = 0;
+
+    for (size_t pos = 0; pos < popstats.size(); pos++) {
+        const StatT *p = popstats[pos];
+        if (p == NULL)
+            continue;
+        if (bins.empty())
+            origin = p->bp;
+        long idx = (p->bp - origin) / width;
+        if (bins.empty() || bins.back().idx != idx)
+            bins.push_back({idx, pos, pos + 1});
+        else
+            bins.back().end = pos + 1;
+    }
+
+    //
+    // Compute the moments of each bin: for term k, the sum of the weighted statistics
+    // (resp. of the weights) times t^k / k!, t being the distance of the site to the
+    // center of the bin, in units of sigma.
+    //
+    vector<double> num(bins.size() * stride, 0.0);
+    vector<double> den(bins.size() * stride, 0.0);
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (size_t b = 0; b < bins.size(); b++) {
+        double *b_num = num.data() + b * stride;
+        double *b_den = den.data() + b * stride;
+        long    x     = origin + bins[b].idx * width + width / 2;
+
+        for (size_t pos = bins[b].beg; pos < bins[b].end; pos++) {
+            const StatT *p = popstats[pos];
+            if (p == NULL)
+                continue;
+
+            double t = (p->bp - x) / sigma;
+            double f = (p->alleles - 1) * exp(-0.5 * t * t);
+            for (int k = 0; k < n_terms; k++) {
+                for (size_t i = 0; i < n; i++) {
+                    if (p->stat[i] > -7.0) {
+                        b_num[k * n + i] += p->stat[i] * f;
+                        b_den[k * n + i] += f;
+                    }
+                }
+                f *= t / (k + 1);
+            }
+        }
+    }
+
+    auto floor_div = [] (long a, long b) {return a >= 0 ? a / b : -((b - 1 - a) / b);};
+
+    #pragma omp parallel
+    {
+        vector<double> c_num(n), c_den(n);
+
+        #pragma omp for schedule(dynamic, 64)
+        for (size_t pos_c = 0; pos_c < popstats.size(); pos_c++) {
+            const StatT *c = popstats[pos_c];
+
+            if (c == NULL || c->fixed == true)
+                continue;
+
+            std::fill(c_num.begin(), c_num.end(), 0.0);
+            std::fill(c_den.begin(), c_den.end(), 0.0);
+
+            //
+            // The window of the center is [c - limit, c + limit); bins `first` to `last`
+            // lie entirely within it, and the two bins around them straddle its ends.
+            //
+            long lo    = (long) c->bp - limit;
+            long hi    = (long) c->bp + limit;
+            long first = -floor_div(origin - lo, width);
+            long last  = floor_div(hi - origin, width) - 1;
+
+            auto it = std::lower_bound(bins.begin(), bins.end(), first - 1,
+                                       [] (const Bin &b, long idx) {return b.idx < idx;});
+
+            for (; it != bins.end() && it->idx <= last + 1; it++) {
+                if (it->idx < first || it->idx > last) {
+                    for (size_t pos = it->beg; pos < it->end; pos++) {
+                        const StatT *p = popstats[pos];
+                        if (p == NULL || p->bp < lo || p->bp >= hi)
+                            continue;
+
+                        int    dist = p->bp > c->bp ? p->bp - c->bp : c->bp - p->bp;
+                        double w    = (p->alleles - 1) * this->weights[dist];
+                        for (size_t i = 0; i < n; i++) {
+                            if (p->stat[i] > -7.0) {
+                                c_num[i] += p->stat[i] * w;
+                                c_den[i] += w;
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                size_t        b     = it - bins.begin();
+                const double *b_num = num.data() + b * stride;
+                const double *b_den = den.data() + b * stride;
+                long          d     = c->bp - (origin + it->idx * width + width / 2);
+                double        z     = d / sigma;
+                double        w     = this->weights[d >= 0 ? d : -d];
+
+                for (int k = 0; k < n_terms; k++) {
+                    for (size_t i = 0; i < n; i++) {
+                        c_num[i] += w * b_num[k * n + i];
+                        c_den[i] += w * b_den[k * n + i];
+                    }
+                    w *= z;
+                }
+            }
+
+            for (size_t i = 0; i < n; i++)
+                c->smoothed[i] = c_num[i] / c_den[i];
+        }
+    }
+
+    return 0;
+}
+
 #endif // __SMOOTHING_H__
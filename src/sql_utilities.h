@@ -28,6 +28,9 @@
 
 #include "input.h"
 #include "utils.h"
+#include "LociBin.h"
+#include "CatalogStore.h"
+#include "LocusArena.h"
 
 //
 // The expected number of tab-separated fields in our SQL input files.
@@ -47,9 +50,109 @@ int load_snp_calls(string sample,  map<int, SNPRes *> &snpres);
 vector<pair<int, int> > retrieve_bijective_loci(const vector<CatMatch*>& matches);
 vector<pair<int, int> > retrieve_bijective_loci(const vector<pair<int,int>>& sloc_cloc_id_pairs);
 
+//
+// load_loci()
+// ----------
+// Loads the loci of a sample (or of the catalog) from its `.loci.bin` file (or
+// from the catalog store) if it is up to date, from its tags/snps/alleles TSV
+// files otherwise. If an arena is given, the strings and SNPs of the loci are
+// allocated in it (see LocusArena.h).
+//
+template <class LocusT>
+int
+load_loci(LociBinReader &reader, map<int, LocusT *> &loci, int store_reads, bool load_all_model_calls, LocusArena *arena=NULL)
+{
+    while (true) {
+        LocusT *c = new LocusT;
+        c->arena = arena;
+        if (!reader.next(*c, store_reads, load_all_model_calls)) {
+            delete c;
+            break;
+        }
+        if (loci.count(c->id) > 0) {
+            cerr << "Error parsing " << reader.path() << ": locus " << c->id << " appears twice.\n";
+            delete c;
+            return 0;
+        }
+        loci[c->id] = c;
+    }
+    if (reader.bad())
+        return 0;
+
+    for (auto& l : loci)
+        l.second->populate_alleles();
+
+    return 1;
+}
+
+//
+// Loads the catalog from its store (see CatalogStore.h).
+//
+template <class LocusT>
+int
+load_loci(const CatalogStore &store, map<int, LocusT *> &loci, bool load_comps, bool load_all_model_calls, LocusArena *arena=NULL)
+{
+    for (size_t i = 0; i < store.size(); ++i) {
+        LocusT *c = new LocusT;
+        c->arena = arena;
+        store.load(store.entry(i), *c, load_comps, load_all_model_calls);
+        if (loci.count(c->id) > 0)
+            delete loci[c->id];
+        loci[c->id] = c;
+    }
+
+    for (auto& l : loci)
+        l.second->populate_alleles();
+
+    return 1;
+}
+
+template <class LocusT>
+int
+load_catalog_store(const string& prefix, map<int, LocusT *> &loci, bool load_comps, bool load_all_model_calls, bool verbose=true, LocusArena *arena=NULL)
+{
+    CatalogStore store;
+    if (!store.open(prefix + ".store")) {
+        cerr << " Unable to open '" << prefix << "'\n";
+        return 0;
+    }
+    if (verbose)
+        cerr << "  Parsing " << store.path() << "\n";
+
+    return load_loci(store, loci, load_comps, load_all_model_calls, arena);
+}
+
+template <class LocusT>
+int
+load_loci_tsv(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool load_all_model_calls, bool &compressed, bool verbose=true, LocusArena *arena=NULL);
+
+template <class LocusT>
+int
+load_loci(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool load_all_model_calls, bool &compressed, bool verbose=true, LocusArena *arena=NULL)
+{
+    if (use_catalog_store(sample)) {
+        compressed = true;
+        return load_catalog_store(sample, loci, true, load_all_model_calls, verbose, arena);
+    }
+    if (!use_loci_bin(sample))
+        return load_loci_tsv(sample, loci, store_reads, load_all_model_calls, compressed, verbose, arena);
+
+    LociBinReader reader;
+    if (!reader.open(sample + ".loci.bin")) {
+        if (!reader.bad())
+            cerr << " Unable to open '" << sample << "'\n";
+        return 0;
+    }
+    if (verbose)
+        cerr << "  Parsing " << reader.path() << "\n";
+    compressed = true;
+
+    return load_loci(reader, loci, store_reads, load_all_model_calls, arena);
+}
+
 template <class LocusT>
 int
-load_loci(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool load_all_model_calls, bool &compressed, bool verbose=true)
+load_loci_tsv(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool load_all_model_calls, bool &compressed, bool verbose, LocusArena *arena)
 {
     using namespace std;
 
@@ -141,8 +244,7 @@ load_loci(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool
                 // homozygous base (O), a heterozygous base (E), or if the base type was unknown (U).
                 //
                 if (parts[2] == "model") {
-                    loci[id]->model = new char[parts[5].length() + 1];
-                    strcpy(loci[id]->model, parts[5].c_str());
+                    loci[id]->model = arena_str(arena, parts[5].c_str(), parts[5].length());
 
                 } else {
                     //
@@ -153,13 +255,11 @@ load_loci(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool
                     if (store_reads >= 1) {
                         if (store_reads >= 2) {
                             // Load the actual sequences (otherwise don't).
-                            char *read = new char[parts[5].length() + 1];
-                            strcpy(read, parts[5].c_str());
+                            char *read = arena_str(arena, parts[5].c_str(), parts[5].length());
                             loci[id]->reads.push_back(read);
                         }
 
-                        char *read_id = new char[parts[4].length() + 1];
-                        strcpy(read_id, parts[4].c_str());
+                        char *read_id = arena_str(arena, parts[4].c_str(), parts[4].length());
                         loci[id]->comp.push_back(read_id);
                         //
                         // Store the internal stack number for this read.
@@ -193,9 +293,11 @@ load_loci(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool
         }
 
         c = new LocusT;
+        c->arena     = arena;
         c->sample_id = atoi(parts[0].c_str());
         c->id        = id;
-        c->add_consensus(parts[5].c_str());
+        c->len       = parts[5].length();
+        c->con       = arena_str(arena, parts[5].c_str(), c->len);
 
         //
         // Read in the flags
@@ -210,9 +312,7 @@ load_loci(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool
         while (*q != '\0') {
             for (p = q; *q != ',' && *q != '\0'; q++);
             len = q - p;
-            cmp = new char[len + 1];
-            strncpy(cmp, p, len);
-            cmp[len] = '\0';
+            cmp = arena_str(arena, p, len);
             c->comp.push_back(cmp);
             if (*q != '\0') q++;
         }
@@ -281,7 +381,7 @@ load_loci(const string& sample,  map<int, LocusT *> &loci, int store_reads, bool
         if (load_all_model_calls == false && parts[3] != "E")
             continue;
 
-        snp         = new SNP;
+        snp         = arena_snp(arena);
         snp->col    = atoi(parts[2].c_str());
         snp->lratio = atof(parts[4].c_str());
         snp->rank_1 = parts[5].at(0);
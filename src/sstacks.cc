@@ -41,7 +41,6 @@ string  catalog_path;
 string  out_path;
 FileT   in_file_type = FileT::sql;
 int     num_threads  =  1;
-int     samp_id      =  0;
 bool    verify_haplotypes       = true;
 bool    impute_haplotypes       = true;
 bool    require_uniq_haplotypes = false;
@@ -66,7 +65,9 @@ int main (int argc, char* argv[]) {
     #ifdef _OPENMP
     omp_set_num_threads(num_threads);
     #endif
+    BgzfWriter::set_n_threads(num_threads);
 
+    LocusArena         catalog_arena; // Must outlive the catalog loci.
     map<int, Locus *>  catalog;
     bool compressed = false;
     int  res;
@@ -74,16 +75,20 @@ int main (int argc, char* argv[]) {
     cerr << "Searching for matches by sequence identity...\n";
 
     catalog_path += "catalog";
-    res = load_loci(catalog_path, catalog, 0, false, compressed);
+    if (use_catalog_store(catalog_path))
+        // The components of the catalog loci are not needed.
+        res = load_catalog_store(catalog_path, catalog, false, false, true, &catalog_arena);
+    else
+        res = load_loci(catalog_path, catalog, 0, false, compressed, true, &catalog_arena);
 
     if (res == 0) {
         cerr << "Error: Unable to parse catalog, '" << catalog_path << "'\n";
         throw exception();
     }
 
-    KmerHashMap kmer_map;
+    LociIndex<Locus> cat_index (catalog);
+    KmerIndex kmer_map;
     map<int, pair<allele_type, int> > allele_map;
-    vector<char *> kmer_map_keys;
 
     //
     // Build a hash map out of the catalog, for exact matching.;
@@ -96,56 +101,117 @@ int main (int argc, char* argv[]) {
 
     if (gapped_alignments) {
         cerr << "Populating kmer dictionary for gapped alignments...";
-        populate_kmer_hash(catalog, kmer_map, kmer_map_keys, allele_map, gapped_kmer_len);
+        populate_kmer_hash(catalog, kmer_map, allele_map, gapped_kmer_len);
         cerr << "done.\n";
     }
 
-    string sample_path;
-    int    i = 1;
+    //
+    // Samples are loaded on a dedicated thread and matched against the catalog
+    // by chunks of loci, several samples at a time so that the threads stay
+    // busy. Each sample is written out once all its chunks are done, in the
+    // order of the input.
+    //
+    const size_t chunk_size = 256;
 
-    while (!samples.empty()) {
-        map<int, QLocus *> sample;
+    bool load_failed = false;
+    BoundedQueue<unique_ptr<SampleJob>> loaded (2);
+    std::thread loader ([&] () {
+        for (size_t i = 0; !samples.empty(); i++) {
+            unique_ptr<SampleJob> job = load_sample(i, samples.front(), chunk_size);
+            samples.pop();
+            if (!job) {
+                load_failed = true;
+                break;
+            }
+            if (!loaded.push(move(job)))
+                break;
+        }
+        loaded.close();
+    });
+
+    OrderedWriter<unique_ptr<SampleJob>> writer (2 * num_threads + 2,
+        [&] (size_t, unique_ptr<SampleJob> &job) {
+            cerr << "\nProcessing sample '" << job->path << "' [" << job->i + 1 << " of " << sample_cnt << "]\n"
+                 << "Searching for sequence matches...\n";
+            job->seq_stats.report(cerr, job->queries.size(), catalog.size());
+
+            if (gapped_alignments) {
+                cerr << "Searching for gapped alignments...\n";
+                job->gap_stats.report(cerr, job->queries.size());
+            }
 
-        sample_path = samples.front();
-        samples.pop();
+            write_matches(job->path, job->loci, job->sample_id, job->file_type);
+            job.reset();
+        });
 
-        cerr << "\nProcessing sample '" << sample_path << "' [" << i << " of " << sample_cnt << "]\n";
+    std::mutex         sched_mtx;
+    deque<SampleJob *> active; // Samples with chunks left to hand out.
+    bool               all_loaded = false;
 
-        res = load_loci(sample_path, sample, 2, false, compressed);
+    #pragma omp parallel
+    {
+        GappedAln *aln = gapped_alignments ? new GappedAln() : NULL;
 
-        if (res == 0) {
-            cerr << "Error: Unable to parse '" << sample_path << "'\n";
-            throw exception();
-        }
+        while (true) {
+            //
+            // Take the next chunk, starting on a new sample once all the chunks of
+            // the samples in flight have been handed out.
+            //
+            SampleJob *job   = NULL;
+            size_t     chunk = 0;
+            {
+                std::lock_guard<std::mutex> lock (sched_mtx);
+                while (active.empty() && !all_loaded) {
+                    unique_ptr<SampleJob> next;
+                    if (loaded.pop(next))
+                        active.push_back(next.release());
+                    else
+                        all_loaded = true;
+                }
+                if (active.empty())
+                    break;
 
-        in_file_type = compressed == true ? FileT::gzsql : FileT::sql;
+                job   = active.front();
+                chunk = job->next_chunk++;
+                if (job->next_chunk == job->n_chunks)
+                    active.pop_front();
+            }
 
-        //
-        // Assign the ID for this sample data.
-        //
-        samp_id = sample.begin()->second->sample_id;
+            SeqMatchStats seq_stats;
+            GapMatchStats gap_stats;
+            size_t end = std::min((chunk + 1) * chunk_size, job->queries.size());
+            for (size_t k = chunk * chunk_size; k < end; k++) {
+                match_by_sequence(cat_index, catalog_exact_map, job->queries[k], seq_stats);
 
-        //dump_loci(catalog);
-        //dump_loci(sample);
+                //
+                // Loci that did not match exactly are searched for with gapped alignments.
+                //
+                if (gapped_alignments)
+                    match_by_gaps(cat_index, job->queries[k], kmer_map, allele_map, min_match_len, aln, gap_stats);
+            }
 
-        cerr << "Searching for sequence matches...\n";
-        find_matches_by_sequence(catalog, catalog_exact_map, sample);
+            bool done;
+            #pragma omp critical(sample_stats)
+            {
+                job->seq_stats += seq_stats;
+                job->gap_stats += gap_stats;
+                done = --job->chunks_left == 0;
+            }
 
-        if (gapped_alignments) {
-            cerr << "Searching for gapped alignments...\n";
-            search_for_gaps(catalog, sample, kmer_map, allele_map, min_match_len);
+            if (done && !writer.put(job->i, unique_ptr<SampleJob>(job))) {
+                // The writer failed; stop the loader.
+                loaded.close();
+                break;
+            }
         }
 
-        write_matches(sample_path, sample);
-        i++;
-
-        //
-        // Free memory associated with the sample.
-        //
-        for (map<int, QLocus *>::iterator j = sample.begin(); j != sample.end(); j++)
-            delete j->second;
-        sample.clear();
+        delete aln;
     }
+    loader.join();
+    writer.close();
+
+    if (load_failed)
+        throw exception();
 
     //
     // Free memory associated with the hash.
@@ -157,9 +223,6 @@ int main (int argc, char* argv[]) {
         delete [] catalog_exact_map_keys[i];
     catalog_exact_map_keys.clear();
 
-    if (gapped_alignments)
-        free_kmer_hash(kmer_map, kmer_map_keys);
-
     //
     // Free memory associated with the catalog.
     //
@@ -574,95 +637,138 @@ generate_query_haplotypes(Locus *s1_tag, QLocus *s2_tag, set<string> &query_hapl
     return 0;
 }
 
-int
-find_matches_by_sequence(map<int, Locus *> &sample_1, HashMap &sample_1_map, map<int, QLocus *> &sample_2)
+unique_ptr<SampleJob>
+load_sample(size_t i, const string &sample_path, size_t chunk_size)
 {
-    //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
-    //
-    vector<int> keys;
-    for (auto i = sample_2.begin(); i != sample_2.end(); i++)
-        keys.push_back(i->first);
+    unique_ptr<SampleJob> job (new SampleJob(i, sample_path));
+    bool compressed = false;
+
+    int res = load_loci(sample_path, job->loci, 2, false, compressed, false, &job->arena);
+
+    if (res == 0 || job->loci.empty()) {
+        cerr << "Error: Unable to parse '" << sample_path << "'\n";
+        return unique_ptr<SampleJob>();
+    }
+
+    job->file_type = compressed == true ? FileT::gzsql : FileT::sql;
 
     //
-    // Initialize some counters
+    // Assign the ID for this sample data.
     //
-    unsigned long matches = 0;
-    unsigned long mmatch  = 0;
-    unsigned long nosnps  = 0;
-    unsigned long nomatch = 0;
-    unsigned long no_haps = 0;
-    unsigned long tot_hap = 0;
-    unsigned long ver_hap = 0;
+    job->sample_id = job->loci.begin()->second->sample_id;
 
-    #pragma omp parallel
-    {
-        #pragma omp for reduction(+:matches) reduction(+:tot_hap) reduction(+:ver_hap) reduction(+:nomatch) reduction(+:mmatch)
-        for (uint k = 0; k < keys.size(); k++) {
-            QLocus *query = sample_2[keys[k]];
+    for (auto &l : job->loci)
+        job->queries.push_back(l.second);
+    job->n_chunks    = (job->queries.size() + chunk_size - 1) / chunk_size;
+    job->chunks_left = job->n_chunks;
 
-            //
-            // Iterate through the haplotypes for this tag in sample_2
-            //
-            HashMap::iterator hit;
-            map<string, vector<string> > haplo_hits;
-            set<int> loci_hit;
+    return job;
+}
 
-            for (auto q = query->strings.begin(); q != query->strings.end(); q++) {
-                // cerr << "  Looking for haplotype: " << q->first << " with sequence " << q->second.substr(0, min_tag_len) << "\n";
+SeqMatchStats&
+SeqMatchStats::operator+= (const SeqMatchStats &other)
+{
+    matches += other.matches;
+    mmatch  += other.mmatch;
+    nosnps  += other.nosnps;
+    nomatch += other.nomatch;
+    no_haps += other.no_haps;
+    tot_hap += other.tot_hap;
+    ver_hap += other.ver_hap;
+    return *this;
+}
 
-                hit = sample_1_map.find(q->second.c_str());
+void
+SeqMatchStats::report(ostream &os, size_t n_loci, size_t n_catalog) const
+{
+    os << n_loci << " sample loci compared against the catalog containing " << n_catalog << " loci.\n"
+       << "  " << matches << " matching loci, " << no_haps << " contained no verified haplotypes.\n"
+       << "  " << mmatch  << " loci matched more than one catalog locus and were excluded.\n"
+       << "  " << nosnps  << " loci contained SNPs unaccounted for in the catalog and were excluded.\n"
+       << "  " << tot_hap << " total haplotypes examined from matching loci, " << ver_hap << " verified.\n";
+}
 
-                if (hit != sample_1_map.end()) {
-                    tot_hap++;
-                    // cerr << "    Found a match for " << hit->first << "\n";
+GapMatchStats&
+GapMatchStats::operator+= (const GapMatchStats &other)
+{
+    gapped_aln += other.gapped_aln;
+    matches    += other.matches;
+    mmatches   += other.mmatches;
+    nomatches  += other.nomatches;
+    ver_hap    += other.ver_hap;
+    tot_hap    += other.tot_hap;
+    bad_aln    += other.bad_aln;
+    no_haps    += other.no_haps;
+    nosnps     += other.nosnps;
+    return *this;
+}
 
-                    for (auto c = hit->second.begin(); c != hit->second.end(); c++) {
-                        //
-                        // Record the catalog loci hit by the haplotypes of this query locus.
-                        //
-                        loci_hit.insert(c->first);
+void
+GapMatchStats::report(ostream &os, size_t n_loci) const
+{
+    os << "Out of " << n_loci << " query loci, " << gapped_aln << " gapped alignments attempted.\n"
+       << "  "   << matches   << " loci matched one catalog locus; " << tot_hap << " total haplotypes examined, " << ver_hap << " verified.\n"
+       << "  "   << nomatches << " loci matched no catalog locus;\n"
+       << "    " << mmatches  << " loci matched more than one catalog locus and were excluded.\n"
+       << "    " << nosnps    << " loci contained SNPs unaccounted for in the catalog and were excluded.\n"
+       << "    " << no_haps   << " loci had no verified haplotypes.\n"
+       << "    " << bad_aln   << " loci had inconsistent alignments to a catalog locus and were excluded.\n";
+}
 
-                        //
-                        // Record the haplotypes hit between the query and catalog loci.
-                        //
-                        haplo_hits[q->first].push_back(c->second);
+void
+match_by_sequence(const LociIndex<Locus> &sample_1, HashMap &sample_1_map, QLocus *query, SeqMatchStats &stats)
+{
+    //
+    // Iterate through the haplotypes for this tag in sample_2
+    //
+    HashMap::iterator hit;
+    map<string, vector<string> > haplo_hits;
+    set<int> loci_hit;
 
-                        if (verify_haplotypes == false)
-                            query->add_match(c->first, c->second);
-                    }
-                }
-            }
+    for (auto q = query->strings.begin(); q != query->strings.end(); q++) {
+        // cerr << "  Looking for haplotype: " << q->first << " with sequence " << q->second.substr(0, min_tag_len) << "\n";
 
-            if (loci_hit.size() == 0)
-                nomatch++;
-            else if (loci_hit.size() > 0)
-                matches++;
+        hit = sample_1_map.find(q->second.c_str());
 
-            if (verify_haplotypes && loci_hit.size() > 0) {
-                uint verified = verify_sequence_match(sample_1, query, loci_hit, haplo_hits,
-                                                      mmatch, nosnps);
-                ver_hap += verified;
-                if (verified == 0) {
-                    no_haps++;
-                    if (!loci_hit.empty())
-                        assert(write_all_matches ^ query->matches.empty());
-                }
+        if (hit != sample_1_map.end()) {
+            stats.tot_hap++;
+            // cerr << "    Found a match for " << hit->first << "\n";
+
+            for (auto c = hit->second.begin(); c != hit->second.end(); c++) {
+                //
+                // Record the catalog loci hit by the haplotypes of this query locus.
+                //
+                loci_hit.insert(c->first);
+
+                //
+                // Record the haplotypes hit between the query and catalog loci.
+                //
+                haplo_hits[q->first].push_back(c->second);
+
+                if (verify_haplotypes == false)
+                    query->add_match(c->first, c->second);
             }
         }
     }
 
-    cerr << keys.size() << " sample loci compared against the catalog containing " << sample_1.size() << " loci.\n"
-         << "  " << matches << " matching loci, " << no_haps << " contained no verified haplotypes.\n"
-         << "  " << mmatch  << " loci matched more than one catalog locus and were excluded.\n"
-         << "  " << nosnps  << " loci contained SNPs unaccounted for in the catalog and were excluded.\n"
-         << "  " << tot_hap << " total haplotypes examined from matching loci, " << ver_hap << " verified.\n";
-
-    return 0;
+    if (loci_hit.size() == 0)
+        stats.nomatch++;
+    else if (loci_hit.size() > 0)
+        stats.matches++;
+
+    if (verify_haplotypes && loci_hit.size() > 0) {
+        uint verified = verify_sequence_match(sample_1, query, loci_hit, haplo_hits,
+                                              stats.mmatch, stats.nosnps);
+        stats.ver_hap += verified;
+        if (verified == 0) {
+            stats.no_haps++;
+            if (!loci_hit.empty())
+                assert(write_all_matches ^ query->matches.empty());
+        }
+    }
 }
 
-int verify_sequence_match(map<int, Locus *> &sample_1, QLocus *query,
+int verify_sequence_match(const LociIndex<Locus> &sample_1, QLocus *query,
                           set<int> &loci_hit, map<string, vector<string> > &haplo_hits,
                           unsigned long &mmatch, unsigned long &nosnps) {
     //
@@ -676,7 +782,7 @@ int verify_sequence_match(map<int, Locus *> &sample_1, QLocus *query,
         return 0;
     }
 
-    Locus *cat = sample_1[*(loci_hit.begin())];
+    Locus *cat = sample_1.find(*(loci_hit.begin()));
 
     //
     // 2. Make sure the query has no SNPs unaccounted for in the catalog.
@@ -756,240 +862,162 @@ int verify_sequence_match(map<int, Locus *> &sample_1, QLocus *query,
     return verified;
 }
 
-int
-search_for_gaps(map<int, Locus *> &catalog, map<int, QLocus *> &sample,
-                KmerHashMap &kmer_map, map<int, pair<allele_type, int> > &allele_map,
-                double min_match_len)
+void
+match_by_gaps(const LociIndex<Locus> &catalog, QLocus *query,
+              KmerIndex &kmer_map, map<int, pair<allele_type, int> > &allele_map,
+              double min_match_len, GappedAln *aln, GapMatchStats &stats)
 {
     //
     // Search for loci that can be merged with a gapped alignment.
     //
+    Locus                      *tag_2;
+    AlignRes                    aln_res;
+    vector<uint32_t>            kmer_ids;
+    vector<int>                 hits;
+    vector<pair<int, int>>      ordered_hits;
+    uint                        hit_cnt, index, prev_id, allele_id, hits_size, stop, top_hit;
+    pair<allele_type, int>      cat_hit;
+    string                      query_allele, query_seq, cat_allele, cat_seq;
+    set<int>                    loci_hit;
+    vector<pair<char, uint>>    cigar;
 
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // If we already matched this locus to the catalog without using gapped alignments, skip it now.
     //
-    vector<int> keys;
-    for (auto it = sample.begin(); it != sample.end(); it++)
-        keys.push_back(it->first);
+    if (query->matches.size() > 0)
+        return;
 
-    //
-    // Calculate the number of k-mers we will generate. If kmer_len == 0,
-    // determine the optimal length for k-mers.
-    //
-    int con_len   = strlen(sample[keys[0]]->con);
-    int num_kmers = con_len - gapped_kmer_len + 1;
+    stats.gapped_aln++;
 
-    uint gapped_aln = 0;
-    uint matches    = 0;
-    uint mmatches   = 0;
-    uint nomatches  = 0;
-    uint ver_hap    = 0;
-    uint tot_hap    = 0;
-    uint bad_aln    = 0;
-    uint no_haps    = 0;
-    uint nosnps     = 0;
+    map<allele_type, map<allele_type, AlignRes>> query_hits;
 
-    #pragma omp parallel
-    {
-        QLocus                     *query;
-        Locus                      *tag_2;
-        KmerHashMap::iterator       h;
-        AlignRes                    aln_res;
-        vector<char *>              kmers;
-        set<string>                 uniq_kmers;
-        vector<int>                 hits;
-        vector<pair<int, int>>      ordered_hits;
-        uint                        hit_cnt, index, prev_id, allele_id, hits_size, stop, top_hit;
-        pair<allele_type, int>      cat_hit;
-        string                      query_allele, query_seq, cat_allele, cat_seq;
-        map<string, vector<string>> haplo_hits;
-        set<int>                    loci_hit;
-        vector<pair<char, uint>>    cigar;
-
-        GappedAln *aln = new GappedAln();
-
-        initialize_kmers(gapped_kmer_len, num_kmers, kmers);
-
-        #pragma omp for schedule(dynamic) reduction(+:matches) reduction(+:nomatches) reduction(+:mmatches) reduction(+:gapped_aln) reduction(+:ver_hap) \
-                                          reduction(+:tot_hap) reduction(+:bad_aln) reduction(+:no_haps)
-        for (uint i = 0; i < keys.size(); i++) {
-            query = sample[keys[i]];
+    for (auto allele = query->strings.begin(); allele != query->strings.end(); allele++) {
 
-            //
-            // If we already matched this locus to the catalog without using gapped alignments, skip it now.
-            //
-            if (query->matches.size() > 0)
-                continue;
-
-            gapped_aln++;
+        query_allele = allele->first;
+        query_seq    = allele->second;
+        stats.tot_hap++;
 
-            map<allele_type, map<allele_type, AlignRes>> query_hits;
+        hits.clear();
+        ordered_hits.clear();
 
-            loci_hit.clear();
+        //
+        // Lookup the occurances of each k-mer in the kmer_map. We want to search with
+        // unique kmers; otherwise, repetitive kmers will generate, multiple, spurious
+        // hits in sequences with multiple copies of the same kmer.
+        //
+        kmer_map.lookup(allele->second.c_str(), allele->second.length(), true, hits, kmer_ids);
 
-            for (auto allele = query->strings.begin(); allele != query->strings.end(); allele++) {
+        //
+        // Sort the vector of indexes; provides the number of hits to each allele/locus
+        // and orders them largest to smallest.
+        //
+        sort(hits.begin(), hits.end());
 
-                query_allele = allele->first;
-                query_seq    = allele->second;
-                tot_hap++;
+        //
+        // Iterate through the list of hits and collapse them down by number of kmer hits per allele.
+        //
+        hits_size = hits.size();
 
-                generate_kmers_lazily(allele->second.c_str(), gapped_kmer_len, num_kmers, kmers);
+        if (hits_size == 0)
+            continue;
 
-                //
-                // We want to create a list of unique kmers to search with; otherwise, repetitive kmers will
-                // generate, multiple, spurious hits in sequences with multiple copies of the same kmer.
-                //
-                uniq_kmers.clear();
-                for (int j = 0; j < num_kmers; j++)
-                    uniq_kmers.insert(kmers[j]);
+        prev_id   = hits[0];
+        index     = 0;
 
-                hits.clear();
-                ordered_hits.clear();
+        do {
+            hit_cnt   = 0;
+            allele_id = prev_id;
 
-                //
-                // Lookup the occurances of each k-mer in the kmer_map
-                //
-                for (auto j = uniq_kmers.begin(); j != uniq_kmers.end(); j++) {
+            while (index < hits_size && (uint) hits[index] == prev_id) {
+                hit_cnt++;
+                index++;
+            }
 
-                    h = kmer_map.find(j->c_str());
+            if (index < hits_size)
+                prev_id = hits[index];
 
-                    if (h != kmer_map.end())
-                        for (uint k = 0; k <  h->second.size(); k++)
-                            hits.push_back(h->second[k]);
-                }
+            ordered_hits.push_back(make_pair(allele_id, hit_cnt));
 
-                //
-                // Sort the vector of indexes; provides the number of hits to each allele/locus
-                // and orders them largest to smallest.
-                //
-                sort(hits.begin(), hits.end());
+        } while (index < hits_size);
 
-                //
-                // Iterate through the list of hits and collapse them down by number of kmer hits per allele.
-                //
-                hits_size = hits.size();
+        if (ordered_hits.size() == 0)
+            continue;
 
-                if (hits_size == 0)
-                    continue;
+        //
+        // Process the hits from most kmer hits to least kmer hits.
+        //
+        sort(ordered_hits.begin(), ordered_hits.end(), compare_pair_intint);
 
-                prev_id   = hits[0];
-                index     = 0;
+        //
+        // Only try to align the sequences with the most kmers in common.
+        //
+        top_hit = ordered_hits[0].second;
+        stop    = 1;
+        for (uint j = 1; j < ordered_hits.size(); j++)
+            if ((uint) ordered_hits[j].second < top_hit) {
+                stop = j;
+                break;
+            }
 
-                do {
-                    hit_cnt   = 0;
-                    allele_id = prev_id;
+        for (uint j = 0; j < stop; j++) {
+            cat_hit = allele_map.at(ordered_hits[j].first);
+            hit_cnt = ordered_hits[j].second;
 
-                    while (index < hits_size && (uint) hits[index] == prev_id) {
-                        hit_cnt++;
-                        index++;
-                    }
+            tag_2 = catalog.find(cat_hit.second);
 
-                    if (index < hits_size)
-                        prev_id = hits[index];
+            cat_allele = cat_hit.first;
+            cat_seq    = "";
+            for (uint k = 0; k < tag_2->strings.size(); k++)
+                if (tag_2->strings[k].first == cat_hit.first) {
+                    cat_seq = tag_2->strings[k].second;
+                    break;
+                }
 
-                    ordered_hits.push_back(make_pair(allele_id, hit_cnt));
+            aln->init(tag_2->len, query->len);
 
-                } while (index < hits_size);
+            // cerr << "Attempting to align: cat id " << tag_2->id << " with locus id " << query->id << "\n"
+            //      << "Cat allele: " << cat_allele   << "; seq: " << cat_seq << "\n"
+            //      << "Allele:     " << query_allele << "; seq: " << allele->second << "\n";
 
-                if (ordered_hits.size() == 0)
-                    continue;
+            if (aln->align(cat_seq, query_seq)) {
+                aln->parse_cigar(cigar);
 
+                aln_res = aln->result();
                 //
-                // Process the hits from most kmer hits to least kmer hits.
+                // At this point in the analysis, all possible alleles we want to detect must already
+                // be present in the catalog. Therefore, we should reject any alignment that implies a
+                // change in the catalog sequence (with the presence of an deletion element) as
+                // spurious.
                 //
-                sort(ordered_hits.begin(), ordered_hits.end(), compare_pair_intint);
+                if (aln_res.cigar.find('D') != string::npos)
+                    continue;
 
                 //
-                // Only try to align the sequences with the most kmers in common.
+                // If the alignment has too many gaps, skip it.
+                // If the alignment doesn't span enough of the two sequences, skip it.
                 //
-                top_hit = ordered_hits[0].second;
-                stop    = 1;
-                for (uint j = 1; j < ordered_hits.size(); j++)
-                    if ((uint) ordered_hits[j].second < top_hit) {
-                        stop = j;
-                        break;
-                    }
-
-                for (uint j = 0; j < stop; j++) {
-                    cat_hit = allele_map.at(ordered_hits[j].first);
-                    hit_cnt = ordered_hits[j].second;
-
-                    tag_2 = catalog[cat_hit.second];
-
-                    cat_allele = cat_hit.first;
-                    cat_seq    = "";
-                    for (uint k = 0; k < tag_2->strings.size(); k++)
-                        if (tag_2->strings[k].first == cat_hit.first) {
-                            cat_seq = tag_2->strings[k].second;
-                            break;
-                        }
-
-                    aln->init(tag_2->len, query->len);
-
-                    // cerr << "Attempting to align: cat id " << tag_2->id << " with locus id " << query->id << "\n"
-                    //      << "Cat allele: " << cat_allele   << "; seq: " << cat_seq << "\n"
-                    //      << "Allele:     " << query_allele << "; seq: " << allele->second << "\n";
-
-                    if (aln->align(cat_seq, query_seq)) {
-                        aln->parse_cigar(cigar);
-
-                        aln_res = aln->result();
-                        //
-                        // At this point in the analysis, all possible alleles we want to detect must already
-                        // be present in the catalog. Therefore, we should reject any alignment that implies a
-                        // change in the catalog sequence (with the presence of an deletion element) as
-                        // spurious.
-                        //
-                        if (aln_res.cigar.find('D') != string::npos)
-                            continue;
-
-                        //
-                        // If the alignment has too many gaps, skip it.
-                        // If the alignment doesn't span enough of the two sequences, skip it.
-                        //
-                        if (aln_res.gap_cnt <= (max_gaps + 1) &&
-                            aln_res.pct_id  >= min_match_len  &&
-                            dist(cat_seq.c_str(), query_seq.c_str(), cigar) == 0) {
-                            loci_hit.insert(tag_2->id);
-                            query_hits[query_allele][cat_allele] = aln_res;
-                        }
-                    }
+                if (aln_res.gap_cnt <= (max_gaps + 1) &&
+                    aln_res.pct_id  >= min_match_len  &&
+                    dist(cat_seq.c_str(), query_seq.c_str(), cigar) == 0) {
+                    loci_hit.insert(tag_2->id);
+                    query_hits[query_allele][cat_allele] = aln_res;
                 }
             }
-
-            if (verify_gapped_match(catalog, query, loci_hit, query_hits, mmatches, nosnps, no_haps, bad_aln, ver_hap))
-                matches++;
-            else {
-                nomatches++;
-                if (!loci_hit.empty())
-                    assert(write_all_matches ^ query->matches.empty());
-            }
         }
-
-        //
-        // Free the k-mers we generated for this query and the alignment class.
-        //
-        for (uint j = 0; j < kmers.size(); j++)
-            delete [] kmers[j];
-        kmers.clear();
-
-        delete aln;
     }
 
-    cerr << "Out of " << keys.size() << " query loci, " << gapped_aln << " gapped alignments attempted.\n"
-         << "  "   << matches   << " loci matched one catalog locus; " << tot_hap << " total haplotypes examined, " << ver_hap << " verified.\n"
-         << "  "   << nomatches << " loci matched no catalog locus;\n"
-         << "    " << mmatches  << " loci matched more than one catalog locus and were excluded.\n"
-         << "    " << nosnps    << " loci contained SNPs unaccounted for in the catalog and were excluded.\n"
-         << "    " << no_haps   << " loci had no verified haplotypes.\n"
-         << "    " << bad_aln   << " loci had inconsistent alignments to a catalog locus and were excluded.\n";
-
-    return 0;
+    if (verify_gapped_match(catalog, query, loci_hit, query_hits,
+                            stats.mmatches, stats.nosnps, stats.no_haps, stats.bad_aln, stats.ver_hap))
+        stats.matches++;
+    else {
+        stats.nomatches++;
+        if (!loci_hit.empty())
+            assert(write_all_matches ^ query->matches.empty());
+    }
 }
 
 bool
-verify_gapped_match(map<int, Locus *> &catalog, QLocus *query,
+verify_gapped_match(const LociIndex<Locus> &catalog, QLocus *query,
                     set<int> &loci_hit, map<allele_type, map<allele_type, AlignRes> > &query_hits,
                     uint &mmatch, uint &nosnps, uint &no_haps, uint &bad_aln, uint &ver_hits) {
     //
@@ -1006,7 +1034,7 @@ verify_gapped_match(map<int, Locus *> &catalog, QLocus *query,
     }
 
     int    cat_id = *(loci_hit.begin());
-    Locus *cat    = catalog[cat_id];
+    Locus *cat    = catalog.find(cat_id);
 
     AlignRes aln_res;
     string   query_allele, cat_allele, converted_query_allele, qseq;
@@ -1188,7 +1216,7 @@ populate_hash(map<int, Locus *> &sample, HashMap &hash_map, vector<char *> &hash
 }
 
 int
-write_matches(string sample_path, map<int, QLocus *> &sample)
+write_matches(string sample_path, map<int, QLocus *> &sample, int samp_id, FileT in_file_type)
 {
     map<int, QLocus *>::iterator i;
 
@@ -1204,17 +1232,14 @@ write_matches(string sample_path, map<int, QLocus *> &sample)
     //
     // Open the output files for writing.
     //
-    gzFile   gz_matches=NULL;
+    BgzfWriter gz_matches;
     ofstream matches;
     if (in_file_type == FileT::gzsql) {
-        gz_matches = gzopen(out_file.c_str(), "wb");
-        if (!gz_matches) {
+        gz_matches.open(out_file);
+        if (!gz_matches.is_open()) {
             cerr << "Error: Unable to open gzipped matches file '" << out_file << "': " << strerror(errno) << ".\n";
             exit(1);
         }
-        #if ZLIB_VERNUM >= 0x1240
-        gzbuffer(gz_matches, libz_buffer_size);
-        #endif
     } else {
         matches.open(out_file.c_str());
         check_open(matches, out_file);
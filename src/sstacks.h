@@ -43,6 +43,10 @@
 #include <set>
 #include <queue>
 using std::queue;
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sstream>
 
 #include <unordered_map>
 
@@ -55,24 +59,72 @@ using std::queue;
 #include "sql_utilities.h"
 #include "utils.h"
 #include "aln_utils.h"
+#include "pipeline.h"
 
 typedef unordered_map<const char *, vector<pair<int, allele_type> >, hash_charptr, eqstr> HashMap;
 
+//
+// Statistics of the exact (resp. gapped) matching of a sample; each chunk of
+// loci is tallied separately, then added to the sample's totals.
+//
+struct SeqMatchStats {
+    unsigned long matches, mmatch, nosnps, nomatch, no_haps, tot_hap, ver_hap;
+
+    SeqMatchStats() : matches(0), mmatch(0), nosnps(0), nomatch(0), no_haps(0), tot_hap(0), ver_hap(0) {}
+    SeqMatchStats& operator+= (const SeqMatchStats &other);
+    void report(ostream &os, size_t n_loci, size_t n_catalog) const;
+};
+
+struct GapMatchStats {
+    uint gapped_aln, matches, mmatches, nomatches, ver_hap, tot_hap, bad_aln, no_haps, nosnps;
+
+    GapMatchStats() : gapped_aln(0), matches(0), mmatches(0), nomatches(0), ver_hap(0), tot_hap(0), bad_aln(0), no_haps(0), nosnps(0) {}
+    GapMatchStats& operator+= (const GapMatchStats &other);
+    void report(ostream &os, size_t n_loci) const;
+};
+
+//
+// A sample being matched against the catalog. Its loci are processed by
+// chunks, which run alongside the chunks of the other samples in flight.
+//
+struct SampleJob {
+    size_t             i;           // Index of the sample, from 0.
+    string             path;
+    FileT              file_type;
+    int                sample_id;
+    LocusArena         arena;       // Holds the strings of the loci; outlives them.
+    map<int, QLocus *> loci;
+    vector<QLocus *>   queries;     // The loci, in order.
+    size_t             n_chunks;
+    size_t             next_chunk;  // Next chunk to be handed out.
+    size_t             chunks_left; // Chunks not done yet.
+    SeqMatchStats      seq_stats;
+    GapMatchStats      gap_stats;
+
+    SampleJob(size_t i, const string &path)
+        : i(i), path(path), file_type(FileT::sql), sample_id(0),
+          n_chunks(0), next_chunk(0), chunks_left(0) {}
+    SampleJob(const SampleJob&) = delete;
+    SampleJob& operator= (const SampleJob&) = delete;
+    ~SampleJob() {for (auto &l : loci) delete l.second;}
+};
+
 void   help( void );
 void   version( void );
 int    parse_command_line(int, char**);
 int    populate_hash(map<int, Locus *> &, HashMap &, vector<char *> &);
-int    find_matches_by_sequence(map<int, Locus *> &, HashMap &, map<int, QLocus *> &);
+unique_ptr<SampleJob> load_sample(size_t, const string &, size_t);
+void   match_by_sequence(const LociIndex<Locus> &, HashMap &, QLocus *, SeqMatchStats &);
 int    find_matches_by_genomic_loc(map<int, Locus *> &, map<int, QLocus *> &);
-int    verify_sequence_match(map<int, Locus *> &, QLocus *, set<int> &, map<string, vector<string> > &, unsigned long &, unsigned long &);
-int    search_for_gaps(map<int, Locus *> &, map<int, QLocus *> &, KmerHashMap &, map<int, pair<allele_type, int> > &, double);
-bool   verify_gapped_match(map<int, Locus *> &, QLocus *, set<int> &, map<allele_type, map<allele_type, AlignRes> > &, uint &, uint &, uint &, uint &, uint &);
+int    verify_sequence_match(const LociIndex<Locus> &, QLocus *, set<int> &, map<string, vector<string> > &, unsigned long &, unsigned long &);
+void   match_by_gaps(const LociIndex<Locus> &, QLocus *, KmerIndex &, map<int, pair<allele_type, int> > &, double, GappedAln *, GapMatchStats &);
+bool   verify_gapped_match(const LociIndex<Locus> &, QLocus *, set<int> &, map<allele_type, map<allele_type, AlignRes> > &, uint &, uint &, uint &, uint &, uint &);
 int    verify_genomic_loc_match(Locus *, QLocus *, set<string> &, unsigned long &);
 string generate_query_allele(Locus *, Locus *, const char *, allele_type);
 bool   match_alleles(allele_type, allele_type);
 int    generate_query_haplotypes(Locus *, QLocus *, set<string> &);
 int    impute_haplotype(string, vector<pair<allele_type, string> > &, string &);
 bool   compare_dist(pair<int, int>, pair<int, int>);
-int    write_matches(string, map<int, QLocus *> &);
+int    write_matches(string, map<int, QLocus *> &, int, FileT);
 
 #endif // __SSTACKS_H__
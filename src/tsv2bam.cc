@@ -85,36 +85,49 @@ int run() {
     //
     // Read the catalog.
     //
+    // Only the IDs, lengths and numbers of components of the catalog loci are
+    // needed; if there is a catalog store, they are read from its index.
+    //
     cout << "Loading the catalog..." << endl;
-    map<int, Locus*> catalog;
     string catalog_prefix = in_dir + "catalog";
-    bool dummy;
-    int rv = load_loci(catalog_prefix, catalog, 0, false, dummy, false);
-    if (rv != 1) {
-        cerr << "Error: Unable to load catalog '" << catalog_prefix << "'.\n";
-        throw exception();
-    }
-
-    //
-    // Create the BAM target list.
-    //
     stringstream header_sq_lines_ss;
     vector<int> cloc_ids;
     unordered_map<int,size_t> cloc_lengths;
-    cloc_ids.reserve(catalog.size());
-    for (auto& cloc : catalog) {
+    auto add_target = [&] (int id, size_t len, size_t n_comps) {
         // Add the @SQ line.
         header_sq_lines_ss
-                << "@SQ\tSN:" << cloc.first
-                << "\tLN:" << cloc.second->len
-                << "\tnc:" << cloc.second->comp.size()
+                << "@SQ\tSN:" << id
+                << "\tLN:" << len
+                << "\tnc:" << n_comps
                 << "\n";
-        cloc_ids.push_back(cloc.first);
-        cloc_lengths[cloc.first] = cloc.second->len;
-        delete cloc.second;
-        cloc.second = NULL;
+        cloc_ids.push_back(id);
+        cloc_lengths[id] = len;
+    };
+
+    CatalogStore store;
+    if (use_catalog_store(catalog_prefix) && store.open(catalog_prefix + ".store")) {
+        cloc_ids.reserve(store.size());
+        for (size_t i = 0; i < store.size(); ++i) {
+            const CatalogStore::Entry& e = store.entry(i);
+            add_target(e.id, e.len, e.n_comps);
+        }
+        store.close();
+    } else {
+        map<int, Locus*> catalog;
+        bool dummy;
+        int rv = load_loci(catalog_prefix, catalog, 0, false, dummy, false);
+        if (rv != 1) {
+            cerr << "Error: Unable to load catalog '" << catalog_prefix << "'.\n";
+            throw exception();
+        }
+        cloc_ids.reserve(catalog.size());
+        for (auto& cloc : catalog) {
+            add_target(cloc.first, cloc.second->len, cloc.second->comp.size());
+            delete cloc.second;
+            cloc.second = NULL;
+        }
+        catalog.clear();
     }
-    catalog.clear();
     const string header_sq_lines = header_sq_lines_ss.str();
 
     //
@@ -169,6 +182,7 @@ void run(const vector<int>& cloc_ids,
     //
     // Read the sample's tsv files.
     //
+    LocusArena arena; // Holds the reads of the loci; must outlive them.
     map<int, Locus*> sloci;
     vector<CatMatch*> matches;
     int sample_id = -1;
@@ -182,7 +196,7 @@ void run(const vector<int>& cloc_ids,
         sample_id = matches[0]->sample_id;
 
         bool dummy;
-        int rv = load_loci(prefix_path, sloci, 2, false, dummy, false);
+        int rv = load_loci(prefix_path, sloci, 2, false, dummy, false, &arena);
         if(rv != 1) {
             cerr << "Error: Could not find stacks files '" << prefix_path << ".*' (tags, snps and/or alleles).\n";
             throw exception();
@@ -465,8 +479,10 @@ void cigar_apply_to_locus(Locus* l, const Cigar& c) {
 
     if (l->len != cloc_len) {
         assert(cloc_len > l->len); // As matches files don't contain I operations.
-        delete[] l->con;
-        delete[] l->model;
+        if (l->owns(l->con))
+            delete[] l->con;
+        if (l->owns(l->model))
+            delete[] l->model;
         l->con = new char[cloc_len+1];
         l->model = new char[cloc_len+1];
     }
@@ -478,7 +494,8 @@ void cigar_apply_to_locus(Locus* l, const Cigar& c) {
         string new_r = apply_cigar_to_seq(r, c);
         assert(new_r.length() == cloc_len);
         if (l->len != cloc_len) {
-            delete[] r;
+            if (l->owns(r))
+                delete[] r;
             r = new char[cloc_len+1];
         }
         strncpy(r, new_r.c_str(), cloc_len+1);
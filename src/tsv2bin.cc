@@ -0,0 +1,271 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+//
+// tsv2bin -- converts the tags/snps/alleles TSV files of the samples to the
+// binary `.loci.bin` format (see LociBin.h), and those of the catalog to a
+// catalog store (see CatalogStore.h).
+//
+
+#include <iostream>
+#include <sstream>
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "sql_utilities.h"
+#include "log_utils.h"
+#include "locus.h"
+#include "MetaPopInfo.h"
+#include "LociBin.h"
+#include "CatalogStore.h"
+
+void parse_command_line(int argc, char* argv[]);
+void report_options(ostream& os);
+void convert(const string& prefix, ostream& os);
+
+//
+// Argument globals.
+//
+bool quiet = false;
+string in_dir;
+vector<string> samples;
+string popmap_path;
+int num_threads = 1;
+
+//
+// Extra globals.
+//
+const string prog_name = "tsv2bin";
+unique_ptr<LogAlterator> logger = NULL;
+
+// main()
+// ==========
+int main(int argc, char* argv[]) {
+    IF_NDEBUG_TRY
+
+    // Parse arguments
+    parse_command_line(argc, argv);
+
+    // Open the log
+    logger.reset(new LogAlterator(in_dir + prog_name, false, quiet, argc, argv));
+    report_options(cout);
+    cout << "\n";
+
+    // Initialize OPENMP.
+    #ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+    #endif
+
+    //
+    // Convert the catalog, if there is one, and the samples.
+    //
+    vector<string> prefixes;
+    if (access((in_dir + "catalog.tags.tsv").c_str(), F_OK) == 0
+        || access((in_dir + "catalog.tags.tsv.gz").c_str(), F_OK) == 0)
+        prefixes.push_back("catalog");
+    prefixes.insert(prefixes.end(), samples.begin(), samples.end());
+
+    vector<string> outputs (prefixes.size());
+    int omp_return = 0;
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(dynamic)
+        for (size_t i=0; i<prefixes.size(); ++i) {
+            if (omp_return != 0)
+                continue;
+            try {
+                stringstream ss;
+                convert(prefixes[i], ss);
+                outputs[i] = ss.str();
+
+            } catch (exception& e) {
+                #pragma omp critical(exception)
+                omp_return = stacks_handle_exceptions(e);
+            }
+        }
+    }
+    if (omp_return != 0)
+        return omp_return;
+
+    for (const string& o : outputs)
+        cout << o;
+
+    cout << "\n" << prog_name << " is done.\n";
+    return 0;
+    IF_NDEBUG_CATCH_ALL_EXCEPTIONS
+}
+
+void convert(const string& prefix, ostream& os) {
+    string prefix_path = in_dir + prefix;
+
+    map<int, Locus*> loci;
+    bool compressed = false;
+    if (load_loci_tsv(prefix_path, loci, 2, true, compressed, false) != 1) {
+        cerr << "Error: Could not find stacks files '" << prefix_path << ".*' (tags, snps and/or alleles).\n";
+        throw exception();
+    }
+
+    string path;
+    if (prefix == "catalog") {
+        path = prefix_path + ".store";
+        CatalogStoreWriter writer;
+        writer.open(path, loci.size());
+        for (auto& l : loci)
+            writer.write(*l.second);
+        writer.close();
+    } else {
+        path = prefix_path + ".loci.bin";
+        LociBinWriter writer;
+        writer.open(path);
+        for (auto& l : loci)
+            writer.write(*l.second);
+        writer.close();
+    }
+    for (auto& l : loci)
+        delete l.second;
+
+    os << "Wrote " << loci.size() << " loci to '" << path << "'.\n";
+}
+
+void parse_command_line(int argc, char* argv[]) {
+
+    const string help_string = string() +
+            prog_name + " " + VERSION  + "\n" +
+            prog_name + " -P stacks_dir -M popmap\n" +
+            prog_name + " -P stacks_dir -s sample [-s sample ...]\n" +
+            "\n"
+            "  -P,--in-dir: input directory; the catalog is also converted (to\n"
+            "               'catalog.store') if present.\n"
+            "  -M,--popmap: population map.\n"
+            "  -s,--sample: name of one sample.\n"
+            "  -t: number of threads to use (default: 1).\n"
+            "\n"
+            "The programs read the '.loci.bin' file of a sample (or the catalog store)\n"
+            "instead of its TSV files as long as it is at least as recent as them.\n"
+            "\n"
+            ;
+
+    const auto bad_args = [&help_string](){
+        cerr << help_string;
+        exit(13);
+    };
+
+    static const option long_options[] = {
+        {"help",         no_argument,       NULL, 'h'},
+        {"quiet",        no_argument,       NULL, 'q'},
+        {"version",      no_argument,       NULL,  1000},
+        {"in-dir",       required_argument, NULL, 'P'},
+        {"popmap",       required_argument, NULL, 'M'},
+        {"sample",       required_argument, NULL, 's'},
+        {"threads",      required_argument, NULL, 't'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    int long_options_i;
+    while (true) {
+
+        c = getopt_long(argc, argv, "hqt:P:M:s:", long_options, &long_options_i);
+
+        // Detect the end of the options.
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+            cout << help_string;
+            exit(0);
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 1000: //version
+            cout << prog_name << " " << VERSION << "\n";
+            exit(0);
+            break;
+        case 'P':
+            in_dir = optarg;
+            if (in_dir.back() != '/')
+                in_dir += '/';
+            break;
+        case 'M':
+            popmap_path = optarg;
+            break;
+        case 's':
+            samples.push_back(optarg);
+            break;
+        case 't':
+            num_threads = is_integer(optarg);
+            if (num_threads < 0) {
+                cerr << "Error: Illegal -t option value '" << optarg << "'.\n";
+                bad_args();
+            }
+            break;
+        default:
+            bad_args();
+            break;
+        }
+    }
+
+    //
+    // Check command consistency.
+    //
+    if (optind < argc) {
+        cerr << "Error: Failed to parse command line: '" << argv[optind] << "' is seen as a positional argument. Expected no positional arguments.\n";
+        bad_args();
+    }
+
+    // -P
+    if (in_dir.empty()) {
+        cerr << "Error: An input directory is required (-P).\n";
+        bad_args();
+    }
+
+    // -M & -s
+    if (popmap_path.empty() && samples.empty()) {
+        cerr << "Error: One of -M or -s should be provided.\n";
+        bad_args();
+    } else if (!popmap_path.empty() && !samples.empty()) {
+        cerr << "Error: only one of -M or -s should be provided.\n";
+        bad_args();
+    }
+
+    //
+    // Process arguments.
+    //
+    if (!popmap_path.empty()) {
+           MetaPopInfo mpopi;
+           mpopi.init_popmap(popmap_path);
+           for (const Sample& s : mpopi.samples())
+               samples.push_back(s.name);
+    }
+}
+
+void report_options(ostream& os) {
+    os << "Configuration for this run:\n";
+    os << "  Stacks directory: '" << in_dir << "'\n";
+    if (!popmap_path.empty())
+        os << "  Population map: '" << popmap_path << "'\n";
+    os << "  Num. samples: " << samples.size() << "\n";
+    if (num_threads > 1)
+        os << "  Multithreaded.\n";
+}
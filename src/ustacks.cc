@@ -117,6 +117,7 @@ try{
     #ifdef _OPENMP
     omp_set_num_threads(num_threads);
     #endif
+    BgzfWriter::set_n_threads(num_threads);
 
     //
     // Load the reads and build primary & secondary stacks.
@@ -503,17 +504,14 @@ search_for_gaps(map<int, MergedStack *> &merged)
     //
     // Search for loci that can be merged with a gapped alignment.
     //
-    KmerHashMap    kmer_map;
-    vector<char *> kmer_map_keys;
-    MergedStack   *tag_1, *tag_2;
+    KmerIndex    kmer_map;
+    MergedStack *tag_1, *tag_2;
 
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
     //
-    vector<int> keys;
-    for (auto it = merged.begin(); it != merged.end(); it++)
-        keys.push_back(it->first);
+    LociIndex<MergedStack> index (merged);
 
     //
     // Calculate the number of k-mers we will generate.
@@ -528,22 +526,17 @@ search_for_gaps(map<int, MergedStack *> &merged)
     //
     uint min_hits = (round((double) con_len * min_match_len) - (kmer_len * max_gaps)) - kmer_len + 1;
 
-    populate_kmer_hash(merged, kmer_map, kmer_map_keys, kmer_len);
+    populate_kmer_hash(merged, kmer_map, kmer_len);
 
     #pragma omp parallel private(tag_1, tag_2)
     {
-        KmerHashMap::iterator h;
-        vector<char *> query_kmers;
-        set<string>    uniq_kmers;
-        GappedAln     *aln = new GappedAln(con_len);
-        AlignRes       a;
-
-        size_t num_kmers = con_len - kmer_len + 1;
-        initialize_kmers(kmer_len, num_kmers, query_kmers);
+        vector<uint32_t> kmer_ids;
+        GappedAln       *aln = new GappedAln(con_len);
+        AlignRes         a;
 
         #pragma omp for schedule(dynamic)
-        for (uint i = 0; i < keys.size(); i++) {
-            tag_1 = merged[keys[i]];
+        for (uint i = 0; i < index.size(); i++) {
+            tag_1 = index[i];
 
             //
             // Don't compute distances for masked tags.
@@ -557,26 +550,12 @@ search_for_gaps(map<int, MergedStack *> &merged)
                 continue;
 
             if (tag_1->len < kmer_len) continue;
-            num_kmers = tag_1->len - kmer_len + 1;
-            generate_kmers_lazily(tag_1->con, kmer_len, num_kmers, query_kmers);
-
-            assert(num_kmers > 0);
-
-            uniq_kmers.clear();
-            for (uint j = 0; j < num_kmers; j++)
-                uniq_kmers.insert(query_kmers[j]);
 
             vector<int> hits;
             //
-            // Lookup the occurances of each k-mer in the kmer_map
+            // Lookup the occurances of each unique k-mer in the kmer_map
             //
-            for (auto j = uniq_kmers.begin(); j != uniq_kmers.end(); j++) {
-                h = kmer_map.find(j->c_str());
-
-                if (h != kmer_map.end())
-                    for (uint k = 0; k <  h->second.size(); k++)
-                        hits.push_back(h->second[k]);
-            }
+            kmer_map.lookup(tag_1->con, tag_1->len, true, hits, kmer_ids);
 
             //
             // Sort the vector of indexes; provides the number of hits to each allele/locus
@@ -661,18 +640,9 @@ search_for_gaps(map<int, MergedStack *> &merged)
             }
         }
 
-        //
-        // Free the k-mers we generated for this query.
-        //
-        for (uint j = 0; j < query_kmers.size(); j++)
-            delete [] query_kmers[j];
-        query_kmers.clear();
-
         delete aln;
     }
 
-    free_kmer_hash(kmer_map, kmer_map_keys);
-
     return 0;
 }
 
@@ -680,13 +650,12 @@ size_t
 merge_remainders(map<int, MergedStack *> &merged, map<int, Stack *> &unique, map<int, Rem *> &rem)
 {
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
     //
-    vector<int> keys;
+    LociIndex<Rem> index (rem);
     size_t max_rem_len = 0;
     for (auto it = rem.begin(); it != rem.end(); it++) {
-        keys.push_back(it->first);
         max_rem_len = it->second->seq->size() > max_rem_len ? it->second->seq->size() : max_rem_len;
     }
 
@@ -708,46 +677,36 @@ merge_remainders(map<int, MergedStack *> &merged, map<int, Stack *> &unique, map
     //     << "; searching with a k-mer length of " << kmer_len << " (" << num_kmers << " k-mers per read); "
     //     << min_hits << " k-mer hits required.\n";
 
-    KmerHashMap    kmer_map;
-    vector<char *> kmer_map_keys;
-    populate_kmer_hash(merged, kmer_map, kmer_map_keys, kmer_len);
+    KmerIndex kmer_map;
+    populate_kmer_hash(merged, kmer_map, kmer_len);
     size_t utilized = 0;
 
     #pragma omp parallel reduction(+: utilized)
     {
-        KmerHashMap::iterator h;
-        vector<char *> rem_kmers;
+        vector<uint32_t> kmer_ids;
+        vector<int>      kmer_hits;
         Cigar      cigar;
         string     seq;
         char      *buf = new char[max_rem_len + 1];
-        size_t     num_kmers = 0;
 
         #pragma omp for schedule(dynamic)
-        for (uint j = 0; j < keys.size(); j++) {
-            auto it = rem.find(keys[j]);
-            Rem  *r = it->second;
+        for (uint j = 0; j < index.size(); j++) {
+            Rem  *r = index[j];
 
             //
             // Generate the k-mers for this remainder sequence
             //
             r->seq->seq(buf);
             if (r->seq->size() < kmer_len) continue;
-            num_kmers = r->seq->size() - kmer_len + 1;
-            generate_kmers_lazily(buf, kmer_len, num_kmers, rem_kmers);
-
-            assert(num_kmers > 0);
 
             map<int, int> hits;
             //
             // Lookup the occurances of each remainder k-mer in the MergedStack k-mer map
             //
-            for (uint k = 0; k < num_kmers; k++) {
-                h = kmer_map.find(rem_kmers[k]);
-
-                if (h != kmer_map.end())
-                    for (uint n = 0; n < h->second.size(); n++)
-                        hits[h->second[n]]++;
-            }
+            kmer_hits.clear();
+            kmer_map.lookup(buf, r->seq->size(), false, kmer_hits, kmer_ids);
+            for (uint k = 0; k < kmer_hits.size(); k++)
+                hits[kmer_hits[k]]++;
 
             //
             // Iterate through the list of hits. For each hit that has more than min_hits
@@ -761,7 +720,7 @@ merge_remainders(map<int, MergedStack *> &merged, map<int, Stack *> &unique, map
 
                 MergedStack *tag_1 = merged[hit_it->first];
 
-                int d = dist(tag_1, buf);
+                int d = dist(tag_1, buf, max_rem_dist);
 
                 //
                 // Store the distance between these two sequences if it is
@@ -821,17 +780,9 @@ merge_remainders(map<int, MergedStack *> &merged, map<int, Stack *> &unique, map
             }
         }
 
-        //
-        // Free the k-mers we generated for this remainder read
-        //
-        for (uint k = 0; k < rem_kmers.size(); k++)
-            delete [] rem_kmers[k];
-
         delete [] buf;
     }
 
-    free_kmer_hash(kmer_map, kmer_map_keys);
-
     return utilized;
 }
 
@@ -843,13 +794,12 @@ search_for_gapped_remainders(map<int, MergedStack *> &merged, map<int, Stack *>
     //
 
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
     //
-    vector<int> keys;
+    LociIndex<Rem> index (rem);
     size_t max_rem_len = 0;
     for (auto it = rem.begin(); it != rem.end(); it++) {
-        keys.push_back(it->first);
         max_rem_len = it->second->seq->size() > max_rem_len ? it->second->seq->size() : max_rem_len;
     }
 
@@ -868,25 +818,21 @@ search_for_gapped_remainders(map<int, MergedStack *> &merged, map<int, Stack *>
 
     //cerr << "  Searching with a k-mer length of " << kmer_len << " (" << num_kmers << " k-mers per read); " << min_hits << " k-mer hits required.\n";
 
-    KmerHashMap    kmer_map;
-    vector<char *> kmer_map_keys;
-    populate_kmer_hash(merged, kmer_map, kmer_map_keys, kmer_len);
+    KmerIndex kmer_map;
+    populate_kmer_hash(merged, kmer_map, kmer_len);
 
     #pragma omp parallel
     {
-        KmerHashMap::iterator h;
-        vector<char *> rem_kmers;
-        set<string>    uniq_kmers;
-        GappedAln     *aln = new GappedAln(con_len);
-        AlignRes       a;
-        string         seq, buf;
-        char          *rem_buf   = new char[max_rem_len + 1];
-        size_t         num_kmers = 0;
+        vector<uint32_t> kmer_ids;
+        vector<int>      kmer_hits;
+        GappedAln       *aln = new GappedAln(con_len);
+        AlignRes         a;
+        string           seq, buf;
+        char            *rem_buf = new char[max_rem_len + 1];
 
         #pragma omp for schedule(dynamic)
-        for (uint i = 0; i < keys.size(); i++) {
-            auto it = rem.find(keys[i]);
-            Rem  *r = it->second;
+        for (uint i = 0; i < index.size(); i++) {
+            Rem  *r = index[i];
 
             if (r->utilized) continue;
 
@@ -895,26 +841,15 @@ search_for_gapped_remainders(map<int, MergedStack *> &merged, map<int, Stack *>
             //
             r->seq->seq(rem_buf);
             if (r->seq->size() < kmer_len) continue;
-            num_kmers = r->seq->size() - kmer_len + 1;
-            generate_kmers_lazily(rem_buf, kmer_len, num_kmers, rem_kmers);
-
-            uniq_kmers.clear();
-            for (uint j = 0; j < num_kmers; j++)
-                uniq_kmers.insert(rem_kmers[j]);
-
-            assert(num_kmers > 0);
 
             map<int, int> hits;
             //
-            // Lookup the occurances of each remainder k-mer in the MergedStack k-mer map
+            // Lookup the occurances of each unique remainder k-mer in the MergedStack k-mer map
             //
-            for (set<string>::iterator j = uniq_kmers.begin(); j != uniq_kmers.end(); j++) {
-                h = kmer_map.find(j->c_str());
-
-                if (h != kmer_map.end())
-                    for (uint k = 0; k <  h->second.size(); k++)
-                        hits[h->second[k]]++;
-            }
+            kmer_hits.clear();
+            kmer_map.lookup(rem_buf, r->seq->size(), true, kmer_hits, kmer_ids);
+            for (uint k = 0; k < kmer_hits.size(); k++)
+                hits[kmer_hits[k]]++;
 
             //
             // Iterate through the list of hits. For each hit that has more than min_hits
@@ -976,19 +911,10 @@ search_for_gapped_remainders(map<int, MergedStack *> &merged, map<int, Stack *>
             tag_1->rem_queue.push_back(r->id);
         }
 
-        //
-        // Free the k-mers we generated for this query.
-        //
-        for (uint j = 0; j < rem_kmers.size(); j++)
-            delete [] rem_kmers[j];
-        rem_kmers.clear();
-
         delete [] rem_buf;
         delete aln;
     }
 
-    free_kmer_hash(kmer_map, kmer_map_keys);
-
     return 0;
 }
 
@@ -996,25 +922,23 @@ size_t
 merge_gapped_remainders(map<int, MergedStack *> &merged, map<int, Stack *> &unique, map<int, Rem *> &rem)
 {
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
     //
-    vector<int> keys;
-    for (auto it = merged.begin(); it != merged.end(); it++)
-        keys.push_back(it->first);
+    LociIndex<MergedStack> index (merged);
 
     size_t utilized = 0;
 
     #pragma omp parallel reduction(+: utilized)
     {
         Cigar      cigar;
-        GappedAln *aln = new GappedAln(merged[keys[0]]->len);
+        GappedAln *aln = new GappedAln(index[0]->len);
         AlignRes   a;
         string     buf, seq;
 
         #pragma omp for schedule(dynamic)
-        for (uint i = 0; i < keys.size(); i++) {
-            MergedStack *tag_1 = merged.at(keys[i]);
+        for (uint i = 0; i < index.size(); i++) {
+            MergedStack *tag_1 = index[i];
 
             //
             // Don't compute distances for masked tags.
@@ -1157,13 +1081,10 @@ int
 call_consensus(map<int, MergedStack *> &merged, map<int, Stack *> &unique, map<int, Rem *> &rem, bool invoke_model)
 {
     //
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
     //
-    map<int, MergedStack *>::iterator it;
-    vector<int> keys;
-    for (it = merged.begin(); it != merged.end(); it++)
-        keys.push_back(it->first);
+    LociIndex<MergedStack> index (merged);
 
     int i;
     #pragma omp parallel private(i)
@@ -1173,8 +1094,8 @@ call_consensus(map<int, MergedStack *> &merged, map<int, Stack *> &unique, map<i
         Rem         *r;
 
         #pragma omp for schedule(dynamic)
-        for (i = 0; i < (int) keys.size(); i++) {
-            mtag = merged[keys[i]];
+        for (i = 0; i < (int) index.size(); i++) {
+            mtag = index[i];
 
             //
             // Create a two-dimensional array, each row containing one read. For
@@ -2022,16 +1943,12 @@ calc_kmer_distance(map<int, MergedStack *> &merged, int utag_dist)
     // Calculate the distance (number of mismatches) between each pair
     // of Radtags. We expect all radtags to be the same length;
     //
-    KmerHashMap    kmer_map;
-    vector<char *> kmer_map_keys;
-    MergedStack   *tag_1, *tag_2;
-    map<int, MergedStack *>::iterator it;
+    KmerIndex    kmer_map;
+    MergedStack *tag_1, *tag_2;
 
-    // OpenMP can't parallelize random access iterators, so we convert
-    // our map to a vector of integer keys.
-    vector<int> keys;
-    for (it = merged.begin(); it != merged.end(); it++)
-        keys.push_back(it->first);
+    // OpenMP can't parallelize random access iterators, so we index the
+    // loci of our map in a vector.
+    LociIndex<MergedStack> index (merged);
 
     //
     // Calculate the number of k-mers we will generate. If kmer_len == 0,
@@ -2051,39 +1968,31 @@ calc_kmer_distance(map<int, MergedStack *> &merged, int utag_dist)
     //     << "; searching with a k-mer length of " << kmer_len << " (" << num_kmers << " k-mers per read); "
     //     << min_hits << " k-mer hits required.\n";
 
-    populate_kmer_hash(merged, kmer_map, kmer_map_keys, kmer_len);
+    populate_kmer_hash(merged, kmer_map, kmer_len);
 
     #pragma omp parallel private(tag_1, tag_2)
     {
-        KmerHashMap::iterator h;
-        vector<char *>        query_kmers;
-
-        size_t num_kmers = con_len - kmer_len + 1;
-        initialize_kmers(kmer_len, num_kmers, query_kmers);
+        vector<uint32_t> kmer_ids;
+        vector<int>      kmer_hits;
 
         #pragma omp for schedule(dynamic)
-        for (uint i = 0; i < keys.size(); i++) {
-            tag_1 = merged[keys[i]];
+        for (uint i = 0; i < index.size(); i++) {
+            tag_1 = index[i];
 
             // Don't compute distances for masked tags
             if (tag_1->masked) continue;
 
             if (tag_1->len < kmer_len) continue;
-            num_kmers = tag_1->len - kmer_len + 1;
-            generate_kmers_lazily(tag_1->con, kmer_len, num_kmers, query_kmers);
 
             map<int, int> hits;
             int d;
             //
             // Lookup the occurances of each k-mer in the kmer_map
             //
-            for (uint j = 0; j < num_kmers; j++) {
-                h = kmer_map.find(query_kmers[j]);
-
-                if (h != kmer_map.end())
-                    for (uint k = 0; k <  h->second.size(); k++)
-                        hits[h->second[k]]++;
-            }
+            kmer_hits.clear();
+            kmer_map.lookup(tag_1->con, tag_1->len, false, kmer_hits, kmer_ids);
+            for (uint j = 0; j < kmer_hits.size(); j++)
+                hits[kmer_hits[j]]++;
 
             //
             // Iterate through the list of hits. For each hit that has more than min_hits
@@ -2102,7 +2011,7 @@ calc_kmer_distance(map<int, MergedStack *> &merged, int utag_dist)
                 // Don't compare tag_1 against itself.
                 if (tag_1 == tag_2) continue;
 
-                d = dist(tag_1, tag_2);
+                d = dist(tag_1, tag_2, utag_dist);
 
                 //
                 // Check if any of the mismatches occur at the 3' end of the read. If they
@@ -2125,16 +2034,8 @@ calc_kmer_distance(map<int, MergedStack *> &merged, int utag_dist)
             // Sort the vector of distances.
             sort(tag_1->dist.begin(), tag_1->dist.end(), compare_dist);
         }
-
-        //
-        // Free the k-mers we generated for this query
-        //
-        for (uint j = 0; j < query_kmers.size(); j++)
-            delete [] query_kmers[j];
     }
 
-    free_kmer_hash(kmer_map, kmer_map_keys);
-
     return 0;
 }
 
@@ -2637,16 +2538,7 @@ int dump_merged_tags(map<int, MergedStack *> &m) {
 void load_radtags(string in_file, DNASeqHashMap &radtags, size_t& n_reads) {
     n_reads = 0;
 
-    Input *fh = NULL;
-
-    if (in_file_type == FileT::fasta)
-        fh = new Fasta(in_file.c_str());
-    else if (in_file_type == FileT::fastq)
-        fh = new Fastq(in_file.c_str());
-    else if (in_file_type == FileT::gzfasta)
-        fh = new GzFasta(in_file.c_str());
-    else if (in_file_type == FileT::gzfastq)
-        fh = new GzFastq(in_file.c_str());
+    Input *fh = new Fastx(in_file, in_file_type == FileT::fastq || in_file_type == FileT::gzfastq);
 
     long  int corrected = 0;
     size_t i            = 0;
@@ -2654,33 +2546,33 @@ void load_radtags(string in_file, DNASeqHashMap &radtags, size_t& n_reads) {
     short int prev_seql = 0;
     bool  len_mismatch  = false;
 
-    Seq c;
-    c.id   = new char[id_len];
-    c.seq  = new char[max_len];
-    c.qual = new char[max_len];
+    SeqBatch batch;
+    while (fh->next_batch(batch, read_batch_size) > 0) {
+        for (size_t j = 0; j < batch.size(); j++) {
+            Seq &c = *batch[j];
 
-    while ((fh->next_seq(c)) != 0) {
-        if (i % 1000000 == 0 && i>0)
-            cerr << i/1000000 << "M..." << flush;
+            if (i % 1000000 == 0 && i>0)
+                cerr << i/1000000 << "M..." << flush;
 
-        prev_seql = seql;
-        seql      = 0;
+            prev_seql = seql;
+            seql      = 0;
 
-        for (char *p = c.seq; *p != '\0'; p++, seql++)
-            switch (*p) {
-            case 'N':
-            case 'n':
-            case '.':
-                *p = 'A';
-                corrected++;
-            }
+            for (char *p = c.seq; *p != '\0'; p++, seql++)
+                switch (*p) {
+                case 'N':
+                case 'n':
+                case '.':
+                    *p = 'A';
+                    corrected++;
+                }
 
-        if (seql != prev_seql && prev_seql > 0)
-            len_mismatch = true;
+            if (seql != prev_seql && prev_seql > 0)
+                len_mismatch = true;
 
-        DNASeqHashMap::iterator element = radtags.insert({DNANSeq(seql, c.seq), HVal()}).first;
-        element->second.add_id(i);
-        i++;
+            DNASeqHashMap::iterator element = radtags.insert({DNANSeq(seql, c.seq), HVal()}).first;
+            element->second.add_id(i);
+            i++;
+        }
     }
     cerr << "\n";
 
@@ -2705,29 +2597,18 @@ void load_radtags(string in_file, DNASeqHashMap &radtags, size_t& n_reads) {
 int
 load_seq_ids(vector<char *> &seq_ids)
 {
-    Input *fh = NULL;
-
-    if (in_file_type == FileT::fasta)
-        fh = new Fasta(in_file.c_str());
-    else if (in_file_type == FileT::fastq)
-        fh = new Fastq(in_file.c_str());
-    else if (in_file_type == FileT::gzfasta)
-        fh = new GzFasta(in_file.c_str());
-    else if (in_file_type == FileT::gzfastq)
-        fh = new GzFastq(in_file.c_str());
+    Input *fh = new Fastx(in_file, in_file_type == FileT::fastq || in_file_type == FileT::gzfastq);
 
     cerr << "Refetching read IDs...";
 
     char *id;
-    Seq c;
-    c.id   = new char[id_len];
-    c.seq  = new char[max_len];
-    c.qual = new char[max_len];
-
-    while ((fh->next_seq(c)) != 0) {
-        id = new char[strlen(c.id) + 1];
-        strcpy(id, c.id);
-        seq_ids.push_back(id);
+    SeqBatch batch;
+    while (fh->next_batch(batch, read_batch_size) > 0) {
+        for (size_t j = 0; j < batch.size(); j++) {
+            id = new char[strlen(batch[j]->id) + 1];
+            strcpy(id, batch[j]->id);
+            seq_ids.push_back(id);
+        }
     }
 
     delete fh;
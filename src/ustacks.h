@@ -61,6 +61,7 @@ using std::queue;
 #include "FastqI.h"     // Reading input files in FASTQ format
 #include "gzFasta.h"    // Reading gzipped input files in FASTA format
 #include "gzFastq.h"    // Reading gzipped input files in FASTQ format
+#include "FastxI.h"    // Reading input files in FASTQ/FASTA format, by batches
 #include "aln_utils.h"
 #include "GappedAln.h"
 
@@ -538,7 +538,7 @@ VersatileWriter::VersatileWriter(const string& path)
 : path_(path),
   is_gzipped_(false),
   ofs_(),
-  gzfile_()
+  bgzf_()
 {
     std::smatch m;
     std::regex_search(path, m, std::regex("\\.[Gg][Zz]$"));
@@ -551,10 +551,7 @@ VersatileWriter::VersatileWriter(const string& path)
         ofs_.open(path_);
         check_open(ofs_, path_);
     } else {
-        gzfile_ = gzopen(path_.c_str(), "wb");
-        check_open(gzfile_, path_);
-        #if ZLIB_VERNUM >= 0x1240
-        gzbuffer(gzfile_, libz_buffer_size);
-        #endif
+        bgzf_.open(path_);
+        check_open(bgzf_, path_);
     }
 }
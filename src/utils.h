@@ -36,6 +36,7 @@
 
 #include "constants.h"
 #include "nucleotides.h"
+#include "BgzfWriter.h"
 
 char   reverse(char);
 char  *rev_comp(const char *);
@@ -96,6 +97,8 @@ public:
     }
 
     OnlineMeanVar& operator+=(const OnlineMeanVar& other) {
+        if (other.n_ == 0.0)
+            return *this;
         double delta = other.mean_ - mean_;
         double n_tot = n_ + other.n_;
         double w_other = other.n_ / n_tot;
@@ -206,6 +209,9 @@ void check_open (std::ofstream& fs, const string& path) {
 inline
 void check_open (const gzFile fs, const string& path)
     {if (fs == NULL) {cerr << "Error: Failed to gz-open file '" << path << "'.\n"; throw exception();}}
+inline
+void check_open (const BgzfWriter& fs, const string& path)
+    {if (!fs.is_open()) {cerr << "Error: Failed to open '" << path << "' for writing.\n"; throw exception();}}
 
 //
 // Check that a directory exists or try to create it.
@@ -283,13 +289,12 @@ class VersatileWriter {
     const string path_;
     bool is_gzipped_;
     ofstream ofs_;
-    gzFile gzfile_;
+    BgzfWriter bgzf_;
 
     void gzputs_(const char* s);
 
 public:
     VersatileWriter(const string& path);
-    ~VersatileWriter() {gzclose(gzfile_);}
 
     const string& path() const {return path_;}
     void close();
@@ -358,9 +363,8 @@ void strip_read_number(string& read_name) {
 inline
 void VersatileWriter::close() {
     if (is_gzipped_) {
-        if (gzclose(gzfile_) != Z_OK)
-            throw ios::failure("gzclose");
-        gzfile_ = NULL;
+        if (bgzf_.close() != 0)
+            throw ios::failure("bgzf_close");
     } else {
         ofs_.close();
     }
@@ -371,12 +375,17 @@ void gzclose_throwing(gzFile f) {
     if (gzclose(f) != Z_OK)
         throw ios::failure("gzclose");
 }
+inline
+void gzclose_throwing(BgzfWriter& f) {
+    if (f.close() != 0)
+        throw ios::failure("bgzf_close");
+}
 
 inline
 VersatileWriter& operator<< (VersatileWriter& w, char c) {
     if (w.is_gzipped_) {
-        if (gzputc(w.gzfile_, c) == -1)
-            throw ios::failure("gzputc");
+        if (w.bgzf_.putc(c) == -1)
+            throw ios::failure("bgzf_write");
     } else {
         w.ofs_ << c;
     }
@@ -394,8 +403,8 @@ VersatileWriter& operator<< (VersatileWriter& w, const char* s) {
 
 inline
 void VersatileWriter::gzputs_(const char* s) {
-    if (gzputs(gzfile_, s) == -1)
-        throw ios::failure("gzputs");
+    if (bgzf_.puts(s) == -1)
+        throw ios::failure("bgzf_write");
 }
 
 inline
@@ -403,12 +412,17 @@ void gzputs_throwing(gzFile f, const char* s) {
     if (gzputs(f, s) == -1)
         throw ios::failure("gzputs");
 }
+inline
+void gzputs_throwing(BgzfWriter& f, const char* s) {
+    if (f.puts(s) == -1)
+        throw ios::failure("bgzf_write");
+}
 
 inline
 VersatileWriter& operator<< (VersatileWriter& w, const string& s) {
     if (w.is_gzipped_) {
-        if (!s.empty() && gzwrite(w.gzfile_, s.c_str(), s.length()) <= 0)
-            throw ios::failure("gzwrite");
+        if (w.bgzf_.write(s) == -1)
+            throw ios::failure("bgzf_write");
     } else {
         w.ofs_ << s;
     }
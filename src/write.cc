@@ -29,7 +29,7 @@
 #include "write.h"
 
 int
-write_fasta(ofstream *fh, RawRead *href, bool overhang) {
+write_fasta(ostream *fh, RawRead *href, bool overhang) {
     char tile[id_len];
     sprintf(tile, "%04d", href->tile);
 
@@ -57,7 +57,7 @@ write_fasta(ofstream *fh, RawRead *href, bool overhang) {
 }
 
 int
-write_fasta(gzFile *fh, RawRead *href, bool overhang) {
+write_fasta(BgzfWriter *fh, RawRead *href, bool overhang) {
     stringstream sstr;
     char tile[id_len];
     sprintf(tile, "%04d", href->tile);
@@ -80,13 +80,13 @@ write_fasta(gzFile *fh, RawRead *href, bool overhang) {
             "/" << href->read << "\n" <<
             href->seq + offset << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fasta(ofstream *fh, Seq *href) {
+write_fasta(ostream *fh, Seq *href) {
     *fh <<
         ">" <<
         href->id  << "\n" <<
@@ -98,7 +98,7 @@ write_fasta(ofstream *fh, Seq *href) {
 }
 
 int
-write_fasta(gzFile *fh, Seq *href) {
+write_fasta(BgzfWriter *fh, Seq *href) {
     stringstream sstr;
 
     sstr <<
@@ -106,13 +106,13 @@ write_fasta(gzFile *fh, Seq *href) {
         href->id  << "\n" <<
         href->seq << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fastq(ofstream *fh, RawRead *href, bool overhang) {
+write_fastq(ostream *fh, RawRead *href, bool overhang) {
     //
     // Write the sequence and quality scores in FASTQ format.
     //
@@ -147,7 +147,7 @@ write_fastq(ofstream *fh, RawRead *href, bool overhang) {
 }
 
 int
-write_fastq(gzFile *fh, RawRead *href, bool overhang) {
+write_fastq(BgzfWriter *fh, RawRead *href, bool overhang) {
     //
     // Write the sequence and quality scores in FASTQ format.
     //
@@ -177,13 +177,13 @@ write_fastq(gzFile *fh, RawRead *href, bool overhang) {
             "+\n" <<
             href->phred + offset << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fastq(ofstream *fh, Seq *href, int offset) {
+write_fastq(ostream *fh, Seq *href, int offset) {
     *fh <<
         "@" << href->id     << "\n" <<
         href->seq + offset  << "\n" <<
@@ -196,7 +196,7 @@ write_fastq(ofstream *fh, Seq *href, int offset) {
 }
 
 int
-write_fastq(gzFile *fh, Seq *href, int offset) {
+write_fastq(BgzfWriter *fh, Seq *href, int offset) {
     stringstream sstr;
     sstr <<
         "@" << href->id     << "\n" <<
@@ -204,13 +204,13 @@ write_fastq(gzFile *fh, Seq *href, int offset) {
         "+\n" <<
         href->qual + offset << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fasta(ofstream *fh, Seq *href, int offset) {
+write_fasta(ostream *fh, Seq *href, int offset) {
     *fh <<
         ">" <<
         href->id << "\n" <<
@@ -222,20 +222,20 @@ write_fasta(ofstream *fh, Seq *href, int offset) {
 }
 
 int
-write_fasta(gzFile *fh, Seq *href, int offset) {
+write_fasta(BgzfWriter *fh, Seq *href, int offset) {
     stringstream sstr;
     sstr <<
         ">" <<
         href->id << "\n" <<
         href->seq + offset << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fastq(ofstream *fh, Seq *href) {
+write_fastq(ostream *fh, Seq *href) {
     *fh <<
         "@" << href->id << "\n" <<
         href->seq << "\n" <<
@@ -248,7 +248,7 @@ write_fastq(ofstream *fh, Seq *href) {
 }
 
 int
-write_fastq(gzFile *fh, Seq *href) {
+write_fastq(BgzfWriter *fh, Seq *href) {
     stringstream sstr;
     sstr <<
         "@" << href->id << "\n" <<
@@ -256,13 +256,13 @@ write_fastq(gzFile *fh, Seq *href) {
         "+\n" <<
         href->qual << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fastq(ofstream *fh, Seq *href, string msg) {
+write_fastq(ostream *fh, Seq *href, string msg) {
     *fh <<
         "@" << href->id << "|" << msg << "\n" <<
         href->seq << "\n" <<
@@ -275,7 +275,7 @@ write_fastq(ofstream *fh, Seq *href, string msg) {
 }
 
 int
-write_fastq(gzFile *fh, Seq *href, string msg) {
+write_fastq(BgzfWriter *fh, Seq *href, string msg) {
     stringstream sstr;
     sstr <<
         "@" << href->id << "|" << msg << "\n" <<
@@ -283,13 +283,13 @@ write_fastq(gzFile *fh, Seq *href, string msg) {
         "+\n" <<
         href->qual << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fasta(ofstream *fh, Seq *href, string msg) {
+write_fasta(ostream *fh, Seq *href, string msg) {
     *fh <<
         ">" <<
         href->id  << "|" << msg << "\n" <<
@@ -301,20 +301,20 @@ write_fasta(ofstream *fh, Seq *href, string msg) {
 }
 
 int
-write_fasta(gzFile *fh, Seq *href, string msg) {
+write_fasta(BgzfWriter *fh, Seq *href, string msg) {
     stringstream sstr;
     sstr <<
         ">" <<
         href->id  << "|" << msg << "\n" <<
         href->seq << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fasta(ofstream *fh, Seq *href, RawRead *r) {
+write_fasta(ostream *fh, Seq *href, RawRead *r) {
     *fh        << ">"
         << href->id << "\n"
         << r->seq + r->inline_bc_len << "\n";
@@ -325,19 +325,19 @@ write_fasta(ofstream *fh, Seq *href, RawRead *r) {
 }
 
 int
-write_fasta(gzFile *fh, Seq *href, RawRead *r) {
+write_fasta(BgzfWriter *fh, Seq *href, RawRead *r) {
     stringstream sstr;
     sstr << ">"
          << href->id << "\n"
          << r->seq + r->inline_bc_len << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
 
 int
-write_fastq(ofstream *fh, Seq *href, RawRead *r) {
+write_fastq(ostream *fh, Seq *href, RawRead *r) {
     *fh << "@" << href->id << "\n"
         << r->seq   + r->inline_bc_len << "\n"
         << "+\n"
@@ -349,14 +349,14 @@ write_fastq(ofstream *fh, Seq *href, RawRead *r) {
 }
 
 int
-write_fastq(gzFile *fh, Seq *href, RawRead *r) {
+write_fastq(BgzfWriter *fh, Seq *href, RawRead *r) {
     stringstream sstr;
     sstr << "@" << href->id << "\n"
          << r->seq   + r->inline_bc_len << "\n"
          << "+\n"
          << r->phred + r->inline_bc_len << "\n";
 
-    int res = gzputs(*fh, sstr.str().c_str());
+    int res = fh->write(sstr.str());
 
     return res;
 }
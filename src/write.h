@@ -29,27 +29,34 @@
 
 #include "input.h"
 #include "clean.h"
+#include "BgzfWriter.h"
 
-int  write_fastq(ofstream *, RawRead *, bool);
-int  write_fastq(ofstream *, Seq *);
-int  write_fastq(ofstream *, Seq *, int);
-int  write_fastq(ofstream *, Seq *, string);
-int  write_fasta(ofstream *, RawRead *, bool);
-int  write_fasta(ofstream *, Seq *);
-int  write_fasta(ofstream *, Seq *, int);
-int  write_fasta(ofstream *, Seq *, string);
-int  write_fastq(ofstream *, Seq *, RawRead *);
-int  write_fasta(ofstream *, Seq *, RawRead *);
+int  write_fastq(ostream *, RawRead *, bool);
+int  write_fastq(ostream *, Seq *);
+int  write_fastq(ostream *, Seq *, int);
+int  write_fastq(ostream *, Seq *, string);
+int  write_fasta(ostream *, RawRead *, bool);
+int  write_fasta(ostream *, Seq *);
+int  write_fasta(ostream *, Seq *, int);
+int  write_fasta(ostream *, Seq *, string);
+int  write_fastq(ostream *, Seq *, RawRead *);
+int  write_fasta(ostream *, Seq *, RawRead *);
 
-int  write_fastq(gzFile *, RawRead *, bool);
-int  write_fastq(gzFile *, Seq *);
-int  write_fastq(gzFile *, Seq *, int);
-int  write_fastq(gzFile *, Seq *, string);
-int  write_fasta(gzFile *, RawRead *, bool);
-int  write_fasta(gzFile *, Seq *);
-int  write_fasta(gzFile *, Seq *, int);
-int  write_fasta(gzFile *, Seq *, string);
-int  write_fastq(gzFile *, Seq *, RawRead *);
-int  write_fasta(gzFile *, Seq *, RawRead *);
+int  write_fastq(BgzfWriter *, RawRead *, bool);
+int  write_fastq(BgzfWriter *, Seq *);
+int  write_fastq(BgzfWriter *, Seq *, int);
+int  write_fastq(BgzfWriter *, Seq *, string);
+int  write_fasta(BgzfWriter *, RawRead *, bool);
+int  write_fasta(BgzfWriter *, Seq *);
+int  write_fasta(BgzfWriter *, Seq *, int);
+int  write_fasta(BgzfWriter *, Seq *, string);
+int  write_fastq(BgzfWriter *, Seq *, RawRead *);
+int  write_fasta(BgzfWriter *, Seq *, RawRead *);
+
+//
+// Write a block of already formatted records.
+//
+inline int write_string(ostream *fh, const string &s) {*fh << s; return fh->fail() ? -1 : 1;}
+inline int write_string(BgzfWriter *fh, const string &s) {return fh->write(s) < 0 ? -1 : 1;}
 
 #endif // __WRITE_H__
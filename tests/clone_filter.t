@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+
+# Preamble
+test_path=$(cd `dirname "${BASH_SOURCE[0]}"` && pwd)
+test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
+source $test_path/setup.sh
+pair_1=$test_data_path/data_files/in.1.fq.gz
+pair_2=$test_data_path/data_files/in.2.fq.gz
+
+# The kept and discarded reads are compared as sorted sets, as the in-memory
+# mode writes them in hash table order.
+sort_reads="for f in in.1.1 in.2.2 in.1.discards.1 in.2.discards.2; do zcat $out_path/\$f.fq.gz | paste - - - - | LC_ALL=C sort > $out_path/\$f.tsv; done"
+
+plan 2
+
+ok_ 'paired-end clones, in memory' \
+    000_in_memory \
+    "clone_filter -1 $pair_1 -2 $pair_2 -i gzfastq -o %out -D && $sort_reads"
+
+ok_ 'paired-end clones, with bounded memory' \
+    001_max_memory \
+    "clone_filter -1 $pair_1 -2 $pair_2 -i gzfastq -o %out -D --max-memory 16M && $sort_reads"
+
+finish
@@ -8,7 +8,7 @@ freq_in=$test_data_path/data_files/f0_female
 freq_in2=$test_data_path/data_files/f0_male
 freq_in3=$test_data_path/data_files/progeny_002
  
-plan 6
+plan 7
 
 ok_ 'initialize catalog' \
     000_init_cat \
@@ -35,4 +35,11 @@ ok_ 'Allow 1 mismatched base between sample tags' \
     005_num_mis \
     "cstacks --catalog $test_data_path/000_init_cat/eout/batch_1.catalog -s $freq_in2 -o %out -n 1 -b 1"
 
+# Two partial catalogs, of popA_01/popA_02 and popB_01/popB_02; the merged
+# catalog is the one built from the four samples at once.
+part_in=$test_data_path/006_merge_cat/in
+ok_ 'Merge partial catalogs' \
+    006_merge_cat \
+    "cstacks --merge-catalogs -s $part_in/part1/catalog -s $part_in/part2/catalog -o %out -n 3 && for f in tags snps alleles; do zcat $out_path/catalog.\$f.tsv.gz | grep -v '^#' > $out_path/catalog.\$f.tsv; done"
+
 finish
\ No newline at end of file
@@ -0,0 +1,112 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+//
+// gapped_aln -- test driver for GappedAln (see tests/gapped_aln.t).
+//
+// Reads tab-separated lines of the form
+//     query  subject  [q_start  q_end  s_start  s_end]
+//     query  subject  q_pos:s_pos:len[,q_pos:s_pos:len...]
+// and writes the CIGAR of each alignment. Lines with only the two sequences
+// are aligned globally (align()); lines with a region are aligned locally
+// over that region (align_region()), with the same coordinates gstacks uses;
+// lines with a list of exact matches, ordered by query position, are aligned
+// locally around these matches (align_constrained()), as gstacks does with
+// the hits of the suffix tree.
+//
+// With -k, the matrix is scored with the given kernel ("avx2", "sse4.1" or
+// "scalar"); the program fails if the CPU does not support it.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "GappedAln.h"
+
+int
+main(int argc, char *argv[])
+{
+    if (argc == 4 && string(argv[1]) == "-k") {
+        if (!GappedAln::set_kernel(argv[2])) {
+            cerr << "Error: Kernel '" << argv[2] << "' is not supported.\n";
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 2) {
+        cerr << "Usage: gapped_aln [-k kernel] alignments.tsv\n";
+        return 1;
+    }
+
+    ifstream fh(argv[1]);
+    if (!fh.good()) {
+        cerr << "Error: Failed to open '" << argv[1] << "'.\n";
+        return 1;
+    }
+
+    GappedAln aln;
+    string    line;
+    while (getline(fh, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        stringstream iss(line);
+        vector<string> fields;
+        string field;
+        while (iss >> field)
+            fields.push_back(field);
+
+        const string &query = fields[0];
+        const string &subj  = fields[1];
+        aln.init(query.length(), subj.length(), fields.size() > 2);
+
+        int aligned;
+        if (fields.size() == 6) {
+            aligned = aln.align_region(query, subj,
+                                       atoi(fields[2].c_str()), atoi(fields[3].c_str()),
+                                       atoi(fields[4].c_str()), atoi(fields[5].c_str()));
+        } else if (fields.size() == 3) {
+            vector<STAln> alns;
+            stringstream hits(fields[2]);
+            string hit;
+            while (getline(hits, hit, ',')) {
+                size_t q_pos, s_pos, len;
+                if (sscanf(hit.c_str(), "%zu:%zu:%zu", &q_pos, &s_pos, &len) != 3) {
+                    cerr << "Error: Malformed exact match '" << hit << "'.\n";
+                    return 1;
+                }
+                alns.push_back(STAln(alns.size(), q_pos, s_pos, len));
+            }
+            aligned = aln.align_constrained(query, subj, alns);
+        } else {
+            aligned = aln.align(query, subj);
+        }
+
+        if (!aligned) {
+            cout << "*\n";
+            continue;
+        }
+        cout << aln.result().cigar << "\n";
+    }
+
+    return 0;
+}
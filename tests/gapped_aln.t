@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+
+# Preamble
+test_path=$(cd `dirname "${BASH_SOURCE[0]}"` && pwd)
+test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
+source $test_path/setup.sh
+
+plan 9
+
+# Each case is run with every kernel that scores the matrix; the kernels that
+# the CPU does not support are skipped.
+for kernel in scalar sse4.1 avx2; do
+    if gapped_aln -k $kernel /dev/null 2> /dev/null; then
+        test_=ok_
+    else
+        test_=skip_
+    fi
+
+    # Local alignments of short queries over regions that start at the edge of
+    # the matrix, as gstacks does when it looks for the overlap of the paired-end
+    # contig with the locus.
+    $test_ "short queries, local alignment over a region ($kernel)" \
+        000_region \
+        "gapped_aln -k $kernel %in/aln.tsv > %out/cigars.txt"
+
+    $test_ "global alignment ($kernel)" \
+        001_global \
+        "gapped_aln -k $kernel %in/aln.tsv > %out/cigars.txt"
+
+    # Local alignments around given exact matches, as gstacks does for the
+    # reads with the hits of the suffix tree.
+    $test_ "local alignment around exact matches ($kernel)" \
+        002_constrained \
+        "gapped_aln -k $kernel %in/aln.tsv > %out/cigars.txt"
+done
+
+finish
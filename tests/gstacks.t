@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+
+# Preamble
+test_path=$(cd `dirname "${BASH_SOURCE[0]}"` && pwd)
+test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
+source $test_path/setup.sh
+denovo_data=$test_data_path/denovo_data
+ref_data=$test_data_path/ref_data
+
+plan 2
+
+# The overlap of the contigs of each locus is looked for by aligning the end
+# of the single-end contig to the start of the paired-end one (align_region()
+# from the first column of the matrix). Locus 116 overlaps by 7bp; the best
+# alignment for locus 154 is gapped, and its contigs stay separate.
+ok_ 'de novo loci, overlap of the single-end and paired-end contigs' \
+    000_denovo_overlap \
+    "gstacks -P $denovo_data -M $denovo_data/popmap.tsv -O %out && zcat $out_path/catalog.fa.gz > $out_path/catalog.fa"
+
+# With indexed, coordinate-sorted BAMs and enough threads, the genome is read by
+# regions in parallel, and the loci of each region are renumbered to follow
+# those of the previous ones. The outputs must be the same as when the files
+# are read sequentially.
+ok_ 'reference-based loci, read by regions in parallel' \
+    001_ref_regions \
+    "gstacks -I $ref_data -M $ref_data/popmap.tsv -O %out -t 1 \
+        && mkdir $out_path/regions \
+        && gstacks -I $ref_data -M $ref_data/popmap.tsv -O $out_path/regions -t 8 \
+        && grep -q '^Found BAM indexes' $out_path/regions/gstacks.log \
+        && zcat $out_path/catalog.fa.gz > $out_path/catalog.fa \
+        && zcat $out_path/catalog.calls | grep -v '^##' > $out_path/catalog.vcf \
+        && zcat $out_path/regions/catalog.fa.gz > $out_path/regions.fa \
+        && zcat $out_path/regions/catalog.calls | grep -v '^##' > $out_path/regions.vcf"
+
+finish
@@ -5,7 +5,7 @@ test_path=$(cd `dirname "${BASH_SOURCE[0]}"` && pwd)
 test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
 source $test_path/setup.sh
 
-plan 5
+plan 6
 
 #kmer_filter tests
 ok_ "filter out rare kmers" \
@@ -26,4 +26,8 @@ skip_ "input gzfastq" \
 
 ok_ "output fastq" \
     004_outfasta \
-    "kmer_filter -y fasta -i $freq_in -o %out"
\ No newline at end of file
+    "kmer_filter -y fasta -i $freq_in -o %out"
+
+ok_ "kmers longer than 32bp" \
+    005_klen \
+    "kmer_filter -f %in/in.fastq -o %out --abundant --max_k_freq 20 --k-len 40"
@@ -0,0 +1,121 @@
+// -*-mode:c++; c-style:k&r; c-basic-offset:4;-*-
+//
+// Copyright 2018, Julian Catchen <jcatchen@illinois.edu>
+//
+// This file is part of Stacks.
+//
+// Stacks is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Stacks is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Stacks.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+//
+// ksmooth -- test driver for KSmooth (see tests/ksmooth.t).
+//
+// Reads the sites of one chromosome, ordered by position, as tab-separated
+// lines of the form
+//     bp  alleles  fixed  stat_0  stat_1
+// (statistics may be "nan"), smooths them with both the exact and the binned
+// method of KSmooth, whatever the density of the sites, and checks that the
+// smoothed values agree within the given relative tolerance. A value that is
+// NaN with one method must be NaN with the other.
+//
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "PopSum.h"
+#include "smoothing.h"
+
+double sigma = 150000.0;
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 4) {
+        cerr << "Usage: ksmooth sigma tolerance sites.tsv\n";
+        return 1;
+    }
+    sigma = atof(argv[1]);
+    double tolerance = atof(argv[2]);
+
+    ifstream fh(argv[3]);
+    if (!fh.good()) {
+        cerr << "Error: Failed to open '" << argv[3] << "'.\n";
+        return 1;
+    }
+
+    const size_t n_stats = 2;
+    vector<PopStat> sites;
+    string line;
+    while (getline(fh, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        stringstream iss(line);
+        string bp, alleles, fixed, stat_0, stat_1;
+        if (!(iss >> bp >> alleles >> fixed >> stat_0 >> stat_1)) {
+            cerr << "Error: Malformed site '" << line << "'.\n";
+            return 1;
+        }
+        sites.push_back(PopStat());
+        PopStat &s = sites.back();
+        s.bp      = atoi(bp.c_str());
+        s.alleles = atof(alleles.c_str());
+        s.fixed   = fixed == "1";
+        s.stat[0] = strtod(stat_0.c_str(), NULL);
+        s.stat[1] = strtod(stat_1.c_str(), NULL);
+    }
+
+    vector<const PopStat *> ptrs;
+    for (const PopStat &s : sites)
+        ptrs.push_back(&s);
+
+    KSmooth<PopStat> ks (n_stats);
+    vector<double> exact;
+    ks.smooth_exact(ptrs);
+    for (const PopStat &s : sites)
+        exact.insert(exact.end(), s.smoothed, s.smoothed + n_stats);
+    ks.smooth_binned(ptrs);
+
+    size_t n_smoothed = 0;
+    size_t n_nan      = 0;
+    for (size_t j = 0; j < sites.size(); j++) {
+        const PopStat &s = sites[j];
+        if (s.fixed)
+            continue;
+        n_smoothed++;
+        for (size_t i = 0; i < n_stats; i++) {
+            double e = exact[j * n_stats + i];
+            double b = s.smoothed[i];
+            if (std::isnan(e) || std::isnan(b)) {
+                if (std::isnan(e) && std::isnan(b)) {
+                    n_nan++;
+                    continue;
+                }
+            } else if (std::fabs(b - e) <= tolerance * std::fabs(e)) {
+                continue;
+            }
+            cerr.precision(17);
+            cerr << "Error: At " << s.bp << "bp, statistic " << i << " is " << e
+                 << " with the exact method but " << b << " with the binned one.\n";
+            return 1;
+        }
+    }
+
+    cout << sites.size() << " sites, " << n_smoothed << " smoothed; "
+         << n_nan << " smoothed values are NaN\n";
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+
+# Preamble
+test_path=$(cd `dirname "${BASH_SOURCE[0]}"` && pwd)
+test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
+source $test_path/setup.sh
+
+plan 3
+
+# The binned method of KSmooth must give the same smoothed values as the exact
+# one, within the bound on the error of its kernel weights (1e-10, relative).
+# Each case is smoothed with both methods, whatever the density of its sites.
+
+# RAD loci every few hundred bp, from the start to the end of the chromosome,
+# with some fixed sites and some NaN statistics.
+ok_ 'binned vs. exact kernel smoothing, dense sites' \
+    000_dense \
+    "ksmooth 10000 1e-10 %in/sites.tsv > %out/report.txt"
+
+# Clusters of sites more than 6 sigma apart, so that windows are cut short on
+# both sides; in one cluster, a statistic is NaN at every site.
+ok_ 'binned vs. exact kernel smoothing, isolated windows and NaN statistics' \
+    001_gaps_nan \
+    "ksmooth 10000 1e-10 %in/sites.tsv > %out/report.txt"
+
+# A narrow kernel, with bins of a few bp.
+ok_ 'binned vs. exact kernel smoothing, narrow kernel' \
+    002_narrow \
+    "ksmooth 100 1e-10 %in/sites.tsv > %out/report.txt"
+
+finish
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+
+# Preamble
+test_path=$(cd `dirname "${BASH_SOURCE[0]}"` && pwd)
+test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
+source $test_path/setup.sh
+data_files=$test_data_path/data_files
+
+# phasedstacks writes its output next to its input files.
+phasedstacks="phasedstacks -P %in/ -S $out_path/ -b 1 -M $out_path/pm.tsv -t fastphase"
+
+plan 3
+
+ok_ -i $data_files \
+    'D prime for all pairs of SNPs' \
+    000_all \
+    "$phasedstacks"
+
+# The D' values of the pairs in the window are those of the full run.
+ok_ -i $data_files \
+    'D prime for pairs of SNPs at most 5kb apart' \
+    001_ld_window \
+    "$phasedstacks --ld-window 5000"
+
+ok_ -i $data_files \
+    'D prime for pairs of SNPs at most 3 SNPs apart' \
+    002_ld_window_snps \
+    "$phasedstacks --ld-window-snps 3"
+
+finish
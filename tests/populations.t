@@ -6,7 +6,7 @@ test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
 source $test_path/setup.sh
 data_files=$test_data_path/data_files/
 
-plan 29
+plan 30
 
 ok_ -i $data_files \
     'Basic run using batch num 1' \
@@ -153,4 +153,10 @@ ok_ -i $data_files \
     028_btstrp_wl \
     "populations -P %in -b 1 -M $data_files/map.txt --bootstrap_wl $data_files/whitelist.txt -k"
 
+# Deep samples (several hundred reads per site), whose genotype likelihoods go
+# well below 10^-655.
+ok_ 'VCF output for deep-coverage samples' \
+    029_deep_vcf \
+    "populations -P %in -M $test_data_path/029_deep_vcf/in/popmap.txt -O %out --vcf && sed -i '/^##/d' $out_path/populations.snps.vcf"
+
 finish
\ No newline at end of file
@@ -9,8 +9,12 @@ source $test_path/setup.sh
 barcodes=$test_data_path/frequent_data/Barcodes.txt
 freq_in=$test_data_path/frequent_data/in.fastq.gz 
 freq_in2=$test_data_path/frequent_data/in.fastq
+batch_data=$test_data_path/batch_data
 
-plan 15
+# The log without its version and command lines, and checksums of the outputs.
+summary="sed -i 1,2d $out_path/process_radtags.batch_data.log && (cd $out_path && md5sum sample_1.fq sample_2.fq sample_3.fq > samples.md5)"
+
+plan 18
 
 # # Example libtap tests.  Uncomment to run.
 # ok "This test will pass" true
@@ -83,5 +87,20 @@ ok_ 'Provide distance between barcodes for rescue' \
     014_bcdist \
     "process_radtags -i gzfastq -f %in/in.fastq.gz -o %out -E phred33 -e sbfI -b $barcodes --barcode_dist 1 -r"
 
+# The CRC of in.corrupt.fq.gz is wrong, so reading fails at the end of the file.
+# The batches read until then are written out and the run fails.
+ok_ 'Corrupt gzipped input' \
+    015_corrupt_gz \
+    "process_radtags -f $batch_data/in.corrupt.fq.gz -o %out -b $batch_data/barcodes.txt -e sbfI -y fastq; test \$? -eq 1 && $summary"
+
+ok_ 'Corrupt gzipped input, 4 threads' \
+    016_corrupt_gz_threads \
+    "process_radtags -f $batch_data/in.corrupt.fq.gz -o %out -b $batch_data/barcodes.txt -e sbfI -y fastq --threads 4; test \$? -eq 1 && $summary"
+
+# The reads have no CASAVA 1.8 headers, so none can be marked as failing.
+ok_ 'Illumina filter on reads without a CASAVA 1.8 header' \
+    017_filt_ill_nocasava \
+    "process_radtags -f $batch_data/in.fq.gz -o %out -b $batch_data/barcodes.txt -e sbfI -y fastq --filter-illumina && $summary"
+
 # I'm not sure yet what finish() does.
 finish
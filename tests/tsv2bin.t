@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+
+# Preamble
+test_path=$(cd `dirname "${BASH_SOURCE[0]}"` && pwd)
+test_data_path="$test_path/"$(basename "${BASH_SOURCE[0]}" | sed -e 's@\.t$@@')
+source $test_path/setup.sh
+data_files=$test_data_path/data_files
+
+# The matches files, without their header.
+matches="for s in popA_01 popB_01; do zcat $out_path/\$s.matches.tsv.gz | grep -v '^#' > $out_path/\$s.matches.tsv; done"
+
+plan 2
+
+ok_ -i $data_files \
+    'sstacks on the TSV files' \
+    000_tsv \
+    "sstacks -P %in -M $out_path/popmap.tsv && $matches"
+
+# The TSV files are removed after the conversion, so that sstacks can only
+# read the .loci.bin files and the catalog store.
+ok_ -i $data_files \
+    'sstacks on the .loci.bin files and the catalog store' \
+    001_bin \
+    "tsv2bin -P %in -M $out_path/popmap.tsv && find $out_path -name '*.tsv.gz' -delete && sstacks -P $out_path -M $out_path/popmap.tsv && $matches"
+
+finish